@@ -22,6 +22,7 @@
 #include <openssl/rand.h>
 
 #include <algorithm>
+#include <utility>
 
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include "absl/memory/memory.h"
@@ -53,13 +54,20 @@ ClientEkepHandshaker::ClientEkepHandshaker(const EkepHandshakerOptions &options)
       self_assertions_(options.self_assertions),
       accepted_peer_assertions_(options.accepted_peer_assertions),
       available_cipher_suites_({CURVE25519_SHA256}),
-      available_record_protocols_({SEAL_AES128_GCM}),
+      available_record_protocols_(options.record_protocols),
       available_ekep_versions_({"EKEP v1"}),
       additional_authenticated_data_(options.additional_authenticated_data),
+      max_record_frame_size_(options.max_record_frame_size),
+      session_cache_(options.session_cache),
+      session_cache_key_(options.session_cache_key),
+      offered_resumption_(false),
+      resumed_(false),
       selected_cipher_suite_(UNKNOWN_HANDSHAKE_CIPHER),
       selected_record_protocol_(UNKNOWN_RECORD_PROTOCOL),
       expected_message_type_(SERVER_PRECOMMIT),
-      handshaker_state_(EkepHandshaker::HandshakeState::NOT_STARTED) {}
+      handshaker_state_(EkepHandshaker::HandshakeState::NOT_STARTED) {
+  SetCandidateCipherSuites(available_cipher_suites_);
+}
 
 bool ClientEkepHandshaker::IsHandshakeInProgress() const {
   return handshaker_state_ == HandshakeState::IN_PROGRESS;
@@ -122,6 +130,10 @@ ClientEkepHandshaker::Result ClientEkepHandshaker::HandleHandshakeMessage(
     case SERVER_PRECOMMIT:
       expected_message_type_ = SERVER_ID;
       status = HandleServerPrecommit(handshake_message, output);
+      if (resumed_) {
+        // A resumed handshake skips the ServerId message.
+        expected_message_type_ = SERVER_FINISH;
+      }
       break;
     case SERVER_ID:
       expected_message_type_ = SERVER_FINISH;
@@ -218,6 +230,20 @@ Status ClientEkepHandshaker::HandleServerPrecommit(
                                RecordProtocol_Name(record_protocol)));
   }
 
+  // Verify that the server selected a record frame size no larger than the one
+  // offered by the client.
+  if (server_precommit.has_record_frame_size()) {
+    uint32_t record_frame_size = server_precommit.record_frame_size();
+    if (max_record_frame_size_ == 0 ||
+        record_frame_size < EkepHandshaker::kMinRecordFrameSize ||
+        record_frame_size > max_record_frame_size_) {
+      return Status(Abort_ErrorCode_PROTOCOL_ERROR,
+                    absl::StrCat("Selected record frame size is invalid: ",
+                                 record_frame_size));
+    }
+    SetRecordFrameSize(record_frame_size);
+  }
+
   // Verify that the server sent an adequately-sized challenge.
   if (server_precommit.challenge().size() != kEkepChallengeSize) {
     return Status(Abort_ErrorCode_PROTOCOL_ERROR,
@@ -225,6 +251,10 @@ Status ClientEkepHandshaker::HandleServerPrecommit(
                                server_precommit.challenge().size()));
   }
 
+  if (server_precommit.resumption_accepted()) {
+    return ResumeSession(server_precommit);
+  }
+
   // Verify that the server requested a non-empty subset of the assertions that
   // were offered by the client.
   if (server_precommit.server_requests().empty()) {
@@ -270,6 +300,49 @@ Status ClientEkepHandshaker::HandleServerPrecommit(
                        server_precommit.server_requests().cend(), output);
 }
 
+Status ClientEkepHandshaker::ResumeSession(
+    const ServerPrecommit &server_precommit) {
+  if (!offered_resumption_) {
+    return Status(Abort_ErrorCode_PROTOCOL_ERROR,
+                  "Server resumed a session that was not offered by the "
+                  "client");
+  }
+
+  // The resumed handshake must use the parameters of the original session.
+  const EkepResumptionState &state = resumption_session_.state;
+  if (selected_ekep_version_ != state.ekep_version().name() ||
+      selected_cipher_suite_ != state.cipher_suite() ||
+      selected_record_protocol_ != state.record_protocol()) {
+    return Status(Abort_ErrorCode_PROTOCOL_ERROR,
+                  "Server resumed a session with different parameters");
+  }
+
+  // No assertions are exchanged in a resumed handshake.
+  if (!server_precommit.server_offers().empty() ||
+      !server_precommit.server_requests().empty()) {
+    return Status(Abort_ErrorCode_PROTOCOL_ERROR,
+                  "Server exchanged assertions in a resumed handshake");
+  }
+
+  resumed_ = true;
+  for (const EnclaveIdentity &identity :
+       state.peer_identities().identities()) {
+    AddPeerIdentity(identity);
+  }
+  verified_peer_assertions_.assign(state.peer_assertions().cbegin(),
+                                   state.peer_assertions().cend());
+
+  // At this stage in the protocol, the transcript is:
+  //   hash(ClientPrecommit || ServerPrecommit)
+  //
+  // This transcript is used by both the client and server to derive the EKEP
+  // secrets of a resumed handshake.
+  ASYLO_RETURN_IF_ERROR(GetTranscriptHash(&secrets_transcript_hash_));
+  return DeriveResumedSecrets(selected_cipher_suite_, secrets_transcript_hash_,
+                              state.resumption_secret(), &master_secret_,
+                              &authenticator_secret_);
+}
+
 Status ClientEkepHandshaker::HandleServerId(const google::protobuf::Message &message) {
   const auto *server_id_ptr = dynamic_cast<const ServerId *>(&message);
   if (!server_id_ptr) {
@@ -310,6 +383,7 @@ Status ClientEkepHandshaker::HandleServerId(const google::protobuf::Message &mes
                     "Assertion could not be verified");
     }
     AddPeerIdentity(identity);
+    verified_peer_assertions_.push_back(*desc_it);
     expected_peer_assertions_.erase(desc_it);
   }
 
@@ -326,9 +400,8 @@ Status ClientEkepHandshaker::HandleServerId(const google::protobuf::Message &mes
 
   // Derive EKEP Master and Authenticator secrets using the current transcript
   // and the server's public key.
-  std::string transcript_hash;
-  ASYLO_RETURN_IF_ERROR(GetTranscriptHash(&transcript_hash));
-  return DeriveSecrets(selected_cipher_suite_, transcript_hash,
+  ASYLO_RETURN_IF_ERROR(GetTranscriptHash(&secrets_transcript_hash_));
+  return DeriveSecrets(selected_cipher_suite_, secrets_transcript_hash_,
                        server_public_key, dh_private_key_, &master_secret_,
                        &authenticator_secret_);
 }
@@ -361,6 +434,7 @@ Status ClientEkepHandshaker::HandleServerFinish(const google::protobuf::Message
                   "Server handshake authenticator value is incorrect");
   }
 
+  SaveSession(server_finish);
   return WriteClientFinish(output);
 }
 
@@ -386,12 +460,23 @@ Status ClientEkepHandshaker::WriteClientPrecommit(std::string *output) {
         additional_authenticated_data_);
   }
 
+  if (max_record_frame_size_ != 0) {
+    client_precommit.set_max_record_frame_size(max_record_frame_size_);
+  }
+
   std::vector<uint8_t> challenge(kEkepChallengeSize);
   if (RAND_bytes(challenge.data(), kEkepChallengeSize) != 1) {
     return Status(Abort_ErrorCode_INTERNAL_ERROR, "Internal error");
   }
   client_precommit.set_challenge(challenge.data(), challenge.size());
 
+  // Assertion offers and requests are still included so that the server can
+  // fall back to a full handshake if it does not accept the ticket.
+  offered_resumption_ = TakeResumableSession();
+  if (offered_resumption_) {
+    client_precommit.set_resumption_ticket(resumption_session_.ticket);
+  }
+
   for (const AssertionDescription &description : self_assertions_) {
     // Note that assertion generators were verified during creation of the
     // handshaker so there is no need to check whether the call to
@@ -503,6 +588,68 @@ Status ClientEkepHandshaker::WriteClientFinish(std::string *output) {
   return WriteFrameAndUpdateTranscript(CLIENT_FINISH, client_finish, output);
 }
 
+bool ClientEkepHandshaker::TakeResumableSession() {
+  if (!session_cache_ ||
+      !session_cache_->Take(session_cache_key_, &resumption_session_)) {
+    return false;
+  }
+
+  // The session can only be resumed if this handshaker supports its
+  // parameters and still accepts the assertions that established the peer's
+  // identities.
+  const EkepResumptionState &state = resumption_session_.state;
+  if (std::find(available_ekep_versions_.cbegin(),
+                available_ekep_versions_.cend(),
+                state.ekep_version().name()) ==
+          available_ekep_versions_.cend() ||
+      std::find(available_cipher_suites_.cbegin(),
+                available_cipher_suites_.cend(),
+                state.cipher_suite()) == available_cipher_suites_.cend() ||
+      std::find(available_record_protocols_.cbegin(),
+                available_record_protocols_.cend(),
+                state.record_protocol()) ==
+          available_record_protocols_.cend()) {
+    return false;
+  }
+  for (const AssertionDescription &description : state.peer_assertions()) {
+    if (FindAssertionDescription(accepted_peer_assertions_, description) ==
+        accepted_peer_assertions_.cend()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ClientEkepHandshaker::SaveSession(const ServerFinish &server_finish) {
+  if (!session_cache_ || !server_finish.has_resumption_ticket()) {
+    return;
+  }
+
+  EkepClientSession session;
+  session.ticket = server_finish.resumption_ticket();
+  EkepResumptionState *state = &session.state;
+  state->mutable_ekep_version()->set_name(selected_ekep_version_);
+  state->set_cipher_suite(selected_cipher_suite_);
+  state->set_record_protocol(selected_record_protocol_);
+  *state->mutable_peer_identities() = PeerIdentities();
+  for (const AssertionDescription &description : verified_peer_assertions_) {
+    *state->add_peer_assertions() = description;
+  }
+
+  CleansingVector<uint8_t> resumption_secret;
+  Status status =
+      DeriveResumptionSecret(selected_cipher_suite_, secrets_transcript_hash_,
+                             master_secret_, &resumption_secret);
+  if (!status.ok()) {
+    // Failing to save the session does not affect the current handshake.
+    LOG(ERROR) << "Failed to derive resumption secret: " << status;
+    return;
+  }
+  state->set_resumption_secret(resumption_secret.data(),
+                               resumption_secret.size());
+  session_cache_->Insert(session_cache_key_, std::move(session));
+}
+
 bool ClientEkepHandshaker::SetSelectedEkepVersion(const std::string &ekep_version) {
   // Verify that the selected EKEP version was offered by the client.
   auto version_it = std::find(available_ekep_versions_.cbegin(),
@@ -28,6 +28,7 @@
 #include <google/protobuf/message.h>
 #include "asylo/grpc/auth/core/ekep_handshaker.h"
 #include "asylo/grpc/auth/core/ekep_handshaker_util.h"
+#include "asylo/grpc/auth/core/ekep_session_resumption.h"
 #include "asylo/util/cleansing_types.h"
 
 namespace asylo {
@@ -36,6 +37,11 @@ namespace asylo {
 // handshake. It handles ServerPrecommit, ServerId, and ServerFinish messages
 // from the server and sends ClientPrecommit, ClientId, and ClientFinish
 // messages to the server.
+//
+// If the handshaker is configured with a session cache, it offers a
+// resumption ticket from the cache in its ClientPrecommit. If the server
+// accepts the ticket, the server follows its ServerPrecommit with a
+// ServerFinish and the ClientId and ServerId messages are skipped.
 class ClientEkepHandshaker final : public EkepHandshaker {
  public:
   // Creates a ClientEkepHandshaker configured with the given |options|, if
@@ -80,6 +86,12 @@ class ClientEkepHandshaker final : public EkepHandshaker {
   // the handshake transcript with the outgoing ClientId frame.
   Status HandleServerPrecommit(const google::protobuf::Message &message, std::string *output);
 
+  // Validates that the ServerPrecommit handshake message contained in
+  // |server_precommit| resumes the session offered in the ClientPrecommit. If
+  // validation succeeds, restores the peer's identities and derives the EKEP
+  // secrets from the resumption secret.
+  Status ResumeSession(const ServerPrecommit &server_precommit);
+
   // Validates the ServerId handshake message contained in |message|.
   Status HandleServerId(const google::protobuf::Message &message);
 
@@ -91,6 +103,14 @@ class ClientEkepHandshaker final : public EkepHandshaker {
   // Writes the ClientPrecommit frame to |output| and updates the transcript.
   Status WriteClientPrecommit(std::string *output);
 
+  // Takes a session for the server from the session cache and returns true if
+  // the session can be resumed by this handshaker.
+  bool TakeResumableSession();
+
+  // Saves the resumption ticket issued in |server_finish| to the session
+  // cache, if there is one.
+  void SaveSession(const ServerFinish &server_finish);
+
   // Generates an assertion for each assertion request in the range
   // [|requests_first|, |requests_last|) and adds the resulting assertions to a
   // ClientId frame that is written to |output|. Updates the handshake
@@ -138,6 +158,32 @@ class ClientEkepHandshaker final : public EkepHandshaker {
   // Additional data that is authenticated during the handshake.
   const std::string additional_authenticated_data_;
 
+  // The largest protected record-protocol frame the client accepts, or zero to
+  // use the record protocol's default.
+  const size_t max_record_frame_size_;
+
+  // A cache of resumable sessions, or nullptr if session resumption is
+  // disabled.
+  const std::shared_ptr<EkepSessionCache> session_cache_;
+
+  // The key under which sessions with the server are held in
+  // |session_cache_|.
+  const std::string session_cache_key_;
+
+  // The session offered for resumption in the ClientPrecommit. Only valid if
+  // |offered_resumption_| is true.
+  EkepClientSession resumption_session_;
+
+  // Whether the ClientPrecommit offered a resumption ticket.
+  bool offered_resumption_;
+
+  // Whether the server accepted the offered resumption ticket.
+  bool resumed_;
+
+  // Descriptions of the peer assertions that establish the peer's identities,
+  // either verified in this handshake or restored from a resumed session.
+  std::vector<AssertionDescription> verified_peer_assertions_;
+
   // Assertions expected from the peer. This field is populated after validation
   // of the ServerPrecommit message.
   std::vector<AssertionDescription> expected_peer_assertions_;
@@ -163,6 +209,9 @@ class ClientEkepHandshaker final : public EkepHandshaker {
   CleansingVector<uint8_t> authenticator_secret_;
   CleansingVector<uint8_t> master_secret_;
 
+  // The transcript hash from which the EKEP secrets were derived.
+  std::string secrets_transcript_hash_;
+
   // A snapshot of the transcript to which the server's assertions are bound:
   //   hash(ClientPrecommit || ServerPrecommit || ClientId)
   std::string server_assertion_transcript_;
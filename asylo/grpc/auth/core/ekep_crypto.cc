@@ -35,6 +35,7 @@
 #include "asylo/util/logging.h"
 #include "asylo/grpc/auth/core/ekep_error_space.h"
 #include "asylo/util/status.h"
+#include "asylo/util/status_macros.h"
 
 namespace asylo {
 namespace {
@@ -44,6 +45,8 @@ constexpr size_t kEkepSecretSize =
 
 constexpr char kEkepHkdfSalt[] = "EKEP Handshake v1";
 constexpr char kEkepHkdfSaltRecordProtocol[] = "EKEP Record Protocol v1";
+constexpr char kEkepHkdfSaltResumption[] = "EKEP Resumption v1";
+constexpr char kEkepHkdfSaltResumedHandshake[] = "EKEP Session Resumption v1";
 constexpr char kServerAuthenticatedText[] = "EKEP Handshake v1: Server Finish";
 constexpr char kClientAuthenticatedText[] = "EKEP Handshake v1: Client Finish";
 
@@ -77,6 +80,52 @@ Status Hmac(const HandshakeCipher &ciphersuite, ByteContainerView key,
   return Status::OkStatus();
 }
 
+// Sets |digest| to the hash function used for HKDF by |ciphersuite|.
+//
+// If the ciphersuite is unsupported, returns BAD_HANDSHAKE_CIPHER.
+Status GetHkdfDigest(const HandshakeCipher &ciphersuite,
+                     const EVP_MD **digest) {
+  switch (ciphersuite) {
+    case CURVE25519_SHA256:
+      *digest = EVP_sha256();
+      return Status::OkStatus();
+    default:
+      return Status(
+          Abort_ErrorCode_BAD_HANDSHAKE_CIPHER,
+          "Ciphersuite not supported: " + HandshakeCipher_Name(ciphersuite));
+  }
+}
+
+// Derives the EKEP master and authenticator secrets from the input key
+// material |secret| using HKDF initialized with |digest|, |salt|, and
+// |transcript_hash|.
+Status ExpandSecrets(const EVP_MD *digest, ByteContainerView secret,
+                     const char *salt, ByteContainerView transcript_hash,
+                     CleansingVector<uint8_t> *master_secret,
+                     CleansingVector<uint8_t> *authenticator_secret) {
+  std::string salt_string(salt);
+  CleansingVector<uint8_t> output_key;
+  output_key.resize(kEkepSecretSize);
+  if (!HKDF(output_key.data(), kEkepSecretSize, digest, secret.data(),
+            secret.size(),
+            reinterpret_cast<const uint8_t *>(salt_string.data()),
+            salt_string.size(), transcript_hash.data(),
+            transcript_hash.size())) {
+    LOG(ERROR) << "HKDF failed: " << BsslLastErrorString();
+    return Status(Abort_ErrorCode_INTERNAL_ERROR, "Internal error");
+  }
+
+  // Copy the master secret.
+  std::copy(output_key.cbegin(), output_key.cbegin() + kEkepMasterSecretSize,
+            std::back_inserter(*master_secret));
+
+  // Copy the authenticator secret.
+  std::copy(output_key.cbegin() + kEkepMasterSecretSize, output_key.cend(),
+            std::back_inserter(*authenticator_secret));
+
+  return Status::OkStatus();
+}
+
 }  // namespace
 
 Status DeriveSecrets(const HandshakeCipher &ciphersuite,
@@ -121,27 +170,47 @@ Status DeriveSecrets(const HandshakeCipher &ciphersuite,
           "Ciphersuite not supported: " + HandshakeCipher_Name(ciphersuite));
   }
 
-  // Derive the master and authenticator secrets using HKDF.
-  std::string salt(kEkepHkdfSalt);
-  CleansingVector<uint8_t> output_key;
-  output_key.resize(kEkepSecretSize);
-  if (!HKDF(output_key.data(), kEkepSecretSize, digest, shared_secret.data(),
-            shared_secret.size(),
+  return ExpandSecrets(digest, shared_secret, kEkepHkdfSalt, transcript_hash,
+                       master_secret, authenticator_secret);
+}
+
+Status DeriveResumptionSecret(const HandshakeCipher &ciphersuite,
+                              ByteContainerView transcript_hash,
+                              ByteContainerView master_secret,
+                              CleansingVector<uint8_t> *resumption_secret) {
+  resumption_secret->clear();
+  const EVP_MD *digest = nullptr;
+  ASYLO_RETURN_IF_ERROR(GetHkdfDigest(ciphersuite, &digest));
+
+  resumption_secret->resize(kEkepResumptionSecretSize);
+  std::string salt(kEkepHkdfSaltResumption);
+  if (!HKDF(resumption_secret->data(), resumption_secret->size(), digest,
+            master_secret.data(), master_secret.size(),
             reinterpret_cast<const uint8_t *>(salt.data()), salt.size(),
             transcript_hash.data(), transcript_hash.size())) {
     LOG(ERROR) << "HKDF failed: " << BsslLastErrorString();
+    resumption_secret->clear();
     return Status(Abort_ErrorCode_INTERNAL_ERROR, "Internal error");
   }
+  return Status::OkStatus();
+}
 
-  // Copy the master secret.
-  std::copy(output_key.cbegin(), output_key.cbegin() + kEkepMasterSecretSize,
-            std::back_inserter(*master_secret));
+Status DeriveResumedSecrets(const HandshakeCipher &ciphersuite,
+                            ByteContainerView transcript_hash,
+                            ByteContainerView resumption_secret,
+                            CleansingVector<uint8_t> *master_secret,
+                            CleansingVector<uint8_t> *authenticator_secret) {
+  const EVP_MD *digest = nullptr;
+  ASYLO_RETURN_IF_ERROR(GetHkdfDigest(ciphersuite, &digest));
 
-  // Copy the authenticator secret.
-  std::copy(output_key.cbegin() + kEkepMasterSecretSize, output_key.cend(),
-            std::back_inserter(*authenticator_secret));
+  if (resumption_secret.size() != kEkepResumptionSecretSize) {
+    return Status(Abort_ErrorCode_PROTOCOL_ERROR,
+                  absl::StrCat("Resumption secret has incorrect size: ",
+                               resumption_secret.size()));
+  }
 
-  return Status::OkStatus();
+  return ExpandSecrets(digest, resumption_secret, kEkepHkdfSaltResumedHandshake,
+                       transcript_hash, master_secret, authenticator_secret);
 }
 
 Status DeriveRecordProtocolKey(const HandshakeCipher &ciphersuite,
@@ -175,6 +244,10 @@ Status DeriveRecordProtocolKey(const HandshakeCipher &ciphersuite,
       // encrypted with the key.
       RAND_bytes(record_protocol_key->data(), record_protocol_key->size());
       break;
+    case ALTSRP_AES128_GCM_REKEY:
+      record_protocol_key->resize(kAltsAes128GcmRekeyKeySize);
+      RAND_bytes(record_protocol_key->data(), record_protocol_key->size());
+      break;
     default:
       return Status(Abort_ErrorCode_BAD_RECORD_PROTOCOL,
                     "Record protocol not supported " +
@@ -33,6 +33,8 @@ namespace asylo {
 constexpr size_t kEkepMasterSecretSize = 64;
 constexpr size_t kEkepAuthenticatorSecretSize = 64;
 constexpr size_t kSealAes128GcmKeySize = 16;
+constexpr size_t kAltsAes128GcmRekeyKeySize = 44;
+constexpr size_t kEkepResumptionSecretSize = 64;
 
 // Derives EKEP secrets based on the selected |ciphersuite| and the input
 // |transcript_hash|, |peer_dh_public_key|, and |self_dh_private_key|. On
@@ -73,6 +75,33 @@ Status DeriveRecordProtocolKey(const HandshakeCipher &ciphersuite,
                                ByteContainerView master_secret,
                                CleansingVector<uint8_t> *record_protocol_key);
 
+// Derives the resumption secret that is bound to a resumption ticket, using
+// HKDF initialized with the hash function from |ciphersuite|, the input key
+// material |master_secret|, and the |transcript_hash| from which
+// |master_secret| was derived. On success, writes the resumption secret to
+// |resumption_secret|.
+//
+// If the ciphersuite is unsupported, returns BAD_HANDSHAKE_CIPHER.
+// Returns INTERNAL_ERROR on other errors.
+Status DeriveResumptionSecret(const HandshakeCipher &ciphersuite,
+                              ByteContainerView transcript_hash,
+                              ByteContainerView master_secret,
+                              CleansingVector<uint8_t> *resumption_secret);
+
+// Derives EKEP secrets for a resumed handshake based on the selected
+// |ciphersuite|, the input |transcript_hash|, and the |resumption_secret| bound
+// to the redeemed resumption ticket. On success, writes the master secret to
+// |master_secret| and the authenticator secret to |authenticator_secret|.
+//
+// If the ciphersuite is unsupported, returns BAD_HANDSHAKE_CIPHER.
+// If the resumption secret has an invalid size, returns PROTOCOL_ERROR.
+// Returns INTERNAL_ERROR on other errors.
+Status DeriveResumedSecrets(const HandshakeCipher &ciphersuite,
+                            ByteContainerView transcript_hash,
+                            ByteContainerView resumption_secret,
+                            CleansingVector<uint8_t> *master_secret,
+                            CleansingVector<uint8_t> *authenticator_secret);
+
 // The following two methods compute the handshake authenticator for the
 // client and the server using HMAC initialized with the hash function from
 // |ciphersuite|, and the key in |authenticator_secret|. On success they write
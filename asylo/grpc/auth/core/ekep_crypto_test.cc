@@ -67,6 +67,37 @@ constexpr char kTestAuthenticatorSecret[] =
 //     kTestRecordProtocolKey
 constexpr char kTestRecordProtocolKey[] = "c7e0f5436c0fe4efdb6327469651b9fe";
 
+// Test vector for rekeying record protocol key derivation.
+//   Inputs:
+//     kTestMasterSecret, kTestTranscriptHash
+//   Outputs:
+//     kTestRekeyRecordProtocolKey
+constexpr char kTestRekeyRecordProtocolKey[] =
+    "c7e0f5436c0fe4efdb6327469651b9fe0b50787e2c74e2211e57ae267fac1399"
+    "cb1a07f574c35315fe4599c4";
+
+// Test vector for resumption secret derivation.
+//   Inputs:
+//     kTestMasterSecret, kTestTranscriptHash
+//   Outputs:
+//     kTestResumptionSecret
+constexpr char kTestResumptionSecret[] =
+    "379d6f9ab7985fe433e362737aea298fed336bc8c942218be40b1af3b8b8a453"
+    "1909ed0bb69847928fc84806bb3e82da2287729c78f7fdf37e2ce2ef3657e949";
+
+// Test vector for resumed-handshake secret derivation.
+//   Inputs:
+//     kTestResumptionSecret, kTestTranscriptHash
+//   Outputs:
+//     kTestResumedMasterSecret, kTestResumedAuthenticatorSecret
+constexpr char kTestResumedMasterSecret[] =
+    "a58e53ce85b3dea55f5a6234d818d19748090a55d276c187504d6b8bb3f9e269"
+    "8c4c0ea67064961319a1b973a8438ceea4de4ecf1f73fcc008d8fb344ea9506d";
+
+constexpr char kTestResumedAuthenticatorSecret[] =
+    "c468d280901e1892d283672a2548f17d7a57319e9765b0fc600ba5fcd7b39d84"
+    "8a37f736775581e51793a8e9a606c9ff5175a7ce243e7153df0c5a977ea7917d";
+
 // Test vector for server handshake-authenticator computation.
 //   Inputs:
 //     kTestAuthenticatorSecret
@@ -240,6 +271,125 @@ TEST(EkepCryptoTest, DeriveRecordProtocolKeySealAes128Gcm) {
   EXPECT_EQ(*actual_key, expected_key);
 }
 
+// Verify success of DeriveRecordProtocolKey when using the ciphersuite
+// consisting of Curve25519 and SHA256, and the rekeying ALTS record protocol.
+TEST(EkepCryptoTest, DeriveRecordProtocolKeyAltsAes128GcmRekey) {
+  UnsafeBytes<SHA256_DIGEST_LENGTH> transcript_hash;
+  ASYLO_ASSERT_OK(
+      SetTrivialObjectFromHexString(kTestTranscriptHash, &transcript_hash));
+
+  SafeBytes<kEkepMasterSecretSize> master_secret;
+  ASYLO_ASSERT_OK(
+      SetTrivialObjectFromHexString(kTestMasterSecret, &master_secret));
+
+  SafeBytes<kAltsAes128GcmRekeyKeySize> expected_key;
+  ASYLO_ASSERT_OK(SetTrivialObjectFromHexString(kTestRekeyRecordProtocolKey,
+                                                &expected_key));
+
+  CleansingVector<uint8_t> key;
+
+  ASSERT_TRUE(DeriveRecordProtocolKey(CURVE25519_SHA256,
+                                      ALTSRP_AES128_GCM_REKEY, transcript_hash,
+                                      master_secret, &key)
+                  .ok());
+  ASSERT_EQ(key.size(), kAltsAes128GcmRekeyKeySize);
+
+  // Verify that the record protocol key is as expected.
+  SafeBytes<kAltsAes128GcmRekeyKeySize> *actual_key =
+      SafeBytes<kAltsAes128GcmRekeyKeySize>::Place(&key, /*offset=*/0);
+  EXPECT_EQ(*actual_key, expected_key);
+}
+
+// Verify that DeriveResumptionSecret fails and returns BAD_HANDSHAKE_CIPHER
+// when passed an unsupported ciphersuite.
+TEST(EkepCryptoTest, DeriveResumptionSecretBadCiphersuite) {
+  std::string transcript_hash;
+  std::vector<uint8_t> master_secret;
+  CleansingVector<uint8_t> resumption_secret;
+
+  Status status = DeriveResumptionSecret(UNKNOWN_HANDSHAKE_CIPHER,
+                                         transcript_hash, master_secret,
+                                         &resumption_secret);
+  EXPECT_THAT(status, StatusIs(Abort_ErrorCode_BAD_HANDSHAKE_CIPHER));
+}
+
+// Verify success of DeriveResumptionSecret when using the ciphersuite
+// consisting of Curve25519 and SHA256.
+TEST(EkepCryptoTest, DeriveResumptionSecretWithCurve25519Sha256) {
+  UnsafeBytes<SHA256_DIGEST_LENGTH> transcript_hash;
+  ASYLO_ASSERT_OK(
+      SetTrivialObjectFromHexString(kTestTranscriptHash, &transcript_hash));
+
+  SafeBytes<kEkepMasterSecretSize> master_secret;
+  ASYLO_ASSERT_OK(
+      SetTrivialObjectFromHexString(kTestMasterSecret, &master_secret));
+
+  SafeBytes<kEkepResumptionSecretSize> expected_resumption_secret;
+  ASYLO_ASSERT_OK(SetTrivialObjectFromHexString(kTestResumptionSecret,
+                                                &expected_resumption_secret));
+
+  CleansingVector<uint8_t> resumption_secret;
+  ASYLO_ASSERT_OK(DeriveResumptionSecret(CURVE25519_SHA256, transcript_hash,
+                                         master_secret, &resumption_secret));
+  ASSERT_EQ(resumption_secret.size(), kEkepResumptionSecretSize);
+
+  SafeBytes<kEkepResumptionSecretSize> *actual_resumption_secret =
+      SafeBytes<kEkepResumptionSecretSize>::Place(&resumption_secret,
+                                                  /*offset=*/0);
+  EXPECT_EQ(*actual_resumption_secret, expected_resumption_secret);
+}
+
+// Verify that DeriveResumedSecrets fails and returns PROTOCOL_ERROR when passed
+// a resumption secret of incorrect size.
+TEST(EkepCryptoTest, DeriveResumedSecretsBadResumptionSecretSize) {
+  std::string transcript_hash;
+  std::vector<uint8_t> resumption_secret(kEkepResumptionSecretSize - 1);
+  CleansingVector<uint8_t> master_secret;
+  CleansingVector<uint8_t> authenticator_secret;
+
+  Status status = DeriveResumedSecrets(CURVE25519_SHA256, transcript_hash,
+                                       resumption_secret, &master_secret,
+                                       &authenticator_secret);
+  EXPECT_THAT(status, StatusIs(Abort_ErrorCode_PROTOCOL_ERROR));
+}
+
+// Verify success of DeriveResumedSecrets when using the ciphersuite consisting
+// of Curve25519 and SHA256.
+TEST(EkepCryptoTest, DeriveResumedSecretsWithCurve25519Sha256) {
+  UnsafeBytes<SHA256_DIGEST_LENGTH> transcript_hash;
+  ASYLO_ASSERT_OK(
+      SetTrivialObjectFromHexString(kTestTranscriptHash, &transcript_hash));
+
+  SafeBytes<kEkepResumptionSecretSize> resumption_secret;
+  ASYLO_ASSERT_OK(
+      SetTrivialObjectFromHexString(kTestResumptionSecret, &resumption_secret));
+
+  SafeBytes<kEkepMasterSecretSize> expected_master_secret;
+  ASYLO_ASSERT_OK(SetTrivialObjectFromHexString(kTestResumedMasterSecret,
+                                                &expected_master_secret));
+
+  SafeBytes<kEkepAuthenticatorSecretSize> expected_authenticator_secret;
+  ASYLO_ASSERT_OK(SetTrivialObjectFromHexString(
+      kTestResumedAuthenticatorSecret, &expected_authenticator_secret));
+
+  CleansingVector<uint8_t> master_secret;
+  CleansingVector<uint8_t> authenticator_secret;
+  ASYLO_ASSERT_OK(DeriveResumedSecrets(CURVE25519_SHA256, transcript_hash,
+                                       resumption_secret, &master_secret,
+                                       &authenticator_secret));
+  ASSERT_EQ(master_secret.size(), kEkepMasterSecretSize);
+  ASSERT_EQ(authenticator_secret.size(), kEkepAuthenticatorSecretSize);
+
+  SafeBytes<kEkepMasterSecretSize> *actual_master_secret =
+      SafeBytes<kEkepMasterSecretSize>::Place(&master_secret, /*offset=*/0);
+  EXPECT_EQ(*actual_master_secret, expected_master_secret);
+
+  SafeBytes<kEkepAuthenticatorSecretSize> *actual_authenticator_secret =
+      SafeBytes<kEkepAuthenticatorSecretSize>::Place(&authenticator_secret,
+                                                     /*offset=*/0);
+  EXPECT_EQ(*actual_authenticator_secret, expected_authenticator_secret);
+}
+
 // Verify that ComputeClientHandshakeAuthenticator fails and returns
 // BAD_HANDSHAKER_CIPHER when passed an unsupported ciphersuite.
 TEST(EkepCryptoTest, ComputeClientHandshakeAuthenticatorBadCipherSuite) {
@@ -20,6 +20,8 @@
 
 #include <cstdint>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
@@ -27,6 +29,7 @@
 #include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
 #include "asylo/crypto/hash_interface.h"
+#include "asylo/crypto/sha256_hash.h"
 #include "asylo/crypto/util/bssl_util.h"
 #include "asylo/crypto/util/byte_container_view.h"
 #include "asylo/util/logging.h"
@@ -233,6 +236,16 @@ StatusOr<RecordProtocol> EkepHandshaker::GetRecordProtocol() {
   return record_protocol_;
 }
 
+StatusOr<size_t> EkepHandshaker::GetRecordFrameSize() {
+  if (!IsHandshakeCompleted()) {
+    return Status(asylo::error::GoogleError::FAILED_PRECONDITION,
+                  "Cannot retrieve record frame size before handshake is "
+                  "complete");
+  }
+
+  return record_frame_size_;
+}
+
 StatusOr<CleansingVector<uint8_t>> EkepHandshaker::GetRecordProtocolKey() {
   if (!IsHandshakeCompleted()) {
     return Status(asylo::error::GoogleError::FAILED_PRECONDITION,
@@ -244,7 +257,7 @@ StatusOr<CleansingVector<uint8_t>> EkepHandshaker::GetRecordProtocolKey() {
 }
 
 EkepHandshaker::EkepHandshaker(int max_frame_size)
-    : max_frame_size_(max_frame_size) {
+    : max_frame_size_(max_frame_size), record_frame_size_(0) {
   peer_identities_ = absl::make_unique<EnclaveIdentities>();
 }
 
@@ -335,10 +348,18 @@ void EkepHandshaker::AddPeerIdentity(const EnclaveIdentity &identity) {
   *peer_identities_->add_identities() = identity;
 }
 
+const EnclaveIdentities &EkepHandshaker::PeerIdentities() const {
+  return *peer_identities_;
+}
+
 void EkepHandshaker::SetRecordProtocol(RecordProtocol record_protocol) {
   record_protocol_ = record_protocol;
 }
 
+void EkepHandshaker::SetRecordFrameSize(size_t record_frame_size) {
+  record_frame_size_ = record_frame_size;
+}
+
 Status EkepHandshaker::DeriveAndSetRecordProtocolKey(
     HandshakeCipher cipher_suite, RecordProtocol record_protocol,
     ByteContainerView master_secret) {
@@ -349,8 +370,34 @@ Status EkepHandshaker::DeriveAndSetRecordProtocolKey(
                                  &record_protocol_key_);
 }
 
+void EkepHandshaker::SetCandidateCipherSuites(
+    const std::vector<HandshakeCipher> &cipher_suites) {
+  std::vector<std::unique_ptr<HashInterface>> hashers;
+  for (HandshakeCipher cipher_suite : cipher_suites) {
+    switch (cipher_suite) {
+      case CURVE25519_SHA256:
+        hashers.push_back(absl::make_unique<Sha256Hash>());
+        break;
+      default:
+        // Without a candidate for every cipher suite, the transcript must be
+        // buffered until the hash function is known.
+        LOG(WARNING) << "No transcript hash function for cipher suite "
+                     << HandshakeCipher_Name(cipher_suite);
+        return;
+    }
+  }
+  if (!transcript_.SetCandidateHashers(std::move(hashers))) {
+    LOG(DFATAL) << "Candidate transcript hash functions set too late";
+  }
+}
+
 bool EkepHandshaker::SetTranscriptHashFunction(HashInterface *hash) {
-  return transcript_.SetHasher(hash);
+  std::unique_ptr<HashInterface> hasher(hash);
+  if (!transcript_.SetHasher(hasher.get())) {
+    return false;
+  }
+  hasher.release();
+  return true;
 }
 
 Status EkepHandshaker::GetTranscriptHash(std::string *transcript_hash) {
@@ -366,9 +413,7 @@ Status EkepHandshaker::GetTranscriptHash(std::string *transcript_hash) {
 void EkepHandshaker::UpdateTranscriptWithOutgoingBytes(
     const char *outgoing_bytes, int outgoing_bytes_size) {
   if (outgoing_bytes_size > 0) {
-    google::protobuf::io::ArrayInputStream sent_bytes(outgoing_bytes,
-                                            outgoing_bytes_size);
-    transcript_.Add(&sent_bytes);
+    transcript_.Add(outgoing_bytes, outgoing_bytes_size);
   }
 }
 
@@ -20,6 +20,7 @@
 #define ASYLO_GRPC_AUTH_CORE_EKEP_HANDSHAKER_H_
 
 #include <cstdint>
+#include <vector>
 
 #include <google/protobuf/io/zero_copy_stream.h>
 #include <google/protobuf/message.h>
@@ -85,6 +86,12 @@ class EkepHandshaker {
   // attack on an EkepHandshaker.
   static constexpr size_t kFrameSizeLimit = 1 << 30;  // 1 GB
 
+  // The bounds on the size of protected record-protocol frames that can be
+  // negotiated during the handshake. These match the bounds imposed by the
+  // ALTS frame protector.
+  static constexpr size_t kMinRecordFrameSize = 1 << 10;  // 1 KB
+  static constexpr size_t kMaxRecordFrameSize = 1 << 20;  // 1 MB
+
   virtual ~EkepHandshaker() = default;
 
   // Performs the next handshake step for this handshaker. This step processes a
@@ -148,6 +155,12 @@ class EkepHandshaker {
   // GoogleError::FAILED_PRECONDITION.
   StatusOr<RecordProtocol> GetRecordProtocol();
 
+  // Returns the negotiated size of protected record-protocol frames, given that
+  // the handshake has successfully completed. A size of zero indicates that the
+  // record protocol's default frame size should be used. If the handshake has
+  // not yet completed, returns GoogleError::FAILED_PRECONDITION.
+  StatusOr<size_t> GetRecordFrameSize();
+
   // Returns the record protocol key, given that the handshake has successfully
   // completed. If the handshake has not yet completed, returns
   // GoogleError::FAILED_PRECONDITION.
@@ -185,7 +198,14 @@ class EkepHandshaker {
                                        const google::protobuf::Message &handshake_message,
                                        std::string *output);
 
-  // Sets the transcript hash function for this handshaker.
+  // Hashes the transcript in place with the hash function of each of
+  // |cipher_suites| until the transcript hash function is set, instead of
+  // buffering the transcript. Must be called before any frames are exchanged.
+  void SetCandidateCipherSuites(
+      const std::vector<HandshakeCipher> &cipher_suites);
+
+  // Sets the transcript hash function for this handshaker. Takes ownership of
+  // |hash|.
   bool SetTranscriptHashFunction(HashInterface *hash);
 
   // Returns the current transcript hash for this handshaker.
@@ -197,9 +217,16 @@ class EkepHandshaker {
   // Adds an identity to the list of peer identities.
   void AddPeerIdentity(const EnclaveIdentity &identity);
 
+  // Returns the list of peer identities added so far.
+  const EnclaveIdentities &PeerIdentities() const;
+
   // Sets the record protocol to use after the handshake completes.
   void SetRecordProtocol(RecordProtocol record_protocol);
 
+  // Sets the size of protected frames to use in the record protocol after the
+  // handshake completes.
+  void SetRecordFrameSize(size_t record_frame_size);
+
   // Derives and sets the record protocol key using the given |cipher_suite|,
   // |record_protocol|, |master_secret|, and the current handshake transcript.
   Status DeriveAndSetRecordProtocolKey(HandshakeCipher cipher_suite,
@@ -282,6 +309,10 @@ class EkepHandshaker {
   // The record protocol to use to secure the session.
   RecordProtocol record_protocol_;
 
+  // The size of protected record-protocol frames, or zero to use the record
+  // protocol's default.
+  size_t record_frame_size_;
+
   // The key used in the record protocol.
   CleansingVector<uint8_t> record_protocol_key_;
 };
@@ -61,6 +61,28 @@ Status EkepHandshakerOptions::Validate() const {
                   "max_frame_size");
   }
 
+  if (record_protocols.empty()) {
+    return Status(asylo::error::GoogleError::INVALID_ARGUMENT,
+                  "Must supply at least one record protocol");
+  }
+  for (RecordProtocol record_protocol : record_protocols) {
+    if (record_protocol != SEAL_AES128_GCM &&
+        record_protocol != ALTSRP_AES128_GCM_REKEY) {
+      return Status(asylo::error::GoogleError::INVALID_ARGUMENT,
+                    absl::StrCat("Unsupported record protocol: ",
+                                 RecordProtocol_Name(record_protocol)));
+    }
+  }
+
+  if (max_record_frame_size != 0 &&
+      (max_record_frame_size < EkepHandshaker::kMinRecordFrameSize ||
+       max_record_frame_size > EkepHandshaker::kMaxRecordFrameSize)) {
+    return Status(asylo::error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("max_record_frame_size must be zero or between ",
+                               EkepHandshaker::kMinRecordFrameSize, " and ",
+                               EkepHandshaker::kMaxRecordFrameSize));
+  }
+
   if (self_assertions.empty()) {
     return Status(asylo::error::GoogleError::INVALID_ARGUMENT,
                   "Must supply at least one self assertion");
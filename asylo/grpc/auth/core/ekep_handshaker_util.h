@@ -19,9 +19,12 @@
 #ifndef ASYLO_GRPC_AUTH_CORE_EKEP_HANDSHAKER_UTIL_H_
 #define ASYLO_GRPC_AUTH_CORE_EKEP_HANDSHAKER_UTIL_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "asylo/grpc/auth/core/ekep_session_resumption.h"
+#include "asylo/grpc/auth/core/handshake.pb.h"
 #include "asylo/identity/enclave_assertion_generator.h"
 #include "asylo/identity/enclave_assertion_verifier.h"
 #include "asylo/identity/identity.pb.h"
@@ -45,6 +48,27 @@ struct EkepHandshakerOptions {
   // Additional data presented by the EKEP participant during the handshake.
   std::string additional_authenticated_data;
 
+  // Record protocols supported by the EKEP participant, in order of most
+  // preferred to least preferred.
+  std::vector<RecordProtocol> record_protocols = {SEAL_AES128_GCM};
+
+  // The largest protected record-protocol frame the EKEP participant is willing
+  // to send and receive, or zero to use the record protocol's default frame
+  // size. The participants use the smaller of their two sizes.
+  size_t max_record_frame_size = 0;
+
+  // Client only. If non-null, the client offers a resumption ticket held in
+  // this cache for session_cache_key, if there is one, and saves any ticket
+  // issued by the server in the cache.
+  std::shared_ptr<EkepSessionCache> session_cache;
+
+  // Client only. Identifies the server in session_cache.
+  std::string session_cache_key;
+
+  // Server only. If non-null, the server accepts resumption tickets sealed by
+  // this crypter and issues a new ticket at the end of every handshake.
+  std::shared_ptr<EkepTicketCrypter> ticket_crypter;
+
   // Validates the handshaker options. All of the following conditions must
   // hold, otherwise returns INVALID_ARGUMENT:
   //   * max_frame_size is non-zero and does not exceed
@@ -57,6 +81,11 @@ struct EkepHandshakerOptions {
   //   appropriate assertion-verification library available
   //   * The size of additional_authenticated_data is less than or equal to
   //   max_frame_size
+  //   * record_protocols is non-empty and contains only supported record
+  //   protocols
+  //   * max_record_frame_size is zero or between
+  //   EkepHandshaker::kMinRecordFrameSize and
+  //   EkepHandshaker::kMaxRecordFrameSize
   Status Validate() const;
 };
 
@@ -103,6 +103,36 @@ TEST_F(EkepHandshakerUtilTest, ValidateBadAadSize) {
   EXPECT_THAT(options.Validate(), Not(IsOk()));
 }
 
+// Verify that Validate fails on a set of options with no record protocols or
+// an unsupported record protocol.
+TEST_F(EkepHandshakerUtilTest, ValidateBadRecordProtocols) {
+  EkepHandshakerOptions options = default_options_;
+
+  options.record_protocols.clear();
+  EXPECT_THAT(options.Validate(), Not(IsOk()));
+
+  options.record_protocols = {ALTSRP_AES128_GCM_REKEY, SEAL_AES128_GCM};
+  EXPECT_THAT(options.Validate(), IsOk());
+
+  options.record_protocols = {UNKNOWN_RECORD_PROTOCOL};
+  EXPECT_THAT(options.Validate(), Not(IsOk()));
+}
+
+// Verify that Validate fails on a set of options with a maximum record frame
+// size outside the supported bounds.
+TEST_F(EkepHandshakerUtilTest, ValidateBadRecordFrameSize) {
+  EkepHandshakerOptions options = default_options_;
+
+  options.max_record_frame_size = EkepHandshaker::kMaxRecordFrameSize;
+  EXPECT_THAT(options.Validate(), IsOk());
+
+  options.max_record_frame_size = EkepHandshaker::kMaxRecordFrameSize + 1;
+  EXPECT_THAT(options.Validate(), Not(IsOk()));
+
+  options.max_record_frame_size = EkepHandshaker::kMinRecordFrameSize - 1;
+  EXPECT_THAT(options.Validate(), Not(IsOk()));
+}
+
 // Verify that Validate fails on a set of options with an empty list of self
 // assertions.
 TEST_F(EkepHandshakerUtilTest, ValidateMissingSelfIdentities) {
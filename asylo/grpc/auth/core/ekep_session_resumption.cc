@@ -0,0 +1,212 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/grpc/auth/core/ekep_session_resumption.h"
+
+#include <openssl/mem.h>
+#include <openssl/rand.h>
+
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/time/clock.h"
+#include "absl/types/span.h"
+#include "asylo/util/cleansing_types.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace {
+
+// The size of a ticket key, in bytes.
+constexpr size_t kTicketKeySize = 32;
+
+// Associated data that binds a sealed EkepResumptionState to its purpose.
+constexpr char kTicketAssociatedData[] = "EKEP Resumption Ticket v1";
+
+// Returns true if |state| has an expiration time that has passed.
+bool IsExpired(const EkepResumptionState &state) {
+  return state.has_expiration_time() &&
+         state.expiration_time() < absl::ToUnixSeconds(absl::Now());
+}
+
+}  // namespace
+
+StatusOr<std::unique_ptr<EkepTicketCrypter>> EkepTicketCrypter::Create(
+    absl::Duration ticket_lifetime) {
+  if (ticket_lifetime <= absl::ZeroDuration()) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "Ticket lifetime must be positive");
+  }
+
+  CleansingVector<uint8_t> key(kTicketKeySize);
+  if (RAND_bytes(key.data(), key.size()) != 1) {
+    return Status(error::GoogleError::INTERNAL,
+                  "Failed to generate ticket key");
+  }
+
+  std::unique_ptr<experimental::AeadCryptor> cryptor;
+  ASYLO_ASSIGN_OR_RETURN(
+      cryptor, experimental::AeadCryptor::CreateAesGcmSivCryptor(key));
+  return absl::WrapUnique(
+      new EkepTicketCrypter(std::move(cryptor), ticket_lifetime));
+}
+
+EkepTicketCrypter::EkepTicketCrypter(
+    std::unique_ptr<experimental::AeadCryptor> cryptor,
+    absl::Duration ticket_lifetime)
+    : ticket_lifetime_(ticket_lifetime), cryptor_(std::move(cryptor)) {}
+
+Status EkepTicketCrypter::IssueTicket(EkepResumptionState state,
+                                      std::string *ticket) {
+  state.set_expiration_time(
+      absl::ToUnixSeconds(absl::Now() + ticket_lifetime_));
+
+  std::string serialized_state;
+  if (!state.SerializeToString(&serialized_state)) {
+    return Status(error::GoogleError::INTERNAL,
+                  "Failed to serialize resumption state");
+  }
+
+  EkepResumptionTicket ticket_proto;
+  Status status;
+  {
+    absl::MutexLock lock(&mu_);
+    std::vector<uint8_t> nonce(cryptor_->NonceSize());
+    std::vector<uint8_t> sealed_state(serialized_state.size() +
+                                      cryptor_->MaxSealOverhead());
+    size_t sealed_state_size;
+    status = cryptor_->Seal(serialized_state, kTicketAssociatedData,
+                            absl::MakeSpan(nonce), absl::MakeSpan(sealed_state),
+                            &sealed_state_size);
+    if (status.ok()) {
+      ticket_proto.set_nonce(nonce.data(), nonce.size());
+      ticket_proto.set_sealed_state(sealed_state.data(), sealed_state_size);
+    }
+  }
+
+  // The serialized state contains the resumption secret.
+  OPENSSL_cleanse(&serialized_state[0], serialized_state.size());
+  ASYLO_RETURN_IF_ERROR(status);
+
+  if (!ticket_proto.SerializeToString(ticket)) {
+    return Status(error::GoogleError::INTERNAL,
+                  "Failed to serialize resumption ticket");
+  }
+  return Status::OkStatus();
+}
+
+Status EkepTicketCrypter::RedeemTicket(const std::string &ticket,
+                                       EkepResumptionState *state) {
+  EkepResumptionTicket ticket_proto;
+  if (!ticket_proto.ParseFromString(ticket)) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "Failed to parse resumption ticket");
+  }
+
+  CleansingVector<uint8_t> serialized_state(
+      ticket_proto.sealed_state().size());
+  size_t serialized_state_size;
+  {
+    absl::MutexLock lock(&mu_);
+    if (ticket_proto.nonce().size() != cryptor_->NonceSize()) {
+      return Status(error::GoogleError::INVALID_ARGUMENT,
+                    "Resumption ticket has a nonce of incorrect size");
+    }
+    ASYLO_RETURN_IF_ERROR(cryptor_->Open(
+        ticket_proto.sealed_state(), kTicketAssociatedData,
+        ticket_proto.nonce(), absl::MakeSpan(serialized_state),
+        &serialized_state_size));
+  }
+
+  if (!state->ParseFromArray(serialized_state.data(), serialized_state_size)) {
+    return Status(error::GoogleError::INTERNAL,
+                  "Failed to parse resumption state");
+  }
+
+  if (IsExpired(*state)) {
+    state->Clear();
+    return Status(error::GoogleError::FAILED_PRECONDITION,
+                  "Resumption ticket has expired");
+  }
+  return Status::OkStatus();
+}
+
+EkepSessionCache::EkepSessionCache(size_t max_sessions)
+    : max_sessions_(max_sessions), insertion_count_(0) {}
+
+void EkepSessionCache::Insert(const std::string &peer,
+                              EkepClientSession session) {
+  if (max_sessions_ == 0) {
+    return;
+  }
+
+  absl::MutexLock lock(&mu_);
+  sessions_.erase(peer);
+  EvictLocked();
+
+  uint64_t insertion = insertion_count_++;
+  sessions_.emplace(peer, std::make_pair(insertion, std::move(session)));
+  insertion_order_.emplace_back(peer, insertion);
+}
+
+bool EkepSessionCache::Take(const std::string &peer,
+                            EkepClientSession *session) {
+  absl::MutexLock lock(&mu_);
+  auto it = sessions_.find(peer);
+  if (it == sessions_.end()) {
+    return false;
+  }
+
+  bool expired = IsExpired(it->second.second.state);
+  if (!expired) {
+    *session = std::move(it->second.second);
+  }
+  sessions_.erase(it);
+  return !expired;
+}
+
+size_t EkepSessionCache::size() const {
+  absl::MutexLock lock(&mu_);
+  return sessions_.size();
+}
+
+void EkepSessionCache::EvictLocked() {
+  while (sessions_.size() >= max_sessions_ && !insertion_order_.empty()) {
+    const std::pair<std::string, uint64_t> &oldest = insertion_order_.front();
+    auto it = sessions_.find(oldest.first);
+    if (it != sessions_.end() && it->second.first == oldest.second) {
+      sessions_.erase(it);
+    }
+    insertion_order_.pop_front();
+  }
+
+  // Drop stale entries left behind by sessions that were taken or replaced, so
+  // that |insertion_order_| stays proportional to the size of the cache.
+  if (insertion_order_.size() > 2 * max_sessions_) {
+    std::deque<std::pair<std::string, uint64_t>> live_entries;
+    for (auto &entry : insertion_order_) {
+      auto it = sessions_.find(entry.first);
+      if (it != sessions_.end() && it->second.first == entry.second) {
+        live_entries.push_back(std::move(entry));
+      }
+    }
+    insertion_order_.swap(live_entries);
+  }
+}
+
+}  // namespace asylo
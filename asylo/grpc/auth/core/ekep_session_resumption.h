@@ -0,0 +1,134 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_GRPC_AUTH_CORE_EKEP_SESSION_RESUMPTION_H_
+#define ASYLO_GRPC_AUTH_CORE_EKEP_SESSION_RESUMPTION_H_
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "asylo/crypto/aead_cryptor.h"
+#include "asylo/grpc/auth/core/handshake.pb.h"
+#include "asylo/util/status.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+
+// EkepTicketCrypter seals EkepResumptionState into the resumption tickets
+// issued by an EKEP server, and opens the tickets that clients present in
+// later handshakes. Tickets are sealed with AES-GCM-SIV under a random key that
+// is generated when the crypter is created and never leaves the enclave.
+// Consequently, a ticket can only be redeemed by server handshakers that share
+// the crypter that issued it.
+//
+// EkepTicketCrypter is thread-safe.
+class EkepTicketCrypter {
+ public:
+  // Creates an EkepTicketCrypter with a fresh ticket key. Tickets issued by the
+  // crypter can be redeemed for |ticket_lifetime| after they are issued.
+  static StatusOr<std::unique_ptr<EkepTicketCrypter>> Create(
+      absl::Duration ticket_lifetime);
+
+  // Sets the expiration time of |state| and seals it into a resumption ticket,
+  // which is written to |ticket|.
+  Status IssueTicket(EkepResumptionState state, std::string *ticket);
+
+  // Opens |ticket| and writes the resumption state bound to it to |state|.
+  // Returns an error if |ticket| was not issued by this crypter or if it has
+  // expired.
+  Status RedeemTicket(const std::string &ticket, EkepResumptionState *state);
+
+ private:
+  EkepTicketCrypter(std::unique_ptr<experimental::AeadCryptor> cryptor,
+                    absl::Duration ticket_lifetime);
+
+  // The period for which an issued ticket can be redeemed.
+  const absl::Duration ticket_lifetime_;
+
+  // The cryptor used to seal and open tickets.
+  std::unique_ptr<experimental::AeadCryptor> cryptor_ GUARDED_BY(mu_);
+
+  // A mutex that guards |cryptor_|.
+  absl::Mutex mu_;
+};
+
+// A resumable session retained by an EKEP client.
+struct EkepClientSession {
+  // The resumption ticket issued by the server.
+  std::string ticket;
+
+  // The state of the handshake in which |ticket| was issued.
+  EkepResumptionState state;
+};
+
+// EkepSessionCache holds the resumable sessions of EKEP clients, keyed by an
+// identifier of the server, such as its target address. Each session is handed
+// out at most once, so that a ticket is never presented in more than one
+// handshake by the client. When the cache is full, the oldest session is
+// evicted.
+//
+// EkepSessionCache is thread-safe.
+class EkepSessionCache {
+ public:
+  // Creates a cache that holds at most |max_sessions| sessions.
+  explicit EkepSessionCache(size_t max_sessions);
+
+  // Inserts |session| for the server identified by |peer|, replacing any
+  // session already held for |peer|.
+  void Insert(const std::string &peer, EkepClientSession session);
+
+  // Removes the session held for the server identified by |peer| and writes it
+  // to |session|. Returns false if there is no unexpired session for |peer|.
+  bool Take(const std::string &peer, EkepClientSession *session);
+
+  // Returns the number of sessions in the cache.
+  size_t size() const;
+
+ private:
+  // Evicts sessions in insertion order until there is room for one more.
+  void EvictLocked() EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // The maximum number of sessions held by the cache.
+  const size_t max_sessions_;
+
+  // The number of sessions inserted so far. Used to tell apart successive
+  // sessions held for the same peer.
+  uint64_t insertion_count_ GUARDED_BY(mu_);
+
+  // Sessions keyed by peer, along with the insertion number of each session.
+  absl::flat_hash_map<std::string, std::pair<uint64_t, EkepClientSession>>
+      sessions_ GUARDED_BY(mu_);
+
+  // Peers and insertion numbers in insertion order. May contain stale entries
+  // for sessions that were taken or replaced.
+  std::deque<std::pair<std::string, uint64_t>> insertion_order_
+      GUARDED_BY(mu_);
+
+  // A mutex that guards all the above members.
+  mutable absl::Mutex mu_;
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_GRPC_AUTH_CORE_EKEP_SESSION_RESUMPTION_H_
@@ -0,0 +1,197 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/grpc/auth/core/ekep_session_resumption.h"
+
+#include <memory>
+#include <string>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/time/time.h"
+#include "asylo/grpc/auth/core/handshake.pb.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/util/status.h"
+
+namespace asylo {
+namespace {
+
+using ::testing::Not;
+
+constexpr char kResumptionSecret[] = "resumption secret";
+constexpr char kPeer1[] = "peer 1";
+constexpr char kPeer2[] = "peer 2";
+constexpr char kPeer3[] = "peer 3";
+
+class EkepSessionResumptionTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    state_.mutable_ekep_version()->set_name("EKEP v1");
+    state_.set_cipher_suite(CURVE25519_SHA256);
+    state_.set_record_protocol(SEAL_AES128_GCM);
+    state_.set_resumption_secret(kResumptionSecret);
+  }
+
+  // Returns a session with the given |ticket|.
+  EkepClientSession MakeSession(const std::string &ticket) {
+    EkepClientSession session;
+    session.ticket = ticket;
+    session.state = state_;
+    return session;
+  }
+
+  EkepResumptionState state_;
+};
+
+// Verifies that EkepTicketCrypter::Create fails with a non-positive ticket
+// lifetime.
+TEST_F(EkepSessionResumptionTest, CreateCrypterFailsWithBadLifetime) {
+  EXPECT_THAT(EkepTicketCrypter::Create(absl::ZeroDuration()).status(),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+// Verifies that a ticket issued by a crypter can be redeemed with the same
+// crypter.
+TEST_F(EkepSessionResumptionTest, RedeemIssuedTicket) {
+  auto crypter_result = EkepTicketCrypter::Create(absl::Hours(1));
+  ASSERT_THAT(crypter_result, IsOk());
+  std::unique_ptr<EkepTicketCrypter> crypter =
+      std::move(crypter_result.ValueOrDie());
+
+  std::string ticket;
+  ASSERT_THAT(crypter->IssueTicket(state_, &ticket), IsOk());
+  EXPECT_EQ(ticket.find(kResumptionSecret), std::string::npos);
+
+  EkepResumptionState state;
+  ASSERT_THAT(crypter->RedeemTicket(ticket, &state), IsOk());
+  EXPECT_EQ(state.ekep_version().name(), state_.ekep_version().name());
+  EXPECT_EQ(state.cipher_suite(), state_.cipher_suite());
+  EXPECT_EQ(state.record_protocol(), state_.record_protocol());
+  EXPECT_EQ(state.resumption_secret(), state_.resumption_secret());
+  EXPECT_TRUE(state.has_expiration_time());
+}
+
+// Verifies that a ticket cannot be redeemed with a different crypter.
+TEST_F(EkepSessionResumptionTest, RedeemTicketFromOtherCrypterFails) {
+  auto crypter1_result = EkepTicketCrypter::Create(absl::Hours(1));
+  auto crypter2_result = EkepTicketCrypter::Create(absl::Hours(1));
+  ASSERT_THAT(crypter1_result, IsOk());
+  ASSERT_THAT(crypter2_result, IsOk());
+
+  std::string ticket;
+  ASSERT_THAT(crypter1_result.ValueOrDie()->IssueTicket(state_, &ticket),
+              IsOk());
+
+  EkepResumptionState state;
+  EXPECT_THAT(crypter2_result.ValueOrDie()->RedeemTicket(ticket, &state),
+              Not(IsOk()));
+}
+
+// Verifies that a modified ticket cannot be redeemed.
+TEST_F(EkepSessionResumptionTest, RedeemTamperedTicketFails) {
+  auto crypter_result = EkepTicketCrypter::Create(absl::Hours(1));
+  ASSERT_THAT(crypter_result, IsOk());
+  std::unique_ptr<EkepTicketCrypter> crypter =
+      std::move(crypter_result.ValueOrDie());
+
+  std::string ticket;
+  ASSERT_THAT(crypter->IssueTicket(state_, &ticket), IsOk());
+
+  EkepResumptionTicket ticket_proto;
+  ASSERT_TRUE(ticket_proto.ParseFromString(ticket));
+  std::string *sealed_state = ticket_proto.mutable_sealed_state();
+  ASSERT_FALSE(sealed_state->empty());
+  (*sealed_state)[0] ^= 1;
+  ASSERT_TRUE(ticket_proto.SerializeToString(&ticket));
+
+  EkepResumptionState state;
+  EXPECT_THAT(crypter->RedeemTicket(ticket, &state), Not(IsOk()));
+}
+
+// Verifies that a malformed ticket cannot be redeemed.
+TEST_F(EkepSessionResumptionTest, RedeemMalformedTicketFails) {
+  auto crypter_result = EkepTicketCrypter::Create(absl::Hours(1));
+  ASSERT_THAT(crypter_result, IsOk());
+
+  EkepResumptionTicket ticket_proto;
+  ticket_proto.set_nonce("short nonce");
+  ticket_proto.set_sealed_state("sealed state");
+  std::string ticket;
+  ASSERT_TRUE(ticket_proto.SerializeToString(&ticket));
+
+  EkepResumptionState state;
+  EXPECT_THAT(crypter_result.ValueOrDie()->RedeemTicket(ticket, &state),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+// Verifies that a session can be taken from the cache only once.
+TEST_F(EkepSessionResumptionTest, TakeSessionOnce) {
+  EkepSessionCache cache(/*max_sessions=*/2);
+  cache.Insert(kPeer1, MakeSession("ticket"));
+  EXPECT_EQ(cache.size(), 1);
+
+  EkepClientSession session;
+  ASSERT_TRUE(cache.Take(kPeer1, &session));
+  EXPECT_EQ(session.ticket, "ticket");
+  EXPECT_EQ(session.state.resumption_secret(), kResumptionSecret);
+
+  EXPECT_FALSE(cache.Take(kPeer1, &session));
+  EXPECT_EQ(cache.size(), 0);
+}
+
+// Verifies that inserting a session for a peer replaces the previous session.
+TEST_F(EkepSessionResumptionTest, InsertReplacesSession) {
+  EkepSessionCache cache(/*max_sessions=*/2);
+  cache.Insert(kPeer1, MakeSession("old ticket"));
+  cache.Insert(kPeer1, MakeSession("new ticket"));
+  EXPECT_EQ(cache.size(), 1);
+
+  EkepClientSession session;
+  ASSERT_TRUE(cache.Take(kPeer1, &session));
+  EXPECT_EQ(session.ticket, "new ticket");
+}
+
+// Verifies that the oldest session is evicted when the cache is full.
+TEST_F(EkepSessionResumptionTest, EvictOldestSession) {
+  EkepSessionCache cache(/*max_sessions=*/2);
+  cache.Insert(kPeer1, MakeSession("ticket 1"));
+  cache.Insert(kPeer2, MakeSession("ticket 2"));
+  cache.Insert(kPeer3, MakeSession("ticket 3"));
+  EXPECT_EQ(cache.size(), 2);
+
+  EkepClientSession session;
+  EXPECT_FALSE(cache.Take(kPeer1, &session));
+  EXPECT_TRUE(cache.Take(kPeer2, &session));
+  EXPECT_TRUE(cache.Take(kPeer3, &session));
+}
+
+// Verifies that an expired session is not handed out.
+TEST_F(EkepSessionResumptionTest, TakeExpiredSessionFails) {
+  EkepSessionCache cache(/*max_sessions=*/2);
+  EkepClientSession expired_session = MakeSession("ticket");
+  expired_session.state.set_expiration_time(
+      absl::ToUnixSeconds(absl::Now() - absl::Minutes(1)));
+  cache.Insert(kPeer1, std::move(expired_session));
+
+  EkepClientSession session;
+  EXPECT_FALSE(cache.Take(kPeer1, &session));
+  EXPECT_EQ(cache.size(), 0);
+}
+
+}  // namespace
+}  // namespace asylo
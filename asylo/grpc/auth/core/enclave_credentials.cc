@@ -20,6 +20,7 @@
 
 #include <string.h>
 
+#include "absl/time/time.h"
 #include "asylo/grpc/auth/core/assertion_description.h"
 #include "asylo/grpc/auth/core/enclave_security_connector.h"
 #include "asylo/grpc/auth/util/safe_string.h"
@@ -29,6 +30,16 @@
 #include "src/core/lib/gprpp/ref_counted_ptr.h"
 #include "src/core/lib/security/credentials/credentials.h"
 
+namespace {
+
+// The maximum number of resumable sessions held by channel credentials.
+constexpr size_t kMaxResumableSessions = 256;
+
+// The period for which a resumption ticket can be redeemed.
+constexpr absl::Duration kResumptionTicketLifetime = absl::Hours(1);
+
+}  // namespace
+
 grpc_core::RefCountedPtr<grpc_channel_credentials>
 grpc_enclave_channel_credentials_create(
     const grpc_enclave_credentials_options *options) {
@@ -87,6 +98,13 @@ grpc_enclave_channel_credentials::grpc_enclave_channel_credentials(
   assertion_description_array_copy(
       /*src=*/&options.accepted_peer_assertions,
       /*dest=*/&accepted_peer_assertions_);
+  max_record_frame_size_ = options.max_record_frame_size;
+  enable_record_protocol_rekeying_ = options.enable_record_protocol_rekeying;
+
+  if (options.enable_session_resumption) {
+    session_cache_ =
+        std::make_shared<asylo::EkepSessionCache>(kMaxResumableSessions);
+  }
 }
 
 grpc_enclave_server_credentials::grpc_enclave_server_credentials(
@@ -105,4 +123,18 @@ grpc_enclave_server_credentials::grpc_enclave_server_credentials(
   assertion_description_array_copy(
       /*src=*/&options.accepted_peer_assertions,
       /*dest=*/&accepted_peer_assertions_);
+  max_record_frame_size_ = options.max_record_frame_size;
+  enable_record_protocol_rekeying_ = options.enable_record_protocol_rekeying;
+
+  if (options.enable_session_resumption) {
+    auto ticket_crypter_result =
+        asylo::EkepTicketCrypter::Create(kResumptionTicketLifetime);
+    if (ticket_crypter_result.ok()) {
+      ticket_crypter_ = std::move(ticket_crypter_result.ValueOrDie());
+    } else {
+      // The server can still perform full handshakes without a crypter.
+      gpr_log(GPR_ERROR, "Failed to create ticket crypter: %s",
+              ticket_crypter_result.status().ToString().c_str());
+    }
+  }
 }
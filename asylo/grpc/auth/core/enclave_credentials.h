@@ -19,7 +19,10 @@
 #ifndef ASYLO_GRPC_AUTH_CORE_ENCLAVE_CREDENTIALS_H_
 #define ASYLO_GRPC_AUTH_CORE_ENCLAVE_CREDENTIALS_H_
 
+#include <memory>
+
 #include "asylo/grpc/auth/core/assertion_description.h"
+#include "asylo/grpc/auth/core/ekep_session_resumption.h"
 #include "asylo/grpc/auth/core/enclave_credentials_options.h"
 #include "asylo/grpc/auth/util/safe_string.h"
 #include "src/core/lib/security/credentials/credentials.h"
@@ -64,6 +67,13 @@ class grpc_enclave_channel_credentials final : public grpc_channel_credentials {
   assertion_description_array* mutable_accepted_peer_assertions() {
     return &accepted_peer_assertions_;
   }
+  const std::shared_ptr<asylo::EkepSessionCache>& session_cache() const {
+    return session_cache_;
+  }
+  size_t max_record_frame_size() const { return max_record_frame_size_; }
+  int enable_record_protocol_rekeying() const {
+    return enable_record_protocol_rekeying_;
+  }
 
  private:
   // Additional authenticated data provided by the client.
@@ -75,6 +85,17 @@ class grpc_enclave_channel_credentials final : public grpc_channel_credentials {
   // Server assertions accepted by the client.
   assertion_description_array accepted_peer_assertions_;
 
+  // Sessions that can be resumed by channels created with these credentials,
+  // or nullptr if session resumption is disabled.
+  std::shared_ptr<asylo::EkepSessionCache> session_cache_;
+
+  // The largest protected record-protocol frame to negotiate, or zero to use
+  // the record protocol's default.
+  size_t max_record_frame_size_;
+
+  // Non-zero if the rekeying record protocol is preferred.
+  int enable_record_protocol_rekeying_;
+
 };
 
 class grpc_enclave_server_credentials final : public grpc_server_credentials {
@@ -95,6 +116,13 @@ class grpc_enclave_server_credentials final : public grpc_server_credentials {
   assertion_description_array* mutable_accepted_peer_assertions() {
     return &accepted_peer_assertions_;
   }
+  const std::shared_ptr<asylo::EkepTicketCrypter>& ticket_crypter() const {
+    return ticket_crypter_;
+  }
+  size_t max_record_frame_size() const { return max_record_frame_size_; }
+  int enable_record_protocol_rekeying() const {
+    return enable_record_protocol_rekeying_;
+  }
 
  private:
   // Additional authenticated data provided by the server.
@@ -106,6 +134,17 @@ class grpc_enclave_server_credentials final : public grpc_server_credentials {
   // Client assertions accepted by the server.
   assertion_description_array accepted_peer_assertions_;
 
+  // The crypter for resumption tickets issued by servers created with these
+  // credentials, or nullptr if session resumption is disabled.
+  std::shared_ptr<asylo::EkepTicketCrypter> ticket_crypter_;
+
+  // The largest protected record-protocol frame to negotiate, or zero to use
+  // the record protocol's default.
+  size_t max_record_frame_size_;
+
+  // Non-zero if the rekeying record protocol is preferred.
+  int enable_record_protocol_rekeying_;
+
 };
 
 #endif  // ASYLO_GRPC_AUTH_CORE_ENCLAVE_CREDENTIALS_H_
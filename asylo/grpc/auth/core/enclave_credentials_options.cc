@@ -24,6 +24,9 @@ void grpc_enclave_credentials_options_init(
   assertion_description_array_init(/*count=*/0, &options->self_assertions);
   assertion_description_array_init(/*count=*/0,
                                    &options->accepted_peer_assertions);
+  options->enable_session_resumption = 0;
+  options->max_record_frame_size = 0;
+  options->enable_record_protocol_rekeying = 0;
 }
 
 void grpc_enclave_credentials_options_destroy(
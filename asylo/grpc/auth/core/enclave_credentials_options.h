@@ -19,6 +19,8 @@
 #ifndef ASYLO_GRPC_AUTH_CORE_ENCLAVE_CREDENTIALS_OPTIONS_H_
 #define ASYLO_GRPC_AUTH_CORE_ENCLAVE_CREDENTIALS_OPTIONS_H_
 
+#include <stddef.h>
+
 #include "asylo/grpc/auth/core/assertion_description.h"
 #include "asylo/grpc/auth/util/safe_string.h"
 
@@ -31,6 +33,16 @@ typedef struct {
   /* The credential holder's accepted peer assertions. */
   assertion_description_array accepted_peer_assertions;
 
+  /* Non-zero if session resumption is enabled. */
+  int enable_session_resumption;
+
+  /* The largest protected record-protocol frame, in bytes, or zero to use the
+   * record protocol's default. */
+  size_t max_record_frame_size;
+
+  /* Non-zero if the rekeying record protocol is preferred. */
+  int enable_record_protocol_rekeying;
+
 } grpc_enclave_credentials_options;
 
 /* Initializes an options object. This should be called before assigning to or
@@ -170,7 +170,9 @@ class grpc_enclave_channel_security_connector final
         /*is_client=*/true, channel_creds->mutable_self_assertions(),
         channel_creds->mutable_accepted_peer_assertions(),
         channel_creds->mutable_additional_authenticated_data(),
-        &tsi_handshaker);
+        channel_creds->session_cache(), target_,
+        /*ticket_crypter=*/nullptr, channel_creds->max_record_frame_size(),
+        channel_creds->enable_record_protocol_rekeying(), &tsi_handshaker);
     if (result != TSI_OK) {
       gpr_log(GPR_ERROR, "Enclave handshaker creation failed with error %s.",
               tsi_result_to_string(result));
@@ -216,7 +218,10 @@ class grpc_enclave_server_security_connector final
     tsi_result result = tsi_enclave_handshaker_create(
         /*is_client=*/false, server_creds->mutable_self_assertions(),
         server_creds->mutable_accepted_peer_assertions(),
-        server_creds->mutable_additional_authenticated_data(), &tsi_handshaker);
+        server_creds->mutable_additional_authenticated_data(),
+        /*session_cache=*/nullptr, /*session_cache_key=*/nullptr,
+        server_creds->ticket_crypter(), server_creds->max_record_frame_size(),
+        server_creds->enable_record_protocol_rekeying(), &tsi_handshaker);
     if (result != TSI_OK) {
       gpr_log(GPR_ERROR, "Enclave handshaker creation failed with error %s.",
               tsi_result_to_string(result));
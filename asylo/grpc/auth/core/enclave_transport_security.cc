@@ -29,6 +29,7 @@
 #include "asylo/grpc/auth/core/ekep_handshaker.h"
 #include "asylo/grpc/auth/core/ekep_handshaker_util.h"
 #include "asylo/grpc/auth/core/handshake.pb.h"
+#include "asylo/grpc/auth/core/handshake_worker_pool.h"
 #include "asylo/grpc/auth/core/server_ekep_handshaker.h"
 #include "asylo/identity/identity.pb.h"
 #include "asylo/util/cleansing_types.h"
@@ -75,24 +76,42 @@ class TsiEnclaveHandshakerResult {
   TsiEnclaveHandshakerResult(
       bool is_client, RecordProtocol record_protocol,
       const CleansingVector<uint8_t> &record_protocol_key,
+      size_t record_frame_size,
       std::unique_ptr<EnclaveIdentities> peer_identities, std::string unused_bytes)
       : is_client_(is_client),
         record_protocol_(record_protocol),
         record_protocol_key_(record_protocol_key),
+        record_frame_size_(record_frame_size),
         peer_identities_(std::move(peer_identities)),
         unused_bytes_(std::move(unused_bytes)) {}
 
   // Creates a frame protector that uses a max frame size of
   // |max_output_protected_frame_size|, if non-null, and places the result in
-  // |protector|.
+  // |protector|. The frame size is capped by the record frame size negotiated
+  // during the handshake, if any.
   tsi_result CreateFrameProtector(size_t *max_output_protected_frame_size,
                                   tsi_frame_protector **protector) {
+    size_t negotiated_frame_size = record_frame_size_;
+    if (negotiated_frame_size != 0) {
+      if (max_output_protected_frame_size) {
+        *max_output_protected_frame_size = std::min(
+            *max_output_protected_frame_size, negotiated_frame_size);
+      } else {
+        max_output_protected_frame_size = &negotiated_frame_size;
+      }
+    }
+
     switch (record_protocol_) {
       case SEAL_AES128_GCM:
         return alts_create_frame_protector(
             record_protocol_key_.data(), record_protocol_key_.size(),
             is_client_, /*is_rekey=*/false, max_output_protected_frame_size,
             protector);
+      case ALTSRP_AES128_GCM_REKEY:
+        return alts_create_frame_protector(
+            record_protocol_key_.data(), record_protocol_key_.size(),
+            is_client_, /*is_rekey=*/true, max_output_protected_frame_size,
+            protector);
       default:
         return TSI_INTERNAL_ERROR;
     }
@@ -167,6 +186,10 @@ class TsiEnclaveHandshakerResult {
   // The record protocol key to use for frame protection.
   CleansingVector<uint8_t> record_protocol_key_;
 
+  // The negotiated size of protected frames, or zero to use the frame
+  // protector's default.
+  size_t record_frame_size_;
+
   // The peer's enclave identities.
   std::unique_ptr<EnclaveIdentities> peer_identities_;
 
@@ -257,24 +280,15 @@ void enclave_handshaker_destroy(tsi_handshaker *self) {
   delete (impl);
 }
 
-tsi_result enclave_handshaker_next(
-    tsi_handshaker *self, const unsigned char *received_bytes,
-    size_t received_bytes_size, const unsigned char **bytes_to_send,
-    size_t *bytes_to_send_size, tsi_handshaker_result **handshaker_result,
-    tsi_handshaker_on_next_done_cb cb, void *user_data) {
-  if ((received_bytes_size > 0 && !received_bytes) || !bytes_to_send ||
-      !bytes_to_send_size || !handshaker_result) {
-    return TSI_INVALID_ARGUMENT;
-  }
-  gpr_log(GPR_INFO,
-          "enclave_handshaker_next(self=%p, received_bytes=%p, "
-          "received_bytes_size=%zu, bytes_to_send=%p, bytes_to_send_size=%p "
-          "handshaker_result=%p, cb=%p, user_data=%p)",
-          self, received_bytes, received_bytes_size, bytes_to_send,
-          bytes_to_send_size, handshaker_result, cb, user_data);
-
-  tsi_enclave_handshaker *tsi_handshaker =
-      reinterpret_cast<tsi_enclave_handshaker *>(self);
+// Runs the next step of the handshake performed by |tsi_handshaker| on
+// |received_bytes|. Sets |bytes_to_send| and |bytes_to_send_size| to the
+// outgoing bytes, if any, and sets |handshaker_result| if the handshake has
+// completed.
+tsi_result enclave_handshaker_next_step(
+    tsi_enclave_handshaker *tsi_handshaker,
+    const unsigned char *received_bytes, size_t received_bytes_size,
+    const unsigned char **bytes_to_send, size_t *bytes_to_send_size,
+    tsi_handshaker_result **handshaker_result) {
   EkepHandshaker *handshaker = tsi_handshaker->handshaker.get();
 
   // Run the next step of the handshake.
@@ -321,6 +335,15 @@ tsi_result enclave_handshaker_next(
         return TSI_INTERNAL_ERROR;
       }
 
+      StatusOr<size_t> record_frame_size_result =
+          handshaker->GetRecordFrameSize();
+      if (!record_frame_size_result.ok()) {
+        gpr_log(GPR_ERROR, "Failed to retrieve record frame size: %s",
+                std::string(record_frame_size_result.status().error_message())
+                    .c_str());
+        return TSI_INTERNAL_ERROR;
+      }
+
       StatusOr<std::unique_ptr<EnclaveIdentities>> identities_result =
           handshaker->GetPeerIdentities();
       if (!identities_result.ok()) {
@@ -333,12 +356,12 @@ tsi_result enclave_handshaker_next(
       tsi_result result = enclave_handshaker_result_create(
           absl::make_unique<TsiEnclaveHandshakerResult>(
               tsi_handshaker->is_client, record_protocol_result.ValueOrDie(),
-              key_result.ValueOrDie(),
+              key_result.ValueOrDie(), record_frame_size_result.ValueOrDie(),
               std::move(identities_result).ValueOrDie(),
               unused_bytes_result.ValueOrDie()),
           handshaker_result);
       if (result == TSI_OK) {
-        self->handshaker_result_created = true;
+        tsi_handshaker->base.handshaker_result_created = true;
       }
       return result;
     }
@@ -348,6 +371,59 @@ tsi_result enclave_handshaker_next(
   }
 }
 
+tsi_result enclave_handshaker_next(
+    tsi_handshaker *self, const unsigned char *received_bytes,
+    size_t received_bytes_size, const unsigned char **bytes_to_send,
+    size_t *bytes_to_send_size, tsi_handshaker_result **handshaker_result,
+    tsi_handshaker_on_next_done_cb cb, void *user_data) {
+  if ((received_bytes_size > 0 && !received_bytes) || !bytes_to_send ||
+      !bytes_to_send_size || !handshaker_result) {
+    return TSI_INVALID_ARGUMENT;
+  }
+  gpr_log(GPR_INFO,
+          "enclave_handshaker_next(self=%p, received_bytes=%p, "
+          "received_bytes_size=%zu, bytes_to_send=%p, bytes_to_send_size=%p "
+          "handshaker_result=%p, cb=%p, user_data=%p)",
+          self, received_bytes, received_bytes_size, bytes_to_send,
+          bytes_to_send_size, handshaker_result, cb, user_data);
+
+  tsi_enclave_handshaker *tsi_handshaker =
+      reinterpret_cast<tsi_enclave_handshaker *>(self);
+
+  // If the caller supports asynchronous completion, run the handshake step on
+  // the handshake worker pool so that the key exchange and assertion
+  // operations do not block the caller's thread. The caller does not call
+  // into the handshaker again until |cb| has been invoked.
+  if (cb) {
+    std::string received;
+    if (received_bytes_size > 0) {
+      received.assign(reinterpret_cast<const char *>(received_bytes),
+                      received_bytes_size);
+    }
+    bool scheduled = HandshakeWorkerPool::GetDefault()->Schedule(
+        [tsi_handshaker, received, cb, user_data]() {
+          const unsigned char *bytes_to_send = nullptr;
+          size_t bytes_to_send_size = 0;
+          tsi_handshaker_result *handshaker_result = nullptr;
+          tsi_result result = enclave_handshaker_next_step(
+              tsi_handshaker,
+              reinterpret_cast<const unsigned char *>(received.data()),
+              received.size(), &bytes_to_send, &bytes_to_send_size,
+              &handshaker_result);
+          cb(result, user_data, bytes_to_send, bytes_to_send_size,
+             handshaker_result);
+        });
+    if (scheduled) {
+      return TSI_ASYNC;
+    }
+    // The pool is saturated. Fall back to running the step on this thread.
+  }
+
+  return enclave_handshaker_next_step(tsi_handshaker, received_bytes,
+                                      received_bytes_size, bytes_to_send,
+                                      bytes_to_send_size, handshaker_result);
+}
+
 const tsi_handshaker_vtable handshaker_vtable = {
     nullptr /* get_bytes_to_send_to_peer -- deprecated */,
     nullptr /* process_bytes_from_peer   -- deprecated */,
@@ -372,6 +448,10 @@ tsi_result tsi_enclave_handshaker_create(
     int is_client, const assertion_description_array *self_assertions,
     const assertion_description_array *accepted_peer_assertions,
     const safe_string *additional_authenticated_data,
+    const std::shared_ptr<asylo::EkepSessionCache> &session_cache,
+    const char *session_cache_key,
+    const std::shared_ptr<asylo::EkepTicketCrypter> &ticket_crypter,
+    size_t max_record_frame_size, int enable_record_protocol_rekeying,
     tsi_handshaker **handshaker) {
   GRPC_API_TRACE(
       "tsi_enclave_handshaker_create(is_client=%d, self_assertions=%p, "
@@ -389,6 +469,16 @@ tsi_result tsi_enclave_handshaker_create(
       asylo::CreateAssertionDescriptionVector(*self_assertions);
   options.accepted_peer_assertions =
       asylo::CreateAssertionDescriptionVector(*accepted_peer_assertions);
+  options.session_cache = session_cache;
+  if (session_cache_key) {
+    options.session_cache_key = session_cache_key;
+  }
+  options.ticket_crypter = ticket_crypter;
+  options.max_record_frame_size = max_record_frame_size;
+  if (enable_record_protocol_rekeying) {
+    options.record_protocols = {asylo::ALTSRP_AES128_GCM_REKEY,
+                                asylo::SEAL_AES128_GCM};
+  }
 
   if (!options.additional_authenticated_data.empty()) {
     gpr_log(GPR_DEBUG, "additional authenticated data: %s",
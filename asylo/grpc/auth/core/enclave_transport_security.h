@@ -19,7 +19,10 @@
 #ifndef ASYLO_GRPC_AUTH_CORE_ENCLAVE_TRANSPORT_SECURITY_H_
 #define ASYLO_GRPC_AUTH_CORE_ENCLAVE_TRANSPORT_SECURITY_H_
 
+#include <memory>
+
 #include "asylo/grpc/auth/core/assertion_description.h"
+#include "asylo/grpc/auth/core/ekep_session_resumption.h"
 #include "asylo/grpc/auth/util/safe_string.h"
 #include "src/core/tsi/transport_security_interface.h"
 
@@ -42,10 +45,22 @@
 //   is willing to accept from the peer during the handshake
 //   * |additional_authenticated_data| is data to be authenticated as part of
 //   the handshake
+//   * |session_cache| holds resumable sessions, keyed by |session_cache_key|.
+//   Only used by client handshakers. May be nullptr.
+//   * |ticket_crypter| issues and redeems resumption tickets. Only used by
+//   server handshakers. May be nullptr.
+//   * |max_record_frame_size| is the largest protected frame to negotiate for
+//   the record protocol, or zero to use the record protocol's default
+//   * |enable_record_protocol_rekeying| indicates whether to prefer the
+//   rekeying ALTS record protocol over the SEAL record protocol
 tsi_result tsi_enclave_handshaker_create(
     int is_client, const assertion_description_array *self_assertions,
     const assertion_description_array *accepted_peer_assertions,
     const safe_string *additional_authenticated_data,
+    const std::shared_ptr<asylo::EkepSessionCache> &session_cache,
+    const char *session_cache_key,
+    const std::shared_ptr<asylo::EkepTicketCrypter> &ticket_crypter,
+    size_t max_record_frame_size, int enable_record_protocol_rekeying,
     tsi_handshaker **handshaker);
 
 #endif  // ASYLO_GRPC_AUTH_CORE_ENCLAVE_TRANSPORT_SECURITY_H_
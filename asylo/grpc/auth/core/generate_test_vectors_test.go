@@ -76,13 +76,14 @@ func deriveSecrets() ([]byte, []byte) {
 	return masterSecret, authSecret
 }
 
-// DeriveRecordProtocolKey generates a SEAL AES128 GCM record protocol key
-// using the given master secret.
-func deriveRecordProtocolKey(masterSecret []byte) []byte {
+// DeriveRecordProtocolKey generates a record protocol key of the given size
+// using the given master secret. SEAL AES128 GCM uses a 16-byte key and ALTS
+// AES128 GCM with rekeying uses a 44-byte key.
+func deriveRecordProtocolKey(masterSecret []byte, keySize int) []byte {
 	hash := sha256.New
 	salt := []byte("EKEP Record Protocol v1")
 	hkdf := hkdf.New(hash, masterSecret, salt, info[:])
-	key := make([]byte, 16)
+	key := make([]byte, keySize)
 
 	n, err := io.ReadFull(hkdf, key)
 	if n != len(key) || err != nil {
@@ -129,13 +130,19 @@ func main() {
 	fmt.Printf("Authenticator secret:\n%s\n\n", hex.EncodeToString(authSecret))
 
 	// EKEP record protocol secrets
-	key := deriveRecordProtocolKey(masterSecret)
+	key := deriveRecordProtocolKey(masterSecret, 16)
 
 	fmt.Println(">>EKEP Record Protocol Key<<")
 	fmt.Printf("Master secret:\n%s\n", hex.EncodeToString(masterSecret[:]))
 	fmt.Printf("HKDF info:\n%s\n", hex.EncodeToString(info[:]))
 	fmt.Printf("Record protocol key:\n%s\n\n", hex.EncodeToString(key[:]))
 
+	// EKEP rekeying record protocol secrets
+	rekeyKey := deriveRecordProtocolKey(masterSecret, 44)
+
+	fmt.Println(">>EKEP Rekeying Record Protocol Key<<")
+	fmt.Printf("Record protocol key:\n%s\n\n", hex.EncodeToString(rekeyKey[:]))
+
 	// EKEP server handshake authenticator
 	serverAuthn := computeServerHandshakeAuthenticator(authSecret)
 
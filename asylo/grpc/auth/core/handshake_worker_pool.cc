@@ -0,0 +1,147 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/grpc/auth/core/handshake_worker_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "include/grpc/support/log.h"
+
+namespace asylo {
+
+constexpr int HandshakeWorkerPool::kDefaultNumThreads;
+constexpr size_t HandshakeWorkerPool::kDefaultMaxQueued;
+
+namespace {
+
+// How long a worker waits for a handshake step before it exits.
+const absl::Duration kIdleTimeout = absl::Seconds(1);
+
+}  // namespace
+
+HandshakeWorkerPool::HandshakeWorkerPool(int num_threads, size_t max_queued)
+    : num_threads_(num_threads),
+      max_queued_(max_queued),
+      shutting_down_(false),
+      in_flight_(0),
+      completed_(0),
+      rejected_(0) {}
+
+HandshakeWorkerPool::~HandshakeWorkerPool() {
+  std::vector<pthread_t> workers;
+  {
+    absl::MutexLock lock(&mu_);
+    shutting_down_ = true;
+    workers.swap(workers_);
+  }
+  for (pthread_t worker : workers) {
+    pthread_join(worker, nullptr);
+  }
+}
+
+HandshakeWorkerPool *HandshakeWorkerPool::GetDefault() {
+  static HandshakeWorkerPool *pool =
+      new HandshakeWorkerPool(kDefaultNumThreads, kDefaultMaxQueued);
+  return pool;
+}
+
+bool HandshakeWorkerPool::Schedule(std::function<void()> step) {
+  absl::MutexLock lock(&mu_);
+  if (shutting_down_ || queue_.size() >= max_queued_ ||
+      !StartWorkersLocked()) {
+    ++rejected_;
+    return false;
+  }
+  queue_.push_back(std::move(step));
+  return true;
+}
+
+HandshakeWorkerPoolStats HandshakeWorkerPool::GetStats() const {
+  absl::MutexLock lock(&mu_);
+  HandshakeWorkerPoolStats stats;
+  stats.queued = queue_.size();
+  stats.in_flight = in_flight_;
+  stats.completed = completed_;
+  stats.rejected = rejected_;
+  return stats;
+}
+
+bool HandshakeWorkerPool::StartWorkersLocked() {
+  while (workers_.size() < static_cast<size_t>(num_threads_)) {
+    pthread_t worker;
+    int ret = pthread_create(&worker, nullptr, &HandshakeWorkerPool::WorkerMain,
+                             this);
+    if (ret != 0) {
+      // Threads may be a scarce resource, for instance inside an enclave with
+      // a small number of TCS. Make do with the workers that are running.
+      gpr_log(GPR_DEBUG, "Failed to start handshake worker thread: %d", ret);
+      break;
+    }
+    workers_.push_back(worker);
+  }
+  return !workers_.empty();
+}
+
+bool HandshakeWorkerPool::HasWorkOrShuttingDown() {
+  return !queue_.empty() || shutting_down_;
+}
+
+void *HandshakeWorkerPool::WorkerMain(void *arg) {
+  static_cast<HandshakeWorkerPool *>(arg)->Work();
+  return nullptr;
+}
+
+void HandshakeWorkerPool::Work() {
+  absl::MutexLock lock(&mu_);
+  while (true) {
+    bool has_work = mu_.AwaitWithTimeout(
+        absl::Condition(this, &HandshakeWorkerPool::HasWorkOrShuttingDown),
+        kIdleTimeout);
+    if (!has_work) {
+      // Retire idle workers so that they do not hold on to threads, which
+      // inside an enclave would keep the enclave from being finalized. If the
+      // worker is not in |workers_| the destructor is waiting to join it.
+      pthread_t self = pthread_self();
+      auto it = std::find_if(
+          workers_.begin(), workers_.end(),
+          [self](pthread_t worker) { return pthread_equal(worker, self); });
+      if (it != workers_.end()) {
+        workers_.erase(it);
+        pthread_detach(pthread_self());
+      }
+      return;
+    }
+    if (queue_.empty()) {
+      // The pool is shutting down and there is no more work.
+      return;
+    }
+    std::function<void()> step = std::move(queue_.front());
+    queue_.pop_front();
+    ++in_flight_;
+
+    mu_.Unlock();
+    step();
+    mu_.Lock();
+
+    --in_flight_;
+    ++completed_;
+  }
+}
+
+}  // namespace asylo
@@ -0,0 +1,114 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_GRPC_AUTH_CORE_HANDSHAKE_WORKER_POOL_H_
+#define ASYLO_GRPC_AUTH_CORE_HANDSHAKE_WORKER_POOL_H_
+
+#include <pthread.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace asylo {
+
+// A snapshot of the state of a HandshakeWorkerPool.
+struct HandshakeWorkerPoolStats {
+  // Number of handshake steps waiting for a worker.
+  size_t queued;
+
+  // Number of handshake steps currently running on a worker.
+  size_t in_flight;
+
+  // Number of handshake steps that have finished running on a worker.
+  uint64_t completed;
+
+  // Number of handshake steps the pool refused because it was full or had no
+  // workers. Refused steps are expected to run on the caller's thread.
+  uint64_t rejected;
+};
+
+// A bounded pool of worker threads that run EKEP handshake steps off of the
+// gRPC threads that deliver handshake bytes.
+//
+// Worker threads are started lazily, by Schedule(), and exit after they have
+// been idle for a short while. If no worker thread can be started, or if the
+// number of queued steps has reached the pool's limit, Schedule() refuses the
+// step and the caller is expected to run it synchronously.
+//
+// This class is thread-safe.
+class HandshakeWorkerPool {
+ public:
+  // The number of worker threads and queued steps of the default pool.
+  static constexpr int kDefaultNumThreads = 4;
+  static constexpr size_t kDefaultMaxQueued = 64;
+
+  // Creates a pool with at most |num_threads| worker threads and at most
+  // |max_queued| steps waiting for a worker.
+  HandshakeWorkerPool(int num_threads, size_t max_queued);
+
+  HandshakeWorkerPool(const HandshakeWorkerPool &other) = delete;
+  HandshakeWorkerPool &operator=(const HandshakeWorkerPool &other) = delete;
+
+  // Runs all queued steps and joins the worker threads.
+  ~HandshakeWorkerPool();
+
+  // Returns the process-wide pool used by enclave TSI handshakers.
+  static HandshakeWorkerPool *GetDefault();
+
+  // Queues |step| to be run on a worker thread. Returns false if the pool
+  // refused |step|, in which case |step| is not run.
+  bool Schedule(std::function<void()> step);
+
+  // Returns a snapshot of the pool's counters.
+  HandshakeWorkerPoolStats GetStats() const;
+
+ private:
+  // Starts worker threads until the pool has |num_threads_| running workers.
+  // Returns false if the pool has no running workers.
+  bool StartWorkersLocked() EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Returns true if a worker has a step to run or should exit.
+  bool HasWorkOrShuttingDown() EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Entry point of a worker thread. |arg| is the HandshakeWorkerPool.
+  static void *WorkerMain(void *arg);
+
+  // Runs queued steps until the pool is shut down and the queue is empty.
+  void Work();
+
+  const int num_threads_;
+  const size_t max_queued_;
+
+  mutable absl::Mutex mu_;
+  std::vector<pthread_t> workers_ GUARDED_BY(mu_);
+  std::deque<std::function<void()>> queue_ GUARDED_BY(mu_);
+  bool shutting_down_ GUARDED_BY(mu_);
+  size_t in_flight_ GUARDED_BY(mu_);
+  uint64_t completed_ GUARDED_BY(mu_);
+  uint64_t rejected_ GUARDED_BY(mu_);
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_GRPC_AUTH_CORE_HANDSHAKE_WORKER_POOL_H_
@@ -0,0 +1,87 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/grpc/auth/core/handshake_worker_pool.h"
+
+#include <gtest/gtest.h>
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/notification.h"
+
+namespace asylo {
+namespace {
+
+constexpr int kNumSteps = 16;
+
+// Verifies that all scheduled steps are run.
+TEST(HandshakeWorkerPoolTest, RunsScheduledSteps) {
+  HandshakeWorkerPool pool(/*num_threads=*/2, /*max_queued=*/kNumSteps);
+  absl::BlockingCounter counter(kNumSteps);
+  for (int i = 0; i < kNumSteps; ++i) {
+    ASSERT_TRUE(pool.Schedule([&counter]() { counter.DecrementCount(); }));
+  }
+  counter.Wait();
+}
+
+// Verifies that the pool refuses steps when its queue is full and reports
+// queued and in-flight steps.
+TEST(HandshakeWorkerPoolTest, RefusesStepsWhenFull) {
+  HandshakeWorkerPool pool(/*num_threads=*/1, /*max_queued=*/1);
+  absl::Notification started;
+  absl::Notification release;
+
+  // Occupy the only worker.
+  ASSERT_TRUE(pool.Schedule([&started, &release]() {
+    started.Notify();
+    release.WaitForNotification();
+  }));
+  started.WaitForNotification();
+
+  // Fill the queue.
+  ASSERT_TRUE(pool.Schedule([]() {}));
+  EXPECT_FALSE(pool.Schedule([]() {}));
+
+  HandshakeWorkerPoolStats stats = pool.GetStats();
+  EXPECT_EQ(stats.queued, 1u);
+  EXPECT_EQ(stats.in_flight, 1u);
+  EXPECT_EQ(stats.completed, 0u);
+  EXPECT_EQ(stats.rejected, 1u);
+
+  release.Notify();
+}
+
+// Verifies that destroying the pool runs all queued steps.
+TEST(HandshakeWorkerPoolTest, DestructorDrainsQueue) {
+  int steps_run = 0;
+  {
+    HandshakeWorkerPool pool(/*num_threads=*/1, /*max_queued=*/kNumSteps);
+    for (int i = 0; i < kNumSteps; ++i) {
+      ASSERT_TRUE(pool.Schedule([&steps_run]() { ++steps_run; }));
+    }
+  }
+  EXPECT_EQ(steps_run, kNumSteps);
+}
+
+// Verifies that a pool without worker threads refuses all steps.
+TEST(HandshakeWorkerPoolTest, RefusesStepsWithoutWorkers) {
+  HandshakeWorkerPool pool(/*num_threads=*/0, /*max_queued=*/kNumSteps);
+  EXPECT_FALSE(pool.Schedule([]() {}));
+  EXPECT_EQ(pool.GetStats().rejected, 1u);
+}
+
+}  // namespace
+}  // namespace asylo
@@ -19,8 +19,11 @@
 #include "asylo/grpc/auth/core/server_ekep_handshaker.h"
 
 #include <openssl/curve25519.h>
+#include <openssl/mem.h>
 #include <openssl/rand.h>
 
+#include <algorithm>
+
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include "absl/memory/memory.h"
 #include "asylo/crypto/sha256_hash.h"
@@ -59,15 +62,21 @@ ServerEkepHandshaker::ServerEkepHandshaker(const EkepHandshakerOptions &options)
       self_assertions_(options.self_assertions),
       accepted_peer_assertions_(options.accepted_peer_assertions),
       available_cipher_suites_({CURVE25519_SHA256}),
-      available_record_protocols_({SEAL_AES128_GCM}),
+      available_record_protocols_(options.record_protocols),
       available_ekep_versions_({"EKEP v1"}),
       additional_authenticated_data_(options.additional_authenticated_data),
+      max_record_frame_size_(options.max_record_frame_size),
+      ticket_crypter_(options.ticket_crypter),
+      resumed_(false),
       selected_cipher_suite_(UNKNOWN_HANDSHAKE_CIPHER),
       selected_record_protocol_(UNKNOWN_RECORD_PROTOCOL),
+      selected_record_frame_size_(0),
       expected_message_type_(CLIENT_PRECOMMIT),
       // The handshake is in progress for the server because it relies on the
       // client to act first.
-      handshaker_state_(EkepHandshaker::HandshakeState::IN_PROGRESS) {}
+      handshaker_state_(EkepHandshaker::HandshakeState::IN_PROGRESS) {
+  SetCandidateCipherSuites(available_cipher_suites_);
+}
 
 bool ServerEkepHandshaker::IsHandshakeInProgress() const {
   return handshaker_state_ == HandshakeState::IN_PROGRESS;
@@ -128,6 +137,10 @@ ServerEkepHandshaker::Result ServerEkepHandshaker::HandleHandshakeMessage(
     case CLIENT_PRECOMMIT:
       expected_message_type_ = CLIENT_ID;
       status = HandleClientPrecommit(handshake_message, output);
+      if (resumed_) {
+        // A resumed handshake skips the ClientId message.
+        expected_message_type_ = CLIENT_FINISH;
+      }
       break;
     case CLIENT_ID:
       expected_message_type_ = CLIENT_FINISH;
@@ -226,12 +239,39 @@ Status ServerEkepHandshaker::HandleClientPrecommit(
                   "No compatible record_protocol");
   }
 
+  // Use the smaller of the two record frame sizes if both participants set
+  // one. Otherwise, the record protocol's default frame size is used.
+  if (client_precommit.has_max_record_frame_size() &&
+      max_record_frame_size_ != 0) {
+    size_t client_max_record_frame_size =
+        client_precommit.max_record_frame_size();
+    if (client_max_record_frame_size < EkepHandshaker::kMinRecordFrameSize) {
+      return Status(Abort_ErrorCode_PROTOCOL_ERROR,
+                    "Received a record frame size that is too small");
+    }
+    selected_record_frame_size_ =
+        std::min(client_max_record_frame_size, max_record_frame_size_);
+    SetRecordFrameSize(selected_record_frame_size_);
+  }
+
   // Verify that the client sent an adequately-sized challenge.
   if (client_precommit.challenge().size() != kEkepChallengeSize) {
     return Status(Abort_ErrorCode_PROTOCOL_ERROR,
                   "Received a challenge with incorrect size");
   }
 
+  // Resume the client's previous session if it presented a valid ticket.
+  // Otherwise, fall back to a full handshake.
+  if (ticket_crypter_ && client_precommit.has_resumption_ticket()) {
+    EkepResumptionState state;
+    if (RedeemResumptionTicket(client_precommit.resumption_ticket(), &state)) {
+      Status status = ResumeSession(state, output);
+      OPENSSL_cleanse(&(*state.mutable_resumption_secret())[0],
+                      state.resumption_secret().size());
+      return status;
+    }
+  }
+
   for (const AssertionOffer &offer : client_precommit.client_offers()) {
     const AssertionDescription &offer_desc = offer.description();
     // Request any assertion that the peer offered and that this handshaker is
@@ -272,6 +312,60 @@ Status ServerEkepHandshaker::HandleClientPrecommit(
   return WriteServerPrecommit(output);
 }
 
+bool ServerEkepHandshaker::RedeemResumptionTicket(const std::string &ticket,
+                                                  EkepResumptionState *state) {
+  Status status = ticket_crypter_->RedeemTicket(ticket, state);
+  if (!status.ok()) {
+    VLOG(1) << "Resumption ticket rejected: " << status;
+    return false;
+  }
+
+  // The session must be resumed with the parameters negotiated in this
+  // handshake, and the server must still accept the assertions that
+  // established the client's identities.
+  if (state->ekep_version().name() != selected_ekep_version_ ||
+      state->cipher_suite() != selected_cipher_suite_ ||
+      state->record_protocol() != selected_record_protocol_) {
+    VLOG(1) << "Resumption ticket has incompatible parameters";
+    return false;
+  }
+  for (const AssertionDescription &description : state->peer_assertions()) {
+    if (FindAssertionDescription(accepted_peer_assertions_, description) ==
+        accepted_peer_assertions_.cend()) {
+      VLOG(1) << "Resumption ticket has an unaccepted peer assertion";
+      return false;
+    }
+  }
+  return true;
+}
+
+Status ServerEkepHandshaker::ResumeSession(const EkepResumptionState &state,
+                                           std::string *output) {
+  resumed_ = true;
+  for (const EnclaveIdentity &identity :
+       state.peer_identities().identities()) {
+    AddPeerIdentity(identity);
+  }
+  verified_peer_assertions_.assign(state.peer_assertions().cbegin(),
+                                   state.peer_assertions().cend());
+
+  // No assertions are exchanged in a resumed handshake, so the ServerPrecommit
+  // carries no offers or requests.
+  ASYLO_RETURN_IF_ERROR(WriteServerPrecommit(output));
+
+  // At this stage in the protocol, the transcript is:
+  //   hash(ClientPrecommit || ServerPrecommit)
+  //
+  // This transcript is used by both the client and server to derive the EKEP
+  // secrets of a resumed handshake.
+  secrets_transcript_hash_ = client_assertion_transcript_;
+  ASYLO_RETURN_IF_ERROR(DeriveResumedSecrets(
+      selected_cipher_suite_, secrets_transcript_hash_,
+      state.resumption_secret(), &master_secret_, &authenticator_secret_));
+
+  return WriteServerFinish(output);
+}
+
 Status ServerEkepHandshaker::HandleClientId(const google::protobuf::Message &message,
                                             std::string *output) {
   const auto *client_id_ptr = dynamic_cast<const ClientId *>(&message);
@@ -312,6 +406,7 @@ Status ServerEkepHandshaker::HandleClientId(const google::protobuf::Message &mes
                     "Assertion could not be verified");
     }
     AddPeerIdentity(identity);
+    verified_peer_assertions_.push_back(*desc_it);
     expected_peer_assertions_.erase(desc_it);
   }
 
@@ -365,6 +460,9 @@ Status ServerEkepHandshaker::WriteServerPrecommit(std::string *output) {
       selected_ekep_version_);
   server_precommit.set_selected_cipher_suite(selected_cipher_suite_);
   server_precommit.set_selected_record_protocol(selected_record_protocol_);
+  if (selected_record_frame_size_ != 0) {
+    server_precommit.set_record_frame_size(selected_record_frame_size_);
+  }
 
   if (!additional_authenticated_data_.empty()) {
     server_precommit.mutable_options()->set_data(
@@ -377,6 +475,10 @@ Status ServerEkepHandshaker::WriteServerPrecommit(std::string *output) {
   }
   server_precommit.set_challenge(challenge.data(), challenge.size());
 
+  if (resumed_) {
+    server_precommit.set_resumption_accepted(true);
+  }
+
   for (const AssertionRequest &request : promised_assertions_) {
     const AssertionDescription &description = request.description();
     // Note that assertion generators were verified during creation of the
@@ -460,22 +562,20 @@ Status ServerEkepHandshaker::WriteServerId(std::string *output) {
   ASYLO_RETURN_IF_ERROR(
       WriteFrameAndUpdateTranscript(SERVER_ID, server_id, output));
 
-  return WriteServerFinish(output);
-}
-
-Status ServerEkepHandshaker::WriteServerFinish(std::string *output) {
   // At this stage in the protocol, the transcript is:
   //   hash(ClientPrecommit || ServerPrecommit || ClientId || ServerId)
   //
   // This transcript is used by both the client and server to derive the EKEP
   // secrets.
-  std::string transcript_hash;
-  ASYLO_RETURN_IF_ERROR(GetTranscriptHash(&transcript_hash));
+  ASYLO_RETURN_IF_ERROR(GetTranscriptHash(&secrets_transcript_hash_));
+  ASYLO_RETURN_IF_ERROR(DeriveSecrets(
+      selected_cipher_suite_, secrets_transcript_hash_, client_public_key_,
+      dh_private_key_, &master_secret_, &authenticator_secret_));
 
-  ASYLO_RETURN_IF_ERROR(DeriveSecrets(selected_cipher_suite_, transcript_hash,
-                                      client_public_key_, dh_private_key_,
-                                      &master_secret_, &authenticator_secret_));
+  return WriteServerFinish(output);
+}
 
+Status ServerEkepHandshaker::WriteServerFinish(std::string *output) {
   CleansingVector<uint8_t> authenticator;
   ASYLO_RETURN_IF_ERROR(ComputeServerHandshakeAuthenticator(
       selected_cipher_suite_, authenticator_secret_, &authenticator));
@@ -484,9 +584,42 @@ Status ServerEkepHandshaker::WriteServerFinish(std::string *output) {
   server_finish.set_handshake_authenticator(authenticator.data(),
                                             authenticator.size());
 
+  if (ticket_crypter_) {
+    // Failing to issue a ticket does not affect the current handshake.
+    Status status =
+        IssueResumptionTicket(server_finish.mutable_resumption_ticket());
+    if (!status.ok()) {
+      LOG(ERROR) << "Failed to issue resumption ticket: " << status;
+      server_finish.clear_resumption_ticket();
+    }
+  }
+
   return WriteFrameAndUpdateTranscript(SERVER_FINISH, server_finish, output);
 }
 
+Status ServerEkepHandshaker::IssueResumptionTicket(std::string *ticket) {
+  CleansingVector<uint8_t> resumption_secret;
+  ASYLO_RETURN_IF_ERROR(
+      DeriveResumptionSecret(selected_cipher_suite_, secrets_transcript_hash_,
+                             master_secret_, &resumption_secret));
+
+  EkepResumptionState state;
+  state.mutable_ekep_version()->set_name(selected_ekep_version_);
+  state.set_cipher_suite(selected_cipher_suite_);
+  state.set_record_protocol(selected_record_protocol_);
+  state.set_resumption_secret(resumption_secret.data(),
+                              resumption_secret.size());
+  *state.mutable_peer_identities() = PeerIdentities();
+  for (const AssertionDescription &description : verified_peer_assertions_) {
+    *state.add_peer_assertions() = description;
+  }
+
+  Status status = ticket_crypter_->IssueTicket(state, ticket);
+  OPENSSL_cleanse(&(*state.mutable_resumption_secret())[0],
+                  state.resumption_secret().size());
+  return status;
+}
+
 bool ServerEkepHandshaker::SetSelectedEkepVersion(
     const google::protobuf::RepeatedPtrField<EkepVersion> &ekep_versions) {
   // Choose the first compatible EKEP version available.
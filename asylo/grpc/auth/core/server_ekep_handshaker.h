@@ -28,6 +28,7 @@
 #include <google/protobuf/message.h>
 #include "asylo/grpc/auth/core/ekep_handshaker.h"
 #include "asylo/grpc/auth/core/ekep_handshaker_util.h"
+#include "asylo/grpc/auth/core/ekep_session_resumption.h"
 #include "asylo/util/cleansing_types.h"
 
 namespace asylo {
@@ -36,6 +37,12 @@ namespace asylo {
 // handshake. It handles ClientPrecommit, ClientId, and ClientFinish messages
 // from the client and sends ServerPrecommit, ServerId, and ServerFinish
 // messages to the client.
+//
+// If the handshaker is configured with a ticket crypter, it issues a
+// resumption ticket in its ServerFinish. When a client presents a valid ticket
+// in its ClientPrecommit, the handshaker resumes the session by following its
+// ServerPrecommit with a ServerFinish, skipping the ClientId and ServerId
+// messages.
 class ServerEkepHandshaker final : public EkepHandshaker {
  public:
   // Creates a ServerEkepHandshaker configured with the given |options|, if
@@ -80,6 +87,17 @@ class ServerEkepHandshaker final : public EkepHandshaker {
   // updates the handshake transcript with the outgoing ServerPrecommit frame.
   Status HandleClientPrecommit(const google::protobuf::Message &message, std::string *output);
 
+  // Redeems the resumption |ticket| presented by the client. Returns true if
+  // the ticket is valid and its session can be resumed by this handshaker, in
+  // which case the resumption state bound to the ticket is written to |state|.
+  bool RedeemResumptionTicket(const std::string &ticket,
+                              EkepResumptionState *state);
+
+  // Resumes the session described by |state|. Writes the ServerPrecommit and
+  // ServerFinish messages to |output| and updates the handshake transcript with
+  // both outgoing frames.
+  Status ResumeSession(const EkepResumptionState &state, std::string *output);
+
   // Validates the ClientId handshake message contained in |message|. If
   // validation succeeds, writes the ServerId and ServerFinish messages to
   // |output| and updates the handshake transcript with both outgoing frames.
@@ -96,9 +114,14 @@ class ServerEkepHandshaker final : public EkepHandshaker {
   Status WriteServerId(std::string *output);
 
   // Writes the ServerFinish frame to |output| and updates the handshake
-  // transcript.
+  // transcript. The EKEP secrets must have been derived before calling this
+  // method.
   Status WriteServerFinish(std::string *output);
 
+  // Issues a resumption ticket for the current session and writes it to
+  // |ticket|.
+  Status IssueResumptionTicket(std::string *ticket);
+
   // Sets the handshaker's selected EKEP version to first compatible EKEP
   // version in |ekep_versions|. Returns false if there is no compatible EKEP
   // version in |ekep_versions|.
@@ -135,6 +158,21 @@ class ServerEkepHandshaker final : public EkepHandshaker {
   // Additional data that is authenticated during the handshake.
   const std::string additional_authenticated_data_;
 
+  // The largest protected record-protocol frame the server accepts, or zero to
+  // use the record protocol's default.
+  const size_t max_record_frame_size_;
+
+  // The crypter used to issue and redeem resumption tickets, or nullptr if
+  // session resumption is disabled.
+  const std::shared_ptr<EkepTicketCrypter> ticket_crypter_;
+
+  // Whether the handshake resumes a previous session.
+  bool resumed_;
+
+  // Descriptions of the peer assertions that establish the peer's identities,
+  // either verified in this handshake or restored from a resumed session.
+  std::vector<AssertionDescription> verified_peer_assertions_;
+
   // Assertions requested by the client that the server is willing to offer.
   // This field is populated after validation of the ClientPrecommit message.
   std::vector<AssertionRequest> promised_assertions_;
@@ -156,6 +194,11 @@ class ServerEkepHandshaker final : public EkepHandshaker {
   // validation of the ClientPrecommit message.
   std::string selected_ekep_version_;
 
+  // The selected size of protected record-protocol frames, or zero to use the
+  // record protocol's default. This field is populated after validation of the
+  // ClientPrecommit message.
+  size_t selected_record_frame_size_;
+
   // The server's ephemeral Diffie-Hellman key-pair.
   std::vector<uint8_t> dh_public_key_;
   CleansingVector<uint8_t> dh_private_key_;
@@ -168,6 +211,9 @@ class ServerEkepHandshaker final : public EkepHandshaker {
   CleansingVector<uint8_t> master_secret_;
   CleansingVector<uint8_t> authenticator_secret_;
 
+  // The transcript hash from which the EKEP secrets were derived.
+  std::string secrets_transcript_hash_;
+
   // A snapshot of the transcript to which the client's assertions are bound:
   //   hash(ClientPrecommit || ServerPrecommit)
   std::string client_assertion_transcript_;
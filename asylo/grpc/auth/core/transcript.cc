@@ -19,12 +19,13 @@
 #include "asylo/grpc/auth/core/transcript.h"
 
 #include <cstdint>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <google/protobuf/io/zero_copy_stream.h>
 #include "asylo/crypto/hash_interface.h"
-#include "asylo/crypto/util/byte_container_util.h"
 #include "asylo/util/status.h"
 
 namespace asylo {
@@ -37,14 +38,48 @@ void Transcript::Add(google::protobuf::io::ZeroCopyInputStream *input) {
   }
 }
 
+bool Transcript::SetCandidateHashers(
+    std::vector<std::unique_ptr<HashInterface>> hashers) {
+  if (hasher_ || bytes_added_ || !candidate_hashers_.empty()) {
+    return false;
+  }
+  candidate_hashers_ = std::move(hashers);
+  for (auto &candidate : candidate_hashers_) {
+    candidate->Init();
+  }
+  return true;
+}
+
 bool Transcript::SetHasher(HashInterface *hasher) {
+  std::unique_ptr<HashInterface> new_hasher(hasher);
   if (hasher_) {
+    // Do not take ownership of |hasher| if it cannot be used.
+    new_hasher.release();
     return false;
   }
-  hasher_.reset(hasher);
+
+  if (!candidate_hashers_.empty()) {
+    // The transcript was only hashed by the candidates, so one of them must be
+    // adopted.
+    for (auto &candidate : candidate_hashers_) {
+      if (candidate->GetHashAlgorithm() == new_hasher->GetHashAlgorithm()) {
+        hasher_ = std::move(candidate);
+        break;
+      }
+    }
+    if (!hasher_) {
+      new_hasher.release();
+      return false;
+    }
+    candidate_hashers_.clear();
+    return true;
+  }
+
+  hasher_ = std::move(new_hasher);
   hasher_->Init();
   hasher_->Update(bytes_to_hash_);
   bytes_to_hash_.clear();
+  bytes_to_hash_.shrink_to_fit();
   return true;
 }
 
@@ -52,20 +87,33 @@ bool Transcript::Hash(std::string *digest) {
   if (!hasher_) {
     return false;
   }
-  std::vector<uint8_t> tmp_digest;
-  Status status = hasher_->CumulativeHash(&tmp_digest);
-  if (!status.ok()) {
-    LOG(ERROR) << "Error while generating transcript hash: " << status;
-    return false;
+  if (!digest_valid_) {
+    Status status = hasher_->CumulativeHash(&digest_);
+    if (!status.ok()) {
+      LOG(ERROR) << "Error while generating transcript hash: " << status;
+      return false;
+    }
+    digest_valid_ = true;
   }
-  *digest = CopyToByteContainer<std::string>(tmp_digest);
+  digest->assign(digest_.cbegin(), digest_.cend());
   return true;
 }
 
 void Transcript::Add(const void *data, size_t len) {
+  if (len == 0) {
+    return;
+  }
+  bytes_added_ = true;
+  digest_valid_ = false;
+
   if (hasher_) {
     // Append to the hash function context.
     hasher_->Update({data, len});
+  } else if (!candidate_hashers_.empty()) {
+    // Append to the context of every candidate hash function.
+    for (auto &candidate : candidate_hashers_) {
+      candidate->Update({data, len});
+    }
   } else {
     // Append to the internal buffer.
     bytes_to_hash_.append(reinterpret_cast<const char *>(data), len);
@@ -19,9 +19,11 @@
 #ifndef ASYLO_GRPC_AUTH_CORE_TRANSCRIPT_H_
 #define ASYLO_GRPC_AUTH_CORE_TRANSCRIPT_H_
 
+#include <cstdint>
 #include <cstdlib>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <google/protobuf/io/zero_copy_stream.h>
 #include "asylo/crypto/hash_interface.h"
@@ -43,6 +45,16 @@ namespace asylo {
 // is necessary to first set the hash function for the transcript via the
 // SetHasher method.
 //
+// If the set of possible hash functions is known up front, the buffering of
+// early frames can be avoided by passing a candidate hasher for each of them to
+// SetCandidateHashers before any bytes are added. All candidates then hash the
+// transcript in place as bytes are added, and SetHasher adopts the candidate
+// that implements the selected hash algorithm.
+//
+// The digest returned by Hash is cached until more bytes are added, so that
+// repeated queries at the same point of the transcript only finalize the hash
+// once.
+//
 // This class is not thread-safe.
 class Transcript {
  public:
@@ -53,9 +65,18 @@ class Transcript {
   // Adds the entire contents of |input| to the transcript hash.
   void Add(google::protobuf::io::ZeroCopyInputStream *input);
 
+  // Adds |len| bytes from |data| to the transcript hash.
+  void Add(const void *data, size_t len);
+
+  // Sets |hashers| as the candidate hash functions for the transcript. Returns
+  // false if any bytes have already been added to the transcript, or if a hash
+  // function or candidates have already been set.
+  bool SetCandidateHashers(std::vector<std::unique_ptr<HashInterface>> hashers);
+
   // Sets |hasher| as the hash function to use for hashing the transcript.
-  // Returns false if a hash function has already been set. Takes ownership of
-  // |hasher|.
+  // Returns false if a hash function has already been set, or if candidate
+  // hash functions were set and none of them implements the same algorithm as
+  // |hasher|. Takes ownership of |hasher| if successful.
   bool SetHasher(HashInterface *hasher);
 
   // Sets |digest| to a string containing a hash of the current transcript.
@@ -64,15 +85,23 @@ class Transcript {
   bool Hash(std::string *digest);
 
  private:
-  // Adds |len| bytes from |data| to the transcript hash.
-  void Add(const void *data, size_t len);
-
   // An internal buffer of bytes to hash. Once |hasher_| is set, all bytes from
   // this buffer are added to the hashing object and the buffer is cleared.
   std::string bytes_to_hash_;
 
   // The hash function used to hash the transcript.
   std::unique_ptr<HashInterface> hasher_;
+
+  // Candidate hash functions that hash the transcript until |hasher_| is set.
+  std::vector<std::unique_ptr<HashInterface>> candidate_hashers_;
+
+  // Whether any bytes have been added to the transcript.
+  bool bytes_added_ = false;
+
+  // The digest of the transcript, if it has been computed since bytes were
+  // last added.
+  std::vector<uint8_t> digest_;
+  bool digest_valid_ = false;
 };
 
 }  // namespace asylo
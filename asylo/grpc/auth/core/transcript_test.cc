@@ -23,6 +23,7 @@
 #include <iterator>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
@@ -158,6 +159,73 @@ TYPED_TEST(TranscriptTest, AddBytesAndHash) {
   EXPECT_EQ(running_hash2, running_hash3);
 }
 
+// Verify that a transcript hashed in place by a candidate hash function has
+// the same hash as a buffered transcript.
+TYPED_TEST(TranscriptTest, CandidateHasherSameAsBufferedHash) {
+  Transcript buffered_transcript;
+  AddFromString(kData1, &buffered_transcript);
+  AddFromString(kData2, &buffered_transcript);
+  EXPECT_TRUE(buffered_transcript.SetHasher(new TypeParam()));
+
+  Transcript candidate_transcript;
+  std::vector<std::unique_ptr<HashInterface>> candidates;
+  candidates.push_back(absl::make_unique<TypeParam>());
+  EXPECT_TRUE(candidate_transcript.SetCandidateHashers(std::move(candidates)));
+  AddFromString(kData1, &candidate_transcript);
+  EXPECT_TRUE(candidate_transcript.SetHasher(new TypeParam()));
+  AddFromString(kData2, &candidate_transcript);
+
+  std::string buffered_hash;
+  std::string candidate_hash;
+  ASSERT_TRUE(buffered_transcript.Hash(&buffered_hash));
+  ASSERT_TRUE(candidate_transcript.Hash(&candidate_hash));
+  EXPECT_EQ(buffered_hash, candidate_hash);
+}
+
+// Verify that candidate hash functions cannot be set after bytes are added.
+TYPED_TEST(TranscriptTest, SetCandidateHashersFailsAfterAdd) {
+  Transcript transcript;
+  AddFromString(kData1, &transcript);
+
+  std::vector<std::unique_ptr<HashInterface>> candidates;
+  candidates.push_back(absl::make_unique<TypeParam>());
+  EXPECT_FALSE(transcript.SetCandidateHashers(std::move(candidates)));
+}
+
+// Verify that Hash returns the same digest until more bytes are added.
+TYPED_TEST(TranscriptTest, HashUpdatesAfterAdd) {
+  Transcript transcript;
+  EXPECT_TRUE(transcript.SetHasher(new TypeParam()));
+  AddFromString(kData1, &transcript);
+
+  std::string hash1;
+  std::string hash2;
+  ASSERT_TRUE(transcript.Hash(&hash1));
+  ASSERT_TRUE(transcript.Hash(&hash2));
+  EXPECT_EQ(hash1, hash2);
+
+  AddFromString(kData2, &transcript);
+  std::string hash3;
+  ASSERT_TRUE(transcript.Hash(&hash3));
+  EXPECT_NE(hash1, hash3);
+}
+
+// Verify that SetHasher fails if no candidate hash function implements the
+// same algorithm.
+TEST(TranscriptCandidateTest, SetHasherFailsWithoutMatchingCandidate) {
+  Transcript transcript;
+  std::vector<std::unique_ptr<HashInterface>> candidates;
+  candidates.push_back(absl::make_unique<FakeHash>());
+  EXPECT_TRUE(transcript.SetCandidateHashers(std::move(candidates)));
+  AddFromString(kData1, &transcript);
+
+  auto hasher = absl::make_unique<Sha256Hash>();
+  EXPECT_FALSE(transcript.SetHasher(hasher.get()));
+
+  std::string digest;
+  EXPECT_FALSE(transcript.Hash(&digest));
+}
+
 }  // namespace
 }  // namespace auth
 }  // namespace grpc
@@ -17,6 +17,8 @@
  */
 #include "asylo/grpc/auth/enclave_credentials_options.h"
 
+#include <algorithm>
+
 namespace asylo {
 
 EnclaveCredentialsOptions &EnclaveCredentialsOptions::Add(
@@ -25,6 +27,12 @@ EnclaveCredentialsOptions &EnclaveCredentialsOptions::Add(
                          additional.self_assertions.end());
   accepted_peer_assertions.insert(additional.accepted_peer_assertions.begin(),
                                   additional.accepted_peer_assertions.end());
+  enable_session_resumption =
+      enable_session_resumption || additional.enable_session_resumption;
+  max_record_frame_size =
+      std::max(max_record_frame_size, additional.max_record_frame_size);
+  enable_record_protocol_rekeying = enable_record_protocol_rekeying ||
+                                    additional.enable_record_protocol_rekeying;
   return *this;
 }
 
@@ -19,6 +19,7 @@
 #ifndef ASYLO_GRPC_AUTH_ENCLAVE_CREDENTIALS_OPTIONS_H_
 #define ASYLO_GRPC_AUTH_ENCLAVE_CREDENTIALS_OPTIONS_H_
 
+#include <cstddef>
 #include <string>
 
 #include "asylo/identity/assertion_description_util.h"
@@ -46,6 +47,24 @@ struct EnclaveCredentialsOptions {
 
   /// Peer assertions accepted by the credential holder.
   AssertionDescriptionHashSet accepted_peer_assertions;
+
+  /// Whether to enable resumption of previously-established sessions. When
+  /// enabled, a server issues resumption tickets and accepts the tickets that
+  /// it issued earlier, and a client presents a ticket from its last session
+  /// with the same target. A resumed session skips the exchange of assertions
+  /// and reuses the peer identities established by the original session.
+  bool enable_session_resumption = false;
+
+  /// The largest protected record-protocol frame, in bytes, to negotiate for
+  /// channels that use these credentials. Larger frames reduce framing
+  /// overhead for bulk transfers at the cost of latency and memory. Must be
+  /// zero, which selects the record protocol's default of 16 KB, or between
+  /// 1 KB and 1 MB. The peers use the smaller of their two sizes.
+  size_t max_record_frame_size = 0;
+
+  /// Whether to prefer a record protocol that periodically derives fresh
+  /// traffic keys, allowing more data to be protected in a single session.
+  bool enable_record_protocol_rekeying = false;
 };
 
 }  // namespace asylo
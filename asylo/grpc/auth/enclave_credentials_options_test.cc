@@ -100,5 +100,24 @@ TEST_F(EnclaveCredentialsOptionsTest, BidirectionalSgxLocalNull) {
                            EqualsProto(sgx_local_assertion_description_)));
 }
 
+/// Verifies that Add() enables session resumption and record protocol rekeying
+/// if either set of options enables them, and keeps the larger record frame
+/// size.
+TEST_F(EnclaveCredentialsOptionsTest, AddTransportOptions) {
+  EnclaveCredentialsOptions options = BidirectionalNullCredentialsOptions();
+  options.max_record_frame_size = 1 << 16;
+
+  EnclaveCredentialsOptions additional_options;
+  additional_options.enable_session_resumption = true;
+  additional_options.max_record_frame_size = 1 << 20;
+  additional_options.enable_record_protocol_rekeying = true;
+
+  options.Add(additional_options);
+  EXPECT_TRUE(options.enable_session_resumption);
+  EXPECT_EQ(options.max_record_frame_size,
+            additional_options.max_record_frame_size);
+  EXPECT_TRUE(options.enable_record_protocol_rekeying);
+}
+
 }  // namespace
 }  // namespace asylo
@@ -63,6 +63,10 @@ void CopyEnclaveCredentialsOptions(const EnclaveCredentialsOptions &src,
                        src.additional_authenticated_data.size(),
                        src.additional_authenticated_data.data());
   }
+  dest->enable_session_resumption = src.enable_session_resumption ? 1 : 0;
+  dest->max_record_frame_size = src.max_record_frame_size;
+  dest->enable_record_protocol_rekeying =
+      src.enable_record_protocol_rekeying ? 1 : 0;
 }
 
 }  // namespace asylo
@@ -94,6 +94,15 @@ bool CredentialsOptionsAreEqual(
                                      actual.accepted_peer_assertions)) {
     return false;
   }
+  if (expected.enable_session_resumption !=
+      static_cast<bool>(actual.enable_session_resumption)) {
+    return false;
+  }
+  if (expected.max_record_frame_size != actual.max_record_frame_size ||
+      expected.enable_record_protocol_rekeying !=
+          static_cast<bool>(actual.enable_record_protocol_rekeying)) {
+    return false;
+  }
   return AdditionalAuthenticatedDataIsEqual(
       expected.additional_authenticated_data,
       actual.additional_authenticated_data);
@@ -123,6 +132,31 @@ TEST_F(BridgeCppToCTest, CopyEnclaveCredentialsOptionsNonEmpty) {
   ASSERT_NO_FATAL_FAILURE(CredentialsOptionsAreEqual(options, bridge_options_));
 }
 
+// Verifies that CopyEnclaveCredentialsOptions carries over whether session
+// resumption is enabled.
+TEST_F(BridgeCppToCTest, CopyEnclaveCredentialsOptionsSessionResumption) {
+  EnclaveCredentialsOptions options = BidirectionalNullCredentialsOptions();
+  options.enable_session_resumption = true;
+  CopyEnclaveCredentialsOptions(options, &bridge_options_);
+
+  EXPECT_TRUE(bridge_options_.enable_session_resumption);
+  ASSERT_NO_FATAL_FAILURE(CredentialsOptionsAreEqual(options, bridge_options_));
+}
+
+// Verifies that CopyEnclaveCredentialsOptions carries over the record protocol
+// configuration.
+TEST_F(BridgeCppToCTest, CopyEnclaveCredentialsOptionsRecordProtocol) {
+  EnclaveCredentialsOptions options = BidirectionalNullCredentialsOptions();
+  options.max_record_frame_size = 1 << 20;
+  options.enable_record_protocol_rekeying = true;
+  CopyEnclaveCredentialsOptions(options, &bridge_options_);
+
+  EXPECT_EQ(bridge_options_.max_record_frame_size,
+            options.max_record_frame_size);
+  EXPECT_TRUE(bridge_options_.enable_record_protocol_rekeying);
+  ASSERT_NO_FATAL_FAILURE(CredentialsOptionsAreEqual(options, bridge_options_));
+}
+
 // Verifies that CopyEnclaveCredentialsOptions correctly translates an empty
 // EnclaveCredentialsOptions struct into a grpc_enclave_credentials_options.
 TEST_F(BridgeCppToCTest, CopyEnclaveCredentialsOptionsEmpty) {
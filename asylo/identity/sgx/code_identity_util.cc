@@ -41,41 +41,6 @@
 
 namespace asylo {
 namespace sgx {
-namespace {
-
-// Retrieves the report key associated with |keyid| for the current enclave and
-// writes it to |key|.
-Status GetReportKey(const UnsafeBytes<kKeyrequestKeyidSize> &keyid,
-                    HardwareKey *key) {
-  if (!AlignedHardwareKeyPtr::IsAligned(key)) {
-    return Status(error::GoogleError::INVALID_ARGUMENT,
-                  "Output parameter |key| is not properly aligned");
-  }
-
-  // Set KEYREQUEST to request the REPORT_KEY with the KEYID value specified in
-  // the report to be verified.
-  AlignedKeyrequestPtr request;
-
-  request->keyname = KeyrequestKeyname::REPORT_KEY;
-  request->keyid = keyid;
-
-  // SGX hardware requires that the reserved fields of KEYREQUEST be set to
-  // zero.
-  request->reserved1.fill(0);
-  request->reserved2.fill(0);
-
-  // The following fields of KEYREQUEST are ignored by the SGX hardware. These
-  // are just initialized to some sane values.
-  request->keypolicy = kKeypolicyMrenclaveBitMask;
-  request->isvsvn = 0;
-  request->cpusvn.fill(0);
-  ClearSecsAttributeSet(&request->attributemask);
-  request->miscmask = 0;
-
-  return GetHardwareKey(*request, key);
-}
-
-}  // namespace
 
 namespace internal {
 
@@ -374,11 +339,45 @@ void SetTargetinfoFromSelfIdentity(Targetinfo *tinfo) {
   tinfo->reserved2.fill(0);
 }
 
+Status GetReportKey(const UnsafeBytes<kKeyrequestKeyidSize> &keyid,
+                    HardwareKey *key) {
+  if (!AlignedHardwareKeyPtr::IsAligned(key)) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "Output parameter |key| is not properly aligned");
+  }
+
+  // Set KEYREQUEST to request the REPORT_KEY with the KEYID value specified in
+  // the report to be verified.
+  AlignedKeyrequestPtr request;
+
+  request->keyname = KeyrequestKeyname::REPORT_KEY;
+  request->keyid = keyid;
+
+  // SGX hardware requires that the reserved fields of KEYREQUEST be set to
+  // zero.
+  request->reserved1.fill(0);
+  request->reserved2.fill(0);
+
+  // The following fields of KEYREQUEST are ignored by the SGX hardware. These
+  // are just initialized to some sane values.
+  request->keypolicy = kKeypolicyMrenclaveBitMask;
+  request->isvsvn = 0;
+  request->cpusvn.fill(0);
+  ClearSecsAttributeSet(&request->attributemask);
+  request->miscmask = 0;
+
+  return GetHardwareKey(*request, key);
+}
+
 Status VerifyHardwareReport(const Report &report) {
   AlignedHardwareKeyPtr report_key;
 
   ASYLO_RETURN_IF_ERROR(GetReportKey(report.keyid, report_key.get()));
+  return VerifyHardwareReportWithKey(report, *report_key);
+}
 
+Status VerifyHardwareReportWithKey(const Report &report,
+                                   const HardwareKey &report_key) {
   // Compute the report MAC. SGX uses CMAC to MAC the contents of the report.
   // The last two fields (KEYID and MAC) from the REPORT struct are not
   // included in the MAC computation.
@@ -386,8 +385,8 @@ Status VerifyHardwareReport(const Report &report) {
   static_assert(kReportMacSize == AES_BLOCK_SIZE,
                 "Size of the mac field in the REPORT structure is incorrect.");
   SafeBytes<kReportMacSize> actual_mac;
-  if (AES_CMAC(/*out=*/actual_mac.data(), /*key=*/report_key->data(),
-               /*key_len=*/report_key->size(),
+  if (AES_CMAC(/*out=*/actual_mac.data(), /*key=*/report_key.data(),
+               /*key_len=*/report_key.size(),
                /*in=*/reinterpret_cast<const uint8_t *>(&report),
                /*in_len=*/offsetof(Report, keyid)) != 1) {
     return Status(
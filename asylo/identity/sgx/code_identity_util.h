@@ -22,6 +22,7 @@
 #include "asylo/identity/identity.pb.h"
 #include "asylo/identity/sgx/code_identity.pb.h"
 #include "asylo/identity/sgx/code_identity_constants.h"
+#include "asylo/identity/sgx/hardware_interface.h"
 #include "asylo/identity/sgx/identity_key_management_structs.h"
 #include "asylo/util/status.h"
 #include "asylo/util/statusor.h"
@@ -116,9 +117,22 @@ Status SerializeSgxExpectation(const CodeIdentityExpectation &sgx_expectation,
 // this TARGETINFO are targeted at this enclave.
 void SetTargetinfoFromSelfIdentity(Targetinfo *tinfo);
 
+// Retrieves the report key associated with |keyid| for the current enclave and
+// writes it to |key|. |key| must be aligned as required by
+// AlignedHardwareKeyPtr.
+Status GetReportKey(const UnsafeBytes<kKeyrequestKeyidSize> &keyid,
+                    HardwareKey *key);
+
 // Verifies the hardware report |report|.
 Status VerifyHardwareReport(const Report &report);
 
+// Verifies the hardware report |report| using |report_key|, which must be the
+// report key associated with |report|.keyid as returned by GetReportKey(). This
+// allows callers that verify many reports to amortize the cost of fetching the
+// report key.
+Status VerifyHardwareReportWithKey(const Report &report,
+                                   const HardwareKey &report_key);
+
 namespace internal {
 
 // Verifies whether |identity| is compatible with |spec|. This function is
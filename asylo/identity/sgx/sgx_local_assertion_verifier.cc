@@ -19,6 +19,7 @@
 #include "asylo/identity/sgx/sgx_local_assertion_verifier.h"
 
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -29,6 +30,7 @@
 #include "asylo/identity/descriptions.h"
 #include "asylo/identity/sgx/code_identity_constants.h"
 #include "asylo/identity/sgx/code_identity_util.h"
+#include "asylo/identity/sgx/hardware_interface.h"
 #include "asylo/identity/sgx/identity_key_management_structs.h"
 #include "asylo/identity/sgx/local_assertion.pb.h"
 #include "asylo/identity/sgx/sgx_local_assertion_authority_config.pb.h"
@@ -36,10 +38,15 @@
 
 namespace asylo {
 
+constexpr size_t SgxLocalAssertionVerifier::kVerifiedReportCacheSize;
+
 const char *const SgxLocalAssertionVerifier::authority_type_ =
     sgx::kSgxLocalAssertionAuthority;
 
-SgxLocalAssertionVerifier::SgxLocalAssertionVerifier() : initialized_(false) {}
+SgxLocalAssertionVerifier::SgxLocalAssertionVerifier()
+    : initialized_(false),
+      report_key_cached_(false),
+      next_verified_report_(0) {}
 
 Status SgxLocalAssertionVerifier::Initialize(const std::string &config) {
   if (IsInitialized()) {
@@ -139,6 +146,60 @@ Status SgxLocalAssertionVerifier::Verify(const std::string &user_data,
     return Status(error::GoogleError::FAILED_PRECONDITION, "Not initialized");
   }
 
+  sgx::Report report;
+  ASYLO_RETURN_IF_ERROR(ParseReport(assertion, &report));
+
+  // First, verify the hardware REPORT embedded in the assertion. This will only
+  // succeed if the REPORT is targeted at this enclave.
+  std::vector<sgx::Report> reports = {report};
+  std::vector<Status> results(1);
+  VerifyReports(reports, &results);
+  ASYLO_RETURN_IF_ERROR(results[0]);
+
+  return ExtractPeerIdentity(user_data, report, peer_identity);
+}
+
+Status SgxLocalAssertionVerifier::VerifyBatch(
+    const std::vector<std::string> &user_data,
+    const std::vector<Assertion> &assertions,
+    std::vector<EnclaveIdentity> *peer_identities,
+    std::vector<Status> *results) const {
+  if (!IsInitialized()) {
+    return Status(error::GoogleError::FAILED_PRECONDITION, "Not initialized");
+  }
+
+  if (user_data.size() != assertions.size()) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "Number of user-data entries does not match number of "
+                  "assertions");
+  }
+
+  peer_identities->clear();
+  peer_identities->resize(assertions.size());
+  results->clear();
+  results->resize(assertions.size());
+
+  std::vector<sgx::Report> reports(assertions.size());
+  for (size_t i = 0; i < assertions.size(); ++i) {
+    (*results)[i] = ParseReport(assertions[i], &reports[i]);
+  }
+
+  // Verify all REPORTs against a single snapshot of the caches, so that the
+  // REPORT key is fetched at most once for the whole batch.
+  VerifyReports(reports, results);
+
+  for (size_t i = 0; i < reports.size(); ++i) {
+    if ((*results)[i].ok()) {
+      (*results)[i] =
+          ExtractPeerIdentity(user_data[i], reports[i], &(*peer_identities)[i]);
+    }
+  }
+
+  return Status::OkStatus();
+}
+
+Status SgxLocalAssertionVerifier::ParseReport(const Assertion &assertion,
+                                              sgx::Report *report) const {
   if (!IsCompatibleAssertionDescription(assertion.description())) {
     return Status(error::GoogleError::INVALID_ARGUMENT,
                   "Assertion has incompatible assertion description");
@@ -150,24 +211,109 @@ Status SgxLocalAssertionVerifier::Verify(const std::string &user_data,
                   "Failed to parse LocalAssertion");
   }
 
-  sgx::Report report;
-  if (local_assertion.report().size() != sizeof(report)) {
+  if (local_assertion.report().size() != sizeof(*report)) {
     return Status(error::GoogleError::INVALID_ARGUMENT,
                   "REPORT from Assertion has incorrect size");
   }
 
-  // First, verify the hardware REPORT embedded in the assertion. This will only
-  // succeed if the REPORT is targeted at this enclave. Note that since the
-  // layout and endianness of the REPORT structure is defined by the Intel SGX
-  // architecture, two SGX enclaves can exchange a REPORT by simply dumping the
-  // raw bytes of a REPORT structure into a proto. This code assumes that the
-  // assertion originates from a machine that supports the Intel SGX
-  // architecture and was copied into the assertion byte-for-byte, so is safe to
-  // restore the REPORT structure directly from the deserialized LocalAssertion.
-  report = TrivialObjectFromBinaryString<sgx::Report>(local_assertion.report());
-  ASYLO_RETURN_IF_ERROR(sgx::VerifyHardwareReport(report));
-
-  // Next, verify that the REPORT is cryptographically-bound to the provided
+  // Note that since the layout and endianness of the REPORT structure is
+  // defined by the Intel SGX architecture, two SGX enclaves can exchange a
+  // REPORT by simply dumping the raw bytes of a REPORT structure into a proto.
+  // This code assumes that the assertion originates from a machine that
+  // supports the Intel SGX architecture and was copied into the assertion
+  // byte-for-byte, so is safe to restore the REPORT structure directly from the
+  // deserialized LocalAssertion.
+  *report =
+      TrivialObjectFromBinaryString<sgx::Report>(local_assertion.report());
+  return Status::OkStatus();
+}
+
+void SgxLocalAssertionVerifier::VerifyReports(
+    const std::vector<sgx::Report> &reports,
+    std::vector<Status> *results) const {
+  std::vector<bool> already_verified(reports.size(), false);
+  bool have_key = false;
+  UnsafeBytes<sgx::kReportKeyidSize> keyid;
+  sgx::AlignedHardwareKeyPtr key;
+  {
+    absl::ReaderMutexLock lock(&report_cache_mu_);
+    for (size_t i = 0; i < reports.size(); ++i) {
+      already_verified[i] =
+          (*results)[i].ok() && IsReportVerifiedLocked(reports[i]);
+    }
+    if (report_key_cached_) {
+      keyid = report_keyid_;
+      *key = *report_key_;
+      have_key = true;
+    }
+  }
+
+  // The REPORT key only changes with the KEYID, which is fixed by the platform
+  // until the next power cycle, so it is fetched from the hardware only when
+  // a REPORT with a new KEYID is seen.
+  bool fetched_key = false;
+  std::vector<const sgx::Report *> newly_verified;
+  for (size_t i = 0; i < reports.size(); ++i) {
+    if (!(*results)[i].ok() || already_verified[i]) {
+      continue;
+    }
+    if (!have_key || keyid != reports[i].keyid) {
+      have_key = false;
+      (*results)[i] = sgx::GetReportKey(reports[i].keyid, key.get());
+      if (!(*results)[i].ok()) {
+        continue;
+      }
+      keyid = reports[i].keyid;
+      have_key = true;
+      fetched_key = true;
+    }
+    (*results)[i] = sgx::VerifyHardwareReportWithKey(reports[i], *key);
+    if ((*results)[i].ok()) {
+      newly_verified.push_back(&reports[i]);
+    }
+  }
+
+  if (!(fetched_key && have_key) && newly_verified.empty()) {
+    return;
+  }
+
+  absl::MutexLock lock(&report_cache_mu_);
+  if (fetched_key && have_key) {
+    report_keyid_ = keyid;
+    *report_key_ = *key;
+    report_key_cached_ = true;
+  }
+  for (const sgx::Report *report : newly_verified) {
+    // Another thread may have verified the same REPORT concurrently.
+    if (IsReportVerifiedLocked(*report)) {
+      continue;
+    }
+    if (verified_reports_.size() < kVerifiedReportCacheSize) {
+      verified_reports_.push_back(*report);
+    } else {
+      verified_reports_[next_verified_report_] = *report;
+      next_verified_report_ =
+          (next_verified_report_ + 1) % kVerifiedReportCacheSize;
+    }
+  }
+}
+
+bool SgxLocalAssertionVerifier::IsReportVerifiedLocked(
+    const sgx::Report &report) const {
+  // A REPORT that is byte-for-byte identical to one that was already verified
+  // carries a valid MAC, so there is no need to recompute it.
+  for (const sgx::Report &verified_report : verified_reports_) {
+    if (memcmp(&verified_report, &report, sizeof(report)) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Status SgxLocalAssertionVerifier::ExtractPeerIdentity(
+    const std::string &user_data, const sgx::Report &report,
+    EnclaveIdentity *peer_identity) const {
+  // Verify that the REPORT is cryptographically-bound to the provided
   // |user_data|. This is done by re-constructing the expected REPORTDATA (a
   // SHA256 hash of |user_data| padded with zeros), and comparing it to the
   // actual REPORTDATA inside the REPORT.
@@ -19,6 +19,7 @@
 #include "asylo/identity/sgx/sgx_local_assertion_verifier.h"
 
 #include <cstdint>
+#include <string>
 #include <vector>
 
 #include <google/protobuf/util/message_differencer.h>
@@ -98,6 +99,32 @@ class SgxLocalAssertionVerifierTest : public ::testing::Test {
         offer->mutable_additional_information());
   }
 
+  // Creates an assertion targeted at this enclave that is bound to
+  // |user_data|, and places the result in |assertion|.
+  void MakeAssertion(absl::string_view user_data, Assertion *assertion) {
+    SetAssertionDescription(assertion->mutable_description());
+
+    Sha256Hash hash;
+    hash.Update(user_data);
+    sgx::AlignedReportdataPtr reportdata;
+    *reportdata = TrivialZeroObject<sgx::Reportdata>();
+    std::vector<uint8_t> digest;
+    ASYLO_ASSERT_OK(hash.CumulativeHash(&digest));
+    reportdata->data.replace(/*pos=*/0, digest);
+
+    sgx::AlignedTargetinfoPtr targetinfo;
+    sgx::SetTargetinfoFromSelfIdentity(targetinfo.get());
+
+    sgx::AlignedReportPtr report;
+    ASYLO_ASSERT_OK(
+        sgx::GetHardwareReport(*targetinfo, *reportdata, report.get()));
+    sgx::LocalAssertion local_assertion;
+    local_assertion.set_report(reinterpret_cast<const char *>(report.get()),
+                               sizeof(*report));
+    ASSERT_TRUE(
+        local_assertion.SerializeToString(assertion->mutable_assertion()));
+  }
+
   // The config used to initialize a SgxLocalAssertionVerifier.
   std::string config_;
 };
@@ -391,5 +418,89 @@ TEST_F(SgxLocalAssertionVerifierTest, VerifySuccess) {
       << expected_identity.DebugString();
 }
 
+// Verify that Verify() succeeds when the same Assertion is verified repeatedly,
+// and that a tampered copy of a previously verified Assertion is still
+// rejected.
+TEST_F(SgxLocalAssertionVerifierTest, VerifyRepeatedAssertion) {
+  SgxLocalAssertionVerifier verifier;
+  ASYLO_ASSERT_OK(verifier.Initialize(config_));
+
+  Assertion assertion;
+  ASSERT_NO_FATAL_FAILURE(MakeAssertion(kUserData, &assertion));
+
+  for (int i = 0; i < 3; ++i) {
+    EnclaveIdentity identity;
+    ASYLO_EXPECT_OK(verifier.Verify(kUserData, assertion, &identity));
+  }
+
+  sgx::LocalAssertion local_assertion;
+  ASSERT_TRUE(local_assertion.ParseFromString(assertion.assertion()));
+  sgx::Report report =
+      TrivialObjectFromBinaryString<sgx::Report>(local_assertion.report());
+  report.isvsvn ^= 1;
+  local_assertion.set_report(reinterpret_cast<const char *>(&report),
+                             sizeof(report));
+  ASSERT_TRUE(local_assertion.SerializeToString(assertion.mutable_assertion()));
+
+  EnclaveIdentity identity;
+  EXPECT_THAT(verifier.Verify(kUserData, assertion, &identity), Not(IsOk()));
+}
+
+// Verify that VerifyBatch() fails if the verifier is not yet initialized.
+TEST_F(SgxLocalAssertionVerifierTest, VerifyBatchFailsIfNotInitialized) {
+  SgxLocalAssertionVerifier verifier;
+
+  std::vector<EnclaveIdentity> identities;
+  std::vector<Status> results;
+  EXPECT_THAT(verifier.VerifyBatch({}, {}, &identities, &results),
+              Not(IsOk()));
+}
+
+// Verify that VerifyBatch() fails if the number of user-data entries does not
+// match the number of assertions.
+TEST_F(SgxLocalAssertionVerifierTest, VerifyBatchFailsIfSizesMismatch) {
+  SgxLocalAssertionVerifier verifier;
+  ASYLO_ASSERT_OK(verifier.Initialize(config_));
+
+  std::vector<Assertion> assertions(1);
+  ASSERT_NO_FATAL_FAILURE(MakeAssertion(kUserData, &assertions[0]));
+
+  std::vector<EnclaveIdentity> identities;
+  std::vector<Status> results;
+  EXPECT_THAT(verifier.VerifyBatch({kUserData, kUserData}, assertions,
+                                   &identities, &results),
+              Not(IsOk()));
+}
+
+// Verify that VerifyBatch() reports a separate result for each assertion, and
+// extracts the enclave's CodeIdentity from each valid assertion.
+TEST_F(SgxLocalAssertionVerifierTest, VerifyBatchReportsPerAssertionResults) {
+  SgxLocalAssertionVerifier verifier;
+  ASYLO_ASSERT_OK(verifier.Initialize(config_));
+
+  std::vector<Assertion> assertions(3);
+  ASSERT_NO_FATAL_FAILURE(MakeAssertion(kUserData, &assertions[0]));
+  ASSERT_NO_FATAL_FAILURE(MakeAssertion(kUserData, &assertions[1]));
+  SetAssertionDescription(assertions[2].mutable_description());
+  assertions[2].set_assertion(kBadLocalAssertion);
+
+  std::vector<std::string> user_data = {kUserData, "Other user data",
+                                        kUserData};
+  std::vector<EnclaveIdentity> identities;
+  std::vector<Status> results;
+  ASYLO_ASSERT_OK(
+      verifier.VerifyBatch(user_data, assertions, &identities, &results));
+  ASSERT_EQ(results.size(), assertions.size());
+  ASSERT_EQ(identities.size(), assertions.size());
+
+  ASYLO_EXPECT_OK(results[0]);
+  EXPECT_THAT(results[1], Not(IsOk()));
+  EXPECT_THAT(results[2], Not(IsOk()));
+
+  sgx::CodeIdentity code_identity;
+  ASSERT_TRUE(code_identity.ParseFromString(identities[0].identity()));
+  EXPECT_THAT(code_identity, EqualsProto(sgx::GetSelfIdentity()->identity));
+}
+
 }  // namespace
 }  // namespace asylo
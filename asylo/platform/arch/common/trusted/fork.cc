@@ -45,4 +45,8 @@ Status TransferSecureSnapshotKey(
   abort();
 }
 
+void RunSnapshotWorker() {
+  // No snapshot is ever taken or restored outside the SGX hardware backend.
+}
+
 }  // namespace asylo
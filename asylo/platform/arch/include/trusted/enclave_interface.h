@@ -74,6 +74,11 @@ struct EnclaveMemoryLayout {
 
 void enc_get_memory_layout(struct EnclaveMemoryLayout *enclave_memory_layout);
 
+// Returns the address the enclave image is loaded at. Subtracting it from the
+// address of enclave code gives the corresponding address in the enclave's ELF
+// file.
+void *enc_get_base_address();
+
 // A macro expanding to an expression appropriate for use as the body of a busy
 // loop.
 #ifdef __x86_64__
@@ -87,6 +87,15 @@ int __asylo_restore(const char *snapshot_layout, size_t snapshot_layout_len,
 int __asylo_transfer_secure_snapshot_key(const char *input, size_t input_len,
                                          char **output, size_t *output_len);
 
+// Enclave snapshot worker routine, run on a host thread donated to seal or
+// restore a snapshot.
+int __asylo_run_snapshot_worker();
+
+// Enclave call metrics routine.
+//
+// The output type is asylo::EnclaveOutput.
+int __asylo_get_call_metrics(char **output, size_t *output_len);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
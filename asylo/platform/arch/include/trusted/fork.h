@@ -42,6 +42,10 @@ Status RestoreForFork(const SnapshotLayout &snapshot_layout);
 Status TransferSecureSnapshotKey(
     const ForkHandshakeConfig &fork_handshake_config);
 
+// Seals or restores chunks of the snapshot being taken or restored by another
+// thread, if any, on a host thread donated to the enclave.
+void RunSnapshotWorker();
+
 }  // namespace asylo
 
 #endif  // ASYLO_PLATFORM_ARCH_INCLUDE_TRUSTED_FORK_H_
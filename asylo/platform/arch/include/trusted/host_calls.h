@@ -99,9 +99,17 @@ int enc_untrusted_lstat(const char *pathname, struct stat *stat_buffer);
 int enc_untrusted_symlink(const char *from, const char *to);
 int enc_untrusted_fstat(int fd, struct stat *stat_buffer);
 int enc_untrusted_isatty(int file);
+// Writes and reads through |buf|, |size| bytes of untrusted memory owned by the
+// caller. enc_untrusted_readv scatters the bytes read to |iov|.
 ssize_t enc_untrusted_writev(int fd, char *buf, int size);
 ssize_t enc_untrusted_readv(int fd, const struct iovec *iov, int iovcnt,
                             char *buf, int size);
+// Sends and receives through |buf|, |len| bytes of untrusted memory owned by
+// the caller.
+ssize_t enc_untrusted_send_with_untrusted_ptr(int sockfd, const void *buf,
+                                              size_t len, int flags);
+ssize_t enc_untrusted_recv_with_untrusted_ptr(int sockfd, void *buf,
+                                              size_t len, int flags);
 
 //////////////////////////////////////
 //            Sockets               //
@@ -125,6 +133,13 @@ ssize_t enc_untrusted_sendmsg(
     int sockfd, const struct bridge_msghdr *bridge_msg, int flags);
 ssize_t enc_untrusted_recvmsg(int sockfd, struct msghdr *msg,
                               struct bridge_msghdr *bridge_msg, int flags);
+// Sends or receives the |vlen| messages of |msgvec| with a single host call.
+// The buffers of each message must already be in untrusted memory.
+int enc_untrusted_sendmmsg(int sockfd, struct bridge_mmsghdr *msgvec,
+                           unsigned int vlen, int flags);
+int enc_untrusted_recvmmsg(int sockfd, struct bridge_mmsghdr *msgvec,
+                           unsigned int vlen, int flags,
+                           struct timespec *timeout);
 int enc_untrusted_getaddrinfo(const char *node, const char *service,
                               const struct addrinfo *hints,
                               struct addrinfo **res);
@@ -169,6 +184,19 @@ int enc_untrusted_epoll_ctl(int epfd, int op, int fd,
                             struct epoll_event *event);
 int enc_untrusted_epoll_wait(int epfd, struct epoll_event *events,
                              int maxevents, int timeout);
+// Starts a host thread harvesting the events of |epfd| into |ring|, an
+// asylo::EpollRing in untrusted memory. Returns a handle to the thread, or
+// nullptr on failure.
+void *enc_untrusted_epoll_agent_start(int epfd, void *ring);
+// Blocks until the ring of |agent| holds events, or |timeout| milliseconds
+// elapse. A zero |timeout| harvests the events ready without blocking.
+void enc_untrusted_epoll_agent_wait(void *agent, int timeout);
+// Stops |agent| and wakes the threads waiting in it. Later waits return
+// immediately.
+void enc_untrusted_epoll_agent_stop(void *agent);
+// Waits for the thread of the stopped |agent| to exit, and frees it. No thread
+// may wait in |agent| any longer.
+void enc_untrusted_epoll_agent_destroy(void *agent);
 
 //////////////////////////////////////
 //            inotify.h             //
@@ -282,6 +310,12 @@ int enc_untrusted_truncate(const char *path, off_t length);
 int enc_untrusted_ftruncate(int fd, off_t length);
 void enc_untrusted__exit(int rc);
 pid_t enc_untrusted_fork(const char *enclave_name, bool restore_snapshot);
+// Starts up to |count| host threads entering the enclave to run
+// RunSnapshotWorker() while a snapshot is taken or restored.
+void enc_untrusted_start_snapshot_workers(int count);
+// Waits for the threads started by enc_untrusted_start_snapshot_workers() to
+// leave the enclave.
+void enc_untrusted_join_snapshot_workers();
 
 //////////////////////////////////////
 //            utime.h               //
@@ -313,6 +347,11 @@ void *enc_untrusted_acquire_shared_resource(enum SharedNameKind kind,
 int enc_untrusted_release_shared_resource(enum SharedNameKind kind,
                                           const char *name);
 
+// Sets a function to be called by each thread returning into the enclave from
+// a host call, or clears it if |hook| is nullptr. Used to deliver signals
+// queued by the host to threads already running inside the enclave.
+void enc_set_host_call_return_hook(void (*hook)(void));
+
 //////////////////////////////////////
 //            Debugging             //
 //////////////////////////////////////
@@ -83,6 +83,10 @@ int ecall_run(const char *input, bridge_size_t input_len, char **output,
 
 int ecall_donate_thread() { return asylo::__asylo_threading_donate(); }
 
+int ecall_run_snapshot_worker() {
+  return asylo::__asylo_run_snapshot_worker();
+}
+
 // Invokes the enclave signal handling entry-point. Returns a non-zero error
 // code on failure.
 int ecall_handle_signal(const char *input, bridge_size_t input_len) {
@@ -175,3 +179,20 @@ int ecall_transfer_secure_snapshot_key(const char *input,
   }
   return result;
 }
+
+// Invokes the enclave call metrics entry-point. Returns a non-zero error code
+// on failure.
+int ecall_get_call_metrics(char **output, bridge_size_t *output_len) {
+  int result = 0;
+  size_t tmp_output_len;
+  try {
+    result = asylo::__asylo_get_call_metrics(output, &tmp_output_len);
+  } catch (...) {
+    LOG(FATAL) << "Uncaught exception in enclave";
+  }
+
+  if (output_len) {
+    *output_len = static_cast<bridge_size_t>(tmp_output_len);
+  }
+  return result;
+}
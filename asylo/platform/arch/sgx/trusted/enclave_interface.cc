@@ -18,6 +18,7 @@
 
 #include "asylo/platform/arch/include/trusted/enclave_interface.h"
 
+#include "include/global_data.h"
 #include "include/sgx_thread.h"
 #include "include/sgx_trts.h"
 
@@ -60,4 +61,6 @@ void enc_get_memory_layout(struct EnclaveMemoryLayout *enclave_memory_layout) {
   enclave_memory_layout->reserved_size = memory_layout.reserved_size;
 }
 
+void *enc_get_base_address() { return &__ImageBase; }
+
 }  //  extern "C"
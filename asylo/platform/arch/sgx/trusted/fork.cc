@@ -1,41 +1,156 @@
-/*
- *
- * Copyright 2018 Asylo authors
- *
- * Licensed under the Apache License, Version 2.0 (the "License");
- * you may not use this file except in compliance with the License.
- * You may obtain a copy of the License at
- *
- *     http://www.apache.org/licenses/LICENSE-2.0
- *
- * Unless required by applicable law or agreed to in writing, software
- * distributed under the License is distributed on an "AS IS" BASIS,
- * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
- * See the License for the specific language governing permissions and
- * limitations under the License.
- *
- */
-
 #include "asylo/platform/arch/include/trusted/fork.h"
 
+#include <openssl/aead.h>
+#include <openssl/mem.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 
+#include "absl/strings/str_cat.h"
 #include "asylo/util/logging.h"
 #include "asylo/grpc/auth/core/client_ekep_handshaker.h"
 #include "asylo/grpc/auth/core/server_ekep_handshaker.h"
 #include "asylo/identity/descriptions.h"
+#include "asylo/identity/enclave_assertion_authority_config.pb.h"
 #include "asylo/identity/identity_acl_evaluator.h"
+#include "asylo/identity/init.h"
 #include "asylo/identity/sgx/code_identity_util.h"
-#include "asylo/identity/sgx/self_identity.h"
 #include "asylo/identity/sgx/sgx_code_identity_expectation_matcher.h"
+#include "asylo/identity/sgx/sgx_local_assertion_authority_config.pb.h"
 #include "asylo/platform/arch/include/trusted/enclave_interface.h"
 #include "asylo/platform/arch/include/trusted/host_calls.h"
+#include "asylo/platform/arch/sgx/trusted/snapshot_seal.h"
+#include "asylo/platform/core/trusted_global_state.h"
+#include "asylo/util/cleansing_types.h"
 #include "asylo/util/posix_error_space.h"
 #include "asylo/util/status.h"
+#include "asylo/util/status_macros.h"
+
+// Peak number of bytes of the heap handed out by sbrk, maintained in sbrk.cc.
+extern "C" size_t g_peak_heap_used;
 
 namespace asylo {
 namespace {
 
+// Size of the pages the heap is committed in.
+constexpr size_t kHeapPageSize = 4096;
+
+// Maximum number of host threads donated to the enclave to seal or restore the
+// heap alongside the thread taking or restoring the snapshot.
+constexpr int kMaxSnapshotWorkers = 7;
+
+// Additional data authenticated with the snapshot key when it is transferred
+// from the parent to the child enclave.
+constexpr char kSnapshotKeyTransferContext[] = "Asylo fork snapshot key";
+
+// Size of the message carrying the snapshot key from the parent to the child
+// enclave: a nonce, the encrypted key and a tag.
+constexpr size_t kSnapshotKeyMessageSize =
+    kSnapshotNonceSize + kSnapshotKeySize + kSnapshotTagSize;
+
+const char *const kSnapshotSectionNames[kNumSnapshotSections] = {
+    "data", "bss", "heap", "thread data", "stack"};
+
+// A section sealed or restored chunk by chunk. A SnapshotJob lives on the stack
+// of the thread taking or restoring the snapshot, which shares its chunks with
+// host threads donated to the enclave through RunSnapshotWorker().
+struct SnapshotJob {
+  SnapshotJob(const SnapshotCipher *cipher, bool seal, SnapshotSection section,
+              const void *source, size_t size, void *destination,
+              uint8_t *tags)
+      : cipher(cipher),
+        seal(seal),
+        section(section),
+        source(static_cast<const uint8_t *>(source)),
+        size(size),
+        destination(static_cast<uint8_t *>(destination)),
+        tags(tags),
+        next_chunk(0),
+        failed(false) {}
+
+  const SnapshotCipher *const cipher;
+
+  // True if the section is sealed, false if it is restored.
+  const bool seal;
+
+  const SnapshotSection section;
+  const uint8_t *const source;
+  const size_t size;
+  uint8_t *const destination;
+
+  // Tags of the chunks of the section in the manifest.
+  uint8_t *const tags;
+
+  // Index of the next chunk to seal or restore.
+  std::atomic<size_t> next_chunk;
+
+  // Set if a chunk could not be sealed or authenticated.
+  std::atomic<bool> failed;
+};
+
+// The job donated threads work on, or nullptr if there is none. A job is only
+// published for the heap, after the data and bss sections are sealed or
+// restored, so neither this variable nor |snapshot_workers| is captured or
+// overwritten while threads use them.
+std::atomic<SnapshotJob *> active_snapshot_job(nullptr);
+
+// Number of donated threads in RunSnapshotWorker().
+std::atomic<int> snapshot_workers(0);
+
+// Seals or restores chunks of |job| until none is left.
+void WorkOnSnapshotJob(SnapshotJob *job) {
+  size_t num_chunks = NumSnapshotChunks(job->size);
+  for (size_t chunk = job->next_chunk.fetch_add(1);
+       chunk < num_chunks && !job->failed;
+       chunk = job->next_chunk.fetch_add(1)) {
+    bool ok = job->seal
+                  ? job->cipher->SealChunk(job->section, chunk, job->source,
+                                           job->size, job->destination,
+                                           job->tags)
+                  : job->cipher->OpenChunk(job->section, chunk, job->source,
+                                           job->size, job->destination,
+                                           job->tags);
+    if (!ok) {
+      job->failed = true;
+    }
+  }
+}
+
+// Seals or restores every chunk of |job|. If |parallel| is true, host threads
+// are donated to the enclave to work on the chunks as well. Returns false if a
+// chunk could not be sealed or authenticated.
+bool RunSnapshotJob(SnapshotJob *job, bool parallel) {
+  size_t num_chunks = NumSnapshotChunks(job->size);
+  int num_workers = 0;
+  if (parallel && num_chunks > 1) {
+    num_workers =
+        static_cast<int>(std::min<size_t>(kMaxSnapshotWorkers, num_chunks - 1));
+    active_snapshot_job = job;
+    // The host may donate fewer threads, or none. The calling thread works on
+    // the chunks in any case.
+    enc_untrusted_start_snapshot_workers(num_workers);
+  }
+  WorkOnSnapshotJob(job);
+  if (num_workers > 0) {
+    // A donated thread registers itself before it reads the job, so once the
+    // job is withdrawn, no thread uses it after the count drops to zero. The
+    // host threads are joined as well, so none is still leaving the enclave
+    // when the caller restores the stack of a thread.
+    active_snapshot_job = nullptr;
+    while (snapshot_workers > 0) {
+      enc_untrusted_sched_yield();
+    }
+    enc_untrusted_join_snapshot_workers();
+  }
+  return !job->failed;
+}
+
 // Structure describing the layout of per-thread memory resources.
 struct ThreadMemoryLayout {
   // Base address of the thread data for the current thread, including the stack
@@ -76,10 +191,46 @@ const struct ThreadMemoryLayout GetThreadLayoutForSnapshot() {
   return forked_thread_memory_layout;
 }
 
+// Returns the number of bytes at the start of a heap of |heap_size| bytes that
+// have ever been handed out by sbrk. Bytes beyond that have never been written,
+// so they are left out of the snapshot and are still zero in the child.
+size_t GetUsedHeapSize(size_t heap_size) {
+  size_t used = (g_peak_heap_used + kHeapPageSize - 1) & ~(kHeapPageSize - 1);
+  return std::min(used, heap_size);
+}
+
+// Frees the untrusted memory of a partially taken snapshot.
+void FreeSnapshot(void *sections[kNumSnapshotSections], void *manifest) {
+  for (int i = 0; i < kNumSnapshotSections; ++i) {
+    if (sections[i]) {
+      enc_untrusted_free(sections[i]);
+    }
+  }
+  if (manifest) {
+    enc_untrusted_free(manifest);
+  }
+}
+
+// Restores |section| of |size| bytes from |source| into |destination| using
+// the chunk tags at |tags|, with donated threads if |parallel| is true. Aborts
+// if the section cannot be authenticated: the enclave memory is then partially
+// overwritten, and the heap may be inconsistent, so not even an error can be
+// returned safely.
+void RestoreSectionOrDie(const SnapshotCipher &cipher, SnapshotSection section,
+                         uint64_t source, size_t size, void *destination,
+                         uint8_t *tags, bool parallel) {
+  SnapshotJob job(&cipher, /*seal=*/false, section,
+                  reinterpret_cast<const void *>(source), size, destination,
+                  tags);
+  if (!RunSnapshotJob(&job, parallel)) {
+    abort();
+  }
+}
+
 }  // namespace
 
 // Takes a snapshot of the enclave data/bss/heap and stack for the calling
-// thread by copying to untrusted memory.
+// thread by sealing them to untrusted memory.
 Status TakeSnapshotForFork(SnapshotLayout *snapshot_layout) {
   if (!snapshot_layout) {
     return Status(error::GoogleError::INVALID_ARGUMENT,
@@ -111,61 +262,122 @@ Status TakeSnapshotForFork(SnapshotLayout *snapshot_layout) {
                   "Can't locate the stack of the thread calling fork");
   }
 
-  // Allocate and copy data section.
-  void *snapshot_data = enc_untrusted_malloc(enclave_layout.data_size);
-  if (!snapshot_data) {
+  // Generate a fresh snapshot key. The key of an earlier snapshot that was
+  // never transferred is discarded.
+  DiscardPendingSnapshotKey();
+  uint8_t key[kSnapshotKeySize];
+  if (RAND_bytes(key, sizeof(key)) != 1) {
+    OPENSSL_cleanse(key, sizeof(key));
     return Status(error::GoogleError::INTERNAL,
-                  "Failed allocate untrusted memory for data of the snapshot");
+                  "Failed to generate the snapshot key");
   }
-  snapshot_layout->set_data_base(reinterpret_cast<uint64_t>(snapshot_data));
-  memcpy(snapshot_data, enclave_layout.data_base, enclave_layout.data_size);
-  snapshot_layout->set_data_size(enclave_layout.data_size);
-
-  // Allocate and copy bss section.
-  void *snapshot_bss = enc_untrusted_malloc(enclave_layout.bss_size);
-  if (!snapshot_bss) {
-    return Status(
-        error::GoogleError::INTERNAL,
-        "Failed to allocate untrusted memory for bss of the snapshot");
+  SnapshotCipher cipher;
+  Status status = cipher.Init(key);
+  if (!status.ok()) {
+    OPENSSL_cleanse(key, sizeof(key));
+    return status;
   }
-  snapshot_layout->set_bss_base(reinterpret_cast<uint64_t>(snapshot_bss));
-  memcpy(snapshot_bss, enclave_layout.bss_base, enclave_layout.bss_size);
-  snapshot_layout->set_bss_size(enclave_layout.bss_size);
 
-  // Allocate and copy thread data for the calling thread.
-  void *snapshot_thread = enc_untrusted_malloc(enclave_layout.thread_size);
-  if (!snapshot_thread) {
-    return Status(
-        error::GoogleError::INTERNAL,
-        "Failed to allocate untrusted memory for thread data of the snapshot");
+  SnapshotManifestHeader header;
+  header.chunk_size = kSnapshotChunkSize;
+
+  const void *sources[kNumSnapshotSections];
+  sources[kDataSection] = enclave_layout.data_base;
+  sources[kBssSection] = enclave_layout.bss_base;
+  sources[kHeapSection] = enclave_layout.heap_base;
+  sources[kThreadSection] = thread_layout.thread_base;
+  sources[kStackSection] = thread_layout.stack_limit;
+  header.section_sizes[kDataSection] = enclave_layout.data_size;
+  header.section_sizes[kBssSection] = enclave_layout.bss_size;
+  header.section_sizes[kThreadSection] = thread_layout.thread_size;
+  header.section_sizes[kStackSection] =
+      reinterpret_cast<size_t>(thread_layout.stack_base) -
+      reinterpret_cast<size_t>(thread_layout.stack_limit);
+
+  // Allocate untrusted memory for every section. The heap is measured last,
+  // once the enclave memory allocated for taking the snapshot is in use.
+  void *sections[kNumSnapshotSections] = {};
+  for (SnapshotSection section : {kDataSection, kBssSection, kThreadSection,
+                                  kStackSection, kHeapSection}) {
+    if (section == kHeapSection) {
+      header.section_sizes[kHeapSection] =
+          GetUsedHeapSize(enclave_layout.heap_size);
+    }
+    sections[section] = enc_untrusted_malloc(
+        std::max<size_t>(header.section_sizes[section], 1));
+    if (!sections[section]) {
+      OPENSSL_cleanse(key, sizeof(key));
+      FreeSnapshot(sections, /*manifest=*/nullptr);
+      return Status(error::GoogleError::INTERNAL,
+                    absl::StrCat("Failed to allocate untrusted memory for ",
+                                 kSnapshotSectionNames[section],
+                                 " of the snapshot"));
+    }
   }
-  snapshot_layout->set_thread_base(reinterpret_cast<uint64_t>(snapshot_thread));
-  memcpy(snapshot_thread, thread_layout.thread_base, thread_layout.thread_size);
-  snapshot_layout->set_thread_size(enclave_layout.thread_size);
-
-  // Allocate and copy heap.
-  void *snapshot_heap = enc_untrusted_malloc(enclave_layout.heap_size);
-  if (!snapshot_heap) {
-    return Status(
-        error::GoogleError::INTERNAL,
-        "Failed to allocate untrusted memory for heap of the snapshot");
+  size_t manifest_size = SnapshotManifestSize(header);
+  uint8_t *manifest =
+      static_cast<uint8_t *>(enc_untrusted_malloc(manifest_size));
+  if (!manifest) {
+    OPENSSL_cleanse(key, sizeof(key));
+    FreeSnapshot(sections, /*manifest=*/nullptr);
+    return Status(error::GoogleError::INTERNAL,
+                  "Failed to allocate untrusted memory for snapshot manifest");
+  }
+  memcpy(manifest, &header, sizeof(header));
+
+  // Seal every section and record the tag of each chunk in the manifest.
+  // Nothing below allocates enclave memory, so the sealed sections are
+  // consistent with each other. The heap is sealed last, together with donated
+  // threads, once the data and bss sections no longer change the snapshot.
+  uint8_t *tags = manifest + sizeof(header);
+  for (SnapshotSection section : {kDataSection, kBssSection, kThreadSection,
+                                  kStackSection, kHeapSection}) {
+    if (section == kHeapSection) {
+      // The key is pending transfer to the child enclave from now on. It is
+      // not part of the sealed data or bss section.
+      SetPendingSnapshotKey(key);
+      OPENSSL_cleanse(key, sizeof(key));
+    }
+    SnapshotJob job(&cipher, /*seal=*/true, section, sources[section],
+                    header.section_sizes[section], sections[section],
+                    tags + SnapshotTagsOffset(header, section));
+    if (!RunSnapshotJob(&job, /*parallel=*/section == kHeapSection)) {
+      DiscardPendingSnapshotKey();
+      FreeSnapshot(sections, manifest);
+      return Status(error::GoogleError::INTERNAL,
+                    absl::StrCat("Failed to seal ",
+                                 kSnapshotSectionNames[section],
+                                 " of the snapshot"));
+    }
   }
-  snapshot_layout->set_heap_base(reinterpret_cast<uint64_t>(snapshot_heap));
-  memcpy(snapshot_heap, enclave_layout.heap_base, enclave_layout.heap_size);
-  snapshot_layout->set_heap_size(enclave_layout.heap_size);
 
-  // Allocate and copy stack for the calling thread.
-  size_t stack_size = reinterpret_cast<size_t>(thread_layout.stack_base) -
-                      reinterpret_cast<size_t>(thread_layout.stack_limit);
-  void *snapshot_stack = enc_untrusted_malloc(stack_size);
-  if (!snapshot_stack) {
-    return Status(
-        error::GoogleError::INTERNAL,
-        "Failed to allocate untrusted memory for stack of the snapshot");
+  // The chunk tags are read back from untrusted memory. A tag changed by the
+  // host only makes the child enclave reject the snapshot.
+  size_t tags_size = manifest_size - sizeof(header) - kSnapshotTagSize;
+  if (!cipher.SealManifest(header, tags, tags_size)) {
+    DiscardPendingSnapshotKey();
+    FreeSnapshot(sections, manifest);
+    return Status(error::GoogleError::INTERNAL,
+                  "Failed to seal the snapshot manifest");
   }
-  snapshot_layout->set_stack_base(reinterpret_cast<uint64_t>(snapshot_stack));
-  memcpy(snapshot_stack, thread_layout.stack_limit, stack_size);
-  snapshot_layout->set_stack_size(stack_size);
+
+  snapshot_layout->set_data_base(
+      reinterpret_cast<uint64_t>(sections[kDataSection]));
+  snapshot_layout->set_data_size(header.section_sizes[kDataSection]);
+  snapshot_layout->set_bss_base(
+      reinterpret_cast<uint64_t>(sections[kBssSection]));
+  snapshot_layout->set_bss_size(header.section_sizes[kBssSection]);
+  snapshot_layout->set_heap_base(
+      reinterpret_cast<uint64_t>(sections[kHeapSection]));
+  snapshot_layout->set_heap_size(header.section_sizes[kHeapSection]);
+  snapshot_layout->set_thread_base(
+      reinterpret_cast<uint64_t>(sections[kThreadSection]));
+  snapshot_layout->set_thread_size(header.section_sizes[kThreadSection]);
+  snapshot_layout->set_stack_base(
+      reinterpret_cast<uint64_t>(sections[kStackSection]));
+  snapshot_layout->set_stack_size(header.section_sizes[kStackSection]);
+  snapshot_layout->set_manifest_base(reinterpret_cast<uint64_t>(manifest));
+  snapshot_layout->set_manifest_size(manifest_size);
 
   return Status::OkStatus();
 }
@@ -188,44 +400,97 @@ Status RestoreForFork(const SnapshotLayout &snapshot_layout) {
                   "enclave bss section is not found or unexpected");
   }
   if (!enclave_layout.heap_base ||
+      snapshot_layout.heap_size() > enclave_layout.heap_size ||
       !enc_is_within_enclave(enclave_layout.heap_base,
                              snapshot_layout.heap_size())) {
     return Status(error::GoogleError::INTERNAL,
                   "enclave heap not found or unexpected");
   }
 
-  // Restore data section.
   if (!enc_is_outside_enclave(
           reinterpret_cast<void *>(snapshot_layout.data_base()),
           snapshot_layout.data_size())) {
     return Status(error::GoogleError::INTERNAL,
                   "snapshot data section is not outside the enclave");
   }
-  memcpy(enclave_layout.data_base,
-         reinterpret_cast<void *>(snapshot_layout.data_base()),
-         snapshot_layout.data_size());
-
-  // Restore bss section.
   if (!enc_is_outside_enclave(
           reinterpret_cast<void *>(snapshot_layout.bss_base()),
           snapshot_layout.bss_size())) {
     return Status(error::GoogleError::INTERNAL,
                   "snapshot bss section is not outside the enclave");
   }
-  memcpy(enclave_layout.bss_base,
-         reinterpret_cast<void *>(snapshot_layout.bss_base()),
-         snapshot_layout.bss_size());
-
-  // Restore heap.
   if (!enc_is_outside_enclave(
           reinterpret_cast<void *>(snapshot_layout.heap_base()),
           snapshot_layout.heap_size())) {
     return Status(error::GoogleError::INTERNAL,
                   "snapshot heap is not outside the enclave");
   }
-  memcpy(enclave_layout.heap_base,
-         reinterpret_cast<void *>(snapshot_layout.heap_base()),
-         snapshot_layout.heap_size());
+  if (!enc_is_outside_enclave(
+          reinterpret_cast<void *>(snapshot_layout.thread_base()),
+          snapshot_layout.thread_size())) {
+    return Status(error::GoogleError::INTERNAL,
+                  "snapshot thread is not outside the enclave");
+  }
+  if (!enc_is_outside_enclave(
+          reinterpret_cast<void *>(snapshot_layout.stack_base()),
+          snapshot_layout.stack_size())) {
+    return Status(error::GoogleError::INTERNAL,
+                  "snapshot stack is not outside the enclave");
+  }
+  uint8_t *manifest =
+      reinterpret_cast<uint8_t *>(snapshot_layout.manifest_base());
+  size_t manifest_size = snapshot_layout.manifest_size();
+  if (!manifest || !enc_is_outside_enclave(manifest, manifest_size)) {
+    return Status(error::GoogleError::INTERNAL,
+                  "snapshot manifest is not outside the enclave");
+  }
+
+  // Copy the manifest header into the enclave and check that it describes the
+  // snapshot layout.
+  const uint64_t section_sizes[kNumSnapshotSections] = {
+      snapshot_layout.data_size(), snapshot_layout.bss_size(),
+      snapshot_layout.heap_size(), snapshot_layout.thread_size(),
+      snapshot_layout.stack_size()};
+  SnapshotManifestHeader header;
+  ASYLO_RETURN_IF_ERROR(ReadSnapshotManifestHeader(manifest, manifest_size,
+                                                   section_sizes, &header));
+
+  // Authenticate the manifest with the key transferred from the parent
+  // enclave. The key is used up by this attempt, so a snapshot can be restored
+  // at most once.
+  uint8_t key[kSnapshotKeySize];
+  if (!TakePendingSnapshotKey(key)) {
+    return Status(error::GoogleError::FAILED_PRECONDITION,
+                  "No snapshot key was transferred from the parent enclave");
+  }
+  SnapshotCipher cipher;
+  Status status = cipher.Init(key);
+  OPENSSL_cleanse(key, sizeof(key));
+  ASYLO_RETURN_IF_ERROR(status);
+  uint8_t *tags = manifest + sizeof(header);
+  size_t tags_size = manifest_size - sizeof(header) - kSnapshotTagSize;
+  if (!cipher.OpenManifest(header, tags, tags_size)) {
+    return Status(error::GoogleError::INTERNAL,
+                  "Failed to authenticate the snapshot manifest");
+  }
+
+  // Restore data section, bss section and heap. Enclave memory must not be
+  // allocated until all three are restored. The heap is restored together with
+  // donated threads once the data and bss sections are in place. The thread
+  // data and stack are restored after those threads are gone, since one may
+  // have run on the thread the sections belong to.
+  RestoreSectionOrDie(cipher, kDataSection, snapshot_layout.data_base(),
+                      snapshot_layout.data_size(), enclave_layout.data_base,
+                      tags + SnapshotTagsOffset(header, kDataSection),
+                      /*parallel=*/false);
+  RestoreSectionOrDie(cipher, kBssSection, snapshot_layout.bss_base(),
+                      snapshot_layout.bss_size(), enclave_layout.bss_base,
+                      tags + SnapshotTagsOffset(header, kBssSection),
+                      /*parallel=*/false);
+  RestoreSectionOrDie(cipher, kHeapSection, snapshot_layout.heap_base(),
+                      snapshot_layout.heap_size(), enclave_layout.heap_base,
+                      tags + SnapshotTagsOffset(header, kHeapSection),
+                      /*parallel=*/true);
 
   // Get the information of the thread that calls fork. These are saved in data
   // section, and should be available now since data/bss are restored.
@@ -243,27 +508,15 @@ Status RestoreForFork(const SnapshotLayout &snapshot_layout) {
                   "target tcs stack not found or unexpected");
   }
 
-  // Restore thread data for the calling thread.
-  if (!enc_is_outside_enclave(
-          reinterpret_cast<void *>(snapshot_layout.thread_base()),
-          snapshot_layout.thread_size())) {
-    return Status(error::GoogleError::INTERNAL,
-                  "snapshot thread is not outside the enclave");
-  }
-  memcpy(thread_layout.thread_base,
-         reinterpret_cast<void *>(snapshot_layout.thread_base()),
-         snapshot_layout.thread_size());
-
-  // Restore stack for the calling thread.
-  if (!enc_is_outside_enclave(
-          reinterpret_cast<void *>(snapshot_layout.stack_base()),
-          snapshot_layout.stack_size())) {
-    return Status(error::GoogleError::INTERNAL,
-                  "snapshot stack is not outside the enclave");
-  }
-  memcpy(thread_layout.stack_limit,
-         reinterpret_cast<void *>(snapshot_layout.stack_base()),
-         snapshot_layout.stack_size());
+  // Restore thread data and stack for the calling thread.
+  RestoreSectionOrDie(cipher, kThreadSection, snapshot_layout.thread_base(),
+                      snapshot_layout.thread_size(), thread_layout.thread_base,
+                      tags + SnapshotTagsOffset(header, kThreadSection),
+                      /*parallel=*/false);
+  RestoreSectionOrDie(cipher, kStackSection, snapshot_layout.stack_base(),
+                      snapshot_layout.stack_size(), thread_layout.stack_limit,
+                      tags + SnapshotTagsOffset(header, kStackSection),
+                      /*parallel=*/false);
 
   return Status::OkStatus();
 }
@@ -293,16 +546,14 @@ Status RunEkepHandshake(EkepHandshaker *handshaker, bool is_parent,
   // Loop till the handshake finishes.
   char buf[1024];
   while (result == EkepHandshaker::Result::IN_PROGRESS) {
-    int bytes_received = 0;
     do {
       outgoing_bytes.clear();
       int rc = enc_untrusted_read(socket, buf, sizeof(buf));
       if (rc <= 0) {
         return Status(static_cast<error::PosixError>(errno), "Read failed");
       }
-      bytes_received += rc;
-      result =
-          handshaker->NextHandshakeStep(buf, bytes_received, &outgoing_bytes);
+      // The handshaker buffers the bytes of an incomplete frame itself.
+      result = handshaker->NextHandshakeStep(buf, rc, &outgoing_bytes);
     } while (result == EkepHandshaker::Result::NOT_ENOUGH_DATA);
 
     if (result == EkepHandshaker::Result::ABORTED) {
@@ -350,10 +601,153 @@ Status ComparePeerAndSelfIdentity(const EnclaveIdentity &peer_identity) {
   return Status::OkStatus();
 }
 
+// Initializes the SGX local assertion authority used for the handshake, unless
+// the enclave config did already. The child enclave is loaded with a config of
+// its own, so both enclaves fall back to the local attestation domain of the
+// host.
+Status InitializeForkAssertionAuthority() {
+  const EnclaveConfig *config;
+  ASYLO_ASSIGN_OR_RETURN(config, GetEnclaveConfig());
+  if (!config->host_config().has_local_attestation_domain()) {
+    return Status::OkStatus();
+  }
+  SgxLocalAssertionAuthorityConfig authority_config;
+  authority_config.set_attestation_domain(
+      config->host_config().local_attestation_domain());
+  EnclaveAssertionAuthorityConfig assertion_authority_config;
+  SetSgxLocalAssertionDescription(
+      assertion_authority_config.mutable_description());
+  if (!authority_config.SerializeToString(
+          assertion_authority_config.mutable_config())) {
+    return Status(error::GoogleError::INTERNAL,
+                  "Failed to serialize the SGX local assertion authority "
+                  "config");
+  }
+  // Authorities already initialized are left as they are.
+  const EnclaveAssertionAuthorityConfig *configs = &assertion_authority_config;
+  return InitializeEnclaveAssertionAuthorities(configs, configs + 1);
+}
+
+// Derives the key encrypting the snapshot key for the transfer from
+// |record_protocol_key|, the key the handshake established.
+void DeriveTransferKey(const CleansingVector<uint8_t> &record_protocol_key,
+                       uint8_t transfer_key[SHA256_DIGEST_LENGTH]) {
+  SHA256_CTX context;
+  SHA256_Init(&context);
+  SHA256_Update(&context, kSnapshotKeyTransferContext,
+                sizeof(kSnapshotKeyTransferContext));
+  SHA256_Update(&context, record_protocol_key.data(),
+                record_protocol_key.size());
+  SHA256_Final(transfer_key, &context);
+  OPENSSL_cleanse(&context, sizeof(context));
+}
+
+// Encrypts |key| into |message| if |seal| is true, or decrypts |message| into
+// |key| otherwise, with the transfer key derived from |record_protocol_key|.
+// |message| holds a nonce, the encrypted key and a tag.
+Status CryptSnapshotKey(const CleansingVector<uint8_t> &record_protocol_key,
+                        bool seal, uint8_t message[kSnapshotKeyMessageSize],
+                        uint8_t key[kSnapshotKeySize]) {
+  uint8_t transfer_key[SHA256_DIGEST_LENGTH];
+  DeriveTransferKey(record_protocol_key, transfer_key);
+  EVP_AEAD_CTX context;
+  bool ok = EVP_AEAD_CTX_init(&context, EVP_aead_aes_256_gcm(), transfer_key,
+                              sizeof(transfer_key), kSnapshotTagSize,
+                              /*impl=*/nullptr) == 1;
+  OPENSSL_cleanse(transfer_key, sizeof(transfer_key));
+  if (!ok) {
+    return Status(error::GoogleError::INTERNAL,
+                  "Failed to initialize the snapshot key transfer cipher");
+  }
+  uint8_t *nonce = message;
+  uint8_t *ciphertext = message + kSnapshotNonceSize;
+  size_t length = 0;
+  if (seal) {
+    ok = RAND_bytes(nonce, kSnapshotNonceSize) == 1 &&
+         EVP_AEAD_CTX_seal(&context, ciphertext, &length,
+                           kSnapshotKeySize + kSnapshotTagSize, nonce,
+                           kSnapshotNonceSize, key, kSnapshotKeySize,
+                           /*ad=*/nullptr, /*ad_len=*/0) == 1 &&
+         length == kSnapshotKeySize + kSnapshotTagSize;
+  } else {
+    ok = EVP_AEAD_CTX_open(&context, key, &length, kSnapshotKeySize, nonce,
+                           kSnapshotNonceSize, ciphertext,
+                           kSnapshotKeySize + kSnapshotTagSize,
+                           /*ad=*/nullptr, /*ad_len=*/0) == 1 &&
+         length == kSnapshotKeySize;
+  }
+  EVP_AEAD_CTX_cleanup(&context);
+  if (!ok) {
+    return Status(error::GoogleError::INTERNAL,
+                  seal ? "Failed to encrypt the snapshot key"
+                       : "Failed to decrypt the snapshot key");
+  }
+  return Status::OkStatus();
+}
+
+// Sends the pending snapshot key to the child enclave on |socket|, encrypted
+// for the handshake that established |record_protocol_key|.
+Status SendSnapshotKey(const CleansingVector<uint8_t> &record_protocol_key,
+                       int socket) {
+  uint8_t key[kSnapshotKeySize];
+  if (!TakePendingSnapshotKey(key)) {
+    return Status(error::GoogleError::FAILED_PRECONDITION,
+                  "No snapshot key to transfer");
+  }
+  uint8_t message[kSnapshotKeyMessageSize];
+  Status status =
+      CryptSnapshotKey(record_protocol_key, /*seal=*/true, message, key);
+  OPENSSL_cleanse(key, sizeof(key));
+  ASYLO_RETURN_IF_ERROR(status);
+  size_t written = 0;
+  while (written < sizeof(message)) {
+    int rc = enc_untrusted_write(socket, message + written,
+                                 sizeof(message) - written);
+    if (rc <= 0) {
+      return Status(static_cast<error::PosixError>(errno), "Write failed");
+    }
+    written += rc;
+  }
+  return Status::OkStatus();
+}
+
+// Receives the snapshot key from the parent enclave on |socket|, encrypted for
+// the handshake that established |record_protocol_key|, and makes it the
+// pending snapshot key. |unused_bytes| are the bytes the handshake read past
+// its last frame.
+Status ReceiveSnapshotKey(const CleansingVector<uint8_t> &record_protocol_key,
+                          const std::string &unused_bytes, int socket) {
+  uint8_t message[kSnapshotKeyMessageSize];
+  if (unused_bytes.size() > sizeof(message)) {
+    return Status(error::GoogleError::INTERNAL,
+                  "Unexpected data after the snapshot key");
+  }
+  memcpy(message, unused_bytes.data(), unused_bytes.size());
+  size_t received = unused_bytes.size();
+  while (received < sizeof(message)) {
+    int rc = enc_untrusted_read(socket, message + received,
+                                sizeof(message) - received);
+    if (rc <= 0) {
+      return Status(static_cast<error::PosixError>(errno), "Read failed");
+    }
+    received += rc;
+  }
+  uint8_t key[kSnapshotKeySize];
+  ASYLO_RETURN_IF_ERROR(
+      CryptSnapshotKey(record_protocol_key, /*seal=*/false, message, key));
+  SetPendingSnapshotKey(key);
+  OPENSSL_cleanse(key, sizeof(key));
+  return Status::OkStatus();
+}
+
 // Securely transfer the snapshot key. First create a shared secret from an EKEP
 // handshake between the parent and the child enclave. The parent enclave then
 // encrypt the snapshot key with the shared secret, and sends it to the child
 // enclave. The chlid enclave then decrypts the key with the shared secret.
+//
+// The parent sends the key of its last snapshot at most once, and the child
+// only restores a snapshot with a key it received, so neither a snapshot nor a
+// key message can be replayed.
 Status TransferSecureSnapshotKey(
     const ForkHandshakeConfig &fork_handshake_config) {
   if (!fork_handshake_config.has_is_parent() ||
@@ -368,6 +762,8 @@ Status TransferSecureSnapshotKey(
                   "The socket field for handshake is invalid");
   }
 
+  ASYLO_RETURN_IF_ERROR(InitializeForkAssertionAuthority());
+
   AssertionDescription description;
   SetSgxLocalAssertionDescription(&description);
 
@@ -396,8 +792,26 @@ Status TransferSecureSnapshotKey(
 
   ASYLO_RETURN_IF_ERROR(ComparePeerAndSelfIdentity(peer_identity));
 
-  return Status(error::GoogleError::UNIMPLEMENTED,
-                "Encrypting snapshot key not implemented yet");
+  CleansingVector<uint8_t> record_protocol_key;
+  ASYLO_ASSIGN_OR_RETURN(record_protocol_key,
+                         handshaker->GetRecordProtocolKey());
+  if (is_parent) {
+    return SendSnapshotKey(record_protocol_key,
+                           fork_handshake_config.socket());
+  }
+  std::string unused_bytes;
+  ASYLO_ASSIGN_OR_RETURN(unused_bytes, handshaker->GetUnusedBytes());
+  return ReceiveSnapshotKey(record_protocol_key, unused_bytes,
+                            fork_handshake_config.socket());
+}
+
+void RunSnapshotWorker() {
+  ++snapshot_workers;
+  SnapshotJob *job = active_snapshot_job;
+  if (job) {
+    WorkOnSnapshotJob(job);
+  }
+  --snapshot_workers;
 }
 
 pid_t enc_fork(const char *enclave_name) {
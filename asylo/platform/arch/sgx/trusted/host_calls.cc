@@ -36,6 +36,7 @@
 #include <sys/utsname.h>
 #include <unistd.h>
 #include <utime.h>
+#include <atomic>
 #include <cstring>
 #include <string>
 #include <vector>
@@ -49,6 +50,7 @@
 #include "asylo/platform/common/bridge_functions.h"
 #include "asylo/platform/common/bridge_proto_serializer.h"
 #include "asylo/platform/common/bridge_types.h"
+#include "asylo/platform/common/call_metrics.h"
 #include "asylo/platform/common/memory.h"
 #include "asylo/util/status.h"
 #include "include/sgx_trts.h"
@@ -56,17 +58,34 @@
 namespace asylo {
 namespace {
 
-#define CHECK_OCALL(status_)                                                 \
-  do {                                                                       \
-    sgx_status_t status##__COUNTER__ = status_;                              \
-    if (status##__COUNTER__ != SGX_SUCCESS) {                                \
-      enc_untrusted_puts(                                                    \
-          absl::StrCat(                                                      \
-              __FILE__, ":", __LINE__, ": ",                                 \
-              asylo::Status(status##__COUNTER__, "ocall failed").ToString()) \
-              .c_str());                                                     \
-      abort();                                                               \
-    }                                                                        \
+// Function called by threads returning from host calls, or nullptr.
+std::atomic<void (*)(void)> host_call_return_hook(nullptr);
+
+// Makes the ocall |status_| and aborts if it fails, then runs the host call
+// return hook. The latency of the ocall is recorded with the host call counter
+// named after the enclosing function.
+#define CHECK_OCALL(status_)                                                   \
+  do {                                                                         \
+    static ::asylo::CallCounter *const call_counter =                          \
+        ::asylo::CallMetricsRegistry::GetInstance()->GetCounter(               \
+            ::asylo::CallMetric::HOST_CALL, __func__);                         \
+    sgx_status_t ocall_status;                                                 \
+    {                                                                          \
+      ::asylo::ScopedCallTimer call_timer(call_counter);                       \
+      ocall_status = status_;                                                  \
+    }                                                                          \
+    if (ocall_status != SGX_SUCCESS) {                                         \
+      enc_untrusted_puts(                                                      \
+          absl::StrCat(__FILE__, ":", __LINE__, ": ",                          \
+                       asylo::Status(ocall_status, "ocall failed").ToString()) \
+              .c_str());                                                       \
+      abort();                                                                 \
+    }                                                                          \
+    void (*ocall_return_hook)(void) =                                          \
+        ::asylo::host_call_return_hook.load(std::memory_order_acquire);       \
+    if (ocall_return_hook) {                                                   \
+      ocall_return_hook();                                                     \
+    }                                                                          \
   } while (0)
 
 }  // namespace
@@ -224,7 +243,6 @@ void fill_iov(const char *buf, int size, const struct iovec *iov, int iovcnt) {
 }
 
 ssize_t enc_untrusted_writev(int fd, char *buf, int size) {
-  asylo::UntrustedUniquePtr<char> tmp(buf);
   bridge_ssize_t ret;
 
   CHECK_OCALL(
@@ -234,13 +252,28 @@ ssize_t enc_untrusted_writev(int fd, char *buf, int size) {
 
 ssize_t enc_untrusted_readv(int fd, const struct iovec *iov, int iovcnt,
                             char *buf, int size) {
-  asylo::UntrustedUniquePtr<char> tmp(buf);
   bridge_ssize_t ret;
   CHECK_OCALL(ocall_enc_untrusted_read_with_untrusted_ptr(&ret, fd, buf, size));
   fill_iov(buf, ret, iov, iovcnt);
   return static_cast<ssize_t>(ret);
 }
 
+ssize_t enc_untrusted_send_with_untrusted_ptr(int sockfd, const void *buf,
+                                              size_t len, int flags) {
+  bridge_ssize_t ret;
+  CHECK_OCALL(ocall_enc_untrusted_send_with_untrusted_ptr(
+      &ret, sockfd, buf, static_cast<bridge_size_t>(len), flags));
+  return static_cast<ssize_t>(ret);
+}
+
+ssize_t enc_untrusted_recv_with_untrusted_ptr(int sockfd, void *buf,
+                                              size_t len, int flags) {
+  bridge_ssize_t ret;
+  CHECK_OCALL(ocall_enc_untrusted_recv_with_untrusted_ptr(
+      &ret, sockfd, buf, static_cast<bridge_size_t>(len), flags));
+  return static_cast<ssize_t>(ret);
+}
+
 //////////////////////////////////////
 //             Sockets              //
 //////////////////////////////////////
@@ -310,6 +343,27 @@ ssize_t enc_untrusted_recvmsg(int sockfd,
   return static_cast<ssize_t>(ret);
 }
 
+int enc_untrusted_sendmmsg(int sockfd, struct bridge_mmsghdr *msgvec,
+                           unsigned int vlen, int flags) {
+  int ret;
+  CHECK_OCALL(ocall_enc_untrusted_sendmmsg(&ret, sockfd, msgvec, vlen, flags));
+  return ret;
+}
+
+int enc_untrusted_recvmmsg(int sockfd, struct bridge_mmsghdr *msgvec,
+                           unsigned int vlen, int flags,
+                           struct timespec *timeout) {
+  struct bridge_timespec bridge_timeout;
+  if (timeout && !asylo::ToBridgeTimespec(timeout, &bridge_timeout)) {
+    errno = EINVAL;
+    return -1;
+  }
+  int ret;
+  CHECK_OCALL(ocall_enc_untrusted_recvmmsg(
+      &ret, sockfd, msgvec, vlen, flags, timeout ? &bridge_timeout : nullptr));
+  return ret;
+}
+
 const char *enc_untrusted_inet_ntop(int af, const void *src, char *dst,
                                     socklen_t size) {
   char *ret;
@@ -631,6 +685,24 @@ int enc_untrusted_epoll_wait(int epfd, struct epoll_event *events,
   return ret;
 }
 
+void *enc_untrusted_epoll_agent_start(int epfd, void *ring) {
+  void *ret;
+  CHECK_OCALL(ocall_enc_untrusted_epoll_agent_start(&ret, epfd, ring));
+  return ret;
+}
+
+void enc_untrusted_epoll_agent_wait(void *agent, int timeout) {
+  CHECK_OCALL(ocall_enc_untrusted_epoll_agent_wait(agent, timeout));
+}
+
+void enc_untrusted_epoll_agent_stop(void *agent) {
+  CHECK_OCALL(ocall_enc_untrusted_epoll_agent_stop(agent));
+}
+
+void enc_untrusted_epoll_agent_destroy(void *agent) {
+  CHECK_OCALL(ocall_enc_untrusted_epoll_agent_destroy(agent));
+}
+
 //////////////////////////////////////
 //           inotify.h              //
 //////////////////////////////////////
@@ -1006,6 +1078,15 @@ pid_t enc_untrusted_fork(const char *enclave_name, bool restore_snapshot) {
   return ret;
 }
 
+void enc_untrusted_start_snapshot_workers(int count) {
+  // If no thread is started, the caller seals or restores the snapshot alone.
+  ocall_enc_untrusted_start_snapshot_workers(count);
+}
+
+void enc_untrusted_join_snapshot_workers() {
+  CHECK_OCALL(ocall_enc_untrusted_join_snapshot_workers());
+}
+
 //////////////////////////////////////
 //             wait.h               //
 //////////////////////////////////////
@@ -1054,6 +1135,10 @@ int enc_untrusted_release_shared_resource(enum SharedNameKind kind,
   return ret ? 0 : -1;
 }
 
+void enc_set_host_call_return_hook(void (*hook)(void)) {
+  asylo::host_call_return_hook.store(hook, std::memory_order_release);
+}
+
 //////////////////////////////////////
 //           Debugging              //
 //////////////////////////////////////
@@ -0,0 +1,218 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/arch/sgx/trusted/snapshot_seal.h"
+
+#include <openssl/mem.h>
+#include <openssl/sha.h>
+#include <algorithm>
+#include <cstring>
+
+#include "asylo/platform/posix/memory/memory.h"
+
+namespace asylo {
+namespace {
+
+// The key of the last snapshot taken, or the key received from the parent
+// enclave. See SetPendingSnapshotKey().
+struct PendingSnapshotKey {
+  bool set;
+  uint8_t key[kSnapshotKeySize];
+};
+
+PendingSnapshotKey pending_snapshot_key = {false, {}};
+
+// Writes the nonce for chunk |chunk| of |section| to |nonce|. The manifest tag
+// uses the section index kNumSnapshotSections. Every snapshot is sealed with a
+// fresh key, so nonces only need to be unique within a snapshot.
+void MakeNonce(uint32_t section, uint64_t chunk,
+               uint8_t nonce[kSnapshotNonceSize]) {
+  memcpy(nonce, &section, sizeof(section));
+  memcpy(nonce + sizeof(section), &chunk, sizeof(chunk));
+}
+
+// Computes the hash authenticated by the manifest tag from |header| and the
+// |tags_size| bytes of chunk tags at |tags|.
+void HashManifest(const SnapshotManifestHeader &header, const uint8_t *tags,
+                  size_t tags_size, uint8_t digest[SHA256_DIGEST_LENGTH]) {
+  SHA256_CTX context;
+  SHA256_Init(&context);
+  SHA256_Update(&context, &header, sizeof(header));
+  SHA256_Update(&context, tags, tags_size);
+  SHA256_Final(digest, &context);
+}
+
+}  // namespace
+
+size_t NumSnapshotChunks(size_t size) {
+  return (size + kSnapshotChunkSize - 1) / kSnapshotChunkSize;
+}
+
+size_t SnapshotManifestSize(const SnapshotManifestHeader &header) {
+  size_t num_chunks = 0;
+  for (uint64_t section_size : header.section_sizes) {
+    num_chunks += NumSnapshotChunks(section_size);
+  }
+  return sizeof(header) + (num_chunks + 1) * kSnapshotTagSize;
+}
+
+size_t SnapshotTagsOffset(const SnapshotManifestHeader &header,
+                          SnapshotSection section) {
+  size_t num_chunks = 0;
+  for (int i = 0; i < section; ++i) {
+    num_chunks += NumSnapshotChunks(header.section_sizes[i]);
+  }
+  return num_chunks * kSnapshotTagSize;
+}
+
+Status ReadSnapshotManifestHeader(
+    const uint8_t *manifest, size_t manifest_size,
+    const uint64_t section_sizes[kNumSnapshotSections],
+    SnapshotManifestHeader *header) {
+  if (manifest_size < sizeof(*header) + kSnapshotTagSize) {
+    return Status(error::GoogleError::INTERNAL,
+                  "snapshot manifest is too small");
+  }
+  memcpy(header, manifest, sizeof(*header));
+  if (header->chunk_size != kSnapshotChunkSize ||
+      !std::equal(section_sizes, section_sizes + kNumSnapshotSections,
+                  header->section_sizes) ||
+      SnapshotManifestSize(*header) != manifest_size) {
+    return Status(error::GoogleError::INTERNAL,
+                  "snapshot manifest does not match the snapshot layout");
+  }
+  return Status::OkStatus();
+}
+
+SnapshotCipher::SnapshotCipher() : initialized_(false) {
+  EVP_AEAD_CTX_zero(&context_);
+}
+
+SnapshotCipher::~SnapshotCipher() {
+  if (initialized_) {
+    heap_switch(state_buffer_, sizeof(state_buffer_));
+    EVP_AEAD_CTX_cleanup(&context_);
+    heap_switch(/*address=*/nullptr, /*size=*/0);
+  }
+  OPENSSL_cleanse(state_buffer_, sizeof(state_buffer_));
+}
+
+Status SnapshotCipher::Init(const uint8_t *key) {
+  heap_switch(state_buffer_, sizeof(state_buffer_));
+  initialized_ = EVP_AEAD_CTX_init(&context_, EVP_aead_aes_128_gcm(), key,
+                                   kSnapshotKeySize, kSnapshotTagSize,
+                                   /*impl=*/nullptr) == 1;
+  heap_switch(/*address=*/nullptr, /*size=*/0);
+  if (!initialized_) {
+    return Status(error::GoogleError::INTERNAL,
+                  "Failed to initialize the snapshot cipher");
+  }
+  return Status::OkStatus();
+}
+
+bool SnapshotCipher::SealChunk(uint32_t section, size_t chunk,
+                               const uint8_t *source, size_t size,
+                               uint8_t *destination, uint8_t *tags) const {
+  size_t offset = chunk * kSnapshotChunkSize;
+  size_t chunk_size = std::min(kSnapshotChunkSize, size - offset);
+  uint8_t nonce[kSnapshotNonceSize];
+  MakeNonce(section, chunk, nonce);
+  uint8_t tag[kSnapshotTagSize];
+  size_t tag_size = 0;
+  if (EVP_AEAD_CTX_seal_scatter(
+          &context_, destination + offset, tag, &tag_size, sizeof(tag), nonce,
+          sizeof(nonce), source + offset, chunk_size, /*extra_in=*/nullptr,
+          /*extra_in_len=*/0, /*ad=*/nullptr, /*ad_len=*/0) != 1 ||
+      tag_size != sizeof(tag)) {
+    return false;
+  }
+  memcpy(tags + chunk * kSnapshotTagSize, tag, sizeof(tag));
+  return true;
+}
+
+bool SnapshotCipher::OpenChunk(uint32_t section, size_t chunk,
+                               const uint8_t *source, size_t size,
+                               uint8_t *destination,
+                               const uint8_t *tags) const {
+  size_t offset = chunk * kSnapshotChunkSize;
+  size_t chunk_size = std::min(kSnapshotChunkSize, size - offset);
+  uint8_t nonce[kSnapshotNonceSize];
+  MakeNonce(section, chunk, nonce);
+  uint8_t tag[kSnapshotTagSize];
+  memcpy(tag, tags + chunk * kSnapshotTagSize, sizeof(tag));
+  memcpy(destination + offset, source + offset, chunk_size);
+  return EVP_AEAD_CTX_open_gather(
+             &context_, destination + offset, nonce, sizeof(nonce),
+             destination + offset, chunk_size, tag, sizeof(tag),
+             /*ad=*/nullptr, /*ad_len=*/0) == 1;
+}
+
+bool SnapshotCipher::SealManifest(const SnapshotManifestHeader &header,
+                                  uint8_t *tags, size_t tags_size) const {
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  HashManifest(header, tags, tags_size, digest);
+  uint8_t nonce[kSnapshotNonceSize];
+  MakeNonce(kNumSnapshotSections, 0, nonce);
+  uint8_t manifest_tag[kSnapshotTagSize];
+  size_t tag_size = 0;
+  if (EVP_AEAD_CTX_seal_scatter(
+          &context_, /*out=*/nullptr, manifest_tag, &tag_size,
+          sizeof(manifest_tag), nonce, sizeof(nonce), /*in=*/nullptr,
+          /*in_len=*/0, /*extra_in=*/nullptr, /*extra_in_len=*/0, digest,
+          sizeof(digest)) != 1 ||
+      tag_size != sizeof(manifest_tag)) {
+    return false;
+  }
+  memcpy(tags + tags_size, manifest_tag, sizeof(manifest_tag));
+  return true;
+}
+
+bool SnapshotCipher::OpenManifest(const SnapshotManifestHeader &header,
+                                  const uint8_t *tags,
+                                  size_t tags_size) const {
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  HashManifest(header, tags, tags_size, digest);
+  uint8_t nonce[kSnapshotNonceSize];
+  MakeNonce(kNumSnapshotSections, 0, nonce);
+  uint8_t manifest_tag[kSnapshotTagSize];
+  memcpy(manifest_tag, tags + tags_size, sizeof(manifest_tag));
+  return EVP_AEAD_CTX_open_gather(&context_, /*out=*/nullptr, nonce,
+                                  sizeof(nonce), /*in=*/nullptr, /*in_len=*/0,
+                                  manifest_tag, sizeof(manifest_tag), digest,
+                                  sizeof(digest)) == 1;
+}
+
+void SetPendingSnapshotKey(const uint8_t *key) {
+  memcpy(pending_snapshot_key.key, key, kSnapshotKeySize);
+  pending_snapshot_key.set = true;
+}
+
+void DiscardPendingSnapshotKey() {
+  OPENSSL_cleanse(&pending_snapshot_key, sizeof(pending_snapshot_key));
+}
+
+bool TakePendingSnapshotKey(uint8_t key[kSnapshotKeySize]) {
+  if (!pending_snapshot_key.set) {
+    return false;
+  }
+  memcpy(key, pending_snapshot_key.key, kSnapshotKeySize);
+  DiscardPendingSnapshotKey();
+  return true;
+}
+
+}  // namespace asylo
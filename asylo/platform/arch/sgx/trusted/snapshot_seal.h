@@ -0,0 +1,151 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_ARCH_SGX_TRUSTED_SNAPSHOT_SEAL_H_
+#define ASYLO_PLATFORM_ARCH_SGX_TRUSTED_SNAPSHOT_SEAL_H_
+
+#include <openssl/aead.h>
+#include <cstddef>
+#include <cstdint>
+
+#include "asylo/util/status.h"
+
+namespace asylo {
+
+// Size of the chunks in which sections are sealed and restored. Each chunk is
+// sealed independently under its own nonce.
+constexpr size_t kSnapshotChunkSize = 1 << 20;
+
+// Size of the AES-128-GCM keys, nonces and tags used to seal a snapshot.
+constexpr size_t kSnapshotKeySize = 16;
+constexpr size_t kSnapshotNonceSize = 12;
+constexpr size_t kSnapshotTagSize = 16;
+
+// Size of the buffer holding the state of a SnapshotCipher.
+constexpr size_t kCipherStateBufferSize = 2048;
+
+// Sections of the enclave captured in a snapshot, in the order of their chunk
+// tags in the manifest.
+enum SnapshotSection : uint32_t {
+  kDataSection = 0,
+  kBssSection,
+  kHeapSection,
+  kThreadSection,
+  kStackSection,
+  kNumSnapshotSections
+};
+
+// Header of a snapshot manifest. In untrusted memory, the header is followed
+// by the tag of every chunk of every section, in section order, and then by a
+// tag authenticating the header and all chunk tags.
+struct SnapshotManifestHeader {
+  // Size of the chunks the sections are sealed in.
+  uint64_t chunk_size;
+
+  // Size of each section.
+  uint64_t section_sizes[kNumSnapshotSections];
+};
+
+// Returns the number of chunks a section of |size| bytes is sealed in.
+size_t NumSnapshotChunks(size_t size);
+
+// Returns the size of the manifest of a snapshot described by |header|.
+size_t SnapshotManifestSize(const SnapshotManifestHeader &header);
+
+// Returns the offset of the tags of |section| from the first chunk tag of a
+// manifest described by |header|.
+size_t SnapshotTagsOffset(const SnapshotManifestHeader &header,
+                          SnapshotSection section);
+
+// Copies the header of the |manifest_size| bytes of |manifest| in untrusted
+// memory to |header|, and checks that it describes a snapshot of sections of
+// |section_sizes| bytes sealed in chunks of kSnapshotChunkSize bytes. The
+// manifest is not authenticated.
+Status ReadSnapshotManifestHeader(
+    const uint8_t *manifest, size_t manifest_size,
+    const uint64_t section_sizes[kNumSnapshotSections],
+    SnapshotManifestHeader *header);
+
+// An AES-GCM cipher keyed with a snapshot key.
+//
+// A SnapshotCipher must live on the stack of the thread taking or restoring a
+// snapshot. Its state is allocated from a buffer inside the object instead of
+// the heap, so that the state is neither captured in a snapshot nor
+// overwritten while the heap is restored. Sealing and opening do not allocate
+// memory, and may run on several threads at once.
+class SnapshotCipher {
+ public:
+  SnapshotCipher();
+
+  SnapshotCipher(const SnapshotCipher &other) = delete;
+  SnapshotCipher &operator=(const SnapshotCipher &other) = delete;
+
+  ~SnapshotCipher();
+
+  // Initializes the cipher with the |kSnapshotKeySize| bytes of |key|.
+  Status Init(const uint8_t *key);
+
+  // Seals chunk |chunk| of the |size| bytes of |section| at |source| into
+  // |destination| in untrusted memory, and writes its tag to |tags|.
+  bool SealChunk(uint32_t section, size_t chunk, const uint8_t *source,
+                 size_t size, uint8_t *destination, uint8_t *tags) const;
+
+  // Restores chunk |chunk| of the |size| bytes of |section| at |source| in
+  // untrusted memory into |destination|, authenticating it with its tag in
+  // |tags|. The chunk is copied into the enclave and then opened in place, so
+  // that the host cannot change it while it is being authenticated.
+  bool OpenChunk(uint32_t section, size_t chunk, const uint8_t *source,
+                 size_t size, uint8_t *destination, const uint8_t *tags) const;
+
+  // Writes the manifest tag authenticating |header| and the |tags_size| bytes
+  // of chunk tags at |tags| to |tags| + |tags_size|.
+  bool SealManifest(const SnapshotManifestHeader &header, uint8_t *tags,
+                    size_t tags_size) const;
+
+  // Checks the manifest tag at |tags| + |tags_size| against |header| and the
+  // |tags_size| bytes of chunk tags at |tags|.
+  bool OpenManifest(const SnapshotManifestHeader &header, const uint8_t *tags,
+                    size_t tags_size) const;
+
+ private:
+  alignas(16) uint8_t state_buffer_[kCipherStateBufferSize];
+  EVP_AEAD_CTX context_;
+  bool initialized_;
+};
+
+// The pending snapshot key is the key of the last snapshot taken, until it is
+// transferred to the child enclave, or the key received from the parent
+// enclave, until the snapshot is restored. Each key is used for a single
+// snapshot and is handed over once, so the host can neither pick the key of a
+// snapshot nor restore a snapshot twice.
+//
+// The parent sets the key only after the data and bss sections are sealed, so
+// it is never part of a snapshot.
+
+// Sets the pending snapshot key to the |kSnapshotKeySize| bytes at |key|.
+void SetPendingSnapshotKey(const uint8_t *key);
+
+// Erases the pending snapshot key, if any.
+void DiscardPendingSnapshotKey();
+
+// Moves the pending snapshot key to |key|. Returns false if there is none.
+bool TakePendingSnapshotKey(uint8_t key[kSnapshotKeySize]);
+
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_ARCH_SGX_TRUSTED_SNAPSHOT_SEAL_H_
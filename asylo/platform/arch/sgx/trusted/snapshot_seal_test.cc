@@ -0,0 +1,242 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/arch/sgx/trusted/snapshot_seal.h"
+
+#include <openssl/rand.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/util/status.h"
+
+namespace asylo {
+namespace {
+
+using ::testing::Not;
+
+// Sizes of the sections of the test snapshot. The heap spans several chunks,
+// the last of them partial, and the bss section is empty.
+constexpr uint64_t kSectionSizes[kNumSnapshotSections] = {
+    1000, 0, 2 * kSnapshotChunkSize + 123, 4096, 5000};
+
+// A snapshot sealed to untrusted memory.
+struct SealedSnapshot {
+  std::vector<uint8_t> sections[kNumSnapshotSections];
+  std::vector<uint8_t> manifest;
+};
+
+class SnapshotSealTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_EQ(RAND_bytes(key_, sizeof(key_)), 1);
+    for (int i = 0; i < kNumSnapshotSections; ++i) {
+      plaintext_[i].resize(kSectionSizes[i]);
+      for (size_t j = 0; j < plaintext_[i].size(); ++j) {
+        plaintext_[i][j] = static_cast<uint8_t>(i * 31 + j);
+      }
+    }
+  }
+
+  void TearDown() override { DiscardPendingSnapshotKey(); }
+
+  // Seals the test sections with |key| the way a snapshot is taken for fork.
+  void Seal(const uint8_t *key, SealedSnapshot *snapshot) {
+    SnapshotCipher cipher;
+    ASSERT_THAT(cipher.Init(key), IsOk());
+    SnapshotManifestHeader header;
+    header.chunk_size = kSnapshotChunkSize;
+    memcpy(header.section_sizes, kSectionSizes, sizeof(kSectionSizes));
+    snapshot->manifest.resize(SnapshotManifestSize(header));
+    memcpy(snapshot->manifest.data(), &header, sizeof(header));
+    uint8_t *tags = snapshot->manifest.data() + sizeof(header);
+    for (int i = 0; i < kNumSnapshotSections; ++i) {
+      SnapshotSection section = static_cast<SnapshotSection>(i);
+      snapshot->sections[i].resize(kSectionSizes[i]);
+      for (size_t chunk = 0; chunk < NumSnapshotChunks(kSectionSizes[i]);
+           ++chunk) {
+        ASSERT_TRUE(cipher.SealChunk(
+            section, chunk, plaintext_[i].data(), kSectionSizes[i],
+            snapshot->sections[i].data(),
+            tags + SnapshotTagsOffset(header, section)));
+      }
+    }
+    size_t tags_size =
+        snapshot->manifest.size() - sizeof(header) - kSnapshotTagSize;
+    ASSERT_TRUE(cipher.SealManifest(header, tags, tags_size));
+  }
+
+  // Checks the manifest of |snapshot| with |key| and restores its sections to
+  // |restored| the way a snapshot is restored for fork. Returns a non-OK
+  // status if the manifest or any chunk cannot be authenticated.
+  Status Restore(const uint8_t *key, const SealedSnapshot &snapshot,
+                 std::vector<uint8_t> restored[kNumSnapshotSections]) {
+    SnapshotManifestHeader header;
+    Status status = ReadSnapshotManifestHeader(snapshot.manifest.data(),
+                                               snapshot.manifest.size(),
+                                               kSectionSizes, &header);
+    if (!status.ok()) {
+      return status;
+    }
+    SnapshotCipher cipher;
+    status = cipher.Init(key);
+    if (!status.ok()) {
+      return status;
+    }
+    const uint8_t *tags = snapshot.manifest.data() + sizeof(header);
+    size_t tags_size =
+        snapshot.manifest.size() - sizeof(header) - kSnapshotTagSize;
+    if (!cipher.OpenManifest(header, tags, tags_size)) {
+      return Status(error::GoogleError::INTERNAL,
+                    "Failed to authenticate the manifest");
+    }
+    for (int i = 0; i < kNumSnapshotSections; ++i) {
+      SnapshotSection section = static_cast<SnapshotSection>(i);
+      restored[i].resize(kSectionSizes[i]);
+      for (size_t chunk = 0; chunk < NumSnapshotChunks(kSectionSizes[i]);
+           ++chunk) {
+        if (!cipher.OpenChunk(section, chunk, snapshot.sections[i].data(),
+                              kSectionSizes[i], restored[i].data(),
+                              tags + SnapshotTagsOffset(header, section))) {
+          return Status(error::GoogleError::INTERNAL,
+                        "Failed to authenticate a chunk");
+        }
+      }
+    }
+    return Status::OkStatus();
+  }
+
+  uint8_t key_[kSnapshotKeySize];
+  std::vector<uint8_t> plaintext_[kNumSnapshotSections];
+};
+
+TEST_F(SnapshotSealTest, RestoresSealedSnapshot) {
+  SealedSnapshot snapshot;
+  ASSERT_NO_FATAL_FAILURE(Seal(key_, &snapshot));
+  EXPECT_NE(snapshot.sections[kHeapSection], plaintext_[kHeapSection]);
+
+  std::vector<uint8_t> restored[kNumSnapshotSections];
+  ASSERT_THAT(Restore(key_, snapshot, restored), IsOk());
+  for (int i = 0; i < kNumSnapshotSections; ++i) {
+    EXPECT_EQ(restored[i], plaintext_[i]) << "section " << i;
+  }
+}
+
+TEST_F(SnapshotSealTest, RejectsTamperedChunk) {
+  SealedSnapshot snapshot;
+  ASSERT_NO_FATAL_FAILURE(Seal(key_, &snapshot));
+  snapshot.sections[kHeapSection][kSnapshotChunkSize + 7] ^= 1;
+
+  std::vector<uint8_t> restored[kNumSnapshotSections];
+  EXPECT_THAT(Restore(key_, snapshot, restored), Not(IsOk()));
+}
+
+TEST_F(SnapshotSealTest, RejectsReorderedChunks) {
+  SealedSnapshot snapshot;
+  ASSERT_NO_FATAL_FAILURE(Seal(key_, &snapshot));
+  std::vector<uint8_t> &heap = snapshot.sections[kHeapSection];
+  std::swap_ranges(heap.begin(), heap.begin() + kSnapshotChunkSize,
+                   heap.begin() + kSnapshotChunkSize);
+
+  std::vector<uint8_t> restored[kNumSnapshotSections];
+  EXPECT_THAT(Restore(key_, snapshot, restored), Not(IsOk()));
+}
+
+TEST_F(SnapshotSealTest, RejectsTamperedChunkTag) {
+  SealedSnapshot snapshot;
+  ASSERT_NO_FATAL_FAILURE(Seal(key_, &snapshot));
+  snapshot.manifest[sizeof(SnapshotManifestHeader)] ^= 1;
+
+  std::vector<uint8_t> restored[kNumSnapshotSections];
+  EXPECT_THAT(Restore(key_, snapshot, restored), Not(IsOk()));
+}
+
+TEST_F(SnapshotSealTest, RejectsTamperedManifestTag) {
+  SealedSnapshot snapshot;
+  ASSERT_NO_FATAL_FAILURE(Seal(key_, &snapshot));
+  snapshot.manifest.back() ^= 1;
+
+  std::vector<uint8_t> restored[kNumSnapshotSections];
+  EXPECT_THAT(Restore(key_, snapshot, restored), Not(IsOk()));
+}
+
+TEST_F(SnapshotSealTest, RejectsManifestOfOtherLayout) {
+  SealedSnapshot snapshot;
+  ASSERT_NO_FATAL_FAILURE(Seal(key_, &snapshot));
+  SnapshotManifestHeader header;
+
+  uint64_t section_sizes[kNumSnapshotSections];
+  memcpy(section_sizes, kSectionSizes, sizeof(section_sizes));
+  section_sizes[kStackSection] += 1;
+  EXPECT_THAT(
+      ReadSnapshotManifestHeader(snapshot.manifest.data(),
+                                 snapshot.manifest.size(), section_sizes,
+                                 &header),
+      Not(IsOk()));
+
+  // A manifest truncated by one tag.
+  EXPECT_THAT(ReadSnapshotManifestHeader(
+                  snapshot.manifest.data(),
+                  snapshot.manifest.size() - kSnapshotTagSize, kSectionSizes,
+                  &header),
+              Not(IsOk()));
+
+  // A manifest too small to hold its header.
+  EXPECT_THAT(ReadSnapshotManifestHeader(snapshot.manifest.data(),
+                                         sizeof(header), kSectionSizes,
+                                         &header),
+              Not(IsOk()));
+}
+
+TEST_F(SnapshotSealTest, RejectsOtherKey) {
+  SealedSnapshot snapshot;
+  ASSERT_NO_FATAL_FAILURE(Seal(key_, &snapshot));
+  uint8_t other_key[kSnapshotKeySize];
+  memcpy(other_key, key_, sizeof(other_key));
+  other_key[0] ^= 1;
+
+  std::vector<uint8_t> restored[kNumSnapshotSections];
+  EXPECT_THAT(Restore(other_key, snapshot, restored), Not(IsOk()));
+}
+
+TEST_F(SnapshotSealTest, PendingKeyIsTakenOnce) {
+  uint8_t key[kSnapshotKeySize];
+  EXPECT_FALSE(TakePendingSnapshotKey(key));
+
+  SetPendingSnapshotKey(key_);
+  ASSERT_TRUE(TakePendingSnapshotKey(key));
+  EXPECT_EQ(memcmp(key, key_, sizeof(key)), 0);
+
+  // The key is used up, so a second restore of the snapshot finds no key.
+  EXPECT_FALSE(TakePendingSnapshotKey(key));
+}
+
+TEST_F(SnapshotSealTest, DiscardedKeyCannotBeTaken) {
+  SetPendingSnapshotKey(key_);
+  DiscardPendingSnapshotKey();
+
+  uint8_t key[kSnapshotKeySize];
+  EXPECT_FALSE(TakePendingSnapshotKey(key));
+}
+
+}  // namespace
+}  // namespace asylo
@@ -0,0 +1,209 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/arch/sgx/untrusted/epoll_agent.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+
+#include "absl/time/time.h"
+#include "asylo/platform/common/bridge_functions.h"
+
+namespace asylo {
+
+std::unique_ptr<EpollAgent> EpollAgent::Create(int epfd, EpollRing *ring) {
+  if (!ring || ring->events.InstanceVersion() !=
+                   decltype(ring->events)::TypeVersion()) {
+    return nullptr;
+  }
+  int wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd < 0) {
+    return nullptr;
+  }
+  struct epoll_event wake_event;
+  wake_event.events = EPOLLIN;
+  wake_event.data.u64 = EpollRing::kAgentWakeKey;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, wake_fd, &wake_event) != 0) {
+    close(wake_fd);
+    return nullptr;
+  }
+  return std::unique_ptr<EpollAgent>(new EpollAgent(epfd, wake_fd, ring));
+}
+
+EpollAgent::EpollAgent(int epfd, int wake_fd, EpollRing *ring)
+    : epfd_(epfd),
+      wake_fd_(wake_fd),
+      ring_(ring),
+      stopping_(false),
+      waiters_(0),
+      polls_(0) {
+  thread_ = std::thread(&EpollAgent::Run, this);
+}
+
+EpollAgent::~EpollAgent() {
+  Stop();
+  {
+    absl::MutexLock lock(&mu_);
+    while (waiters_ > 0) {
+      cond_.Wait(&mu_);
+    }
+  }
+  thread_.join();
+  // Closing the eventfd also removes it from the instance.
+  close(wake_fd_);
+}
+
+void EpollAgent::Stop() {
+  {
+    absl::MutexLock lock(&mu_);
+    stopping_ = true;
+    cond_.SignalAll();
+  }
+  Wake();
+}
+
+void EpollAgent::Wait(int timeout) {
+  if (timeout == 0) {
+    {
+      absl::MutexLock lock(&mu_);
+      ++waiters_;
+      ++polls_;
+    }
+    // A blocking harvest gives up once it sees the poll, so the poll reads
+    // the instance itself right away.
+    Wake();
+    {
+      absl::MutexLock harvest_lock(&harvest_mu_);
+      if (!stopping_) {
+        Harvest(/*block=*/false);
+      }
+    }
+    absl::MutexLock lock(&mu_);
+    --polls_;
+    --waiters_;
+    // Let the agent resume the harvest it gave up, or the destructor proceed.
+    cond_.SignalAll();
+    return;
+  }
+
+  absl::Time deadline = timeout < 0 ? absl::InfiniteFuture()
+                                    : absl::Now() + absl::Milliseconds(timeout);
+  bool last_blocked_waiter;
+  {
+    absl::MutexLock lock(&mu_);
+    // Wake the agent to pick up the harvest request.
+    cond_.SignalAll();
+    ++waiters_;
+    while (ring_->events.empty() && !stopping_) {
+      if (cond_.WaitWithDeadline(&mu_, deadline)) {
+        break;
+      }
+    }
+    --waiters_;
+    last_blocked_waiter = waiters_ == polls_;
+    if (waiters_ == 0 && stopping_) {
+      cond_.SignalAll();
+    }
+  }
+  // No thread is left to consume a harvest, so the agent stops waiting on the
+  // instance rather than harvest events ahead of the next wait.
+  if (last_blocked_waiter) {
+    Wake();
+  }
+}
+
+bool EpollAgent::WaitForRequest() {
+  absl::MutexLock lock(&mu_);
+  while (!stopping_) {
+    // A request made by a waiter which has since given up is dropped.
+    if (polls_ == 0 && ring_->harvest_requested.exchange(0) != 0 &&
+        waiters_ > 0) {
+      return true;
+    }
+    cond_.Wait(&mu_);
+  }
+  return false;
+}
+
+bool EpollAgent::KeepHarvesting() {
+  absl::MutexLock lock(&mu_);
+  return !stopping_ && polls_ == 0 && waiters_ > 0;
+}
+
+void EpollAgent::Wake() {
+  uint64_t value = 1;
+  while (write(wake_fd_, &value, sizeof(value)) < 0 && errno == EINTR) {
+  }
+}
+
+void EpollAgent::Harvest(bool block) {
+  // Events left in the ring have not been consumed yet. Harvesting again
+  // would report level-triggered events twice.
+  if (!ring_->events.empty()) {
+    return;
+  }
+  struct epoll_event events[EpollRing::kMaxEvents];
+  bridge_epoll_event records[EpollRing::kMaxEvents];
+  int num_records = 0;
+  do {
+    int num_events =
+        epoll_wait(epfd_, events, EpollRing::kMaxEvents, block ? -1 : 0);
+    if (num_events < 0 && errno != EINTR) {
+      return;
+    }
+    for (int i = 0; i < num_events; ++i) {
+      if (events[i].data.u64 == EpollRing::kAgentWakeKey) {
+        uint64_t value;
+        while (read(wake_fd_, &value, sizeof(value)) < 0 && errno == EINTR) {
+        }
+        continue;
+      }
+      records[num_records].events = ToBridgeEpollEvents(events[i].events);
+      records[num_records].data = events[i].data.u64;
+      ++num_records;
+    }
+  } while (num_records == 0 && block && KeepHarvesting());
+  if (num_records == 0) {
+    return;
+  }
+
+  absl::MutexLock lock(&mu_);
+  ring_->events.Write(reinterpret_cast<const uint8_t *>(records),
+                      num_records * sizeof(bridge_epoll_event));
+  cond_.SignalAll();
+}
+
+void EpollAgent::Run() {
+  while (WaitForRequest()) {
+    {
+      absl::MutexLock lock(&harvest_mu_);
+      Harvest(/*block=*/true);
+    }
+    // A harvest given up for a poll is resumed once the poll is done, if the
+    // poll found no events for the threads still waiting.
+    absl::MutexLock lock(&mu_);
+    if (ring_->events.empty() && waiters_ > polls_ && !stopping_) {
+      ring_->harvest_requested.store(1);
+    }
+  }
+}
+
+}  // namespace asylo
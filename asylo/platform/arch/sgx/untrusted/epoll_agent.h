@@ -0,0 +1,120 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_ARCH_SGX_UNTRUSTED_EPOLL_AGENT_H_
+#define ASYLO_PLATFORM_ARCH_SGX_UNTRUSTED_EPOLL_AGENT_H_
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/platform/common/epoll_ring.h"
+
+namespace asylo {
+
+// A host thread waiting on an epoll instance on behalf of the enclave. When a
+// caller of Wait() has found the ring empty and requested a harvest, the agent
+// waits for events on the instance and writes them to an EpollRing the enclave
+// reads without leaving the enclave.
+//
+// The agent only waits on the instance while a caller of Wait() is blocked for
+// events, so events are harvested when the enclave asks for them rather than
+// ahead of time, when a level-triggered event could be handled before it is
+// read and reported stale. Between requests the agent sleeps until Wait()
+// signals it.
+//
+// The agent adds an eventfd to the instance, used to interrupt its wait on the
+// instance, under the key EpollRing::kAgentWakeKey.
+class EpollAgent {
+ public:
+  // Starts an agent harvesting the events of the epoll instance |epfd| into
+  // |ring|. Returns nullptr if |ring| does not have the expected layout, or if
+  // the agent fails to add its eventfd to the instance.
+  static std::unique_ptr<EpollAgent> Create(int epfd, EpollRing *ring);
+
+  // Stops the agent, and waits for its thread and for every caller of Wait()
+  // to return.
+  ~EpollAgent();
+
+  // Stops harvesting and wakes every caller of Wait(), without waiting for
+  // them to return. Later calls to Wait() return immediately.
+  void Stop() LOCKS_EXCLUDED(mu_);
+
+  EpollAgent(const EpollAgent &other) = delete;
+  EpollAgent &operator=(const EpollAgent &other) = delete;
+
+  // Blocks until the ring holds events, or |timeout| milliseconds elapse. A
+  // negative |timeout| waits indefinitely. A zero |timeout| harvests the
+  // events ready on the instance without blocking, interrupting a harvest in
+  // progress so that the poll sees every event ready when it is made.
+  void Wait(int timeout) LOCKS_EXCLUDED(mu_, harvest_mu_);
+
+ private:
+  EpollAgent(int epfd, int wake_fd, EpollRing *ring);
+
+  // Harvests events each time the enclave requests it, until the agent stops.
+  void Run();
+
+  // Waits for the enclave to request a harvest. Returns false if the agent is
+  // stopping.
+  bool WaitForRequest() LOCKS_EXCLUDED(mu_);
+
+  // Returns true while a blocking harvest should go on waiting for events.
+  bool KeepHarvesting() LOCKS_EXCLUDED(mu_);
+
+  // Interrupts a wait on the instance.
+  void Wake();
+
+  // Writes the events ready on the epoll instance to the ring, if it is empty.
+  // If |block| is true, waits for events while KeepHarvesting() holds.
+  void Harvest(bool block) EXCLUSIVE_LOCKS_REQUIRED(harvest_mu_)
+      LOCKS_EXCLUDED(mu_);
+
+  const int epfd_;
+
+  // Eventfd in the instance, written to interrupt a wait on the instance.
+  const int wake_fd_;
+
+  EpollRing *const ring_;
+
+  // Held while waiting on the epoll instance, so events are harvested into
+  // the ring by one thread at a time and none is reported twice.
+  absl::Mutex harvest_mu_ ACQUIRED_BEFORE(mu_);
+
+  absl::Mutex mu_;
+
+  // Signaled when events are written to the ring, when the enclave waits for
+  // events, and when the agent stops.
+  absl::CondVar cond_;
+
+  std::atomic<bool> stopping_;
+
+  // Number of threads in Wait().
+  int waiters_ GUARDED_BY(mu_);
+
+  // Number of threads in Wait() with a zero timeout.
+  int polls_ GUARDED_BY(mu_);
+
+  std::thread thread_;
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_ARCH_SGX_UNTRUSTED_EPOLL_AGENT_H_
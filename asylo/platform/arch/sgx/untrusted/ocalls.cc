@@ -48,9 +48,12 @@
 #include <cstdio>
 #include <cstdlib>
 #include <ctime>
+#include <thread>
+#include <vector>
 
 #include "absl/memory/memory.h"
 #include "asylo/enclave.pb.h"
+#include "asylo/platform/arch/sgx/untrusted/epoll_agent.h"
 #include "asylo/platform/arch/sgx/untrusted/generated_bridge_u.h"
 #include "asylo/platform/arch/sgx/untrusted/sgx_client.h"
 #include "asylo/platform/common/bridge_functions.h"
@@ -119,6 +122,92 @@ void HandleSignalInSim(int signum, siginfo_t *info, void *ucontext) {
   }
 }
 
+// Converts the |vlen| bridge messages of |msgvec| to the host messages |msgs|,
+// whose scatter/gather arrays are stored in |iovs|. Returns false if any
+// message fails to convert.
+bool FromBridgeMMsgHdrs(const struct bridge_mmsghdr *msgvec, uint32_t vlen,
+                        std::vector<struct mmsghdr> *msgs,
+                        std::vector<struct iovec> *iovs) {
+  size_t total_iovlen = 0;
+  for (uint32_t i = 0; i < vlen; ++i) {
+    total_iovlen += msgvec[i].msg_hdr.msg_iovlen;
+  }
+  // Reserve up front so that pointers into |iovs| stay valid.
+  iovs->reserve(total_iovlen);
+  msgs->resize(vlen);
+  for (uint32_t i = 0; i < vlen; ++i) {
+    const struct bridge_msghdr *bridge_msg = &msgvec[i].msg_hdr;
+    struct msghdr *msg = &(*msgs)[i].msg_hdr;
+    if (!asylo::FromBridgeMsgHdr(bridge_msg, msg)) {
+      return false;
+    }
+    size_t first = iovs->size();
+    for (uint64_t j = 0; j < bridge_msg->msg_iovlen; ++j) {
+      struct iovec iov;
+      if (!asylo::FromBridgeIovec(&bridge_msg->msg_iov[j], &iov)) {
+        return false;
+      }
+      iovs->push_back(iov);
+    }
+    msg->msg_iov = iovs->data() + first;
+    (*msgs)[i].msg_len = 0;
+  }
+  return true;
+}
+
+// Host threads donated to an enclave taking or restoring a snapshot. A
+// SnapshotWorkers is in scope on the thread entering the enclave for that, and
+// its threads are joined when it goes out of scope.
+class SnapshotWorkers {
+ public:
+  explicit SnapshotWorkers(asylo::SgxClient *client)
+      : client_(client), previous_(current_) {
+    current_ = this;
+  }
+
+  ~SnapshotWorkers() {
+    Join();
+    current_ = previous_;
+  }
+
+  SnapshotWorkers(const SnapshotWorkers &other) = delete;
+  SnapshotWorkers &operator=(const SnapshotWorkers &other) = delete;
+
+  // Returns the SnapshotWorkers in scope on the calling thread, or nullptr.
+  static SnapshotWorkers *Current() { return current_; }
+
+  // Starts up to |count| threads entering the enclave to work on the snapshot.
+  // The thread in the enclave works on it as well, so no more threads are
+  // started than there are other processors.
+  void Start(int count) {
+    int processors = static_cast<int>(std::thread::hardware_concurrency());
+    if (processors > 0) {
+      count = std::min(count, processors - 1);
+    }
+    asylo::SgxClient *client = client_;
+    for (int i = 0; i < count; ++i) {
+      threads_.emplace_back([client] { client->EnterAndRunSnapshotWorker(); });
+    }
+  }
+
+  // Waits for the started threads to leave the enclave.
+  void Join() {
+    for (std::thread &thread : threads_) {
+      thread.join();
+    }
+    threads_.clear();
+  }
+
+ private:
+  static thread_local SnapshotWorkers *current_;
+
+  asylo::SgxClient *const client_;
+  SnapshotWorkers *const previous_;
+  std::vector<std::thread> threads_;
+};
+
+thread_local SnapshotWorkers *SnapshotWorkers::current_ = nullptr;
+
 }  // namespace
 
 // Threading implementation-defined untrusted thread donate routine.
@@ -242,6 +331,22 @@ bridge_ssize_t ocall_enc_untrusted_read_with_untrusted_ptr(int fd, void *buf,
   return static_cast<bridge_ssize_t>(read(fd, buf, size));
 }
 
+bridge_ssize_t ocall_enc_untrusted_send_with_untrusted_ptr(int sockfd,
+                                                           const void *buf,
+                                                           bridge_size_t len,
+                                                           int flags) {
+  return static_cast<bridge_ssize_t>(
+      send(sockfd, buf, static_cast<size_t>(len), flags));
+}
+
+bridge_ssize_t ocall_enc_untrusted_recv_with_untrusted_ptr(int sockfd,
+                                                           void *buf,
+                                                           bridge_size_t len,
+                                                           int flags) {
+  return static_cast<bridge_ssize_t>(
+      recv(sockfd, buf, static_cast<size_t>(len), flags));
+}
+
 //////////////////////////////////////
 //             Sockets              //
 //////////////////////////////////////
@@ -337,6 +442,43 @@ bridge_ssize_t ocall_enc_untrusted_recvmsg(int sockfd,
   return ret;
 }
 
+int ocall_enc_untrusted_sendmmsg(int sockfd, struct bridge_mmsghdr *msgvec,
+                                 uint32_t vlen, int flags) {
+  std::vector<struct mmsghdr> msgs;
+  std::vector<struct iovec> iovs;
+  if (!FromBridgeMMsgHdrs(msgvec, vlen, &msgs, &iovs)) {
+    errno = EFAULT;
+    return -1;
+  }
+  int ret = sendmmsg(sockfd, msgs.data(), vlen, flags);
+  for (int i = 0; i < ret; ++i) {
+    msgvec[i].msg_len = msgs[i].msg_len;
+  }
+  return ret;
+}
+
+int ocall_enc_untrusted_recvmmsg(int sockfd, struct bridge_mmsghdr *msgvec,
+                                 uint32_t vlen, int flags,
+                                 const struct bridge_timespec *timeout) {
+  std::vector<struct mmsghdr> msgs;
+  std::vector<struct iovec> iovs;
+  if (!FromBridgeMMsgHdrs(msgvec, vlen, &msgs, &iovs)) {
+    errno = EFAULT;
+    return -1;
+  }
+  struct timespec tmp_timeout;
+  int ret = recvmmsg(
+      sockfd, msgs.data(), vlen, flags,
+      timeout ? asylo::FromBridgeTimespec(timeout, &tmp_timeout) : nullptr);
+  for (int i = 0; i < ret; ++i) {
+    msgvec[i].msg_len = msgs[i].msg_len;
+    msgvec[i].msg_hdr.msg_namelen = msgs[i].msg_hdr.msg_namelen;
+    msgvec[i].msg_hdr.msg_controllen = msgs[i].msg_hdr.msg_controllen;
+    msgvec[i].msg_hdr.msg_flags = msgs[i].msg_hdr.msg_flags;
+  }
+  return ret;
+}
+
 char *ocall_enc_untrusted_inet_ntop(int af, const void *src,
                                     bridge_size_t src_size, char *dst,
                                     bridge_size_t buf_size) {
@@ -546,6 +688,28 @@ int ocall_enc_untrusted_epoll_wait(const char *serialized_args,
   return ret;
 }
 
+void *ocall_enc_untrusted_epoll_agent_start(int epfd, void *ring) {
+  std::unique_ptr<asylo::EpollAgent> agent =
+      asylo::EpollAgent::Create(epfd, static_cast<asylo::EpollRing *>(ring));
+  if (!agent) {
+    errno = EINVAL;
+    return nullptr;
+  }
+  return agent.release();
+}
+
+void ocall_enc_untrusted_epoll_agent_wait(void *agent, int timeout) {
+  static_cast<asylo::EpollAgent *>(agent)->Wait(timeout);
+}
+
+void ocall_enc_untrusted_epoll_agent_stop(void *agent) {
+  static_cast<asylo::EpollAgent *>(agent)->Stop();
+}
+
+void ocall_enc_untrusted_epoll_agent_destroy(void *agent) {
+  delete static_cast<asylo::EpollAgent *>(agent);
+}
+
 //////////////////////////////////////
 //           inotify.h              //
 //////////////////////////////////////
@@ -940,8 +1104,11 @@ pid_t ocall_enc_untrusted_fork(const char *enclave_name,
   // current enclave memory.
   void *enclave_base_address = client->base_address();
   asylo::SnapshotLayout snapshot_layout;
-  asylo::Status status =
-      manager->EnterAndTakeSnapshot(client, &snapshot_layout);
+  asylo::Status status;
+  {
+    SnapshotWorkers workers(client);
+    status = manager->EnterAndTakeSnapshot(client, &snapshot_layout);
+  }
   if (!status.ok()) {
     LOG(ERROR) << "EnterAndTakeSnapshot failed: " << status;
     errno = ENOMEM;
@@ -960,52 +1127,110 @@ pid_t ocall_enc_untrusted_fork(const char *enclave_name,
       snapshot_layout.thread_base()));
   asylo::MallocUniquePtr<void> snapshot_stack_deleter(reinterpret_cast<void *>(
       snapshot_layout.stack_base()));
+  asylo::MallocUniquePtr<void> snapshot_manifest_deleter(
+      reinterpret_cast<void *>(snapshot_layout.manifest_base()));
 
   asylo::SgxLoader *loader =
       dynamic_cast<asylo::SgxLoader *>(manager->GetLoaderFromClient(client));
 
+  // The parent enclave transfers the key of the snapshot to the child enclave
+  // over a socket pair.
+  int socket_pair[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, socket_pair) == -1) {
+    return -1;
+  }
+
   pid_t pid = fork();
   if (pid == -1) {
+    close(socket_pair[0]);
+    close(socket_pair[1]);
+    return pid;
+  }
+
+  if (pid != 0) {
+    close(socket_pair[1]);
+    asylo::ForkHandshakeConfig fork_handshake_config;
+    fork_handshake_config.set_is_parent(true);
+    fork_handshake_config.set_socket(socket_pair[0]);
+    status = manager->EnterAndTransferSecureSnapshotKey(client,
+                                                        fork_handshake_config);
+    close(socket_pair[0]);
+    if (!status.ok()) {
+      // The child enclave cannot restore the snapshot without the key, and
+      // fails to fork.
+      LOG(ERROR) << "EnterAndTransferSecureSnapshotKey failed: " << status;
+    }
     return pid;
   }
 
+  close(socket_pair[0]);
   size_t enclave_size = client->size();
 
   asylo::EnclaveConfig config;
   config.set_enable_fork(true);
-  if (pid == 0) {
-    // Load an enclave at the same virtual space as the parent.
-    status = manager->LoadEnclave(enclave_name, *loader, config,
-                                  enclave_base_address, enclave_size);
-    if (!status.ok()) {
-      LOG(ERROR) << "Load new enclave failed:" << status;
-      errno = ENOMEM;
-      return -1;
-    }
+  // Load an enclave at the same virtual space as the parent.
+  status = manager->LoadEnclave(enclave_name, *loader, config,
+                                enclave_base_address, enclave_size);
+  if (!status.ok()) {
+    LOG(ERROR) << "Load new enclave failed:" << status;
+    close(socket_pair[1]);
+    errno = ENOMEM;
+    return -1;
+  }
 
-    // Verifies that the new enclave is loaded at the same virtual address space
-    // as the parent enclave.
-    client = dynamic_cast<asylo::SgxClient *>(manager->GetClient(enclave_name));
-    void *child_enclave_base_address = client->base_address();
-    if (child_enclave_base_address != enclave_base_address) {
-      LOG(ERROR) << "New enclave address: " << child_enclave_base_address
-                 << " is different from the parent enclave address: "
-                 << enclave_base_address;
-      errno = EAGAIN;
-      return -1;
-    }
+  // Verifies that the new enclave is loaded at the same virtual address space
+  // as the parent enclave.
+  client = dynamic_cast<asylo::SgxClient *>(manager->GetClient(enclave_name));
+  void *child_enclave_base_address = client->base_address();
+  if (child_enclave_base_address != enclave_base_address) {
+    LOG(ERROR) << "New enclave address: " << child_enclave_base_address
+               << " is different from the parent enclave address: "
+               << enclave_base_address;
+    close(socket_pair[1]);
+    errno = EAGAIN;
+    return -1;
+  }
 
-    // Enters the child enclave and restore the enclave memory.
+  // Receives the snapshot key from the parent enclave.
+  asylo::ForkHandshakeConfig fork_handshake_config;
+  fork_handshake_config.set_is_parent(false);
+  fork_handshake_config.set_socket(socket_pair[1]);
+  status = manager->EnterAndTransferSecureSnapshotKey(client,
+                                                      fork_handshake_config);
+  close(socket_pair[1]);
+  if (!status.ok()) {
+    LOG(ERROR) << "EnterAndTransferSecureSnapshotKey failed: " << status;
+    errno = EAGAIN;
+    return -1;
+  }
+
+  // Enters the child enclave and restore the enclave memory.
+  {
+    SnapshotWorkers workers(client);
     status = manager->EnterAndRestore(client, snapshot_layout);
-    if (!status.ok()) {
-      LOG(ERROR) << "EnterAndRestore failed: " << status;
-      errno = EAGAIN;
-      return -1;
-    }
+  }
+  if (!status.ok()) {
+    LOG(ERROR) << "EnterAndRestore failed: " << status;
+    errno = EAGAIN;
+    return -1;
   }
   return pid;
 }
 
+void ocall_enc_untrusted_start_snapshot_workers(int count) {
+  SnapshotWorkers *workers = SnapshotWorkers::Current();
+  if (workers) {
+    workers->Start(count);
+  }
+}
+
+void ocall_enc_untrusted_join_snapshot_workers() {
+  SnapshotWorkers *workers = SnapshotWorkers::Current();
+  if (workers) {
+    workers->Join();
+  }
+}
+
 //////////////////////////////////////
 //             wait.h               //
 //////////////////////////////////////
@@ -21,15 +21,18 @@
 #include <cstdint>
 #include <string>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/types/span.h"
 #include "asylo/util/logging.h"
 #include "asylo/platform/arch/sgx/sgx_error_space.h"
 #include "asylo/platform/arch/sgx/untrusted/generated_bridge_u.h"
 #include "asylo/platform/common/bridge_functions.h"
 #include "asylo/platform/common/bridge_types.h"
+#include "asylo/platform/common/call_metrics.h"
 #include "asylo/util/elf_reader.h"
 #include "asylo/util/file_mapping.h"
 #include "asylo/util/posix_error_space.h"
@@ -42,6 +45,48 @@ constexpr absl::string_view kCallingProcessBinaryFile = "/proc/self/exe";
 
 constexpr int kMaxEnclaveCreateAttempts = 5;
 
+// Returns the counter for calls to the ecall named |name|.
+CallCounter *GetEcallCounter(const char *name) {
+  return CallMetricsRegistry::GetInstance()->GetCounter(CallMetric::ECALL,
+                                                        name);
+}
+
+// Returns the contents of the section |section_name| of the binary of the
+// calling process. The binary is mapped into memory once, and the mapping is
+// shared by every enclave loaded from it, so that enclaves loaded concurrently
+// do not each map and parse the binary.
+StatusOr<absl::Span<const uint8_t>> GetSelfBinarySection(
+    const std::string &section_name) {
+  static absl::Mutex *mu = new absl::Mutex();
+  static FileMapping *self_binary_mapping = nullptr;
+  static auto *sections =
+      new absl::flat_hash_map<std::string, absl::Span<const uint8_t>>();
+
+  absl::MutexLock lock(mu);
+  auto it = sections->find(section_name);
+  if (it != sections->end()) {
+    return it->second;
+  }
+
+  if (!self_binary_mapping) {
+    FileMapping mapping;
+    ASYLO_ASSIGN_OR_RETURN(
+        mapping, FileMapping::CreateFromFile(kCallingProcessBinaryFile));
+    self_binary_mapping = new FileMapping(std::move(mapping));
+  }
+
+  ElfReader self_binary_reader;
+  ASYLO_ASSIGN_OR_RETURN(
+      self_binary_reader,
+      ElfReader::CreateFromSpan(self_binary_mapping->buffer()));
+
+  absl::Span<const uint8_t> section;
+  ASYLO_ASSIGN_OR_RETURN(section,
+                         self_binary_reader.GetSectionData(section_name));
+  sections->emplace(section_name, section);
+  return section;
+}
+
 }  // namespace
 
 
@@ -55,6 +100,8 @@ static Status initialize(sgx_enclave_id_t eid, const char *name,
                          size_t *output_len) {
   int result;
   bridge_size_t bridge_output_len;
+  static CallCounter *const call_counter = GetEcallCounter("ecall_initialize");
+  ScopedCallTimer call_timer(call_counter);
   sgx_status_t sgx_status = ecall_initialize(
       eid, &result, name, input, static_cast<bridge_size_t>(input_len), output,
       &bridge_output_len);
@@ -82,6 +129,8 @@ static Status run(sgx_enclave_id_t eid, const char *input, size_t input_len,
                   char **output, size_t *output_len) {
   int result;
   bridge_size_t bridge_output_len;
+  static CallCounter *const call_counter = GetEcallCounter("ecall_run");
+  ScopedCallTimer call_timer(call_counter);
   sgx_status_t sgx_status =
       ecall_run(eid, &result, input, static_cast<bridge_size_t>(input_len),
                 output, &bridge_output_len);
@@ -110,6 +159,8 @@ static Status finalize(sgx_enclave_id_t eid, const char *input,
                        size_t input_len, char **output, size_t *output_len) {
   int result;
   bridge_size_t bridge_output_len;
+  static CallCounter *const call_counter = GetEcallCounter("ecall_finalize");
+  ScopedCallTimer call_timer(call_counter);
   sgx_status_t sgx_status =
       ecall_finalize(eid, &result, input, static_cast<bridge_size_t>(input_len),
                      output, &bridge_output_len);
@@ -174,6 +225,9 @@ static Status take_snapshot(sgx_enclave_id_t eid, char **output,
                             size_t *output_len) {
   int result;
   bridge_size_t bridge_output_len;
+  static CallCounter *const call_counter =
+      GetEcallCounter("ecall_take_snapshot");
+  ScopedCallTimer call_timer(call_counter);
   sgx_status_t sgx_status =
       ecall_take_snapshot(eid, &result, output, &bridge_output_len);
   if (output_len) {
@@ -199,6 +253,8 @@ static Status restore(sgx_enclave_id_t eid, const char *input, size_t input_len,
                       char **output, size_t *output_len) {
   int result;
   bridge_size_t bridge_output_len;
+  static CallCounter *const call_counter = GetEcallCounter("ecall_restore");
+  ScopedCallTimer call_timer(call_counter);
   sgx_status_t sgx_status =
       ecall_restore(eid, &result, input, static_cast<bridge_size_t>(input_len),
                     output, &bridge_output_len);
@@ -226,6 +282,9 @@ static Status transfer_secure_snapshot_key(sgx_enclave_id_t eid,
                                            char **output, size_t *output_len) {
   int result;
   bridge_size_t bridge_output_len;
+  static CallCounter *const call_counter =
+      GetEcallCounter("ecall_transfer_secure_snapshot_key");
+  ScopedCallTimer call_timer(call_counter);
   sgx_status_t sgx_status = ecall_transfer_secure_snapshot_key(
       eid, &result, input, static_cast<bridge_size_t>(input_len), output,
       &bridge_output_len);
@@ -244,6 +303,29 @@ static Status transfer_secure_snapshot_key(sgx_enclave_id_t eid,
   return Status::OkStatus();
 }
 
+// Enters the enclave and invokes the call metrics entry-point. If the ecall
+// fails, return a non-OK status.
+static Status get_call_metrics(sgx_enclave_id_t eid, char **output,
+                               size_t *output_len) {
+  int result;
+  bridge_size_t bridge_output_len;
+  sgx_status_t sgx_status =
+      ecall_get_call_metrics(eid, &result, output, &bridge_output_len);
+  if (output_len) {
+    *output_len = static_cast<size_t>(bridge_output_len);
+  }
+  if (sgx_status != SGX_SUCCESS) {
+    // Return a Status object in the SGX error space.
+    return Status(sgx_status, "Call to ecall_get_call_metrics failed");
+  } else if (result || *output_len == 0) {
+    // Ecall succeeded but did not return a value. This indicates that the
+    // trusted code failed to propagate error information over the enclave
+    // boundary.
+    return Status(error::GoogleError::INTERNAL, "No output from enclave");
+  }
+  return Status::OkStatus();
+}
+
 StatusOr<std::unique_ptr<EnclaveClient>> SgxLoader::LoadEnclave(
     const std::string &name, void *base_address, const size_t enclave_size,
     const EnclaveConfig &config) const {
@@ -289,17 +371,8 @@ StatusOr<std::unique_ptr<EnclaveClient>> SgxEmbeddedLoader::LoadEnclave(
   std::unique_ptr<SgxClient> client = absl::make_unique<SgxClient>(name);
   client->base_address_ = base_address;
 
-  FileMapping self_binary_mapping;
-  ASYLO_ASSIGN_OR_RETURN(self_binary_mapping, FileMapping::CreateFromFile(
-                                                  kCallingProcessBinaryFile));
-
-  ElfReader self_binary_reader;
-  ASYLO_ASSIGN_OR_RETURN(self_binary_reader, ElfReader::CreateFromSpan(
-                                                 self_binary_mapping.buffer()));
-
   absl::Span<const uint8_t> enclave_buffer;
-  ASYLO_ASSIGN_OR_RETURN(enclave_buffer,
-                         self_binary_reader.GetSectionData(section_name_));
+  ASYLO_ASSIGN_OR_RETURN(enclave_buffer, GetSelfBinarySection(section_name_));
 
   int updated;
   sgx_status_t status;
@@ -360,6 +433,10 @@ Status SgxClient::EnterAndInitialize(const EnclaveConfig &config) {
   return status;
 }
 
+bool SgxClient::IsOutOfEnclaveThreads(const Status &status) const {
+  return status.Is(SGX_ERROR_OUT_OF_TCS);
+}
+
 Status SgxClient::EnterAndRun(const EnclaveInput &input,
                               EnclaveOutput *output) {
   std::string buf;
@@ -436,6 +513,15 @@ Status SgxClient::EnterAndDonateThread() {
   return status;
 }
 
+Status SgxClient::EnterAndRunSnapshotWorker() {
+  int result;
+  sgx_status_t sgx_status = ecall_run_snapshot_worker(id_, &result);
+  if (sgx_status != SGX_SUCCESS) {
+    return Status(sgx_status, "Call to ecall_run_snapshot_worker failed");
+  }
+  return Status::OkStatus();
+}
+
 Status SgxClient::EnterAndHandleSignal(const EnclaveSignal &signal) {
   EnclaveSignal enclave_signal;
   int bridge_signum = ToBridgeSignal(signal.signum());
@@ -455,8 +541,6 @@ Status SgxClient::EnterAndHandleSignal(const EnclaveSignal &signal) {
 }
 
 Status SgxClient::EnterAndTakeSnapshot(SnapshotLayout *snapshot_layout) {
-  LOG(WARNING) << "ENCLAVE FORK IS INSECURE CURRENTLY. THE SNAPSHOT IS "
-                  "UNENCRYPTED AND IT LEAKS ALL ENCLAVE DATA!";
   char *output_buf = nullptr;
   size_t output_len = 0;
 
@@ -533,6 +617,26 @@ Status SgxClient::EnterAndTransferSecureSnapshotKey(
   return status;
 }
 
+Status SgxClient::EnterAndGetCallMetrics(CallMetrics *metrics) {
+  char *output_buf = nullptr;
+  size_t output_len = 0;
+
+  ASYLO_RETURN_IF_ERROR(get_call_metrics(id_, &output_buf, &output_len));
+
+  // Enclave entry-point was successfully invoked. |output_buf| is guaranteed to
+  // have a value, allocated inside the enclave using enc_untrusted_malloc().
+  EnclaveOutput local_output;
+  local_output.ParseFromArray(output_buf, output_len);
+  free(output_buf);
+
+  Status status;
+  status.RestoreFrom(local_output.status());
+  if (status.ok() && metrics) {
+    metrics->MergeFrom(local_output.call_metrics());
+  }
+  return status;
+}
+
 Status SgxClient::DestroyEnclave() {
   sgx_status_t rc = sgx_destroy_enclave(id_);
   if (rc != SGX_SUCCESS) {
@@ -52,10 +52,15 @@ class SgxClient : public EnclaveClient {
   // Sets a new expected process ID for an existing SGX enclave.
   void SetProcessId();
 
+  // Enters the enclave to help seal or restore the snapshot in progress, if
+  // any, and returns once no chunk of it is left.
+  Status EnterAndRunSnapshotWorker();
+
  private:
   friend class SgxLoader;
   friend class SgxEmbeddedLoader;
 
+  bool IsOutOfEnclaveThreads(const Status &status) const override;
   Status EnterAndInitialize(const EnclaveConfig &config) override;
   Status EnterAndFinalize(const EnclaveFinal &final_input) override;
   Status EnterAndDonateThread() override;
@@ -64,6 +69,7 @@ class SgxClient : public EnclaveClient {
   Status EnterAndRestore(const SnapshotLayout &snapshot_layout) override;
   Status EnterAndTransferSecureSnapshotKey(
       const ForkHandshakeConfig &fork_handshake_config) override;
+  Status EnterAndGetCallMetrics(CallMetrics *metrics) override;
   Status DestroyEnclave() override;
 
   std::string path_;               // Path to enclave object file.
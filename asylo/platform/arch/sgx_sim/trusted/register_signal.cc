@@ -19,6 +19,9 @@
 #include "asylo/platform/arch/include/trusted/register_signal.h"
 
 #include <signal.h>
+#include <sys/ucontext.h>
+#include <cstdint>
+#include <cstring>
 
 #include "asylo/platform/arch/include/trusted/host_calls.h"
 #include "asylo/platform/common/bridge_functions.h"
@@ -26,6 +29,20 @@
 #include "asylo/platform/posix/signal/signal_manager.h"
 
 namespace asylo {
+namespace {
+
+// Layout of the host's ucontext_t on x86-64 Linux, up to and including the
+// general registers.
+struct HostUcontext {
+  uint64_t uc_flags;
+  void *uc_link;
+  void *ss_sp;
+  int ss_flags;
+  size_t ss_size;
+  greg_t gregs[NGREG];
+};
+
+}  // namespace
 
 // Translates |bridge_signum| to the value inside the enclave, and passes it to
 // the signal handler registered inside enclave.
@@ -48,7 +65,17 @@ void TranslateAndHandleSignal(int bridge_signum,
   if (sigismember(&mask, signum)) {
     return;
   }
-  Status status = signal_manager->HandleSignal(signum, &info, ucontext);
+  // The host passes its own ucontext_t, whose layout differs from the one
+  // inside the enclave. Copy the registers over, so that handlers see the same
+  // ucontext_t as when the signal is delivered by entering the enclave.
+  ucontext_t enclave_ucontext = {};
+  if (ucontext) {
+    memcpy(enclave_ucontext.uc_mcontext.gregs,
+           static_cast<const HostUcontext *>(ucontext)->gregs,
+           sizeof(enclave_ucontext.uc_mcontext.gregs));
+  }
+  Status status =
+      signal_manager->HandleSignal(signum, &info, &enclave_ucontext);
   if (!status.ok()) {
     LOG(ERROR) << status;
   }
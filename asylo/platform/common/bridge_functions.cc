@@ -32,6 +32,7 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <poll.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -281,6 +282,30 @@ int ToBridgeFLockOperation(int flock_operation) {
   return bridge_flock_operation;
 }
 
+uint32_t FromBridgeEpollEvents(uint32_t bridge_events) {
+  uint32_t events = 0;
+  if (bridge_events & BRIDGE_EPOLLIN) events |= EPOLLIN;
+  if (bridge_events & BRIDGE_EPOLLPRI) events |= EPOLLPRI;
+  if (bridge_events & BRIDGE_EPOLLOUT) events |= EPOLLOUT;
+  if (bridge_events & BRIDGE_EPOLLRDHUP) events |= EPOLLRDHUP;
+  if (bridge_events & BRIDGE_EPOLLERR) events |= EPOLLERR;
+  if (bridge_events & BRIDGE_EPOLLHUP) events |= EPOLLHUP;
+  if (bridge_events & BRIDGE_EPOLLMSG) events |= EPOLLMSG;
+  return events;
+}
+
+uint32_t ToBridgeEpollEvents(uint32_t events) {
+  uint32_t bridge_events = 0;
+  if (events & EPOLLIN) bridge_events |= BRIDGE_EPOLLIN;
+  if (events & EPOLLPRI) bridge_events |= BRIDGE_EPOLLPRI;
+  if (events & EPOLLOUT) bridge_events |= BRIDGE_EPOLLOUT;
+  if (events & EPOLLRDHUP) bridge_events |= BRIDGE_EPOLLRDHUP;
+  if (events & EPOLLERR) bridge_events |= BRIDGE_EPOLLERR;
+  if (events & EPOLLHUP) bridge_events |= BRIDGE_EPOLLHUP;
+  if (events & EPOLLMSG) bridge_events |= BRIDGE_EPOLLMSG;
+  return bridge_events;
+}
+
 int FromBridgeSysconfConstants(enum SysconfConstants bridge_sysconf_constant) {
   switch (bridge_sysconf_constant) {
     case BRIDGE_SC_NPROCESSORS_CONF:
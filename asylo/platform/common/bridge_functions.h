@@ -46,6 +46,14 @@ int FromBridgeFLockOperation(int bridge_flock_operation);
 // supported options are provided.
 int ToBridgeFLockOperation(int flock_operation);
 
+// Converts |bridge_events| to runtime epoll events. Returns 0 if no supported
+// events are provided.
+uint32_t FromBridgeEpollEvents(uint32_t bridge_events);
+
+// Converts the runtime epoll events |events| to bridge epoll events. Returns 0
+// if no supported events are provided.
+uint32_t ToBridgeEpollEvents(uint32_t events);
+
 // Converts |bridge_sysconf_constant| to a runtime sysconf constant. Returns -1
 // if unsuccessful.
 int FromBridgeSysconfConstants(enum SysconfConstants bridge_sysconf_constant);
@@ -20,6 +20,7 @@
 
 #include <fcntl.h>
 #include <netdb.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <syslog.h>
@@ -54,6 +55,21 @@ TEST_F(BridgeTest, BridgeFLockOperationTest) {
               to_matcher);
 }
 
+TEST_F(BridgeTest, BridgeEpollEventsTest) {
+  intvec from_bits = {BRIDGE_EPOLLIN,    BRIDGE_EPOLLPRI, BRIDGE_EPOLLOUT,
+                      BRIDGE_EPOLLRDHUP, BRIDGE_EPOLLERR, BRIDGE_EPOLLHUP,
+                      BRIDGE_EPOLLMSG};
+  intvec to_bits = {EPOLLIN,  EPOLLPRI, EPOLLOUT, EPOLLRDHUP,
+                    EPOLLERR, EPOLLHUP, EPOLLMSG};
+  EXPECT_EQ(from_bits.size(), to_bits.size());
+  auto from_matcher = IsFiniteRestrictionOf<int, int>(FromBridgeEpollEvents);
+  EXPECT_THAT(FuzzBitsetTranslationFunction(from_bits, to_bits, ITER_BOUND),
+              from_matcher);
+  auto to_matcher = IsFiniteRestrictionOf<int, int>(ToBridgeEpollEvents);
+  EXPECT_THAT(FuzzBitsetTranslationFunction(to_bits, from_bits, ITER_BOUND),
+              to_matcher);
+}
+
 TEST_F(BridgeTest, BridgeSysconfConstantsTest) {
   std::vector<enum SysconfConstants> from_consts = {BRIDGE_SC_NPROCESSORS_CONF,
                                                     BRIDGE_SC_NPROCESSORS_ONLN,
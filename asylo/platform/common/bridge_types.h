@@ -331,6 +331,16 @@ enum BridgePollEvents {
   BRIDGE_POLLWRBAND = 0x400,
 };
 
+enum BridgeEpollEvents {
+  BRIDGE_EPOLLIN = 0x001,
+  BRIDGE_EPOLLPRI = 0x002,
+  BRIDGE_EPOLLOUT = 0x004,
+  BRIDGE_EPOLLRDHUP = 0x008,
+  BRIDGE_EPOLLERR = 0x010,
+  BRIDGE_EPOLLHUP = 0x020,
+  BRIDGE_EPOLLMSG = 0x040,
+};
+
 struct bridge_in_addr {
   uint32_t inet_addr;
 } ABSL_ATTRIBUTE_PACKED;
@@ -421,6 +431,11 @@ struct bridge_pollfd {
   int16_t revents;
 };
 
+struct bridge_epoll_event {
+  uint32_t events;
+  uint64_t data;
+} ABSL_ATTRIBUTE_PACKED;
+
 struct bridge_msghdr {
   void *msg_name;
   uint64_t msg_namelen;
@@ -436,6 +451,11 @@ struct bridge_iovec {
   uint64_t iov_len;
 };
 
+struct bridge_mmsghdr {
+  struct bridge_msghdr msg_hdr;
+  uint32_t msg_len;
+};
+
 struct bridge_siginfo_t {
   int32_t si_signo;
   int32_t si_code;
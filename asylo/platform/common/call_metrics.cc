@@ -0,0 +1,197 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/common/call_metrics.h"
+
+#include <time.h>
+
+#include "absl/memory/memory.h"
+#include "asylo/platform/common/time_util.h"
+
+namespace asylo {
+
+constexpr int CallCounter::kMinLatencyBits;
+constexpr int CallCounter::kMaxLatencyBits;
+constexpr int CallCounter::kNumBuckets;
+constexpr int CallCounter::kNumShards;
+
+namespace {
+
+// Source of per-thread shard indices.
+std::atomic<int> next_shard_index(0);
+
+// Set while the calling thread reads the clock. Reading the clock inside an
+// enclave may itself cross the enclave boundary the first time it is called,
+// so timers started during a clock read are ignored.
+thread_local bool reading_clock = false;
+
+// Returns the value of a monotonic clock in nanoseconds.
+uint64_t MonotonicNanoseconds() {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+    return 0;
+  }
+  return static_cast<uint64_t>(TimeSpecToNanoseconds(&ts));
+}
+
+}  // namespace
+
+CallCounter::CallCounter(CallMetric::CallType type, std::string name)
+    : type_(type), name_(std::move(name)) {
+  for (Shard &shard : shards_) {
+    shard.count.store(0, std::memory_order_relaxed);
+    shard.total_latency_ns.store(0, std::memory_order_relaxed);
+    for (std::atomic<uint64_t> &bucket : shard.buckets) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+void CallCounter::Record(uint64_t latency_ns) {
+  Shard *shard = GetShard();
+  shard->count.fetch_add(1, std::memory_order_relaxed);
+  shard->total_latency_ns.fetch_add(latency_ns, std::memory_order_relaxed);
+  shard->buckets[BucketForLatency(latency_ns)].fetch_add(
+      1, std::memory_order_relaxed);
+}
+
+void CallCounter::Snapshot(CallMetric *metric) const {
+  uint64_t count = 0;
+  uint64_t total_latency_ns = 0;
+  uint64_t buckets[kNumBuckets] = {};
+  for (const Shard &shard : shards_) {
+    count += shard.count.load(std::memory_order_relaxed);
+    total_latency_ns += shard.total_latency_ns.load(std::memory_order_relaxed);
+    for (int i = 0; i < kNumBuckets; ++i) {
+      buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  int num_buckets = kNumBuckets;
+  while (num_buckets > 0 && buckets[num_buckets - 1] == 0) {
+    --num_buckets;
+  }
+
+  metric->Clear();
+  metric->set_type(type_);
+  metric->set_name(name_);
+  metric->set_count(count);
+  metric->set_total_latency_ns(total_latency_ns);
+  for (int i = 0; i < num_buckets; ++i) {
+    metric->add_latency_buckets(buckets[i]);
+  }
+}
+
+int CallCounter::BucketForLatency(uint64_t latency_ns) {
+  if (latency_ns < (UINT64_C(1) << kMinLatencyBits)) {
+    return 0;
+  }
+  int msb = 63 - __builtin_clzll(latency_ns);
+  if (msb >= kMaxLatencyBits) {
+    return kNumBuckets - 1;
+  }
+  int half = (latency_ns >> (msb - 1)) & 1;
+  return 1 + 2 * (msb - kMinLatencyBits) + half;
+}
+
+uint64_t CallCounter::BucketLowerBound(int bucket) {
+  if (bucket <= 0) {
+    return 0;
+  }
+  if (bucket >= kNumBuckets - 1) {
+    return UINT64_C(1) << kMaxLatencyBits;
+  }
+  int msb = kMinLatencyBits + (bucket - 1) / 2;
+  int half = (bucket - 1) % 2;
+  return (UINT64_C(1) << msb) + half * (UINT64_C(1) << (msb - 1));
+}
+
+CallCounter::Shard *CallCounter::GetShard() {
+  thread_local int shard_index =
+      next_shard_index.fetch_add(1, std::memory_order_relaxed);
+  return &shards_[shard_index % kNumShards];
+}
+
+CallMetricsRegistry *CallMetricsRegistry::GetInstance() {
+  static CallMetricsRegistry *instance = new CallMetricsRegistry();
+  return instance;
+}
+
+CallCounter *CallMetricsRegistry::GetCounter(CallMetric::CallType type,
+                                             const std::string &name) {
+  auto key = std::make_pair(static_cast<int>(type), name);
+  {
+    absl::ReaderMutexLock lock(&mu_);
+    auto it = counters_.find(key);
+    if (it != counters_.end()) {
+      return it->second.get();
+    }
+  }
+  absl::MutexLock lock(&mu_);
+  std::unique_ptr<CallCounter> &counter = counters_[key];
+  if (!counter) {
+    counter = absl::make_unique<CallCounter>(type, name);
+  }
+  return counter.get();
+}
+
+CallCounter *CallMetricsRegistry::GetCounter(CallMetric::CallType type,
+                                             uint64_t selector) {
+  auto key = std::make_pair(static_cast<int>(type), selector);
+  {
+    absl::ReaderMutexLock lock(&mu_);
+    auto it = selector_counters_.find(key);
+    if (it != selector_counters_.end()) {
+      return it->second;
+    }
+  }
+  CallCounter *counter =
+      GetCounter(type, "selector " + std::to_string(selector));
+  absl::MutexLock lock(&mu_);
+  selector_counters_[key] = counter;
+  return counter;
+}
+
+void CallMetricsRegistry::Snapshot(CallMetrics *metrics) const {
+  absl::MutexLock lock(&mu_);
+  for (const auto &entry : counters_) {
+    CallMetric metric;
+    entry.second->Snapshot(&metric);
+    if (metric.count() > 0) {
+      *metrics->add_metrics() = std::move(metric);
+    }
+  }
+}
+
+ScopedCallTimer::ScopedCallTimer(CallCounter *counter)
+    : counter_(reading_clock ? nullptr : counter), start_ns_(0) {
+  if (counter_) {
+    reading_clock = true;
+    start_ns_ = MonotonicNanoseconds();
+    reading_clock = false;
+  }
+}
+
+ScopedCallTimer::~ScopedCallTimer() {
+  if (counter_) {
+    uint64_t end_ns = MonotonicNanoseconds();
+    counter_->Record(end_ns > start_ns_ ? end_ns - start_ns_ : 0);
+  }
+}
+
+}  // namespace asylo
@@ -0,0 +1,140 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_COMMON_CALL_METRICS_H_
+#define ASYLO_PLATFORM_COMMON_CALL_METRICS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/enclave.pb.h"
+
+namespace asylo {
+
+// Counts calls of one kind and records the distribution of their latencies in
+// a log-linear histogram. Counters are sharded across threads so that threads
+// recording calls concurrently rarely write to the same cache line.
+//
+// Latencies below 2^kMinLatencyBits nanoseconds fall into bucket 0. Every
+// power of two from there up to 2^kMaxLatencyBits nanoseconds is split into
+// two buckets of equal width, and the last bucket holds all larger latencies.
+//
+// This class is thread-safe.
+class CallCounter {
+ public:
+  static constexpr int kMinLatencyBits = 6;
+  static constexpr int kMaxLatencyBits = 40;
+  static constexpr int kNumBuckets =
+      2 * (kMaxLatencyBits - kMinLatencyBits) + 2;
+
+  CallCounter(CallMetric::CallType type, std::string name);
+
+  CallCounter(const CallCounter &other) = delete;
+  CallCounter &operator=(const CallCounter &other) = delete;
+
+  // Records a call that took |latency_ns| nanoseconds.
+  void Record(uint64_t latency_ns);
+
+  // Sets |metric| to the calls recorded so far.
+  void Snapshot(CallMetric *metric) const;
+
+  // Returns the index of the bucket holding a latency of |latency_ns|.
+  static int BucketForLatency(uint64_t latency_ns);
+
+  // Returns the smallest latency, in nanoseconds, held by |bucket|.
+  static uint64_t BucketLowerBound(int bucket);
+
+ private:
+  static constexpr int kNumShards = 4;
+
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total_latency_ns;
+    std::atomic<uint64_t> buckets[kNumBuckets];
+  };
+
+  // Returns the shard used by the calling thread.
+  Shard *GetShard();
+
+  const CallMetric::CallType type_;
+  const std::string name_;
+  Shard shards_[kNumShards];
+};
+
+// A process-wide registry of call counters. Inside an enclave, the registry
+// holds the counters of that enclave.
+//
+// This class is thread-safe.
+class CallMetricsRegistry {
+ public:
+  static CallMetricsRegistry *GetInstance();
+
+  // Returns the counter for calls of the given |type| and |name|, creating it
+  // if needed. The returned counter lives as long as the process, so callers
+  // on hot paths should look it up once and keep the pointer.
+  CallCounter *GetCounter(CallMetric::CallType type, const std::string &name)
+      LOCKS_EXCLUDED(mu_);
+
+  // Returns the counter for calls of the given |type| made through the
+  // numeric |selector|. The counter is named "selector <selector>".
+  CallCounter *GetCounter(CallMetric::CallType type, uint64_t selector)
+      LOCKS_EXCLUDED(mu_);
+
+  // Adds a snapshot of every counter that has recorded a call to |metrics|.
+  void Snapshot(CallMetrics *metrics) const LOCKS_EXCLUDED(mu_);
+
+ private:
+  CallMetricsRegistry() = default;
+
+  mutable absl::Mutex mu_;
+  absl::flat_hash_map<std::pair<int, std::string>,
+                      std::unique_ptr<CallCounter>>
+      counters_ GUARDED_BY(mu_);
+
+  // Counters looked up by selector, which are also held by |counters_|.
+  absl::flat_hash_map<std::pair<int, uint64_t>, CallCounter *>
+      selector_counters_ GUARDED_BY(mu_);
+};
+
+// Records the time from its construction to its destruction with a
+// CallCounter.
+class ScopedCallTimer {
+ public:
+  // Starts timing a call to be recorded with |counter|. If |counter| is
+  // nullptr, nothing is recorded.
+  explicit ScopedCallTimer(CallCounter *counter);
+
+  ScopedCallTimer(const ScopedCallTimer &other) = delete;
+  ScopedCallTimer &operator=(const ScopedCallTimer &other) = delete;
+
+  ~ScopedCallTimer();
+
+ private:
+  CallCounter *counter_;
+  uint64_t start_ns_;
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_COMMON_CALL_METRICS_H_
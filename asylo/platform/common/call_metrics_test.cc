@@ -0,0 +1,107 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/common/call_metrics.h"
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace asylo {
+namespace {
+
+// Verifies that every latency falls into the bucket whose bounds contain it.
+TEST(CallMetricsTest, BucketBoundsContainLatency) {
+  for (uint64_t latency : {UINT64_C(0), UINT64_C(1), UINT64_C(63),
+                           UINT64_C(64), UINT64_C(95), UINT64_C(96),
+                           UINT64_C(127), UINT64_C(128), UINT64_C(1000),
+                           UINT64_C(123456789), (UINT64_C(1) << 40) - 1,
+                           UINT64_C(1) << 40, UINT64_MAX}) {
+    int bucket = CallCounter::BucketForLatency(latency);
+    ASSERT_GE(bucket, 0);
+    ASSERT_LT(bucket, CallCounter::kNumBuckets);
+    EXPECT_LE(CallCounter::BucketLowerBound(bucket), latency) << latency;
+    if (bucket + 1 < CallCounter::kNumBuckets) {
+      EXPECT_GT(CallCounter::BucketLowerBound(bucket + 1), latency) << latency;
+    }
+  }
+}
+
+// Verifies that bucket lower bounds are strictly increasing.
+TEST(CallMetricsTest, BucketLowerBoundsIncrease) {
+  for (int i = 1; i < CallCounter::kNumBuckets; ++i) {
+    EXPECT_GT(CallCounter::BucketLowerBound(i),
+              CallCounter::BucketLowerBound(i - 1));
+  }
+}
+
+// Verifies that calls recorded from several threads are all counted.
+TEST(CallMetricsTest, RecordFromManyThreads) {
+  constexpr int kNumThreads = 8;
+  constexpr int kCallsPerThread = 1000;
+  CallCounter counter(CallMetric::HOST_CALL, "call");
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back([&counter]() {
+      for (int j = 0; j < kCallsPerThread; ++j) {
+        counter.Record(100);
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  CallMetric metric;
+  counter.Snapshot(&metric);
+  EXPECT_EQ(metric.type(), CallMetric::HOST_CALL);
+  EXPECT_EQ(metric.name(), "call");
+  EXPECT_EQ(metric.count(), kNumThreads * kCallsPerThread);
+  EXPECT_EQ(metric.total_latency_ns(), 100 * kNumThreads * kCallsPerThread);
+  int bucket = CallCounter::BucketForLatency(100);
+  ASSERT_EQ(metric.latency_buckets_size(), bucket + 1);
+  EXPECT_EQ(metric.latency_buckets(bucket), kNumThreads * kCallsPerThread);
+}
+
+// Verifies that the registry returns the same counter for the same call and
+// only reports counters that have recorded calls.
+TEST(CallMetricsTest, RegistrySnapshot) {
+  CallMetricsRegistry *registry = CallMetricsRegistry::GetInstance();
+  CallCounter *counter =
+      registry->GetCounter(CallMetric::ECALL, "registry_test_call");
+  EXPECT_EQ(registry->GetCounter(CallMetric::ECALL, "registry_test_call"),
+            counter);
+  EXPECT_NE(registry->GetCounter(CallMetric::EXIT_HANDLER,
+                                 "registry_test_call"),
+            counter);
+
+  { ScopedCallTimer timer(counter); }
+
+  CallMetrics metrics;
+  registry->Snapshot(&metrics);
+  ASSERT_EQ(metrics.metrics_size(), 1);
+  EXPECT_EQ(metrics.metrics(0).type(), CallMetric::ECALL);
+  EXPECT_EQ(metrics.metrics(0).name(), "registry_test_call");
+  EXPECT_EQ(metrics.metrics(0).count(), 1);
+}
+
+}  // namespace
+}  // namespace asylo
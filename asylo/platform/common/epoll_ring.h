@@ -0,0 +1,59 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_COMMON_EPOLL_RING_H_
+#define ASYLO_PLATFORM_COMMON_EPOLL_RING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "asylo/platform/common/bridge_types.h"
+#include "asylo/platform/common/ring_buffer.h"
+
+namespace asylo {
+
+// Memory shared between the enclave and a host epoll agent thread, which waits
+// on an epoll instance on behalf of the enclave.
+//
+// The enclave requests a harvest by setting |harvest_requested| when a wait
+// finds |events| empty. The agent then waits on the epoll instance and writes
+// the events it returns to |events| as bridge_epoll_event records.
+// The enclave is the only reader and the agent the only writer of |events|.
+//
+// The ring is allocated and constructed by the enclave in untrusted memory, so
+// the enclave must validate every record it reads.
+struct EpollRing {
+  // Maximum number of events harvested at once.
+  static constexpr size_t kMaxEvents = 256;
+
+  // Key of the events the agent uses to interrupt its own wait on the
+  // instance. The enclave never registers a file descriptor with this key.
+  static constexpr uint64_t kAgentWakeKey = UINT64_MAX;
+
+  EpollRing() : harvest_requested(0) {}
+
+  RingBuffer<kMaxEvents * sizeof(bridge_epoll_event)> events;
+
+  // Nonzero if the agent should harvest events.
+  std::atomic<int32_t> harvest_requested;
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_COMMON_EPOLL_RING_H_
@@ -16,70 +16,52 @@
  *
  */
 #include <errno.h>
+#include <cstring>
 
+#include "absl/memory/memory.h"
 #include "asylo/util/logging.h"
 #include "asylo/platform/common/bridge_functions.h"
 #include "asylo/platform/core/bridge_msghdr_wrapper.h"
-#include "asylo/platform/core/untrusted_cache_malloc.h"
 
-namespace asylo {
-namespace {
+void *asylo::BridgeMsghdrWrapper::NewUntrustedBuffer(size_t size) {
+  buffers_.push_back(absl::make_unique<UntrustedScratchBuffer>(size));
+  void *buffer = buffers_.back()->data();
+  // The operation fails if it cannot allocate the necessary resources.
+  LOG_IF(FATAL, !buffer) << "Untrusted memory allocation failed";
+  return buffer;
+}
 
-// Allocates untrusted memory and copies the buffer |data| of size |size| to it.
-// |addr| is updated to point to the address of the copied memory. It is the
-// responsibility of the caller to free the memory pointed to by |addr|.
-// It is a fatal error if memory cannot be allocated.
-bool CopyToUntrustedMemory(void **addr, void *data, size_t size) {
-  if (data && !addr) {
-    return false;
-  }
+void *asylo::BridgeMsghdrWrapper::CopyToUntrustedMemory(const void *data,
+                                                         size_t size) {
   // The operation trivially succeeds if there is nothing to copy.
   if (!data) {
-    if (addr) {
-      *addr = nullptr;
-    }
-    return true;
+    return nullptr;
   }
-
-  // Instance of the global memory pool singleton.
-  asylo::UntrustedCacheMalloc *untrusted_cache_malloc =
-      asylo::UntrustedCacheMalloc::Instance();
-  void *outside_enclave = untrusted_cache_malloc->Malloc(size);
-  // The operation fails if it cannot allocate the necessary resources.
-  LOG_IF(FATAL, !outside_enclave) << "Untrusted memory allocation failed";
-
+  void *outside_enclave = NewUntrustedBuffer(size);
   memcpy(outside_enclave, data, size);
-  *addr = outside_enclave;
-  return true;
+  return outside_enclave;
 }
 
-}  // namespace
-}  // namespace asylo
-
-asylo::BridgeMsghdrWrapper::BridgeMsghdrWrapper(const struct msghdr *in) {
+asylo::BridgeMsghdrWrapper::BridgeMsghdrWrapper(const struct msghdr *in)
+    : msg_in_(in) {
   struct bridge_msghdr trusted_bridge_msghdr;
   ToBridgeMsgHdr(in, &trusted_bridge_msghdr);
-  struct bridge_msghdr *untrusted_bridge_msghdr = nullptr;
-  const bool ret = CopyToUntrustedMemory(
-      reinterpret_cast<void **>(&untrusted_bridge_msghdr),
-      &trusted_bridge_msghdr, sizeof(struct bridge_msghdr));
-  if (ret && untrusted_bridge_msghdr) {
-    msg_out_.reset(untrusted_bridge_msghdr);
-  }
-  msg_in_ = in;
+  msg_out_ = static_cast<struct bridge_msghdr *>(CopyToUntrustedMemory(
+      &trusted_bridge_msghdr, sizeof(struct bridge_msghdr)));
 }
 
 bridge_msghdr *asylo::BridgeMsghdrWrapper::get_msg()
-    const { return msg_out_.get(); }
+    const { return msg_out_; }
+
+void *asylo::BridgeMsghdrWrapper::get_iov_base(size_t index) const {
+  return index < iov_bases_.size() ? iov_bases_[index] : nullptr;
+}
 
 bool asylo::BridgeMsghdrWrapper::CopyMsgName() {
-  void *tmp_name_ptr = nullptr;
-  if (!CopyToUntrustedMemory(&tmp_name_ptr, msg_in_->msg_name,
-                             msg_in_->msg_namelen)) {
-    return false;
-  }
+  void *tmp_name_ptr =
+      CopyToUntrustedMemory(msg_in_->msg_name, msg_in_->msg_namelen);
+  msg_name_ = tmp_name_ptr;
   if (tmp_name_ptr) {
-    msg_name_ptr_.reset(tmp_name_ptr);
     msg_out_->msg_name = tmp_name_ptr;
   }
   return true;
@@ -87,17 +69,9 @@ bool asylo::BridgeMsghdrWrapper::CopyMsgName() {
 
 // It is a fatal error if memory cannot be allocated.
 bool asylo::BridgeMsghdrWrapper::CopyMsgIov() {
-  // Instance of the global memory pool singleton.
-  asylo::UntrustedCacheMalloc *untrusted_cache_malloc =
-      asylo::UntrustedCacheMalloc::Instance();
-  auto tmp_iov_ptr =
-      reinterpret_cast<struct bridge_iovec *>(untrusted_cache_malloc->Malloc(
-          msg_in_->msg_iovlen * sizeof(struct bridge_iovec)));
-  LOG_IF(FATAL, !tmp_iov_ptr) << "Untrusted memory allocation failed";
-  if (tmp_iov_ptr) {
-    msg_iov_ptr_.reset(tmp_iov_ptr);
-    msg_out_->msg_iov = tmp_iov_ptr;
-  }
+  auto tmp_iov_ptr = static_cast<struct bridge_iovec *>(
+      NewUntrustedBuffer(msg_in_->msg_iovlen * sizeof(struct bridge_iovec)));
+  msg_out_->msg_iov = tmp_iov_ptr;
   for (int i = 0; i < msg_in_->msg_iovlen; ++i) {
     if (!ToBridgeIovec(&msg_in_->msg_iov[i], &msg_out_->msg_iov[i])) {
       LOG(FATAL) << "Iovec allocation failed";
@@ -107,15 +81,12 @@ bool asylo::BridgeMsghdrWrapper::CopyMsgIov() {
 }
 
 bool asylo::BridgeMsghdrWrapper::CopyMsgIovBase() {
+  iov_bases_.resize(msg_in_->msg_iovlen);
   for (int i = 0; i < msg_in_->msg_iovlen; ++i) {
-    msg_iov_base_ptrs_.push_back(nullptr);
-    void *tmp_iov_base_ptr = nullptr;
-    if (!CopyToUntrustedMemory(&tmp_iov_base_ptr, msg_in_->msg_iov[i].iov_base,
-                               msg_in_->msg_iov[i].iov_len)) {
-      return false;
-    }
+    void *tmp_iov_base_ptr = CopyToUntrustedMemory(
+        msg_in_->msg_iov[i].iov_base, msg_in_->msg_iov[i].iov_len);
+    iov_bases_[i] = tmp_iov_base_ptr;
     if (tmp_iov_base_ptr) {
-      msg_iov_base_ptrs_[i].reset(tmp_iov_base_ptr);
       msg_out_->msg_iov[i].iov_base = tmp_iov_base_ptr;
     }
   }
@@ -123,13 +94,10 @@ bool asylo::BridgeMsghdrWrapper::CopyMsgIovBase() {
 }
 
 bool asylo::BridgeMsghdrWrapper::CopyMsgControl() {
-  void *tmp_control_ptr = nullptr;
-  if (!CopyToUntrustedMemory(&tmp_control_ptr, msg_in_->msg_control,
-                             msg_in_->msg_controllen)) {
-    return false;
-  }
+  void *tmp_control_ptr =
+      CopyToUntrustedMemory(msg_in_->msg_control, msg_in_->msg_controllen);
+  msg_control_ = tmp_control_ptr;
   if (tmp_control_ptr) {
-    msg_control_ptr_.reset(tmp_control_ptr);
     msg_out_->msg_control = tmp_control_ptr;
   }
   return true;
@@ -20,15 +20,18 @@
 #define ASYLO_PLATFORM_CORE_BRIDGE_MSGHDR_WRAPPER_H_
 
 #include <sys/socket.h>
+#include <cstddef>
+#include <memory>
 #include <vector>
 
-#include "asylo/platform/arch/include/trusted/memory.h"
 #include "asylo/platform/common/bridge_types.h"
+#include "asylo/platform/core/untrusted_scratch.h"
 
 namespace asylo {
 
 // This helper class wraps a bridge_msghdr and does a deep copy of all the
-// buffers to untrusted memory.
+// buffers to untrusted memory. The copies are taken from the untrusted scratch
+// region of the calling thread when it has room for them.
 class BridgeMsghdrWrapper {
  public:
   explicit BridgeMsghdrWrapper(const struct msghdr *in);
@@ -37,18 +40,41 @@ class BridgeMsghdrWrapper {
   bridge_msghdr *get_msg() const;
   bool CopyAllBuffers();
 
+  // Returns the untrusted copy of the buffer of the |index|-th iovec of the
+  // message, or nullptr if it has none. Unlike the pointers in the header
+  // returned by get_msg(), the host cannot modify the returned pointer.
+  void *get_iov_base(size_t index) const;
+
+  // Return the untrusted copies of the address and control buffers of the
+  // message, or nullptr if it has none. Like get_iov_base(), these are kept
+  // inside the enclave.
+  void *get_msg_name() const { return msg_name_; }
+  void *get_msg_control() const { return msg_control_; }
+
  private:
   bool CopyMsgName();
   bool CopyMsgIov();
   bool CopyMsgIovBase();
   bool CopyMsgControl();
 
+  // Returns a new untrusted buffer of |size| bytes, released with the wrapper.
+  void *NewUntrustedBuffer(size_t size);
+
+  // Copies the buffer |data| of size |size| to a new untrusted buffer. Returns
+  // the copy, or nullptr if |data| is nullptr.
+  void *CopyToUntrustedMemory(const void *data, size_t size);
+
   const msghdr *msg_in_;
-  UntrustedUniquePtr<bridge_msghdr> msg_out_;
-  UntrustedUniquePtr<void> msg_name_ptr_;
-  UntrustedUniquePtr<void> msg_iov_ptr_;
-  UntrustedUniquePtr<void> msg_control_ptr_;
-  std::vector<UntrustedUniquePtr<void>> msg_iov_base_ptrs_;
+  bridge_msghdr *msg_out_;
+  std::vector<std::unique_ptr<UntrustedScratchBuffer>> buffers_;
+
+  // Untrusted copies of the iovec buffers, kept inside the enclave.
+  std::vector<void *> iov_bases_;
+
+  // Untrusted copies of the address and control buffers, kept inside the
+  // enclave.
+  void *msg_name_ = nullptr;
+  void *msg_control_ = nullptr;
 };
 
 }  // namespace asylo
@@ -0,0 +1,79 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/core/enclave_client.h"
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+namespace asylo {
+
+void EnclaveClient::EnterAndRunAsync(EnclaveInput input, RunCallback done) {
+  {
+    absl::MutexLock lock(&run_queue_mu_);
+    if (!async_runs_stopped_) {
+      if (!run_queue_) {
+        // Start with a worker per CPU. The queue shrinks itself if the enclave
+        // has fewer threads.
+        int max_workers =
+            std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        run_queue_ = absl::make_unique<EnclaveRunQueue>(this, max_workers);
+      }
+      // Scheduling under |run_queue_mu_| keeps StopAsyncRuns() from destroying
+      // the queue meanwhile. The queue is not stopping while it is owned by
+      // the client, so Schedule() does not invoke |done| here.
+      run_queue_->Schedule(std::move(input), std::move(done));
+      return;
+    }
+  }
+  done(Status(error::GoogleError::FAILED_PRECONDITION,
+              "Enclave no longer accepts asynchronous runs"),
+       EnclaveOutput());
+}
+
+std::future<StatusOr<EnclaveOutput>> EnclaveClient::EnterAndRunAsync(
+    EnclaveInput input) {
+  // std::function requires a copyable callback, so the promise is shared.
+  auto promise = std::make_shared<std::promise<StatusOr<EnclaveOutput>>>();
+  std::future<StatusOr<EnclaveOutput>> future = promise->get_future();
+  EnterAndRunAsync(std::move(input),
+                   [promise](Status status, EnclaveOutput output) {
+                     if (status.ok()) {
+                       promise->set_value(
+                           StatusOr<EnclaveOutput>(std::move(output)));
+                     } else {
+                       promise->set_value(StatusOr<EnclaveOutput>(status));
+                     }
+                   });
+  return future;
+}
+
+void EnclaveClient::StopAsyncRuns() {
+  std::unique_ptr<EnclaveRunQueue> run_queue;
+  {
+    absl::MutexLock lock(&run_queue_mu_);
+    async_runs_stopped_ = true;
+    run_queue = std::move(run_queue_);
+  }
+  // Destroying the queue waits for runs in progress, which may themselves call
+  // EnterAndRunAsync(), so it must happen outside |run_queue_mu_|.
+  run_queue.reset();
+}
+
+}  // namespace asylo
@@ -19,12 +19,21 @@
 #ifndef ASYLO_PLATFORM_CORE_ENCLAVE_CLIENT_H_
 #define ASYLO_PLATFORM_CORE_ENCLAVE_CLIENT_H_
 
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+
+#include "absl/base/thread_annotations.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
 #include "asylo/enclave.pb.h"  // IWYU pragma: export
 #include "asylo/platform/arch/fork.pb.h"
+#include "asylo/platform/core/enclave_run_queue.h"
 #include "asylo/platform/core/shared_name.h"
 #include "asylo/util/status.h"  // IWYU pragma: export
+#include "asylo/util/statusor.h"
 
 namespace asylo {
 
@@ -50,22 +59,71 @@ class EnclaveClient {
   virtual Status EnterAndRun(const EnclaveInput &input,
                              EnclaveOutput *output) = 0;
 
+  /// Callback invoked with the status and output of an asynchronous run.
+  using RunCallback = EnclaveRunQueue::Callback;
+
+  /// Enters the enclave and invokes its execution entry point without blocking
+  /// the calling thread.
+  ///
+  /// The run is queued and performed by a pool of host threads owned by this
+  /// client. The pool never enters the enclave on more threads than the enclave
+  /// has available; while every enclave thread is busy, runs wait in the queue
+  /// instead of failing.
+  ///
+  /// \param input A protobuf message that may be extended with a user-defined
+  ///              message.
+  /// \param done A callback invoked on a pool thread with the status and
+  ///             output of the run. Once the enclave is being destroyed, it is
+  ///             invoked on the calling thread with a FAILED_PRECONDITION
+  ///             status instead.
+  void EnterAndRunAsync(EnclaveInput input, RunCallback done)
+      LOCKS_EXCLUDED(run_queue_mu_);
+
+  /// Enters the enclave and invokes its execution entry point without blocking
+  /// the calling thread.
+  ///
+  /// Behaves as EnterAndRunAsync() with a callback.
+  ///
+  /// \param input A protobuf message that may be extended with a user-defined
+  ///              message.
+  /// \return A future holding the output of the run, or the error status if
+  ///         the run failed.
+  std::future<StatusOr<EnclaveOutput>> EnterAndRunAsync(EnclaveInput input)
+      LOCKS_EXCLUDED(run_queue_mu_);
+
  protected:
   /// Returns the name of the enclave.
   ///
   /// \return The name of the enclave.
-  const std::string &get_name() const { return name_; }
+  std::string get_name() const LOCKS_EXCLUDED(name_mu_) {
+    absl::MutexLock lock(&name_mu_);
+    return name_;
+  }
 
   /// Called by the EnclaveManager to create a client instance.
   ///
   /// \param name The enclave name as registered with the EnclaveManager.
   explicit EnclaveClient(const std::string &name) : name_(name) {}
 
+  /// Returns true if `status` reports that the enclave could not be entered
+  /// because all of its threads are in use.
+  ///
+  /// \param status A status returned by EnterAndRun().
+  virtual bool IsOutOfEnclaveThreads(const Status &status) const {
+    return false;
+  }
+
  private:
   friend class EnclaveManager;
+  friend class EnclaveRunQueue;
   friend class EnclaveSignalDispatcher;
   friend void donate(EnclaveClient *client);
 
+  // Waits for the asynchronous runs in progress to complete and cancels the
+  // runs still queued. Later calls to EnterAndRunAsync() fail. Called by the
+  // EnclaveManager before the enclave is finalized.
+  void StopAsyncRuns() LOCKS_EXCLUDED(run_queue_mu_);
+
   // Enters the enclave and invokes its initialization entry point.
   virtual Status EnterAndInitialize(const EnclaveConfig &config) = 0;
 
@@ -89,12 +147,36 @@ class EnclaveClient {
   virtual Status EnterAndTransferSecureSnapshotKey(
       const ForkHandshakeConfig &fork_handshake_config) = 0;
 
+  // Enters the enclave and retrieves the metrics of its calls to the host.
+  virtual Status EnterAndGetCallMetrics(CallMetrics *metrics) {
+    return Status(error::GoogleError::UNIMPLEMENTED,
+                  "Enclave does not support call metrics");
+  }
+
   // Invoked by the EnclaveManager immediately before the enclave is
   // destroyed. This hook is provided to enable execution of custom logic by the
   // client at the time the enclave is destroyed.
   virtual Status DestroyEnclave() = 0;
 
-  std::string name_;
+  // Guards |name_|, which EnclaveManager::RenameEnclave() may change while
+  // the client is in use.
+  mutable absl::Mutex name_mu_;
+  std::string name_ GUARDED_BY(name_mu_);
+
+  // Queue of asynchronous runs, created by the first call to
+  // EnterAndRunAsync().
+  absl::Mutex run_queue_mu_;
+  std::unique_ptr<EnclaveRunQueue> run_queue_ GUARDED_BY(run_queue_mu_);
+
+  // Set by StopAsyncRuns(), after which no run queue is created.
+  bool async_runs_stopped_ GUARDED_BY(run_queue_mu_) = false;
+
+  // Signals queued for delivery to this enclave. Bit |bridge_signum| - 1 is set
+  // while a signal is queued. Shared with the enclave when it initializes.
+  std::atomic<uint64_t> pending_signals_ = {0};
+
+  // Set while a thread is entering this enclave to deliver a signal.
+  std::atomic<bool> delivering_signal_ = {false};
 };
 
 }  // namespace asylo
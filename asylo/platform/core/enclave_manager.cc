@@ -22,12 +22,18 @@
 #include <stdint.h>
 #include <sys/ucontext.h>
 #include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <thread>
 
 #include "absl/strings/str_cat.h"
 
 #include "asylo/util/logging.h"
+#include "asylo/platform/common/bridge_functions.h"
+#include "asylo/platform/common/call_metrics.h"
 #include "asylo/platform/common/time_util.h"
+#include "asylo/platform/core/enclave_pool.h"
 #include "asylo/util/status_macros.h"
 
 namespace asylo {
@@ -143,7 +149,10 @@ HostConfig EnclaveManager::GetHostConfig() {
   return config;
 }
 
-EnclaveManager::EnclaveManager() : host_config_(GetHostConfig()) {
+EnclaveManager::EnclaveManager()
+    : client_snapshot_(std::make_shared<ClientSnapshot>()),
+      client_snapshot_version_(1),
+      host_config_(GetHostConfig()) {
   Status rc = shared_resource_manager_.RegisterUnmanagedResource(
       SharedName::Address("clock_monotonic"), &clock_monotonic_);
   if (!rc.ok()) {
@@ -166,6 +175,15 @@ Status EnclaveManager::DestroyEnclave(EnclaveClient *client,
     return Status::OkStatus();
   }
 
+  // Make sure no pool hands out the enclave while it is being destroyed.
+  {
+    absl::MutexLock lock(&pools_lock_);
+    for (EnclavePool *pool : pools_) {
+      pool->DropStandby(client);
+    }
+  }
+
+  client->StopAsyncRuns();
   if (!skip_finalize) {
     ASYLO_RETURN_IF_ERROR(client->EnterAndFinalize(final_input));
   }
@@ -174,11 +192,21 @@ Status EnclaveManager::DestroyEnclave(EnclaveClient *client,
   const Status status =
       EnclaveSignalDispatcher::GetInstance()->DeregisterAllSignalsForClient(
           client);
-  absl::WriterMutexLock lock(&client_table_lock_);
-  const auto &name = name_by_client_[client];
-  client_by_name_.erase(name);
-  name_by_client_.erase(client);
-  loader_by_client_.erase(client);
+  // The client is released only after a snapshot without it is published and
+  // the table lock is released. Readers still holding an older snapshot keep
+  // it alive until they are done.
+  std::shared_ptr<EnclaveClient> owned_client;
+  {
+    absl::WriterMutexLock lock(&client_table_lock_);
+    auto client_it = client_by_name_.find(name_by_client_[client]);
+    if (client_it != client_by_name_.end()) {
+      owned_client = std::move(client_it->second);
+      client_by_name_.erase(client_it);
+    }
+    name_by_client_.erase(client);
+    loader_by_client_.erase(client);
+    PublishClientSnapshot();
+  }
 
   return status;
 }
@@ -210,20 +238,117 @@ Status EnclaveManager::EnterAndTransferSecureSnapshotKey(
   return client->EnterAndTransferSecureSnapshotKey(fork_handshake_config);
 }
 
+Status EnclaveManager::GetCallMetrics(EnclaveClient *client,
+                                      CallMetrics *metrics) {
+  if (!metrics) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "Call metrics output is null");
+  }
+  metrics->Clear();
+  if (client) {
+    ASYLO_RETURN_IF_ERROR(client->EnterAndGetCallMetrics(metrics));
+  }
+  CallMetricsRegistry::GetInstance()->Snapshot(metrics);
+  return Status::OkStatus();
+}
+
+Status EnclaveManager::RenameEnclave(EnclaveClient *client,
+                                     const std::string &new_name) {
+  absl::WriterMutexLock lock(&client_table_lock_);
+  auto name_it = name_by_client_.find(client);
+  if (name_it == name_by_client_.end()) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "Enclave client does not exist");
+  }
+  if (client_by_name_.find(new_name) != client_by_name_.end()) {
+    return Status(error::GoogleError::ALREADY_EXISTS,
+                  "Name already exists: " + new_name);
+  }
+
+  auto client_it = client_by_name_.find(name_it->second);
+  std::shared_ptr<EnclaveClient> owned_client = std::move(client_it->second);
+  client_by_name_.erase(client_it);
+  client_by_name_.emplace(new_name, std::move(owned_client));
+  name_it->second = new_name;
+  {
+    absl::MutexLock name_lock(&client->name_mu_);
+    client->name_ = new_name;
+  }
+  PublishClientSnapshot();
+  return Status::OkStatus();
+}
+
+void EnclaveManager::RegisterPool(EnclavePool *pool) {
+  absl::MutexLock lock(&pools_lock_);
+  pools_.insert(pool);
+}
+
+void EnclaveManager::UnregisterPool(EnclavePool *pool) {
+  absl::MutexLock lock(&pools_lock_);
+  pools_.erase(pool);
+}
+
 EnclaveClient *EnclaveManager::GetClient(const std::string &name) const {
-  absl::ReaderMutexLock lock(&client_table_lock_);
-  auto it = client_by_name_.find(name);
-  if (it == client_by_name_.end()) {
+  uint64_t version;
+  std::shared_ptr<const ClientSnapshot> snapshot = GetClientSnapshot(&version);
+  auto it = snapshot->client_by_name.find(name);
+  if (it == snapshot->client_by_name.end()) {
     return nullptr;
   } else {
     return it->second.get();
   }
 }
 
+void EnclaveManager::PublishClientSnapshot() {
+  auto snapshot = std::make_shared<ClientSnapshot>();
+  snapshot->client_by_name = client_by_name_;
+  snapshot->name_by_client = name_by_client_;
+  std::atomic_store(&client_snapshot_,
+                    std::shared_ptr<const ClientSnapshot>(std::move(snapshot)));
+  client_snapshot_version_.fetch_add(1, std::memory_order_release);
+}
+
+std::shared_ptr<const EnclaveManager::ClientSnapshot>
+EnclaveManager::GetClientSnapshot(uint64_t *version) const {
+  // EnclaveManager is a singleton, so one cached snapshot per thread suffices.
+  // Only a weak reference is cached, so that a thread which stops reading the
+  // tables does not keep clients destroyed since then alive.
+  thread_local uint64_t cached_version = 0;
+  thread_local std::weak_ptr<const ClientSnapshot> cached_snapshot;
+
+  // The version is read before the snapshot, so a cached snapshot is never
+  // older than the version it is recorded under.
+  uint64_t current_version =
+      client_snapshot_version_.load(std::memory_order_acquire);
+  std::shared_ptr<const ClientSnapshot> snapshot;
+  if (current_version == cached_version) {
+    snapshot = cached_snapshot.lock();
+  }
+  if (!snapshot) {
+    snapshot = std::atomic_load(&client_snapshot_);
+    cached_snapshot = snapshot;
+    cached_version = current_version;
+  }
+  *version = current_version;
+  return snapshot;
+}
+
+EnclaveClient *EnclaveClientHandle::get() {
+  if (manager_->client_snapshot_version_.load(std::memory_order_acquire) !=
+      version_) {
+    snapshot_ = manager_->GetClientSnapshot(&version_);
+    auto it = snapshot_->client_by_name.find(name_);
+    client_ =
+        it == snapshot_->client_by_name.end() ? nullptr : it->second.get();
+  }
+  return client_;
+}
+
 const std::string EnclaveManager::GetName(const EnclaveClient *client) const {
-  absl::ReaderMutexLock lock(&client_table_lock_);
-  auto it = name_by_client_.find(client);
-  if (it == name_by_client_.end()) {
+  uint64_t version;
+  std::shared_ptr<const ClientSnapshot> snapshot = GetClientSnapshot(&version);
+  auto it = snapshot->name_by_client.find(client);
+  if (it == snapshot->name_by_client.end()) {
     return "";
   } else {
     return it->second;
@@ -294,6 +419,38 @@ Status EnclaveManager::LoadEnclave(const std::string &name,
                              enclave_size);
 }
 
+std::vector<Status> EnclaveManager::LoadEnclaves(
+    const std::vector<EnclaveLoadRequest> &requests, size_t max_concurrency) {
+  std::vector<Status> statuses(requests.size());
+  std::atomic<size_t> next_request(0);
+  auto load_requests = [this, &requests, &statuses, &next_request]() {
+    size_t i;
+    while ((i = next_request.fetch_add(1)) < requests.size()) {
+      const EnclaveLoadRequest &request = requests[i];
+      if (!request.loader) {
+        statuses[i] = Status(error::GoogleError::INVALID_ARGUMENT,
+                             "No loader for enclave: " + request.name);
+        continue;
+      }
+      statuses[i] = LoadEnclave(request.name, *request.loader, request.config);
+    }
+  };
+
+  size_t num_threads = requests.size();
+  if (max_concurrency > 0) {
+    num_threads = std::min(num_threads, max_concurrency);
+  }
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(load_requests);
+  }
+  load_requests();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  return statuses;
+}
+
 Status EnclaveManager::LoadEnclaveInternal(const std::string &name,
                                            const EnclaveLoader &loader,
                                            const EnclaveConfig &config,
@@ -324,23 +481,55 @@ Status EnclaveManager::LoadEnclaveInternal(const std::string &name,
     return result.status();
   }
 
-  // Add the client to the lookup tables.
+  // Add the client to the lookup tables, unless an enclave loaded concurrently
+  // took the name in the meantime.
   EnclaveClient *client = result.ValueOrDie().get();
+  bool name_taken;
   {
     absl::WriterMutexLock lock(&client_table_lock_);
-    client_by_name_.emplace(name, std::move(result).ValueOrDie());
-    name_by_client_.emplace(client, name);
-
-    if (config.enable_fork()) {
-      StatusOr<std::unique_ptr<EnclaveLoader>> loader_result = loader.Copy();
-      if (!loader_result.ok()) {
-        return loader_result.status();
+    name_taken = client_by_name_.find(name) != client_by_name_.end();
+    if (!name_taken) {
+      client_by_name_.emplace(name, std::move(result).ValueOrDie());
+      name_by_client_.emplace(client, name);
+      PublishClientSnapshot();
+
+      if (config.enable_fork()) {
+        StatusOr<std::unique_ptr<EnclaveLoader>> loader_result =
+            loader.Copy();
+        if (!loader_result.ok()) {
+          return loader_result.status();
+        }
+        loader_by_client_.emplace(client,
+                                  std::move(loader_result.ValueOrDie()));
       }
-      loader_by_client_.emplace(client, std::move(loader_result.ValueOrDie()));
     }
   }
-
+  if (name_taken) {
+    Status destroy_status = client->DestroyEnclave();
+    if (!destroy_status.ok()) {
+      LOG(ERROR) << "DestroyEnclave failed after name conflict: "
+                 << destroy_status;
+    }
+    Status status(error::GoogleError::ALREADY_EXISTS,
+                  "Name already exists: " + name);
+    LOG(ERROR) << "LoadEnclave failed: " << status;
+    return status;
+  }
+
+  // Share the client's queue of pending signals with the enclave while it
+  // initializes. The enclave keeps the address, so the name is not needed once
+  // initialization is done.
+  SharedName pending_signals_name =
+      SharedName::Address(absl::StrCat("pending_signals/", name));
+  bool pending_signals_shared =
+      shared_resource_manager_
+          .RegisterUnmanagedResource(pending_signals_name,
+                                     &client->pending_signals_)
+          .ok();
   Status status = client->EnterAndInitialize(config);
+  if (pending_signals_shared) {
+    shared_resource_manager_.ReleaseResource(pending_signals_name);
+  }
   // If initialization fails, don't keep the enclave registered. GetClient will
   // return a nullptr rather than an enclave in a bad state.
   if (!status.ok()) {
@@ -349,21 +538,33 @@ Status EnclaveManager::LoadEnclaveInternal(const std::string &name,
       LOG(ERROR) << "DestroyEnclave failed after EnterAndInitialize failure: "
                  << destroy_status;
     }
+    std::shared_ptr<EnclaveClient> owned_client;
     {
       absl::WriterMutexLock lock(&client_table_lock_);
-      client_by_name_.erase(name);
+      auto client_it = client_by_name_.find(name);
+      if (client_it != client_by_name_.end()) {
+        owned_client = std::move(client_it->second);
+        client_by_name_.erase(client_it);
+      }
       name_by_client_.erase(client);
       loader_by_client_.erase(client);
+      PublishClientSnapshot();
     }
   }
   return status;
 }
 
 void EnclaveManager::RemoveEnclaveReference(const std::string &name) {
+  std::shared_ptr<EnclaveClient> owned_client;
   absl::WriterMutexLock lock(&client_table_lock_);
-  EnclaveClient *client = client_by_name_[name].get();
-  client_by_name_.erase(name);
-  name_by_client_.erase(client);
+  auto client_it = client_by_name_.find(name);
+  if (client_it == client_by_name_.end()) {
+    return;
+  }
+  owned_client = std::move(client_it->second);
+  client_by_name_.erase(client_it);
+  name_by_client_.erase(owned_client.get());
+  PublishClientSnapshot();
 }
 
 void EnclaveManager::SpawnWorkerThread() {
@@ -464,14 +665,54 @@ Status EnclaveSignalDispatcher::EnterEnclaveAndHandleSignal(int signum,
                                                             void *ucontext) {
   EnclaveClient *client;
   ASYLO_ASSIGN_OR_RETURN(client, GetClientForSignal(signum));
+  int bridge_signum = ToBridgeSignal(signum);
+  if (bridge_signum <= 0 || bridge_signum > 64) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Failed to convert signum (", signum,
+                               ") to bridge signum"));
+  }
+
+  if (client->delivering_signal_.exchange(true, std::memory_order_acq_rel)) {
+    // Another thread is inside the enclave delivering a signal. Queue this one
+    // for it, or for a thread already running inside the enclave, to handle.
+    client->pending_signals_.fetch_or(UINT64_C(1) << (bridge_signum - 1),
+                                      std::memory_order_release);
+    return Status::OkStatus();
+  }
+  Status status = EnterAndHandleSignal(client, signum, info->si_code, ucontext);
+  client->delivering_signal_.store(false, std::memory_order_release);
+
+  // Deliver the signals queued after the enclave last checked the queue, which
+  // would otherwise wait for the next signal.
+  uint64_t pending =
+      client->pending_signals_.exchange(0, std::memory_order_acq_rel);
+  while (pending != 0) {
+    int bit = __builtin_ctzll(pending);
+    pending &= pending - 1;
+    int pending_signum = FromBridgeSignal(bit + 1);
+    StatusOr<EnclaveClient *> pending_client =
+        GetClientForSignal(pending_signum);
+    if (pending_client.ok()) {
+      EnterAndHandleSignal(pending_client.ValueOrDie(), pending_signum,
+                           SI_USER, /*ucontext=*/nullptr);
+    }
+  }
+  return status;
+}
+
+Status EnclaveSignalDispatcher::EnterAndHandleSignal(EnclaveClient *client,
+                                                     int signum, int code,
+                                                     void *ucontext) {
   EnclaveSignal enclave_signal;
   enclave_signal.set_signum(signum);
-  enclave_signal.set_code(info->si_code);
+  enclave_signal.set_code(code);
   enclave_signal.clear_gregs();
-  ucontext_t *uc = reinterpret_cast<ucontext_t *>(ucontext);
-  for (int greg_index = 0; greg_index < NGREG; ++greg_index) {
-    enclave_signal.add_gregs(
-        static_cast<uint64_t>(uc->uc_mcontext.gregs[greg_index]));
+  if (ucontext) {
+    ucontext_t *uc = reinterpret_cast<ucontext_t *>(ucontext);
+    for (int greg_index = 0; greg_index < NGREG; ++greg_index) {
+      enclave_signal.add_gregs(
+          static_cast<uint64_t>(uc->uc_mcontext.gregs[greg_index]));
+    }
   }
   return client->EnterAndHandleSignal(enclave_signal);
 }
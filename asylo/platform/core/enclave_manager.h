@@ -22,10 +22,15 @@
 // Declares the enclave client API, providing types and methods for loading,
 // accessing, and finalizing enclaves.
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/memory/memory.h"
 #include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
@@ -41,6 +46,7 @@
 
 namespace asylo {
 class EnclaveLoader;
+class EnclavePool;
 
 /// Enclave Manager configuration.
 class EnclaveManagerOptions {
@@ -116,6 +122,19 @@ class EnclaveManagerOptions {
   absl::variant<ConfigServerConnectionAttributes, HostConfig> host_config_info_;
 };
 
+/// Describes an enclave to load with EnclaveManager::LoadEnclaves().
+struct EnclaveLoadRequest {
+  /// Name to bind the loaded enclave under.
+  std::string name;
+
+  /// Configured enclave loader to load from. The loader is not owned, and must
+  /// outlive the call to LoadEnclaves().
+  const EnclaveLoader *loader;
+
+  /// Enclave configuration to launch the enclave with.
+  EnclaveConfig config;
+};
+
 /// A manager object responsible for creating and managing enclave instances.
 ///
 /// EnclaveManager is a singleton class that tracks the status of enclaves
@@ -212,23 +231,66 @@ class EnclaveManager {
                      EnclaveConfig config, void *base_address = nullptr,
                      const size_t enclave_size = 0);
 
+  /// Loads several enclaves concurrently.
+  ///
+  /// Each enclave is loaded and initialized as if by LoadEnclave() with a
+  /// custom config, on a pool of at most `max_concurrency` threads that
+  /// includes the calling thread. A failure to load one enclave does not affect
+  /// the others. Returns once every enclave is either loaded or failed.
+  ///
+  /// Example:
+  ///
+  /// ```
+  ///  SgxEmbeddedLoader loader(...);
+  ///  std::vector<EnclaveLoadRequest> requests;
+  ///  for (int i = 0; i < 16; ++i) {
+  ///    requests.push_back({absl::StrCat("/Replica", i), &loader, config});
+  ///  }
+  ///  std::vector<Status> statuses = LoadEnclaves(requests);
+  /// ```
+  ///
+  /// \param requests The enclaves to load.
+  /// \param max_concurrency The maximum number of enclaves loaded at the same
+  ///                        time, or 0 to load all enclaves at the same time.
+  /// \return The status of loading each enclave, in the order of `requests`.
+  std::vector<Status> LoadEnclaves(
+      const std::vector<EnclaveLoadRequest> &requests,
+      size_t max_concurrency = 0);
+
+  /// Binds a loaded enclave to a new name.
+  ///
+  /// After this call the enclave is found under `new_name` and no longer under
+  /// its previous name. The enclave itself is not entered, so code inside the
+  /// enclave still sees the name it was initialized under.
+  ///
+  /// It is an error to specify a name which is already bound to an enclave.
+  ///
+  /// \param client A client attached to the enclave to rename.
+  /// \param new_name Name to bind the enclave under.
+  Status RenameEnclave(EnclaveClient *client, const std::string &new_name)
+      LOCKS_EXCLUDED(client_table_lock_);
+
   /// Fetches a client to a loaded enclave.
   ///
+  /// This method does not block on enclaves being loaded or destroyed. Callers
+  /// that look up the same enclave repeatedly can hold an EnclaveClientHandle
+  /// instead.
+  ///
   /// \param name The name of an EnclaveClient that may be registered in the
   ///             EnclaveManager.
   /// \return A mutable pointer to the EnclaveClient if the name is
   ///         registered. Otherwise returns nullptr.
-  EnclaveClient *GetClient(const std::string &name) const
-      LOCKS_EXCLUDED(client_table_lock_);
+  EnclaveClient *GetClient(const std::string &name) const;
 
   /// Returns the name of an enclave client.
   ///
+  /// This method does not block on enclaves being loaded or destroyed.
+  ///
   /// \param client A pointer to a client that may be registered in the
   ///               EnclaveManager.
   /// \return The name of an enclave client. If no enclave matches `client` the
   ///         empty string will be returned.
-  const std::string GetName(const EnclaveClient *client) const
-      LOCKS_EXCLUDED(client_table_lock_);
+  const std::string GetName(const EnclaveClient *client) const;
 
   /// Destroys an enclave.
   ///
@@ -276,6 +338,15 @@ class EnclaveManager {
   Status EnterAndTransferSecureSnapshotKey(
       EnclaveClient *client, const ForkHandshakeConfig &fork_handshake_config);
 
+  /// Collects the number and latency of calls across the enclave boundary.
+  /// The result contains the ecalls and exit handlers timed by this process,
+  /// for all enclaves, and, if `client` is not null, the host calls made by
+  /// the enclave attached to `client`, timed inside that enclave.
+  ///
+  /// \param client A client attached to the enclave to enter, or nullptr.
+  /// \param[out] metrics The collected call metrics.
+  Status GetCallMetrics(EnclaveClient *client, CallMetrics *metrics);
+
   /// Fetches the shared resource manager object.
   ///
   /// \return The SharedResourceManager instance.
@@ -296,6 +367,19 @@ class EnclaveManager {
       LOCKS_EXCLUDED(client_table_lock_);
 
  private:
+  friend class EnclaveClientHandle;
+  friend class EnclavePool;
+
+  // An immutable copy of the client lookup tables. A new snapshot is published
+  // each time the tables change, so readers never wait for writers. A snapshot
+  // shares ownership of its clients, so a client removed from the tables is
+  // not freed while an EnclaveClientHandle still holds an older snapshot.
+  struct ClientSnapshot {
+    absl::flat_hash_map<std::string, std::shared_ptr<EnclaveClient>>
+        client_by_name;
+    absl::flat_hash_map<const EnclaveClient *, std::string> name_by_client;
+  };
+
   EnclaveManager() EXCLUSIVE_LOCKS_REQUIRED(mu_);
   EnclaveManager(EnclaveManager const &) = delete;
   EnclaveManager &operator=(EnclaveManager const &) = delete;
@@ -314,11 +398,29 @@ class EnclaveManager {
                              const size_t enclave_size = 0)
       LOCKS_EXCLUDED(client_table_lock_);
 
+  // Publishes a snapshot of the current client lookup tables to readers.
+  void PublishClientSnapshot() EXCLUSIVE_LOCKS_REQUIRED(client_table_lock_);
+
+  // Returns the latest published snapshot of the client lookup tables and sets
+  // |version| to its version. Each thread caches a weak reference to the last
+  // snapshot it read, so as long as the tables do not change this does not
+  // take the lock guarding |client_snapshot_|. The cache never keeps a
+  // snapshot, or the clients in it, alive.
+  std::shared_ptr<const ClientSnapshot> GetClientSnapshot(
+      uint64_t *version) const;
+
   // Deletes an enclave client reference that points to an enclave that no
   // longer exists. This should only happen during fork.
   void RemoveEnclaveReference(const std::string &name)
       LOCKS_EXCLUDED(client_table_lock_);
 
+  // Registers |pool|, so that its standby enclaves are dropped from it when
+  // they are destroyed.
+  void RegisterPool(EnclavePool *pool) LOCKS_EXCLUDED(pools_lock_);
+
+  // Unregisters a pool registered with RegisterPool().
+  void UnregisterPool(EnclavePool *pool) LOCKS_EXCLUDED(pools_lock_);
+
   // Create a thread to periodically update logic.
   void SpawnWorkerThread();
 
@@ -341,14 +443,28 @@ class EnclaveManager {
   // |loader_by_client_| tables.
   mutable absl::Mutex client_table_lock_;
 
-  absl::flat_hash_map<std::string, std::unique_ptr<EnclaveClient>> client_by_name_
-      GUARDED_BY(client_table_lock_);
+  absl::flat_hash_map<std::string, std::shared_ptr<EnclaveClient>>
+      client_by_name_ GUARDED_BY(client_table_lock_);
   absl::flat_hash_map<const EnclaveClient *, std::string> name_by_client_
       GUARDED_BY(client_table_lock_);
 
   absl::flat_hash_map<const EnclaveClient *, std::unique_ptr<EnclaveLoader>>
       loader_by_client_ GUARDED_BY(client_table_lock_);
 
+  // The latest snapshot of |client_by_name_| and |name_by_client_|. Written
+  // under |client_table_lock_| and read without it, always through
+  // std::atomic_load and std::atomic_store.
+  std::shared_ptr<const ClientSnapshot> client_snapshot_;
+
+  // Version of |client_snapshot_|, incremented after each publication.
+  std::atomic<uint64_t> client_snapshot_version_;
+
+  // A mutex guarding |pools_|. Acquired before the mutex of any pool.
+  absl::Mutex pools_lock_;
+
+  // Pools holding standby enclaves loaded by this manager.
+  absl::flat_hash_set<EnclavePool *> pools_ GUARDED_BY(pools_lock_);
+
   // A part of the configuration for enclaves launched by the enclave manager
   // comes from the Asylo daemon. This member caches such configuration.
   HostConfig host_config_;
@@ -367,6 +483,62 @@ class EnclaveManager {
   static EnclaveManager *instance_ GUARDED_BY(mu_);
 };
 
+/// A cached reference to the enclave bound to a name.
+///
+/// A handle resolves its name once and re-resolves it only after an enclave is
+/// loaded, renamed or destroyed anywhere in the EnclaveManager, so repeated
+/// lookups through a handle cost a single atomic load. A handle never returns
+/// a client that was destroyed before the call to get(). A client returned by
+/// get() is not freed until the next call to get() or until the handle is
+/// destroyed, even if the enclave is destroyed meanwhile.
+///
+/// Example:
+///
+/// ```
+///   EnclaveClientHandle handle(manager, "/EchoEnclave");
+///   ...
+///   EnclaveClient *client = handle.get();
+///   if (client) {
+///     client->EnterAndRun(input, &output);
+///   }
+/// ```
+///
+/// This class is not thread-safe. Threads sharing an enclave should each hold
+/// their own handle.
+class EnclaveClientHandle {
+ public:
+  /// Creates a handle to the enclave bound to `name` in `manager`.
+  ///
+  /// \param manager The EnclaveManager to look up the enclave in.
+  /// \param name The name of the enclave.
+  EnclaveClientHandle(const EnclaveManager *manager, std::string name)
+      : manager_(manager),
+        name_(std::move(name)),
+        version_(0),
+        client_(nullptr) {}
+
+  /// Fetches the client of the enclave currently bound to the name of this
+  /// handle.
+  ///
+  /// \return A mutable pointer to the EnclaveClient if the name is
+  ///         registered. Otherwise returns nullptr.
+  EnclaveClient *get();
+
+  /// Returns the name this handle looks up.
+  const std::string &name() const { return name_; }
+
+ private:
+  const EnclaveManager *manager_;
+  std::string name_;
+  uint64_t version_;
+
+  // The snapshot |client_| was found in. Holding it keeps |client_| alive
+  // until the next call to get() after the client tables change, or until
+  // the handle is destroyed.
+  std::shared_ptr<const EnclaveManager::ClientSnapshot> snapshot_;
+  EnclaveClient *client_;
+};
+
 /// An abstract enclave loader.
 ///
 /// Host applications must load an enclave before using it. This is accomplished
@@ -378,6 +550,7 @@ class EnclaveLoader {
  protected:
   // Only allow the enclave loading via the manager object.
   friend class EnclaveManager;
+  friend class EnclavePool;
 
   // Loads an enclave, returning a pointer to a client on success and a non-ok
   // status on failure.
@@ -425,6 +598,11 @@ class EnclaveSignalDispatcher {
   // Looks for the enclave client that registered |signum|, and calls
   // EnterAndHandleSignal() with that enclave client. |signum|, |info| and
   // |ucontext| are passed into the enclave.
+  //
+  // If another signal is being delivered to the same enclave at the same time,
+  // |signum| is instead queued for that enclave, and is handled by the thread
+  // delivering the other signal or by a thread already running inside the
+  // enclave. Queued signals of the same number are coalesced.
   Status EnterEnclaveAndHandleSignal(int signum, siginfo_t *info,
                                      void *ucontext);
 
@@ -433,6 +611,10 @@ class EnclaveSignalDispatcher {
   EnclaveSignalDispatcher(EnclaveSignalDispatcher const &) = delete;
   void operator=(EnclaveSignalDispatcher const &) = delete;
 
+  // Enters the enclave attached to |client| to handle |signum|.
+  Status EnterAndHandleSignal(EnclaveClient *client, int signum, int code,
+                              void *ucontext);
+
   // Mapping of signal number to the enclave client that registered it.
   absl::flat_hash_map<int, EnclaveClient *> signal_to_client_map_
       GUARDED_BY(signal_enclave_map_lock_);
@@ -0,0 +1,406 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/core/enclave_manager.h"
+
+#include <signal.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "asylo/enclave.pb.h"
+#include "asylo/platform/common/bridge_functions.h"
+#include "asylo/platform/core/enclave_client.h"
+#include "asylo/platform/core/shared_name.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/util/status.h"
+
+namespace asylo {
+namespace {
+
+using ::testing::ElementsAre;
+
+// An enclave client that does not attach to a real enclave. It records the
+// signals delivered to it, and the queue of pending signals it was given when
+// it initialized.
+class FakeClient : public EnclaveClient {
+ public:
+  explicit FakeClient(const std::string &name) : EnclaveClient(name) {}
+
+  ~FakeClient() override {
+    if (deleted) {
+      *deleted = true;
+    }
+  }
+
+  Status EnterAndRun(const EnclaveInput &input,
+                     EnclaveOutput *output) override {
+    return Status::OkStatus();
+  }
+
+  // Signals delivered to the enclave, in order.
+  std::vector<int> handled_signals;
+
+  // Signals raised on the host while the enclave handles a SIGUSR1.
+  std::vector<int> signals_raised_in_handler;
+
+  // The queue of pending signals shared with the enclave.
+  std::atomic<uint64_t> *pending_signals = nullptr;
+
+  // The pending signals observed while the enclave handles a SIGUSR1.
+  uint64_t pending_in_handler = 0;
+
+  // Set when the client is deleted, if not null.
+  bool *deleted = nullptr;
+
+ private:
+  Status EnterAndInitialize(const EnclaveConfig &config) override {
+    SharedName name =
+        SharedName::Address(absl::StrCat("pending_signals/", get_name()));
+    SharedResourceManager *resources =
+        EnclaveManager::Instance().ValueOrDie()->shared_resources();
+    pending_signals = resources->AcquireResource<std::atomic<uint64_t>>(name);
+    if (pending_signals) {
+      resources->ReleaseResource(name);
+    }
+    return Status::OkStatus();
+  }
+
+  Status EnterAndFinalize(const EnclaveFinal &final_input) override {
+    return Status::OkStatus();
+  }
+
+  Status EnterAndDonateThread() override { return Status::OkStatus(); }
+
+  Status EnterAndHandleSignal(const EnclaveSignal &signal) override {
+    handled_signals.push_back(signal.signum());
+    if (signal.signum() == SIGUSR1) {
+      siginfo_t info = {};
+      info.si_code = SI_USER;
+      for (int signum : signals_raised_in_handler) {
+        Status status =
+            EnclaveSignalDispatcher::GetInstance()->EnterEnclaveAndHandleSignal(
+                signum, &info, /*ucontext=*/nullptr);
+        if (!status.ok()) {
+          return status;
+        }
+      }
+      pending_in_handler = pending_signals ? pending_signals->load() : 0;
+    }
+    return Status::OkStatus();
+  }
+
+  Status EnterAndTakeSnapshot(SnapshotLayout *snapshot_layout) override {
+    return Status::OkStatus();
+  }
+
+  Status EnterAndRestore(const SnapshotLayout &snapshot_layout) override {
+    return Status::OkStatus();
+  }
+
+  Status EnterAndTransferSecureSnapshotKey(
+      const ForkHandshakeConfig &fork_handshake_config) override {
+    return Status::OkStatus();
+  }
+
+  Status DestroyEnclave() override { return Status::OkStatus(); }
+};
+
+// A loader of FakeClient enclaves.
+class FakeLoader : public EnclaveLoader {
+ private:
+  StatusOr<std::unique_ptr<EnclaveClient>> LoadEnclave(
+      const std::string &name, void *base_address, const size_t enclave_size,
+      const EnclaveConfig &config) const override {
+    return std::unique_ptr<EnclaveClient>(absl::make_unique<FakeClient>(name));
+  }
+
+  StatusOr<std::unique_ptr<EnclaveLoader>> Copy() const override {
+    return std::unique_ptr<EnclaveLoader>(absl::make_unique<FakeLoader>());
+  }
+};
+
+// A loader of FakeClient enclaves that records how many enclaves it loads at
+// the same time, and fails to load enclaves named |failing_name|. Each load
+// waits until |overlap| enclaves have been loading at the same time, or until
+// a timeout expires, so that at least |overlap| loads overlap if the caller
+// lets them.
+class ConcurrencyTrackingLoader : public EnclaveLoader {
+ public:
+  explicit ConcurrencyTrackingLoader(const std::string &failing_name = "",
+                                     int overlap = 1)
+      : failing_name_(failing_name),
+        overlap_(overlap),
+        loading_(0),
+        max_loading_(0) {}
+
+  // Returns the largest number of enclaves loaded at the same time.
+  int max_loading() const {
+    absl::MutexLock lock(&mu_);
+    return max_loading_;
+  }
+
+ private:
+  StatusOr<std::unique_ptr<EnclaveClient>> LoadEnclave(
+      const std::string &name, void *base_address, const size_t enclave_size,
+      const EnclaveConfig &config) const override {
+    {
+      absl::MutexLock lock(&mu_);
+      max_loading_ = std::max(max_loading_, ++loading_);
+      auto overlapped = [this]() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        return max_loading_ >= overlap_;
+      };
+      mu_.AwaitWithTimeout(absl::Condition(&overlapped), absl::Seconds(10));
+    }
+    // Keep loading for a moment, so that any load beyond |overlap| would be
+    // seen.
+    absl::SleepFor(absl::Milliseconds(5));
+    {
+      absl::MutexLock lock(&mu_);
+      --loading_;
+    }
+    if (name == failing_name_) {
+      return Status(error::GoogleError::INTERNAL, "Failed to load " + name);
+    }
+    return std::unique_ptr<EnclaveClient>(absl::make_unique<FakeClient>(name));
+  }
+
+  StatusOr<std::unique_ptr<EnclaveLoader>> Copy() const override {
+    return std::unique_ptr<EnclaveLoader>(
+        absl::make_unique<ConcurrencyTrackingLoader>(failing_name_, overlap_));
+  }
+
+  const std::string failing_name_;
+  const int overlap_;
+  mutable absl::Mutex mu_;
+  mutable int loading_ GUARDED_BY(mu_);
+  mutable int max_loading_ GUARDED_BY(mu_);
+};
+
+// Returns the bit of |signum| in a queue of pending signals.
+uint64_t PendingBit(int signum) {
+  return UINT64_C(1) << (ToBridgeSignal(signum) - 1);
+}
+
+class EnclaveManagerTest : public ::testing::Test {
+ protected:
+  static void SetUpTestCase() {
+    EnclaveManager::Configure(EnclaveManagerOptions());
+  }
+
+  void SetUp() override {
+    ASYLO_ASSERT_OK_AND_ASSIGN(manager_, EnclaveManager::Instance());
+  }
+
+  // Loads a FakeClient enclave named |name|.
+  FakeClient *LoadFakeEnclave(const std::string &name) {
+    Status status = manager_->LoadEnclave(name, FakeLoader());
+    EXPECT_THAT(status, IsOk());
+    return static_cast<FakeClient *>(manager_->GetClient(name));
+  }
+
+  // Destroys the enclaves named in |requests| that were loaded.
+  void DestroyLoaded(const std::vector<EnclaveLoadRequest> &requests) {
+    for (const EnclaveLoadRequest &request : requests) {
+      EnclaveClient *client = manager_->GetClient(request.name);
+      if (client) {
+        ASYLO_EXPECT_OK(manager_->DestroyEnclave(client, EnclaveFinal()));
+      }
+    }
+  }
+
+  EnclaveManager *manager_;
+};
+
+// Verifies that a destroyed client is not freed while a handle still holds the
+// snapshot of the client tables it found the client in.
+TEST_F(EnclaveManagerTest, KeepsDestroyedClientForOlderSnapshots) {
+  FakeClient *client = LoadFakeEnclave("/OlderSnapshot");
+  ASSERT_NE(client, nullptr);
+  bool deleted = false;
+  client->deleted = &deleted;
+
+  // The handle's snapshot still holds the client once it is destroyed.
+  EnclaveClientHandle handle(manager_, "/OlderSnapshot");
+  EXPECT_EQ(handle.get(), client);
+  ASYLO_EXPECT_OK(manager_->DestroyEnclave(client, EnclaveFinal()));
+  EXPECT_FALSE(deleted);
+
+  // Reading the tables again drops the older snapshot.
+  EXPECT_EQ(handle.get(), nullptr);
+  EXPECT_TRUE(deleted);
+}
+
+// Verifies that a thread which looked up a client without a handle does not
+// keep the client alive once it is destroyed, even if the thread never reads
+// the client tables again.
+TEST_F(EnclaveManagerTest, FreesDestroyedClientReadByIdleThread) {
+  FakeClient *client = LoadFakeEnclave("/IdleReader");
+  ASSERT_NE(client, nullptr);
+  bool deleted = false;
+  client->deleted = &deleted;
+
+  // The reader stays alive, without reading again, until the client is
+  // destroyed.
+  absl::Notification read;
+  absl::Notification destroyed;
+  std::thread reader([this, client, &read, &destroyed] {
+    EXPECT_EQ(manager_->GetClient("/IdleReader"), client);
+    EXPECT_EQ(manager_->GetName(client), "/IdleReader");
+    read.Notify();
+    destroyed.WaitForNotification();
+  });
+  read.WaitForNotification();
+  EXPECT_EQ(manager_->GetClient("/IdleReader"), client);
+
+  ASYLO_EXPECT_OK(manager_->DestroyEnclave(client, EnclaveFinal()));
+  EXPECT_TRUE(deleted);
+  destroyed.Notify();
+  reader.join();
+}
+
+// Verifies that LoadEnclaves() reports the status of each request at the
+// position of the request, including requests without a loader.
+TEST_F(EnclaveManagerTest, LoadEnclavesReturnsStatusesInRequestOrder) {
+  ConcurrencyTrackingLoader loader("/BatchFailing");
+  std::vector<EnclaveLoadRequest> requests = {
+      {"/BatchFirst", &loader, EnclaveConfig()},
+      {"/BatchNoLoader", nullptr, EnclaveConfig()},
+      {"/BatchFailing", &loader, EnclaveConfig()},
+      {"/BatchLast", &loader, EnclaveConfig()},
+  };
+
+  std::vector<Status> statuses = manager_->LoadEnclaves(requests);
+  ASSERT_EQ(statuses.size(), requests.size());
+  EXPECT_THAT(statuses[0], IsOk());
+  EXPECT_THAT(statuses[1], StatusIs(error::GoogleError::INVALID_ARGUMENT));
+  EXPECT_THAT(statuses[2], StatusIs(error::GoogleError::INTERNAL));
+  EXPECT_THAT(statuses[3], IsOk());
+  EXPECT_NE(manager_->GetClient("/BatchFirst"), nullptr);
+  EXPECT_EQ(manager_->GetClient("/BatchNoLoader"), nullptr);
+  EXPECT_EQ(manager_->GetClient("/BatchFailing"), nullptr);
+  EXPECT_NE(manager_->GetClient("/BatchLast"), nullptr);
+
+  DestroyLoaded(requests);
+}
+
+// Verifies that when a batch names the same enclave twice, exactly one of the
+// requests loads it.
+TEST_F(EnclaveManagerTest, LoadEnclavesLoadsDuplicateNameOnce) {
+  ConcurrencyTrackingLoader loader;
+  std::vector<EnclaveLoadRequest> requests = {
+      {"/BatchDuplicate", &loader, EnclaveConfig()},
+      {"/BatchDuplicate", &loader, EnclaveConfig()},
+  };
+
+  std::vector<Status> statuses = manager_->LoadEnclaves(requests);
+  ASSERT_EQ(statuses.size(), requests.size());
+  int num_loaded = 0;
+  for (const Status &status : statuses) {
+    if (status.ok()) {
+      ++num_loaded;
+    } else {
+      EXPECT_THAT(status, StatusIs(error::GoogleError::ALREADY_EXISTS));
+    }
+  }
+  EXPECT_EQ(num_loaded, 1);
+  EXPECT_NE(manager_->GetClient("/BatchDuplicate"), nullptr);
+
+  DestroyLoaded({requests[0]});
+}
+
+// Verifies that LoadEnclaves() loads |max_concurrency| enclaves at the same
+// time, and no more. Each load waits until the limit is reached, so the loads
+// are known to overlap.
+TEST_F(EnclaveManagerTest, LoadEnclavesHonorsMaxConcurrency) {
+  constexpr int kNumEnclaves = 8;
+  constexpr int kMaxConcurrency = 2;
+  ConcurrencyTrackingLoader loader(/*failing_name=*/"", kMaxConcurrency);
+  std::vector<EnclaveLoadRequest> requests;
+  for (int i = 0; i < kNumEnclaves; ++i) {
+    requests.push_back(
+        {absl::StrCat("/BatchConcurrent", i), &loader, EnclaveConfig()});
+  }
+
+  std::vector<Status> statuses =
+      manager_->LoadEnclaves(requests, kMaxConcurrency);
+  for (const Status &status : statuses) {
+    EXPECT_THAT(status, IsOk());
+  }
+  EXPECT_EQ(loader.max_loading(), kMaxConcurrency);
+
+  DestroyLoaded(requests);
+}
+
+// Verifies that each enclave is given its own queue of pending signals while
+// it initializes, and that the queue's name is released afterwards.
+TEST_F(EnclaveManagerTest, SharesPendingSignalsPerEnclave) {
+  FakeClient *first = LoadFakeEnclave("/PendingFirst");
+  FakeClient *second = LoadFakeEnclave("/PendingSecond");
+  ASSERT_NE(first, nullptr);
+  ASSERT_NE(second, nullptr);
+  EXPECT_NE(first->pending_signals, nullptr);
+  EXPECT_NE(second->pending_signals, nullptr);
+  EXPECT_NE(first->pending_signals, second->pending_signals);
+  EXPECT_EQ(manager_->shared_resources()->AcquireResource<void>(
+                SharedName::Address("pending_signals//PendingFirst")),
+            nullptr);
+
+  ASYLO_EXPECT_OK(manager_->DestroyEnclave(first, EnclaveFinal()));
+  ASYLO_EXPECT_OK(manager_->DestroyEnclave(second, EnclaveFinal()));
+}
+
+// Verifies that signals raised while a signal is being delivered to the same
+// enclave are queued for it, coalesced, and delivered once the first delivery
+// returns.
+TEST_F(EnclaveManagerTest, CoalescesSignalsRaisedDuringDelivery) {
+  FakeClient *client = LoadFakeEnclave("/Coalesce");
+  ASSERT_NE(client, nullptr);
+  client->signals_raised_in_handler = {SIGUSR2, SIGUSR2, SIGALRM};
+  EnclaveSignalDispatcher *dispatcher = EnclaveSignalDispatcher::GetInstance();
+  dispatcher->RegisterSignal(SIGUSR1, client);
+  dispatcher->RegisterSignal(SIGUSR2, client);
+  dispatcher->RegisterSignal(SIGALRM, client);
+
+  siginfo_t info = {};
+  info.si_code = SI_USER;
+  ASYLO_EXPECT_OK(dispatcher->EnterEnclaveAndHandleSignal(
+      SIGUSR1, &info, /*ucontext=*/nullptr));
+  EXPECT_EQ(client->pending_in_handler,
+            PendingBit(SIGUSR2) | PendingBit(SIGALRM));
+  EXPECT_THAT(client->handled_signals, ElementsAre(SIGUSR1, SIGUSR2, SIGALRM));
+  EXPECT_EQ(client->pending_signals->load(), 0);
+
+  ASYLO_EXPECT_OK(dispatcher->DeregisterAllSignalsForClient(client));
+  ASYLO_EXPECT_OK(manager_->DestroyEnclave(client, EnclaveFinal()));
+}
+
+}  // namespace
+}  // namespace asylo
@@ -0,0 +1,183 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/core/enclave_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "asylo/util/logging.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace {
+
+// Prefix of the names standby enclaves are registered under.
+constexpr char kStandbyNamePrefix[] = "/asylo/enclave_pool/";
+
+// How long the refill thread waits after failing to load an enclave.
+const absl::Duration kRefillRetryDelay = absl::Seconds(1);
+
+}  // namespace
+
+StatusOr<std::unique_ptr<EnclavePool>> EnclavePool::Create(
+    EnclaveManager *manager, const EnclaveLoader &loader, EnclaveConfig config,
+    size_t size) {
+  if (!manager) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "Enclave pool requires an enclave manager");
+  }
+  std::unique_ptr<EnclaveLoader> loader_copy;
+  ASYLO_ASSIGN_OR_RETURN(loader_copy, loader.Copy());
+  std::unique_ptr<EnclavePool> pool(new EnclavePool(
+      manager, std::move(loader_copy), std::move(config), size));
+  EnclavePool *pool_ptr = pool.get();
+  manager->RegisterPool(pool_ptr);
+  pool->refill_thread_ = std::thread([pool_ptr] { pool_ptr->RefillLoop(); });
+  return std::move(pool);
+}
+
+EnclavePool::EnclavePool(EnclaveManager *manager,
+                         std::unique_ptr<EnclaveLoader> loader,
+                         EnclaveConfig config, size_t size)
+    : manager_(manager),
+      loader_(std::move(loader)),
+      config_(std::move(config)),
+      size_(size),
+      loading_(0),
+      next_standby_index_(0),
+      stopping_(false) {}
+
+EnclavePool::~EnclavePool() {
+  {
+    absl::MutexLock lock(&mu_);
+    stopping_ = true;
+  }
+  if (refill_thread_.joinable()) {
+    refill_thread_.join();
+  }
+  manager_->UnregisterPool(this);
+
+  std::deque<EnclaveClient *> standby;
+  {
+    absl::MutexLock lock(&mu_);
+    standby.swap(standby_);
+  }
+  for (EnclaveClient *client : standby) {
+    Status status = manager_->DestroyEnclave(client, EnclaveFinal());
+    if (!status.ok()) {
+      LOG(ERROR) << "Failed to destroy standby enclave: " << status;
+    }
+  }
+}
+
+StatusOr<EnclaveClient *> EnclavePool::Acquire(const std::string &name) {
+  EnclaveClient *client = nullptr;
+  std::string standby_name;
+  {
+    absl::MutexLock lock(&mu_);
+    if (!standby_.empty()) {
+      client = standby_.front();
+      standby_.pop_front();
+      standby_name = manager_->GetName(client);
+      in_transit_.insert(standby_name);
+    }
+  }
+
+  if (!client) {
+    ASYLO_RETURN_IF_ERROR(manager_->LoadEnclave(name, *loader_, config_));
+    client = manager_->GetClient(name);
+    if (!client) {
+      return Status(error::GoogleError::NOT_FOUND,
+                    "Enclave was destroyed while being acquired: " + name);
+    }
+    return client;
+  }
+
+  Status status = manager_->RenameEnclave(client, name);
+  absl::MutexLock lock(&mu_);
+  // If the enclave started being destroyed meanwhile, DropStandby() already
+  // removed its name and |client| must not be used again.
+  bool owned = in_transit_.erase(standby_name) > 0;
+  if (!status.ok()) {
+    if (owned && status.error_code() == error::GoogleError::ALREADY_EXISTS) {
+      // Keep the enclave for the next caller.
+      standby_.push_front(client);
+    }
+    return status;
+  }
+  return client;
+}
+
+size_t EnclavePool::standby_count() const {
+  absl::MutexLock lock(&mu_);
+  return standby_.size();
+}
+
+void EnclavePool::DropStandby(const EnclaveClient *client) {
+  absl::MutexLock lock(&mu_);
+  standby_.erase(std::remove(standby_.begin(), standby_.end(), client),
+                 standby_.end());
+  if (!in_transit_.empty()) {
+    in_transit_.erase(manager_->GetName(client));
+  }
+}
+
+bool EnclavePool::RefillNeeded() {
+  return stopping_ || standby_.size() + loading_ < size_;
+}
+
+void EnclavePool::RefillLoop() {
+  absl::MutexLock lock(&mu_);
+  while (true) {
+    mu_.Await(absl::Condition(this, &EnclavePool::RefillNeeded));
+    if (stopping_) {
+      return;
+    }
+    std::string name = NextStandbyName();
+    ++loading_;
+    in_transit_.insert(name);
+
+    mu_.Unlock();
+    Status status = manager_->LoadEnclave(name, *loader_, config_);
+    EnclaveClient *client = status.ok() ? manager_->GetClient(name) : nullptr;
+    mu_.Lock();
+
+    --loading_;
+    if (in_transit_.erase(name) == 0) {
+      // The enclave was destroyed as soon as it was loaded.
+      continue;
+    }
+    if (client) {
+      standby_.push_back(client);
+      continue;
+    }
+    LOG(ERROR) << "Failed to load standby enclave: " << status;
+    // Back off rather than retrying a failing load in a tight loop.
+    mu_.AwaitWithTimeout(absl::Condition(&stopping_), kRefillRetryDelay);
+  }
+}
+
+std::string EnclavePool::NextStandbyName() {
+  return absl::StrCat(kStandbyNamePrefix, reinterpret_cast<uintptr_t>(this),
+                      "/", next_standby_index_++);
+}
+
+}  // namespace asylo
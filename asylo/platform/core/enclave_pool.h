@@ -0,0 +1,148 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_CORE_ENCLAVE_POOL_H_
+#define ASYLO_PLATFORM_CORE_ENCLAVE_POOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/enclave.pb.h"
+#include "asylo/platform/core/enclave_client.h"
+#include "asylo/platform/core/enclave_manager.h"
+#include "asylo/util/status.h"
+
+namespace asylo {
+
+/// A pool of loaded and initialized enclaves kept on standby.
+///
+/// Loading and initializing an enclave is expensive. An EnclavePool keeps a
+/// fixed number of enclaves, all loaded by the same loader with the same
+/// configuration, loaded and initialized ahead of time. Acquire() binds one of
+/// them to a name of the caller's choosing and hands it out, and a background
+/// thread loads a replacement.
+///
+/// Standby enclaves are registered with the EnclaveManager under reserved
+/// names, and are renamed with EnclaveManager::RenameEnclave() when acquired.
+/// Enclaves handed out by the pool are owned by the EnclaveManager like any
+/// other enclave, and are destroyed with EnclaveManager::DestroyEnclave(). A
+/// standby enclave destroyed through the EnclaveManager is dropped from the
+/// pool and replaced.
+///
+/// Example:
+///
+/// ```
+///   auto pool_result = EnclavePool::Create(manager, loader, config, 4);
+///   ...
+///   std::unique_ptr<EnclavePool> pool = std::move(pool_result).ValueOrDie();
+///   StatusOr<EnclaveClient *> client_result = pool->Acquire("/Tenant1");
+/// ```
+///
+/// This class is thread-safe.
+class EnclavePool {
+ public:
+  /// Creates a pool that keeps `size` enclaves on standby and starts loading
+  /// them in the background.
+  ///
+  /// \param manager The EnclaveManager to load enclaves with.
+  /// \param loader Configured enclave loader to load from. The pool keeps its
+  ///               own copy of the loader.
+  /// \param config Enclave configuration to launch the enclaves with.
+  /// \param size The number of enclaves to keep on standby.
+  /// \return The new pool, or an error if `loader` cannot be copied.
+  static StatusOr<std::unique_ptr<EnclavePool>> Create(
+      EnclaveManager *manager, const EnclaveLoader &loader,
+      EnclaveConfig config, size_t size);
+
+  EnclavePool(const EnclavePool &other) = delete;
+  EnclavePool &operator=(const EnclavePool &other) = delete;
+
+  /// Stops refilling the pool and destroys the enclaves still on standby.
+  /// Enclaves already handed out are not affected.
+  ~EnclavePool();
+
+  /// Hands out an enclave bound to `name`.
+  ///
+  /// If no enclave is on standby, a new enclave is loaded and initialized
+  /// before this call returns.
+  ///
+  /// \param name Name to bind the enclave under.
+  /// \return A client attached to the enclave, or an error if `name` is
+  ///         already bound to an enclave or no enclave could be loaded.
+  StatusOr<EnclaveClient *> Acquire(const std::string &name)
+      LOCKS_EXCLUDED(mu_);
+
+  /// Returns the number of enclaves currently on standby.
+  size_t standby_count() const LOCKS_EXCLUDED(mu_);
+
+ private:
+  friend class EnclaveManager;
+
+  EnclavePool(EnclaveManager *manager, std::unique_ptr<EnclaveLoader> loader,
+              EnclaveConfig config, size_t size);
+
+  // Removes |client| from the standby enclaves, if it is one of them. Called
+  // by the EnclaveManager before it destroys an enclave.
+  void DropStandby(const EnclaveClient *client) LOCKS_EXCLUDED(mu_);
+
+  // Returns true if the refill thread should stop or load another enclave.
+  bool RefillNeeded() EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Top level loop run by the refill thread.
+  void RefillLoop() LOCKS_EXCLUDED(mu_);
+
+  // Returns a reserved name, not yet used, for a standby enclave.
+  std::string NextStandbyName() EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  EnclaveManager *const manager_;
+  const std::unique_ptr<EnclaveLoader> loader_;
+  const EnclaveConfig config_;
+  const size_t size_;
+
+  mutable absl::Mutex mu_;
+
+  // Enclaves on standby, oldest first.
+  std::deque<EnclaveClient *> standby_ GUARDED_BY(mu_);
+
+  // Number of standby enclaves the refill thread is loading.
+  size_t loading_ GUARDED_BY(mu_);
+
+  // Standby names of the enclaves being loaded by the refill thread or handed
+  // out by Acquire(), which are not in |standby_|. DropStandby() removes the
+  // name of an enclave being destroyed, so that it is not put on standby.
+  absl::flat_hash_set<std::string> in_transit_ GUARDED_BY(mu_);
+
+  // Index used to form the next standby name.
+  uint64_t next_standby_index_ GUARDED_BY(mu_);
+
+  // Set when the pool is being destroyed.
+  bool stopping_ GUARDED_BY(mu_);
+
+  std::thread refill_thread_;
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_CORE_ENCLAVE_POOL_H_
@@ -0,0 +1,199 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/core/enclave_pool.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "asylo/enclave.pb.h"
+#include "asylo/platform/core/enclave_client.h"
+#include "asylo/platform/core/enclave_manager.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/util/status.h"
+
+namespace asylo {
+namespace {
+
+// Number of fake enclaves that are initialized and not yet destroyed.
+std::atomic<int> live_enclaves(0);
+
+// An enclave client that does not attach to a real enclave.
+class FakeClient : public EnclaveClient {
+ public:
+  explicit FakeClient(const std::string &name) : EnclaveClient(name) {}
+
+  Status EnterAndRun(const EnclaveInput &input,
+                     EnclaveOutput *output) override {
+    return Status::OkStatus();
+  }
+
+ private:
+  Status EnterAndInitialize(const EnclaveConfig &config) override {
+    ++live_enclaves;
+    return Status::OkStatus();
+  }
+
+  Status EnterAndFinalize(const EnclaveFinal &final_input) override {
+    return Status::OkStatus();
+  }
+
+  Status EnterAndDonateThread() override { return Status::OkStatus(); }
+
+  Status EnterAndHandleSignal(const EnclaveSignal &signal) override {
+    return Status::OkStatus();
+  }
+
+  Status EnterAndTakeSnapshot(SnapshotLayout *snapshot_layout) override {
+    return Status::OkStatus();
+  }
+
+  Status EnterAndRestore(const SnapshotLayout &snapshot_layout) override {
+    return Status::OkStatus();
+  }
+
+  Status EnterAndTransferSecureSnapshotKey(
+      const ForkHandshakeConfig &fork_handshake_config) override {
+    return Status::OkStatus();
+  }
+
+  Status DestroyEnclave() override {
+    --live_enclaves;
+    return Status::OkStatus();
+  }
+};
+
+// A loader of FakeClient enclaves.
+class FakeLoader : public EnclaveLoader {
+ private:
+  StatusOr<std::unique_ptr<EnclaveClient>> LoadEnclave(
+      const std::string &name, void *base_address, const size_t enclave_size,
+      const EnclaveConfig &config) const override {
+    return std::unique_ptr<EnclaveClient>(absl::make_unique<FakeClient>(name));
+  }
+
+  StatusOr<std::unique_ptr<EnclaveLoader>> Copy() const override {
+    return std::unique_ptr<EnclaveLoader>(absl::make_unique<FakeLoader>());
+  }
+};
+
+constexpr size_t kPoolSize = 3;
+
+class EnclavePoolTest : public ::testing::Test {
+ protected:
+  static void SetUpTestCase() {
+    EnclaveManager::Configure(EnclaveManagerOptions());
+  }
+
+  void SetUp() override {
+    ASYLO_ASSERT_OK_AND_ASSIGN(manager_, EnclaveManager::Instance());
+    ASYLO_ASSERT_OK_AND_ASSIGN(
+        pool_, EnclavePool::Create(manager_, FakeLoader(), EnclaveConfig(),
+                                   kPoolSize));
+  }
+
+  // Waits until the pool holds |kPoolSize| standby enclaves.
+  void WaitForFullPool() {
+    absl::Time deadline = absl::Now() + absl::Seconds(10);
+    while (pool_->standby_count() < kPoolSize && absl::Now() < deadline) {
+      absl::SleepFor(absl::Milliseconds(1));
+    }
+    ASSERT_EQ(pool_->standby_count(), kPoolSize);
+  }
+
+  EnclaveManager *manager_;
+  std::unique_ptr<EnclavePool> pool_;
+};
+
+// Verifies that an acquired enclave is bound to the requested name, including
+// for handles created before it was acquired, and that the pool loads a
+// replacement for it.
+TEST_F(EnclavePoolTest, AcquireRenamesAndRefills) {
+  WaitForFullPool();
+  EnclaveClientHandle handle(manager_, "/Tenant");
+  EXPECT_EQ(handle.get(), nullptr);
+
+  EnclaveClient *client;
+  ASYLO_ASSERT_OK_AND_ASSIGN(client, pool_->Acquire("/Tenant"));
+  EXPECT_EQ(manager_->GetClient("/Tenant"), client);
+  EXPECT_EQ(manager_->GetName(client), "/Tenant");
+  EXPECT_EQ(handle.get(), client);
+
+  WaitForFullPool();
+  EXPECT_EQ(handle.get(), client);
+  ASYLO_EXPECT_OK(manager_->DestroyEnclave(client, EnclaveFinal()));
+  EXPECT_EQ(manager_->GetClient("/Tenant"), nullptr);
+  EXPECT_EQ(handle.get(), nullptr);
+}
+
+// Verifies that acquiring an enclave under a name that is already bound fails
+// and keeps the standby enclave in the pool.
+TEST_F(EnclavePoolTest, AcquireWithTakenNameFails) {
+  WaitForFullPool();
+
+  EnclaveClient *client;
+  ASYLO_ASSERT_OK_AND_ASSIGN(client, pool_->Acquire("/Taken"));
+  WaitForFullPool();
+  EXPECT_THAT(pool_->Acquire("/Taken").status(),
+              StatusIs(error::GoogleError::ALREADY_EXISTS));
+  EXPECT_EQ(pool_->standby_count(), kPoolSize);
+  ASYLO_EXPECT_OK(manager_->DestroyEnclave(client, EnclaveFinal()));
+}
+
+// Verifies that a standby enclave destroyed through the EnclaveManager is
+// dropped from the pool and replaced.
+TEST_F(EnclavePoolTest, DropsDestroyedStandbyEnclaves) {
+  WaitForFullPool();
+
+  // The first standby enclave is registered under a name of the pool's
+  // reserved form.
+  EnclaveClient *standby = manager_->GetClient(absl::StrCat(
+      "/asylo/enclave_pool/", reinterpret_cast<uintptr_t>(pool_.get()), "/0"));
+  ASSERT_NE(standby, nullptr);
+  ASYLO_ASSERT_OK(manager_->DestroyEnclave(standby, EnclaveFinal()));
+
+  WaitForFullPool();
+  EXPECT_EQ(live_enclaves, static_cast<int>(kPoolSize));
+  pool_.reset();
+  EXPECT_EQ(live_enclaves, 0);
+}
+
+// Verifies that destroying the pool destroys its standby enclaves but not the
+// enclaves it handed out.
+TEST_F(EnclavePoolTest, DestroysStandbyEnclaves) {
+  WaitForFullPool();
+
+  EnclaveClient *client;
+  ASYLO_ASSERT_OK_AND_ASSIGN(client, pool_->Acquire("/Survivor"));
+  pool_.reset();
+  EXPECT_EQ(live_enclaves, 1);
+  EXPECT_EQ(manager_->GetClient("/Survivor"), client);
+  ASYLO_EXPECT_OK(manager_->DestroyEnclave(client, EnclaveFinal()));
+  EXPECT_EQ(live_enclaves, 0);
+}
+
+}  // namespace
+}  // namespace asylo
@@ -0,0 +1,174 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/core/enclave_run_queue.h"
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+#include "absl/time/time.h"
+#include "asylo/platform/core/enclave_client.h"
+
+namespace asylo {
+namespace {
+
+// How long a worker waits before retrying a request when every enclave thread
+// is busy and no other request of this queue is in progress to free one.
+const absl::Duration kBusyRetryDelay = absl::Milliseconds(1);
+
+// Set when a callback running on this thread destroys the queue whose worker
+// loop runs on this thread.
+thread_local bool current_queue_destroyed = false;
+
+}  // namespace
+
+EnclaveRunQueue::EnclaveRunQueue(EnclaveClient *client, int max_workers)
+    : client_(client),
+      worker_limit_(std::max(1, max_workers)),
+      max_workers_(worker_limit_),
+      num_workers_(0),
+      in_flight_(0),
+      stopping_(false) {}
+
+EnclaveRunQueue::~EnclaveRunQueue() {
+  std::deque<Request> cancelled;
+  std::vector<std::thread> threads;
+  {
+    absl::MutexLock lock(&mu_);
+    stopping_ = true;
+    cancelled.swap(queue_);
+    threads.swap(threads_);
+  }
+  for (std::thread &thread : threads) {
+    if (thread.get_id() == std::this_thread::get_id()) {
+      // The queue is destroyed by a callback running on one of its own
+      // workers, which cannot join itself. It exits once the callback returns.
+      thread.detach();
+      current_queue_destroyed = true;
+    } else {
+      thread.join();
+    }
+  }
+  for (Request &request : cancelled) {
+    request.done(Status(error::GoogleError::CANCELLED,
+                        "Enclave run queue was destroyed"),
+                 EnclaveOutput());
+  }
+}
+
+void EnclaveRunQueue::Schedule(EnclaveInput input, Callback done) {
+  {
+    absl::MutexLock lock(&mu_);
+    if (!stopping_) {
+      queue_.push_back({std::move(input), std::move(done)});
+      MaybeStartWorker();
+      return;
+    }
+  }
+  done(Status(error::GoogleError::FAILED_PRECONDITION,
+              "Enclave run queue is shutting down"),
+       EnclaveOutput());
+}
+
+int EnclaveRunQueue::max_workers() const {
+  absl::MutexLock lock(&mu_);
+  return max_workers_;
+}
+
+bool EnclaveRunQueue::HasWorkOrStopping() {
+  return !queue_.empty() || stopping_ || num_workers_ > max_workers_;
+}
+
+void EnclaveRunQueue::ReapExitedWorkers() {
+  for (std::thread::id id : exited_) {
+    auto it = std::find_if(
+        threads_.begin(), threads_.end(),
+        [id](const std::thread &thread) { return thread.get_id() == id; });
+    // The worker has released |mu_| and is returning, so the join is brief.
+    it->join();
+    threads_.erase(it);
+  }
+  exited_.clear();
+}
+
+void EnclaveRunQueue::MaybeStartWorker() {
+  ReapExitedWorkers();
+  int idle_workers = num_workers_ - in_flight_;
+  if (!stopping_ && idle_workers < static_cast<int>(queue_.size()) &&
+      num_workers_ < max_workers_) {
+    ++num_workers_;
+    threads_.emplace_back([this] { Work(); });
+  }
+}
+
+void EnclaveRunQueue::Work() {
+  mu_.Lock();
+  while (true) {
+    mu_.Await(absl::Condition(this, &EnclaveRunQueue::HasWorkOrStopping));
+    if (queue_.empty() || num_workers_ > max_workers_) {
+      // The queue is shutting down, or the pool has more workers than the
+      // enclave has threads. The thread is joined by the destructor, or by the
+      // next worker started.
+      --num_workers_;
+      exited_.push_back(std::this_thread::get_id());
+      mu_.Unlock();
+      return;
+    }
+    Request request = std::move(queue_.front());
+    queue_.pop_front();
+    ++in_flight_;
+
+    mu_.Unlock();
+    EnclaveOutput output;
+    Status status = client_->EnterAndRun(request.input, &output);
+    mu_.Lock();
+
+    --in_flight_;
+    if (!stopping_ && client_->IsOutOfEnclaveThreads(status)) {
+      // Every enclave thread is busy. The entries still in progress bound the
+      // number of threads this queue can use, so shrink the pool to match and
+      // retry the request once one of them completes.
+      queue_.push_front(std::move(request));
+      max_workers_ = std::max(1, in_flight_);
+      if (in_flight_ == 0) {
+        // The enclave threads are held by callers outside this queue.
+        mu_.AwaitWithTimeout(absl::Condition(&stopping_), kBusyRetryDelay);
+      }
+      continue;
+    }
+
+    // A run completed, so allow the pool to grow back towards its original
+    // size in case the enclave threads were held by callers outside this
+    // queue.
+    if (max_workers_ < worker_limit_) {
+      ++max_workers_;
+      MaybeStartWorker();
+    }
+
+    mu_.Unlock();
+    request.done(std::move(status), std::move(output));
+    if (current_queue_destroyed) {
+      // The callback destroyed the queue, so none of its members may be used.
+      return;
+    }
+    mu_.Lock();
+  }
+}
+
+}  // namespace asylo
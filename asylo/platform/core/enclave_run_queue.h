@@ -0,0 +1,118 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_CORE_ENCLAVE_RUN_QUEUE_H_
+#define ASYLO_PLATFORM_CORE_ENCLAVE_RUN_QUEUE_H_
+
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/enclave.pb.h"
+#include "asylo/util/status.h"
+
+namespace asylo {
+
+class EnclaveClient;
+
+// A queue of EnterAndRun calls into one enclave, served by a pool of host
+// threads.
+//
+// The pool starts at most |max_workers| threads, and never more threads than
+// the enclave has threads to enter with. The number of enclave threads is not
+// known in advance: when an entry fails because every enclave thread is busy,
+// the request is put back at the head of the queue, and the pool shrinks to
+// the number of entries that were still in progress. A request therefore waits
+// for an enclave thread instead of failing. Each run that completes afterwards
+// raises the limit by one again, up to |max_workers|, so the pool recovers once
+// the enclave threads held elsewhere are released.
+//
+// This class is thread-safe.
+class EnclaveRunQueue {
+ public:
+  // Callback invoked with the status and output of a run.
+  using Callback = std::function<void(Status status, EnclaveOutput output)>;
+
+  // Creates a queue that runs requests in the enclave attached to |client|, on
+  // at most |max_workers| threads.
+  EnclaveRunQueue(EnclaveClient *client, int max_workers);
+
+  EnclaveRunQueue(const EnclaveRunQueue &other) = delete;
+  EnclaveRunQueue &operator=(const EnclaveRunQueue &other) = delete;
+
+  // Waits for the runs in progress to complete and completes the runs still
+  // queued with a CANCELLED status. May be called from a callback, in which
+  // case the worker thread running the callback exits once it returns.
+  ~EnclaveRunQueue();
+
+  // Queues a run of the enclave with |input|. |done| is invoked on a worker
+  // thread once the run completes.
+  void Schedule(EnclaveInput input, Callback done) LOCKS_EXCLUDED(mu_);
+
+  // Returns the current limit on the number of worker threads.
+  int max_workers() const LOCKS_EXCLUDED(mu_);
+
+ private:
+  struct Request {
+    EnclaveInput input;
+    Callback done;
+  };
+
+  // Returns true if a worker has a request to run or should exit.
+  bool HasWorkOrStopping() EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Joins the worker threads that have exited and forgets them.
+  void ReapExitedWorkers() EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Starts a worker thread if the queued requests outnumber the idle workers
+  // and the pool is below its limit.
+  void MaybeStartWorker() EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Top level loop run by each worker thread.
+  void Work() LOCKS_EXCLUDED(mu_);
+
+  EnclaveClient *const client_;
+
+  // The limit on the number of worker threads given at construction.
+  const int worker_limit_;
+
+  mutable absl::Mutex mu_;
+
+  // Requests not yet started, oldest first.
+  std::deque<Request> queue_ GUARDED_BY(mu_);
+
+  // Every worker thread started and not yet joined.
+  std::vector<std::thread> threads_ GUARDED_BY(mu_);
+
+  // The worker threads that have exited and are waiting to be joined.
+  std::vector<std::thread::id> exited_ GUARDED_BY(mu_);
+
+  // The current limit on the number of worker threads, lowered while the
+  // enclave is out of threads.
+  int max_workers_ GUARDED_BY(mu_);
+  int num_workers_ GUARDED_BY(mu_);
+  int in_flight_ GUARDED_BY(mu_);
+  bool stopping_ GUARDED_BY(mu_);
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_CORE_ENCLAVE_RUN_QUEUE_H_
@@ -0,0 +1,188 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/core/enclave_run_queue.h"
+
+#include <atomic>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "asylo/enclave.pb.h"
+#include "asylo/platform/core/enclave_client.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/util/status.h"
+
+namespace asylo {
+namespace {
+
+constexpr int kEnclaveThreads = 2;
+
+// An enclave client that does not attach to a real enclave. Like an SGX
+// enclave, it can be entered by at most |kEnclaveThreads| threads at once.
+class FakeClient : public EnclaveClient {
+ public:
+  FakeClient() : EnclaveClient("fake"), threads_in_enclave_(0) {}
+
+  Status EnterAndRun(const EnclaveInput &input,
+                     EnclaveOutput *output) override {
+    if (++threads_in_enclave_ > kEnclaveThreads) {
+      --threads_in_enclave_;
+      return Status(error::GoogleError::RESOURCE_EXHAUSTED, "Out of threads");
+    }
+    // Keep the enclave thread busy for a moment, so that runs overlap.
+    absl::SleepFor(absl::Milliseconds(1));
+    --threads_in_enclave_;
+    output->mutable_status()->set_code(0);
+    return Status::OkStatus();
+  }
+
+  // Occupies every enclave thread, as callers outside a run queue would.
+  void HoldAllThreads() { threads_in_enclave_ += kEnclaveThreads; }
+
+  // Releases the enclave threads occupied by HoldAllThreads().
+  void ReleaseAllThreads() { threads_in_enclave_ -= kEnclaveThreads; }
+
+ private:
+  bool IsOutOfEnclaveThreads(const Status &status) const override {
+    return status.error_code() == error::GoogleError::RESOURCE_EXHAUSTED;
+  }
+
+  Status EnterAndInitialize(const EnclaveConfig &config) override {
+    return Status::OkStatus();
+  }
+
+  Status EnterAndFinalize(const EnclaveFinal &final_input) override {
+    return Status::OkStatus();
+  }
+
+  Status EnterAndDonateThread() override { return Status::OkStatus(); }
+
+  Status EnterAndHandleSignal(const EnclaveSignal &signal) override {
+    return Status::OkStatus();
+  }
+
+  Status EnterAndTakeSnapshot(SnapshotLayout *snapshot_layout) override {
+    return Status::OkStatus();
+  }
+
+  Status EnterAndRestore(const SnapshotLayout &snapshot_layout) override {
+    return Status::OkStatus();
+  }
+
+  Status EnterAndTransferSecureSnapshotKey(
+      const ForkHandshakeConfig &fork_handshake_config) override {
+    return Status::OkStatus();
+  }
+
+  Status DestroyEnclave() override { return Status::OkStatus(); }
+
+  std::atomic<int> threads_in_enclave_;
+};
+
+// Verifies that runs queued beyond the number of enclave threads wait for a
+// thread instead of failing.
+TEST(EnclaveRunQueueTest, QueuesWhenOutOfEnclaveThreads) {
+  constexpr int kNumRuns = 50;
+  FakeClient client;
+  EnclaveRunQueue queue(&client, /*max_workers=*/8);
+
+  absl::Mutex mu;
+  int completed = 0;
+  int failed = 0;
+  for (int i = 0; i < kNumRuns; ++i) {
+    queue.Schedule(EnclaveInput(), [&](Status status, EnclaveOutput output) {
+      absl::MutexLock lock(&mu);
+      ++completed;
+      if (!status.ok()) {
+        ++failed;
+      }
+    });
+  }
+
+  absl::MutexLock lock(&mu);
+  mu.Await(absl::Condition(
+      +[](int *completed) { return *completed == kNumRuns; }, &completed));
+  EXPECT_EQ(failed, 0);
+}
+
+// Verifies that the pool shrinks while the enclave threads are held outside the
+// queue, and grows again once they are released.
+TEST(EnclaveRunQueueTest, GrowsAfterEnclaveThreadsAreReleased) {
+  constexpr int kNumRuns = 20;
+  FakeClient client;
+  EnclaveRunQueue queue(&client, /*max_workers=*/8);
+
+  client.HoldAllThreads();
+  absl::Mutex mu;
+  int completed = 0;
+  for (int i = 0; i < kNumRuns; ++i) {
+    queue.Schedule(EnclaveInput(), [&](Status status, EnclaveOutput output) {
+      absl::MutexLock lock(&mu);
+      ++completed;
+    });
+  }
+  while (queue.max_workers() > 1) {
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+  client.ReleaseAllThreads();
+
+  absl::MutexLock lock(&mu);
+  mu.Await(absl::Condition(
+      +[](int *completed) { return *completed == kNumRuns; }, &completed));
+  EXPECT_GT(queue.max_workers(), 1);
+}
+
+// Verifies that a callback may destroy the queue that invoked it.
+TEST(EnclaveRunQueueTest, CallbackDestroysQueue) {
+  FakeClient client;
+  auto queue = absl::make_unique<EnclaveRunQueue>(&client, /*max_workers=*/2);
+
+  std::promise<void> destroyed;
+  std::promise<Status> cancelled;
+  queue->Schedule(EnclaveInput(), [&](Status status, EnclaveOutput output) {
+    queue->Schedule(EnclaveInput(), [&](Status status, EnclaveOutput output) {
+      cancelled.set_value(status);
+    });
+    queue.reset();
+    destroyed.set_value();
+  });
+  destroyed.get_future().get();
+  EXPECT_THAT(cancelled.get_future().get(),
+              StatusIs(error::GoogleError::CANCELLED));
+}
+
+// Verifies that the client delivers the output of an asynchronous run through
+// a future.
+TEST(EnclaveRunQueueTest, ClientRunAsyncFuture) {
+  FakeClient client;
+  std::future<StatusOr<EnclaveOutput>> future =
+      client.EnterAndRunAsync(EnclaveInput());
+  StatusOr<EnclaveOutput> result = future.get();
+  ASYLO_ASSERT_OK(result.status());
+  EXPECT_TRUE(result.ValueOrDie().has_status());
+}
+
+}  // namespace
+}  // namespace asylo
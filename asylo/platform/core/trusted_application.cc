@@ -20,6 +20,7 @@
 
 #include <sys/ucontext.h>
 #include <unistd.h>
+#include <atomic>
 #include <cerrno>
 #include <cstdio>
 #include <cstdlib>
@@ -30,13 +31,16 @@
 #include "absl/synchronization/mutex.h"
 #include "asylo/util/logging.h"
 #include "asylo/identity/init.h"
+#include "asylo/platform/arch/include/trusted/enclave_interface.h"
 #include "asylo/platform/arch/include/trusted/fork.h"
 #include "asylo/platform/arch/include/trusted/host_calls.h"
 #include "asylo/platform/arch/include/trusted/time.h"
 #include "asylo/platform/common/bridge_functions.h"
+#include "asylo/platform/common/call_metrics.h"
 #include "asylo/platform/core/shared_name_kind.h"
 #include "asylo/platform/core/trusted_global_state.h"
 #include "asylo/platform/core/untrusted_cache_malloc.h"
+#include "asylo/platform/core/untrusted_scratch.h"
 #include "asylo/platform/posix/io/io_manager.h"
 #include "asylo/platform/posix/io/native_paths.h"
 #include "asylo/platform/posix/io/random_devices.h"
@@ -168,6 +172,9 @@ static absl::Mutex get_application_lock;
 // Initialize IO subsystem.
 static void InitializeIO(const EnclaveConfig &config);
 
+// Connects the signal manager to the signals the host queues for this enclave.
+static void ConnectPendingSignals();
+
 TrustedApplication *GetApplicationInstance() {
   absl::MutexLock lock(&get_application_lock);
   if (!global_trusted_application) {
@@ -203,6 +210,7 @@ Status TrustedApplication::InitializeInternal(const EnclaveConfig &config) {
                  << status;
   }
   SetEnclaveConfig(config);
+  ConnectPendingSignals();
   // This call can fail, but it should not stop the enclave from running.
   status = InitializeEnclaveAssertionAuthorities(
       config.enclave_assertion_authority_configs().begin(),
@@ -214,9 +222,40 @@ Status TrustedApplication::InitializeInternal(const EnclaveConfig &config) {
 
   ASYLO_RETURN_IF_ERROR(VerifyAndSetState(EnclaveState::kInternalInitializing,
                                           EnclaveState::kUserInitializing));
+
+  // The log flusher runs on a donated thread, which the enclave only accepts
+  // once user initialization has begun.
+  if (config.logging_config().enable_async_logging() && !StartLogFlusher()) {
+    LOG(WARNING) << "Failed to start the enclave log flusher";
+  }
   return Initialize(config);
 }
 
+// Handles the signals queued by the host. Run by every thread returning into
+// the enclave from a host call.
+static void HandlePendingSignals() {
+  SignalManager::GetInstance()->HandlePendingSignals();
+}
+
+void ConnectPendingSignals() {
+  // The host shares the address under the enclave's name only while the
+  // enclave initializes. Without it, every signal is delivered by entering the
+  // enclave.
+  const std::string name = absl::StrCat("pending_signals/", GetEnclaveName());
+  void *addr =
+      enc_untrusted_acquire_shared_resource(kAddressName, name.c_str());
+  if (!addr) {
+    return;
+  }
+  enc_untrusted_release_shared_resource(kAddressName, name.c_str());
+  if (!enc_is_outside_enclave(addr, sizeof(std::atomic<uint64_t>))) {
+    return;
+  }
+  SignalManager::GetInstance()->SetPendingSignals(
+      static_cast<std::atomic<uint64_t> *>(addr));
+  enc_set_host_call_return_hook(&HandlePendingSignals);
+}
+
 void InitializeIO(const EnclaveConfig &config) {
   auto &io_manager = io::IOManager::GetInstance();
 
@@ -367,6 +406,10 @@ int __asylo_user_fini(const char *input, size_t input_len, char **output,
     return status_serializer.Serialize(status);
   }
 
+  // Write any buffered log messages and return the log flusher's thread
+  // before waiting for all enclave threads to exit.
+  StopLogFlusher();
+
   ThreadManager *thread_manager = ThreadManager::GetInstance();
   thread_manager->Finalize();
 
@@ -389,6 +432,10 @@ int __asylo_threading_donate() {
     return EPERM;
   }
 
+  // Reserve untrusted scratch memory for the host calls of the donated thread
+  // while it runs enclave code.
+  UntrustedScratch scratch;
+
   ThreadManager *thread_manager = ThreadManager::GetInstance();
   return thread_manager->StartThread();
 }
@@ -411,7 +458,7 @@ int __asylo_handle_signal(const char *input, size_t input_len) {
   siginfo_t info;
   info.si_signo = signum;
   info.si_code = signal.code();
-  ucontext_t ucontext;
+  ucontext_t ucontext = {};
   for (int greg_index = 0;
        greg_index < NGREG && greg_index < signal.gregs_size(); ++greg_index) {
     ucontext.uc_mcontext.gregs[greg_index] =
@@ -428,6 +475,8 @@ int __asylo_handle_signal(const char *input, size_t input_len) {
   if (!signal_manager->HandleSignal(signum, &info, &ucontext).ok()) {
     return 1;
   }
+  // Handle the signals the host queued while this one was being delivered.
+  signal_manager->HandlePendingSignals();
   return 0;
 }
 
@@ -503,6 +552,10 @@ int __asylo_restore(const char *input, size_t input_len, char **output,
   }
 
   status = RestoreForFork(snapshot_layout);
+  if (status.ok()) {
+    // The restored address belongs to the parent's enclave client.
+    SignalManager::GetInstance()->SetPendingSignals(nullptr);
+  }
   return status_serializer.Serialize(status);
 }
 
@@ -533,6 +586,27 @@ int __asylo_transfer_secure_snapshot_key(const char *input, size_t input_len,
   return status_serializer.Serialize(status);
 }
 
+int __asylo_run_snapshot_worker() {
+  // Does not check the enclave state, which lives in memory being sealed or
+  // restored. RunSnapshotWorker() only works on a snapshot in progress.
+  RunSnapshotWorker();
+  return 0;
+}
+
+int __asylo_get_call_metrics(char **output, size_t *output_len) {
+  Status status = VerifyOutputArguments(output, output_len);
+  if (!status.ok()) {
+    return 1;
+  }
+  EnclaveOutput enclave_output;
+  StatusSerializer<EnclaveOutput> status_serializer(
+      &enclave_output, enclave_output.mutable_status(), output, output_len);
+
+  CallMetricsRegistry::GetInstance()->Snapshot(
+      enclave_output.mutable_call_metrics());
+  return status_serializer.Serialize(status);
+}
+
 }  // extern "C"
 
 }  // namespace asylo
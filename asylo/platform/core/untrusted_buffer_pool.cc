@@ -0,0 +1,60 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/core/untrusted_buffer_pool.h"
+
+#include "asylo/platform/core/untrusted_cache_malloc.h"
+
+namespace asylo {
+
+constexpr size_t UntrustedBufferPool::kBufferSize;
+constexpr size_t UntrustedBufferPool::kMaxFreeBuffers;
+
+UntrustedBufferPool::~UntrustedBufferPool() {
+  for (void *buffer : free_buffers_) {
+    UntrustedCacheMalloc::Instance()->Free(buffer);
+  }
+}
+
+void *UntrustedBufferPool::Acquire() {
+  {
+    absl::MutexLock lock(&mu_);
+    if (!free_buffers_.empty()) {
+      void *buffer = free_buffers_.back();
+      free_buffers_.pop_back();
+      return buffer;
+    }
+  }
+  return UntrustedCacheMalloc::Instance()->Malloc(kBufferSize);
+}
+
+void UntrustedBufferPool::Release(void *buffer) {
+  if (!buffer) {
+    return;
+  }
+  {
+    absl::MutexLock lock(&mu_);
+    if (free_buffers_.size() < kMaxFreeBuffers) {
+      free_buffers_.push_back(buffer);
+      return;
+    }
+  }
+  UntrustedCacheMalloc::Instance()->Free(buffer);
+}
+
+}  // namespace asylo
@@ -0,0 +1,84 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_CORE_UNTRUSTED_BUFFER_POOL_H_
+#define ASYLO_PLATFORM_CORE_UNTRUSTED_BUFFER_POOL_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace asylo {
+
+// A pool of fixed-size buffers of untrusted memory, reused by the host calls
+// moving large payloads through one connection. Buffers are allocated on first
+// use, and up to kMaxFreeBuffers released buffers are kept for reuse.
+//
+// This class is thread-safe.
+class UntrustedBufferPool {
+ public:
+  // Size in bytes of each buffer.
+  static constexpr size_t kBufferSize = 1 << 20;
+
+  // Maximum number of released buffers kept by the pool.
+  static constexpr size_t kMaxFreeBuffers = 2;
+
+  // A buffer taken from a pool, returned to the pool when the object goes out
+  // of scope.
+  class Buffer {
+   public:
+    explicit Buffer(UntrustedBufferPool *pool)
+        : pool_(pool), data_(pool->Acquire()) {}
+    ~Buffer() { pool_->Release(data_); }
+
+    Buffer(const Buffer &other) = delete;
+    Buffer &operator=(const Buffer &other) = delete;
+
+    // Returns the start of the buffer, or nullptr if it could not be
+    // allocated.
+    void *data() const { return data_; }
+
+   private:
+    UntrustedBufferPool *const pool_;
+    void *const data_;
+  };
+
+  UntrustedBufferPool() = default;
+  ~UntrustedBufferPool();
+
+  UntrustedBufferPool(const UntrustedBufferPool &other) = delete;
+  UntrustedBufferPool &operator=(const UntrustedBufferPool &other) = delete;
+
+  // Returns a buffer of kBufferSize bytes of untrusted memory, or nullptr on
+  // failure.
+  void *Acquire() LOCKS_EXCLUDED(mu_);
+
+  // Returns |buffer|, obtained from Acquire(), to the pool. Does nothing if
+  // |buffer| is nullptr.
+  void Release(void *buffer) LOCKS_EXCLUDED(mu_);
+
+ private:
+  absl::Mutex mu_;
+  std::vector<void *> free_buffers_ GUARDED_BY(mu_);
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_CORE_UNTRUSTED_BUFFER_POOL_H_
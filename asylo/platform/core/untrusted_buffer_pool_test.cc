@@ -0,0 +1,61 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/core/untrusted_buffer_pool.h"
+
+#include <cstring>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "asylo/platform/arch/include/trusted/enclave_interface.h"
+
+namespace asylo {
+namespace {
+
+// Verifies that buffers are in untrusted memory and do not overlap.
+TEST(UntrustedBufferPoolTest, AcquiresUntrustedBuffers) {
+  UntrustedBufferPool pool;
+  UntrustedBufferPool::Buffer first(&pool);
+  UntrustedBufferPool::Buffer second(&pool);
+  ASSERT_NE(first.data(), nullptr);
+  ASSERT_NE(second.data(), nullptr);
+  EXPECT_NE(first.data(), second.data());
+  EXPECT_TRUE(enc_is_outside_enclave(first.data(),
+                                     UntrustedBufferPool::kBufferSize));
+  EXPECT_TRUE(enc_is_outside_enclave(second.data(),
+                                     UntrustedBufferPool::kBufferSize));
+
+  // Both buffers are usable in full.
+  memset(first.data(), 1, UntrustedBufferPool::kBufferSize);
+  memset(second.data(), 2, UntrustedBufferPool::kBufferSize);
+}
+
+// Verifies that released buffers are reused.
+TEST(UntrustedBufferPoolTest, ReusesReleasedBuffers) {
+  UntrustedBufferPool pool;
+  void *data;
+  {
+    UntrustedBufferPool::Buffer buffer(&pool);
+    data = buffer.data();
+  }
+  UntrustedBufferPool::Buffer buffer(&pool);
+  EXPECT_EQ(buffer.data(), data);
+}
+
+}  // namespace
+}  // namespace asylo
@@ -0,0 +1,89 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/core/untrusted_scratch.h"
+
+#include <algorithm>
+
+#include "asylo/platform/core/untrusted_cache_malloc.h"
+
+namespace asylo {
+namespace {
+
+// Alignment of buffers taken from a scratch region.
+constexpr size_t kAlignment = 16;
+
+// Returns |size| rounded up to a multiple of kAlignment.
+size_t AlignedSize(size_t size) {
+  return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+}  // namespace
+
+constexpr size_t UntrustedScratch::kSize;
+
+thread_local UntrustedScratch *UntrustedScratch::current_ = nullptr;
+
+UntrustedScratch::UntrustedScratch()
+    : previous_(current_),
+      base_(static_cast<uint8_t *>(
+          UntrustedCacheMalloc::Instance()->Malloc(kSize))),
+      used_(0),
+      live_buffers_(0) {
+  // If the region cannot be allocated, buffers keep coming from the previous
+  // region or from UntrustedCacheMalloc.
+  if (base_) {
+    current_ = this;
+  }
+}
+
+UntrustedScratch::~UntrustedScratch() {
+  if (base_) {
+    current_ = previous_;
+    UntrustedCacheMalloc::Instance()->Free(base_);
+  }
+}
+
+bool UntrustedScratch::Available() { return current_ != nullptr; }
+
+UntrustedScratchBuffer::UntrustedScratchBuffer(size_t size)
+    : scratch_(UntrustedScratch::current_ &&
+                       size <= UntrustedScratch::kSize -
+                                   UntrustedScratch::current_->used_
+                   ? UntrustedScratch::current_
+                   : nullptr),
+      size_(size) {
+  if (scratch_) {
+    data_ = scratch_->base_ + scratch_->used_;
+    scratch_->used_ = std::min(UntrustedScratch::kSize,
+                               scratch_->used_ + AlignedSize(size));
+    scratch_->live_buffers_++;
+  } else {
+    data_ = UntrustedCacheMalloc::Instance()->Malloc(size);
+  }
+}
+
+UntrustedScratchBuffer::~UntrustedScratchBuffer() {
+  if (!scratch_) {
+    UntrustedCacheMalloc::Instance()->Free(data_);
+  } else if (--scratch_->live_buffers_ == 0) {
+    scratch_->used_ = 0;
+  }
+}
+
+}  // namespace asylo
@@ -0,0 +1,103 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_CORE_UNTRUSTED_SCRATCH_H_
+#define ASYLO_PLATFORM_CORE_UNTRUSTED_SCRATCH_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace asylo {
+
+// A region of untrusted memory reserved by a thread for the data it passes to
+// host calls, so that host calls made by the thread do not have to allocate
+// untrusted memory.
+//
+// A scratch region is reserved for the calling thread for the lifetime of the
+// UntrustedScratch object. Threads donated to the enclave reserve one for as
+// long as they run enclave code. Memory is handed out from the region by
+// UntrustedScratchBuffer. If the region cannot be allocated, the thread goes on
+// without it.
+class UntrustedScratch {
+ public:
+  // Size of a scratch region in bytes.
+  static constexpr size_t kSize = 64 * 1024;
+
+  UntrustedScratch();
+  ~UntrustedScratch();
+
+  UntrustedScratch(const UntrustedScratch &other) = delete;
+  UntrustedScratch &operator=(const UntrustedScratch &other) = delete;
+
+  // Returns true if the calling thread has a scratch region.
+  static bool Available();
+
+ private:
+  friend class UntrustedScratchBuffer;
+
+  // The scratch region of the calling thread, or nullptr.
+  static thread_local UntrustedScratch *current_;
+
+  // The scratch region in place before this one was reserved.
+  UntrustedScratch *const previous_;
+
+  // Start of the region, or nullptr if it could not be allocated.
+  uint8_t *const base_;
+
+  // Number of bytes handed out from the start of the region.
+  size_t used_;
+
+  // Number of buffers handed out and not released yet. The region is reused
+  // from its start once every buffer is released.
+  size_t live_buffers_;
+};
+
+// A buffer of untrusted memory for the data of a host call, released when the
+// object goes out of scope. The buffer is taken from the scratch region of the
+// calling thread if it has one with enough room, and allocated with
+// UntrustedCacheMalloc otherwise.
+class UntrustedScratchBuffer {
+ public:
+  explicit UntrustedScratchBuffer(size_t size);
+  ~UntrustedScratchBuffer();
+
+  UntrustedScratchBuffer(const UntrustedScratchBuffer &other) = delete;
+  UntrustedScratchBuffer &operator=(const UntrustedScratchBuffer &other) =
+      delete;
+
+  // Returns the start of the buffer.
+  void *data() const { return data_; }
+
+  // Returns the size of the buffer in bytes.
+  size_t size() const { return size_; }
+
+  // Returns true if the buffer was taken from a scratch region.
+  bool in_scratch() const { return scratch_ != nullptr; }
+
+ private:
+  // The scratch region the buffer was taken from, or nullptr if the buffer was
+  // allocated.
+  UntrustedScratch *const scratch_;
+
+  void *data_;
+  const size_t size_;
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_CORE_UNTRUSTED_SCRATCH_H_
@@ -0,0 +1,75 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/core/untrusted_scratch.h"
+
+#include <cstdint>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "asylo/platform/arch/include/trusted/enclave_interface.h"
+
+namespace asylo {
+namespace {
+
+// Verifies that buffers are allocated when the thread has no scratch region.
+TEST(UntrustedScratchTest, AllocatesWithoutScratch) {
+  ASSERT_FALSE(UntrustedScratch::Available());
+  UntrustedScratchBuffer buffer(128);
+  EXPECT_FALSE(buffer.in_scratch());
+  EXPECT_TRUE(enc_is_outside_enclave(buffer.data(), buffer.size()));
+}
+
+// Verifies that buffers taken from a scratch region do not overlap, and that
+// the region is reused once every buffer is released.
+TEST(UntrustedScratchTest, TakesBuffersFromScratch) {
+  UntrustedScratch scratch;
+  ASSERT_TRUE(UntrustedScratch::Available());
+
+  void *first_data;
+  {
+    UntrustedScratchBuffer first(100);
+    UntrustedScratchBuffer second(100);
+    ASSERT_TRUE(first.in_scratch());
+    ASSERT_TRUE(second.in_scratch());
+    EXPECT_TRUE(enc_is_outside_enclave(first.data(), first.size()));
+    EXPECT_TRUE(enc_is_outside_enclave(second.data(), second.size()));
+    EXPECT_GE(static_cast<uint8_t *>(second.data()),
+              static_cast<uint8_t *>(first.data()) + first.size());
+    first_data = first.data();
+  }
+
+  UntrustedScratchBuffer reused(100);
+  EXPECT_TRUE(reused.in_scratch());
+  EXPECT_EQ(reused.data(), first_data);
+}
+
+// Verifies that buffers which do not fit in the scratch region are allocated.
+TEST(UntrustedScratchTest, AllocatesLargeBuffers) {
+  UntrustedScratch scratch;
+  UntrustedScratchBuffer large(UntrustedScratch::kSize + 1);
+  EXPECT_FALSE(large.in_scratch());
+
+  UntrustedScratchBuffer filling(UntrustedScratch::kSize);
+  EXPECT_TRUE(filling.in_scratch());
+  UntrustedScratchBuffer overflow(1);
+  EXPECT_FALSE(overflow.in_scratch());
+}
+
+}  // namespace
+}  // namespace asylo
@@ -63,6 +63,13 @@ struct msghdr {
   int msg_flags;
 };
 
+struct mmsghdr {
+  struct msghdr msg_hdr;
+  unsigned int msg_len;
+};
+
+struct timespec;
+
 int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
 int bind(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
 int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
@@ -89,8 +96,12 @@ ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags,
 // No implementation provided.
 ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags);
 
+int recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+             struct timespec *timeout);
+
 ssize_t send(int sockfd, const void *buf, size_t len, int flags);
 ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags);
+int sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags);
 
 int setsockopt(int socket, int level, int option_name, const void *option_value,
                socklen_t option_len);
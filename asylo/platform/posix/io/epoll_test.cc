@@ -285,6 +285,31 @@ TEST_F(EpollTest, EpollCtlMix) {
   ClosePipes();
 }
 
+// Verifies that events ready at once are all reported by consecutive waits
+// returning one event each.
+TEST_F(EpollTest, ConsecutiveWaitsReportReadyEvents) {
+  InitializePipes();
+  int epfd = epoll_create(1);
+  ASSERT_NE(epfd, -1);
+  RegisterFds(epfd, kRead, /*additional_flags=*/EPOLLET);
+  std::vector<int> write_fds;
+  for (int i = 0; i < kNumPipes; ++i) {
+    write_fds.push_back(fd_pairs_[i][kWrite]);
+  }
+  WriteToPipes(write_fds, kTestString);
+  absl::flat_hash_set<int> read_fds;
+  for (int i = 0; i < kNumPipes; ++i) {
+    struct epoll_event event;
+    ASSERT_EQ(epoll_wait(epfd, &event, 1, -1), 1);
+    EXPECT_TRUE(read_fds.insert(event.data.fd).second);
+  }
+  for (int i = 0; i < kNumPipes; ++i) {
+    EXPECT_NE(read_fds.find(fd_pairs_[i][kRead]), read_fds.end());
+  }
+  ASSERT_EQ(close(epfd), 0);
+  ClosePipes();
+}
+
 TEST_F(EpollTest, LevelTriggeredBehavior) { LevelEdgeBehaviorTest(false); }
 
 TEST_F(EpollTest, EdgeTriggeredBehavior) { LevelEdgeBehaviorTest(true); }
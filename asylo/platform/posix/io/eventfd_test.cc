@@ -16,7 +16,10 @@
  *
  */
 
+#include <poll.h>
+#include <sys/epoll.h>
 #include <sys/eventfd.h>
+#include <sys/select.h>
 #include <unistd.h>
 
 #include <atomic>
@@ -195,5 +198,178 @@ TEST_F(EventFdTest, MaxCounterNonBlock) {
   EXPECT_EQ(errno, EAGAIN);
 }
 
+TEST_F(EventFdTest, PollReportsCounter) {
+  InitializeEventFd(false, 0, true);
+  struct pollfd fds[] = {{event_fd_, POLLIN | POLLOUT, 0}};
+  ASSERT_EQ(poll(fds, 1, 0), 1);
+  EXPECT_EQ(fds[0].revents, POLLOUT);
+
+  ASSERT_EQ(Write(1), sizeof(uint64_t));
+  ASSERT_EQ(poll(fds, 1, 0), 1);
+  EXPECT_EQ(fds[0].revents, POLLIN | POLLOUT);
+  EXPECT_EQ(fds[0].fd, event_fd_);
+
+  ASSERT_EQ(Write(kMaxCounter - 1), sizeof(uint64_t));
+  ASSERT_EQ(poll(fds, 1, 0), 1);
+  EXPECT_EQ(fds[0].revents, POLLIN);
+}
+
+TEST_F(EventFdTest, PollWaitsForWrite) {
+  InitializeEventFd(false, 0, true);
+  struct pollfd fds[] = {{event_fd_, POLLIN, 0}};
+  EXPECT_EQ(poll(fds, 1, 10), 0);
+
+  std::atomic_bool write_complete(false);
+  std::thread worker([this, &write_complete] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kSleepDur));
+    write_complete.store(true);
+    Write(1);
+  });
+  ASSERT_EQ(poll(fds, 1, -1), 1);
+  EXPECT_TRUE(write_complete.load());
+  EXPECT_EQ(fds[0].revents, POLLIN);
+  worker.join();
+}
+
+// Verifies that a poll of an eventfd and a host pipe reports both, and that a
+// write to the eventfd interrupts a wait for the pipe.
+TEST_F(EventFdTest, PollWithHostFileDescriptor) {
+  InitializeEventFd(false, 0, true);
+  int pipe_fds[2];
+  ASSERT_EQ(pipe(pipe_fds), 0);
+  struct pollfd fds[] = {{event_fd_, POLLIN, 0}, {pipe_fds[0], POLLIN, 0}};
+
+  std::thread worker([this] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kSleepDur));
+    Write(1);
+  });
+  ASSERT_EQ(poll(fds, 2, -1), 1);
+  EXPECT_EQ(fds[0].revents, POLLIN);
+  EXPECT_EQ(fds[1].revents, 0);
+  worker.join();
+
+  ASSERT_EQ(write(pipe_fds[1], "x", 1), 1);
+  ASSERT_EQ(poll(fds, 2, 0), 2);
+  EXPECT_EQ(fds[0].revents, POLLIN);
+  EXPECT_EQ(fds[1].revents, POLLIN);
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+}
+
+TEST_F(EventFdTest, SelectReportsCounter) {
+  InitializeEventFd(false, 0, true);
+  fd_set readfds;
+  FD_ZERO(&readfds);
+  FD_SET(event_fd_, &readfds);
+  struct timeval timeout = {0, 0};
+  EXPECT_EQ(select(event_fd_ + 1, &readfds, nullptr, nullptr, &timeout), 0);
+  EXPECT_FALSE(FD_ISSET(event_fd_, &readfds));
+
+  ASSERT_EQ(Write(1), sizeof(uint64_t));
+  FD_SET(event_fd_, &readfds);
+  fd_set writefds = readfds;
+  EXPECT_EQ(select(event_fd_ + 1, &readfds, &writefds, nullptr, &timeout), 2);
+  EXPECT_TRUE(FD_ISSET(event_fd_, &readfds));
+  EXPECT_TRUE(FD_ISSET(event_fd_, &writefds));
+}
+
+TEST_F(EventFdTest, EpollWaitsForWrite) {
+  InitializeEventFd(false, 0, true);
+  int epfd = epoll_create(1);
+  ASSERT_NE(epfd, -1);
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u64 = kCounterStart;
+  ASSERT_EQ(epoll_ctl(epfd, EPOLL_CTL_ADD, event_fd_, &event), 0);
+  EXPECT_EQ(epoll_ctl(epfd, EPOLL_CTL_ADD, event_fd_, &event), -1);
+  EXPECT_EQ(errno, EEXIST);
+
+  struct epoll_event events[2];
+  EXPECT_EQ(epoll_wait(epfd, events, 2, 10), 0);
+  std::atomic_bool write_complete(false);
+  std::thread worker([this, &write_complete] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kSleepDur));
+    write_complete.store(true);
+    Write(1);
+  });
+  ASSERT_EQ(epoll_wait(epfd, events, 2, -1), 1);
+  EXPECT_TRUE(write_complete.load());
+  EXPECT_EQ(events[0].events, EPOLLIN);
+  EXPECT_EQ(events[0].data.u64, kCounterStart);
+  worker.join();
+
+  // The event is level-triggered, so it is reported until the counter is read.
+  EXPECT_EQ(epoll_wait(epfd, events, 2, 0), 1);
+  EXPECT_EQ(Read(), 1);
+  EXPECT_EQ(epoll_wait(epfd, events, 2, 0), 0);
+
+  ASSERT_EQ(epoll_ctl(epfd, EPOLL_CTL_DEL, event_fd_, nullptr), 0);
+  ASSERT_EQ(Write(1), sizeof(uint64_t));
+  EXPECT_EQ(epoll_wait(epfd, events, 2, 0), 0);
+  close(epfd);
+}
+
+// Verifies that an edge-triggered eventfd is reported again after a write to
+// it, but not after a write to another eventfd.
+TEST_F(EventFdTest, EdgeTriggeredEpollIgnoresOtherContexts) {
+  InitializeEventFd(false, 0, true);
+  int other_fd = eventfd(0, EFD_NONBLOCK);
+  ASSERT_NE(other_fd, -1);
+  int epfd = epoll_create(1);
+  ASSERT_NE(epfd, -1);
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLET;
+  event.data.fd = event_fd_;
+  ASSERT_EQ(epoll_ctl(epfd, EPOLL_CTL_ADD, event_fd_, &event), 0);
+
+  struct epoll_event events[2];
+  ASSERT_EQ(Write(1), sizeof(uint64_t));
+  EXPECT_EQ(epoll_wait(epfd, events, 2, 0), 1);
+  EXPECT_EQ(epoll_wait(epfd, events, 2, 0), 0);
+
+  uint64_t one = 1;
+  ASSERT_EQ(write(other_fd, &one, sizeof(one)), sizeof(one));
+  EXPECT_EQ(epoll_wait(epfd, events, 2, 0), 0);
+
+  ASSERT_EQ(Write(1), sizeof(uint64_t));
+  ASSERT_EQ(epoll_wait(epfd, events, 2, 0), 1);
+  EXPECT_EQ(events[0].data.fd, event_fd_);
+  close(epfd);
+  close(other_fd);
+}
+
+// Verifies that an epoll instance watching an eventfd and a host pipe reports
+// events of both.
+TEST_F(EventFdTest, EpollWithHostFileDescriptor) {
+  InitializeEventFd(false, 0, true);
+  int pipe_fds[2];
+  ASSERT_EQ(pipe(pipe_fds), 0);
+  int epfd = epoll_create(1);
+  ASSERT_NE(epfd, -1);
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.fd = event_fd_;
+  ASSERT_EQ(epoll_ctl(epfd, EPOLL_CTL_ADD, event_fd_, &event), 0);
+  event.data.fd = pipe_fds[0];
+  ASSERT_EQ(epoll_ctl(epfd, EPOLL_CTL_ADD, pipe_fds[0], &event), 0);
+
+  struct epoll_event events[2];
+  std::thread worker([this] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kSleepDur));
+    Write(1);
+  });
+  ASSERT_EQ(epoll_wait(epfd, events, 2, -1), 1);
+  EXPECT_EQ(events[0].data.fd, event_fd_);
+  worker.join();
+  EXPECT_EQ(Read(), 1);
+
+  ASSERT_EQ(write(pipe_fds[1], "x", 1), 1);
+  ASSERT_EQ(epoll_wait(epfd, events, 2, -1), 1);
+  EXPECT_EQ(events[0].data.fd, pipe_fds[0]);
+  close(epfd);
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+}
+
 }  // namespace
 }  // namespace asylo
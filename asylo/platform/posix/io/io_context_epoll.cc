@@ -19,15 +19,50 @@
 
 #include <errno.h>
 #include <openssl/rand.h>
+#include <poll.h>
 #include <stdint.h>
+#include <new>
 
 #include "absl/memory/memory.h"
 #include "asylo/platform/arch/include/trusted/host_calls.h"
+#include "asylo/platform/common/bridge_functions.h"
+#include "asylo/platform/core/untrusted_cache_malloc.h"
+#include "asylo/platform/posix/io/readiness_queue.h"
 
 namespace asylo {
 namespace io {
+namespace {
+
+// Key of the wake pipe of the ReadinessQueue in the host epoll instance. Never
+// used as the key of a host file descriptor.
+constexpr uint64_t kWakeKey = 0;
+
+// Returns the poll events corresponding to the epoll events |events|.
+short ToPollEvents(uint32_t events) {
+  short poll_events = 0;
+  if (events & EPOLLIN) poll_events |= POLLIN;
+  if (events & EPOLLPRI) poll_events |= POLLPRI;
+  if (events & EPOLLOUT) poll_events |= POLLOUT;
+  if (events & EPOLLRDHUP) poll_events |= POLLRDHUP;
+  return poll_events;
+}
+
+// Returns the epoll events corresponding to the poll events |poll_events|.
+uint32_t FromPollEvents(short poll_events) {
+  uint32_t events = 0;
+  if (poll_events & (POLLIN | POLLRDNORM)) events |= EPOLLIN;
+  if (poll_events & POLLPRI) events |= EPOLLPRI;
+  if (poll_events & (POLLOUT | POLLWRNORM)) events |= EPOLLOUT;
+  if (poll_events & POLLERR) events |= EPOLLERR;
+  if (poll_events & POLLHUP) events |= EPOLLHUP;
+  if (poll_events & POLLRDHUP) events |= EPOLLRDHUP;
+  return events;
+}
+
+}  // namespace
 
 int IOContextEpoll::EpollCtl(int op, int hostfd, struct epoll_event *event) {
+  absl::MutexLock lock(&mu_);
   struct epoll_event event_copy;
   if (event) {
     event_copy.events = event->events;
@@ -40,7 +75,8 @@ int IOContextEpoll::EpollCtl(int op, int hostfd, struct epoll_event *event) {
         errno = EBADE;
         return -1;
       }
-    } while (key_to_data.find(key) != key_to_data.end());
+    } while (key == kWakeKey || key == EpollRing::kAgentWakeKey ||
+             key_to_data.find(key) != key_to_data.end());
     key_to_data[key] = event->data.u64;
     fd_to_key[hostfd] = key;
     event_copy.data.u64 = key;
@@ -67,8 +103,263 @@ int IOContextEpoll::EpollCtl(int op, int hostfd, struct epoll_event *event) {
   return enc_untrusted_epoll_ctl(host_fd_, op, hostfd, &event_copy);
 }
 
+int IOContextEpoll::EpollCtlEnclave(
+    int op, int fd, std::shared_ptr<IOManager::IOContext> context,
+    struct epoll_event *event) {
+  if (op != EPOLL_CTL_DEL && !event) {
+    errno = EFAULT;
+    return -1;
+  }
+  {
+    absl::MutexLock lock(&mu_);
+    auto it = enclave_interest_.find(fd);
+    // An entry whose context was closed is stale, even if |fd| was reused.
+    if (it != enclave_interest_.end() && it->second.context.lock() != context) {
+      enclave_interest_.erase(it);
+      it = enclave_interest_.end();
+    }
+    if (op == EPOLL_CTL_ADD) {
+      if (it != enclave_interest_.end()) {
+        errno = EEXIST;
+        return -1;
+      }
+      enclave_interest_[fd] = {context, *event, false, 0};
+    } else if (op == EPOLL_CTL_MOD) {
+      if (it == enclave_interest_.end()) {
+        errno = ENOENT;
+        return -1;
+      }
+      it->second.event = *event;
+      it->second.reported = false;
+    } else if (op == EPOLL_CTL_DEL) {
+      if (it == enclave_interest_.end()) {
+        errno = ENOENT;
+        return -1;
+      }
+      enclave_interest_.erase(it);
+    } else {
+      errno = EINVAL;
+      return -1;
+    }
+  }
+  // Threads waiting on this epoll instance inside the enclave pick up the new
+  // interest list.
+  ReadinessQueue::GetInstance()->Notify();
+  return 0;
+}
+
 int IOContextEpoll::EpollWait(struct epoll_event *events, int maxevents,
                               int timeout) {
+  if (maxevents <= 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  ReadinessQueue *queue = ReadinessQueue::GetInstance();
+  absl::Time deadline = PollDeadline(timeout);
+  while (true) {
+    uint64_t generation = queue->Generation();
+    bool expired = timeout == 0 || (timeout > 0 && absl::Now() >= deadline);
+    int num_events;
+    bool watches_host;
+    {
+      absl::MutexLock lock(&mu_);
+      num_events = CollectEnclaveEvents(events, maxevents);
+      watches_host = !fd_to_key.empty() || enclave_interest_.empty();
+    }
+
+    if (!watches_host) {
+      if (num_events > 0 || expired) {
+        return num_events;
+      }
+      queue->Wait(generation, deadline);
+      continue;
+    }
+    if (num_events == maxevents) {
+      return num_events;
+    }
+    int host_timeout = (num_events > 0 || expired) ? 0 : PollTimeout(deadline);
+    int ret = WaitHostEvents(events + num_events, maxevents - num_events,
+                             host_timeout, generation);
+    if (ret < 0) {
+      return num_events > 0 ? num_events : -1;
+    }
+    num_events += ret;
+    if (num_events > 0 || host_timeout == 0) {
+      return num_events;
+    }
+  }
+}
+
+int IOContextEpoll::CollectEnclaveEvents(struct epoll_event *events,
+                                         int maxevents) {
+  int num_events = 0;
+  for (auto it = enclave_interest_.begin();
+       it != enclave_interest_.end() && num_events < maxevents;) {
+    std::shared_ptr<IOManager::IOContext> context = it->second.context.lock();
+    if (!context) {
+      // The context was closed, which removes it from the interest list.
+      enclave_interest_.erase(it++);
+      continue;
+    }
+    EnclaveInterest &interest = it->second;
+    ++it;
+    // The sequence is read first, so that a change racing with the readiness
+    // check is reported again rather than missed.
+    uint64_t sequence = context->ReadinessSequence();
+    short ready = context->PollReadiness(ToPollEvents(interest.event.events));
+    if (!ready || ((interest.event.events & EPOLLET) && interest.reported &&
+                   interest.reported_sequence == sequence)) {
+      continue;
+    }
+    events[num_events].events = FromPollEvents(ready);
+    events[num_events].data = interest.event.data;
+    ++num_events;
+    interest.reported = true;
+    interest.reported_sequence = sequence;
+    if (interest.event.events & EPOLLONESHOT) {
+      // Disabled until modified with EPOLL_CTL_MOD.
+      interest.event.events = 0;
+    }
+  }
+  return num_events;
+}
+
+int IOContextEpoll::WaitHostEvents(struct epoll_event *events, int maxevents,
+                                   int timeout, uint64_t generation) {
+  ReadinessQueue *queue = ReadinessQueue::GetInstance();
+  int wake_fd = -1;
+  if (timeout != 0) {
+    absl::MutexLock lock(&mu_);
+    if (!enclave_interest_.empty()) {
+      wake_fd = queue->BeginHostWait(generation, &timeout);
+      if (wake_fd != -1 && !wake_registered_) {
+        // The wake pipe stays readable until all host waiters return, so it is
+        // edge-triggered to not be harvested over and over.
+        struct epoll_event wake_event;
+        wake_event.events = EPOLLIN | EPOLLET;
+        wake_event.data.u64 = kWakeKey;
+        wake_registered_ = enc_untrusted_epoll_ctl(host_fd_, EPOLL_CTL_ADD,
+                                                   wake_fd, &wake_event) == 0;
+        if (!wake_registered_) {
+          queue->EndHostWait();
+          wake_fd = -1;
+          timeout = LimitUninterruptibleWait(timeout);
+        }
+      }
+    }
+  }
+  int ret = HostEvents(events, maxevents, timeout);
+  if (wake_fd != -1) {
+    queue->EndHostWait();
+  }
+  return ret;
+}
+
+int IOContextEpoll::HostEvents(struct epoll_event *events, int maxevents,
+                               int timeout) {
+  void *agent = nullptr;
+  {
+    absl::MutexLock lock(&mu_);
+    if (StartAgent()) {
+      int num_events = ConsumeEvents(events, maxevents);
+      if (num_events > 0) {
+        return num_events;
+      }
+      if (timeout != 0) {
+        // Only a wait finding the ring empty requests a harvest, so events are
+        // not harvested ahead of the wait that reports them.
+        ring_->harvest_requested.store(1, std::memory_order_release);
+      }
+      agent = agent_;
+      // Registered before the lock is released, so the agent is not destroyed
+      // until this thread returns from it.
+      ++agent_waiters_;
+    }
+  }
+  if (!agent) {
+    return HostEpollWait(events, maxevents, timeout);
+  }
+
+  // The ring is empty. Block until the agent delivers the requested events, or
+  // have it harvest the events ready for a poll.
+  enc_untrusted_epoll_agent_wait(agent, timeout);
+  absl::MutexLock lock(&mu_);
+  if (--agent_waiters_ == 0) {
+    agent_idle_.SignalAll();
+  }
+  if (agent_ != agent) {
+    // The epoll instance was closed while waiting.
+    errno = EBADF;
+    return -1;
+  }
+  return ConsumeEvents(events, maxevents);
+}
+
+bool IOContextEpoll::StartAgent() {
+  if (agent_) {
+    return true;
+  }
+  if (agent_failed_) {
+    return false;
+  }
+  void *buffer = UntrustedCacheMalloc::Instance()->Malloc(sizeof(EpollRing));
+  if (!buffer) {
+    agent_failed_ = true;
+    return false;
+  }
+  ring_ = new (buffer) EpollRing();
+  agent_ = enc_untrusted_epoll_agent_start(host_fd_, ring_);
+  if (!agent_) {
+    ring_->~EpollRing();
+    UntrustedCacheMalloc::Instance()->Free(ring_);
+    ring_ = nullptr;
+    agent_failed_ = true;
+    return false;
+  }
+  return true;
+}
+
+void IOContextEpoll::StopAgent() {
+  if (!agent_) {
+    return;
+  }
+  void *agent = agent_;
+  EpollRing *ring = ring_;
+  agent_ = nullptr;
+  ring_ = nullptr;
+  // Threads waiting in the agent return once it stops, and release mu_ to
+  // leave. The agent and its ring are freed after the last one.
+  enc_untrusted_epoll_agent_stop(agent);
+  while (agent_waiters_ > 0) {
+    agent_idle_.Wait(&mu_);
+  }
+  enc_untrusted_epoll_agent_destroy(agent);
+  ring->~EpollRing();
+  UntrustedCacheMalloc::Instance()->Free(ring);
+}
+
+int IOContextEpoll::ConsumeEvents(struct epoll_event *events, int maxevents) {
+  // The ring is in untrusted memory, so each record is copied into the enclave
+  // before it is used.
+  int num_events = 0;
+  while (num_events < maxevents &&
+         ring_->events.size() >= sizeof(bridge_epoll_event)) {
+    bridge_epoll_event record;
+    ring_->events.Read(reinterpret_cast<uint8_t *>(&record), sizeof(record));
+    // Events of file descriptors removed since the harvest are dropped.
+    auto it = key_to_data.find(record.data);
+    if (it == key_to_data.end()) {
+      continue;
+    }
+    events[num_events].events = FromBridgeEpollEvents(record.events);
+    events[num_events].data.u64 = it->second;
+    ++num_events;
+  }
+  return num_events;
+}
+
+int IOContextEpoll::HostEpollWait(struct epoll_event *events, int maxevents,
+                                  int timeout) {
   int ret = enc_untrusted_epoll_wait(host_fd_, events, maxevents, timeout);
   if (ret == -1) {
     // errno is set in enc_untrusted_epoll_wait.
@@ -76,15 +367,24 @@ int IOContextEpoll::EpollWait(struct epoll_event *events, int maxevents,
   }
   // Convert the random bits in the data field back to the original data using
   // the key_to_data map.
+  absl::MutexLock lock(&mu_);
+  int num_events = 0;
   for (int i = 0; i < ret; ++i) {
     uint64_t key = events[i].data.u64;
-    if (key_to_data.find(key) == key_to_data.end()) {
+    if (key == kWakeKey) {
+      // A wakeup of the ReadinessQueue only interrupts the wait.
+      continue;
+    }
+    auto it = key_to_data.find(key);
+    if (it == key_to_data.end()) {
       errno = EBADE;
       return -1;
     }
-    events[i].data.u64 = key_to_data[key];
+    events[num_events].events = events[i].events;
+    events[num_events].data.u64 = it->second;
+    ++num_events;
   }
-  return ret;
+  return num_events;
 }
 
 int IOContextEpoll::GetHostFileDescriptor() { return host_fd_; }
@@ -100,7 +400,18 @@ ssize_t IOContextEpoll::Write(const void *buf, size_t count) {
   return -1;
 }
 
-int IOContextEpoll::Close() { return enc_untrusted_close(host_fd_); }
+int IOContextEpoll::Close() {
+  {
+    absl::MutexLock lock(&mu_);
+    // Set before the agent stops, since StopAgent() releases mu_ while threads
+    // leave the agent. Later waits fail in the host call on the closed file
+    // descriptor.
+    agent_failed_ = true;
+    StopAgent();
+    enclave_interest_.clear();
+  }
+  return enc_untrusted_close(host_fd_);
+}
 
 }  // namespace io
 }  // namespace asylo
@@ -19,18 +19,46 @@
 #ifndef ASYLO_PLATFORM_POSIX_IO_IO_CONTEXT_EPOLL_H_
 #define ASYLO_PLATFORM_POSIX_IO_IO_CONTEXT_EPOLL_H_
 
+#include <cstdint>
+#include <memory>
+
+#include "absl/base/thread_annotations.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/platform/common/epoll_ring.h"
 #include "asylo/platform/posix/io/io_manager.h"
 
 namespace asylo {
 namespace io {
 // IOContext implementation wrapping an epoll file descriptor
+//
+// EpollWait reads events from an EpollRing filled by a host epoll agent thread,
+// so a wait for events already harvested does not leave the enclave. Only a
+// wait finding the ring empty makes a host call to the agent, which harvests
+// the events ready without blocking if |timeout| is zero. Every event is
+// harvested by the agent, so none is read from the instance twice.
+//
+// The agent harvests only on behalf of a wait which found the ring empty and
+// is still blocked, so the events it harvests are as current as those an
+// epoll_wait call made by that wait would return.
+//
+// Contexts without a host file descriptor, such as eventfd, are kept in an
+// interest list inside the enclave and checked with PollReadiness(). A wait
+// for them alone blocks in the ReadinessQueue; a wait for host file
+// descriptors as well blocks in the host, interrupted by the wake pipe of the
+// ReadinessQueue. An edge-triggered context is reported again only once its
+// own readiness may have changed.
 class IOContextEpoll : public IOManager::IOContext {
  public:
-  explicit IOContextEpoll(int host_fd) : host_fd_(host_fd) {}
+  explicit IOContextEpoll(int host_fd)
+      : host_fd_(host_fd), ring_(nullptr), agent_(nullptr),
+        agent_waiters_(0), agent_failed_(false), wake_registered_(false) {}
   // It's important to note that adding dup'd file descriptors here won't work
   // the same as it would in POSIX.
   int EpollCtl(int op, int hostfd, struct epoll_event *event) override;
+  int EpollCtlEnclave(int op, int fd,
+                      std::shared_ptr<IOManager::IOContext> context,
+                      struct epoll_event *event) override;
   int EpollWait(struct epoll_event *events, int maxevents,
                 int timeout) override;
   int GetHostFileDescriptor() override;
@@ -39,12 +67,85 @@ class IOContextEpoll : public IOManager::IOContext {
   int Close();
 
  private:
+  // A context without a host file descriptor in the interest list.
+  struct EnclaveInterest {
+    std::weak_ptr<IOManager::IOContext> context;
+    struct epoll_event event;
+    // True if the context was reported since it was added or modified.
+    bool reported;
+    // Readiness sequence of the context when it was last reported.
+    uint64_t reported_sequence;
+  };
+
+  // Moves up to |maxevents| events of the ready contexts in
+  // |enclave_interest_| to |events|. Returns the number of events moved.
+  int CollectEnclaveEvents(struct epoll_event *events, int maxevents)
+      EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Waits up to |timeout| milliseconds for events of host file descriptors. If
+  // contexts without a host file descriptor are watched, none of which was
+  // ready at readiness generation |generation|, the wait returns early when
+  // one may have become ready.
+  int WaitHostEvents(struct epoll_event *events, int maxevents, int timeout,
+                     uint64_t generation) LOCKS_EXCLUDED(mu_);
+
+  // Waits for events of host file descriptors, reading the ring filled by the
+  // host epoll agent when it runs. Returns 0 after a wakeup without events.
+  int HostEvents(struct epoll_event *events, int maxevents, int timeout)
+      LOCKS_EXCLUDED(mu_);
+
+  // Starts the host epoll agent if it is not running yet. Returns false if the
+  // agent could not be started.
+  bool StartAgent() EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Stops the host epoll agent, if it is running, and destroys it once no
+  // thread waits in it.
+  void StopAgent() EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Moves up to |maxevents| harvested events from the ring to |events|, and
+  // requests a new harvest if the ring is left empty. Returns the number of
+  // events moved.
+  int ConsumeEvents(struct epoll_event *events, int maxevents)
+      EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Waits for events with a host call to epoll_wait, if the host epoll agent
+  // could not be started.
+  int HostEpollWait(struct epoll_event *events, int maxevents, int timeout)
+      LOCKS_EXCLUDED(mu_);
+
   // Host file descriptor implementing this stream.
   int host_fd_;
-  absl::flat_hash_map<uint64_t, uint64_t> key_to_data;
+
+  absl::Mutex mu_;
+
+  // Events harvested by the host epoll agent, in untrusted memory.
+  EpollRing *ring_ GUARDED_BY(mu_);
+
+  // Handle to the host epoll agent, or nullptr if it is not running.
+  void *agent_ GUARDED_BY(mu_);
+
+  // Number of threads in a host call to the host epoll agent, which is not
+  // destroyed until they return.
+  int agent_waiters_ GUARDED_BY(mu_);
+
+  // Signaled when the last thread in a host call to the agent returns.
+  absl::CondVar agent_idle_;
+
+  // True if the host epoll agent could not be started, in which case waits
+  // fall back to host calls.
+  bool agent_failed_ GUARDED_BY(mu_);
+
+  // True if the wake pipe of the ReadinessQueue was added to the host epoll
+  // instance.
+  bool wake_registered_ GUARDED_BY(mu_);
+
+  // Contexts without a host file descriptor, by enclave file descriptor.
+  absl::flat_hash_map<int, EnclaveInterest> enclave_interest_ GUARDED_BY(mu_);
+
+  absl::flat_hash_map<uint64_t, uint64_t> key_to_data GUARDED_BY(mu_);
   // Manages a mapping from the host file descriptor to a random key to enable
   // updates to the above map durring deletions/modifications.
-  absl::flat_hash_map<int, uint64_t> fd_to_key;
+  absl::flat_hash_map<int, uint64_t> fd_to_key GUARDED_BY(mu_);
 };
 
 }  // namespace io
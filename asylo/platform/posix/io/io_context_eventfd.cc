@@ -17,6 +17,10 @@
  */
 #include "asylo/platform/posix/io/io_context_eventfd.h"
 
+#include <poll.h>
+
+#include "asylo/platform/posix/io/readiness_queue.h"
+
 constexpr uint64_t kMaxCounter = 0xfffffffffffffffe;
 constexpr ssize_t kCounterBufSize = sizeof(uint64_t);
 
@@ -28,21 +32,25 @@ ssize_t IOContextEventFd::Read(void *buf, size_t count) {
     errno = EINVAL;
     return -1;
   }
-  absl::MutexLock counter_mutex_lock(&counter_mutex_);
-  if (nonblock_ && (counter_ == 0)) {
-    errno = EAGAIN;
-    return -1;
-  } else {
-    auto ready = [this]() { return counter_ > 0; };
-    counter_mutex_.Await(absl::Condition(&ready));
-  }
-  if (semaphore_) {
-    *reinterpret_cast<uint64_t *>(buf) = 1;
-    --counter_;
-  } else {
-    *reinterpret_cast<uint64_t *>(buf) = counter_;
-    counter_ = 0;
+  {
+    absl::MutexLock counter_mutex_lock(&counter_mutex_);
+    if (nonblock_ && (counter_ == 0)) {
+      errno = EAGAIN;
+      return -1;
+    } else {
+      auto ready = [this]() { return counter_ > 0; };
+      counter_mutex_.Await(absl::Condition(&ready));
+    }
+    if (semaphore_) {
+      *reinterpret_cast<uint64_t *>(buf) = 1;
+      --counter_;
+    } else {
+      *reinterpret_cast<uint64_t *>(buf) = counter_;
+      counter_ = 0;
+    }
+    ++readiness_sequence_;
   }
+  ReadinessQueue::GetInstance()->Notify();
   return kCounterBufSize;
 }
 
@@ -56,18 +64,41 @@ ssize_t IOContextEventFd::Write(const void *buf, size_t count) {
     errno = EINVAL;
     return -1;
   }
-  absl::MutexLock counter_mutex_lock(&counter_mutex_);
-  if (nonblock_ && (counter_ + add > kMaxCounter)) {
-    errno = EAGAIN;
-    return -1;
-  } else {
-    auto ready = [this, add]() { return (counter_ + add) <= kMaxCounter; };
-    counter_mutex_.Await(absl::Condition(&ready));
+  {
+    absl::MutexLock counter_mutex_lock(&counter_mutex_);
+    if (nonblock_ && (counter_ + add > kMaxCounter)) {
+      errno = EAGAIN;
+      return -1;
+    } else {
+      auto ready = [this, add]() { return (counter_ + add) <= kMaxCounter; };
+      counter_mutex_.Await(absl::Condition(&ready));
+    }
+    counter_ += add;
+    ++readiness_sequence_;
   }
-  counter_ += add;
+  // Pollers of the eventfd wait in the readiness queue, so waking them does not
+  // leave the enclave unless one is blocked in a host call.
+  ReadinessQueue::GetInstance()->Notify();
   return kCounterBufSize;
 }
 
+short IOContextEventFd::PollReadiness(short events) {
+  absl::MutexLock counter_mutex_lock(&counter_mutex_);
+  short ready = 0;
+  if (counter_ > 0) {
+    ready |= POLLIN | POLLRDNORM;
+  }
+  if (counter_ < kMaxCounter) {
+    ready |= POLLOUT | POLLWRNORM;
+  }
+  return ready & events;
+}
+
+uint64_t IOContextEventFd::ReadinessSequence() {
+  absl::MutexLock counter_mutex_lock(&counter_mutex_);
+  return readiness_sequence_;
+}
+
 int IOContextEventFd::Close() {
   return 0;
 }
@@ -49,11 +49,19 @@ class IOContextEventFd : public IOManager::IOContext {
   ssize_t Write(const void *buf, size_t count) override;
   int Close() override;
 
+  // Reports POLLIN while the counter is nonzero, and POLLOUT while it is below
+  // its maximum value.
+  short PollReadiness(short events) override;
+
+  uint64_t ReadinessSequence() override;
+
  private:
   // Host file descriptor implementing this stream.
   uint64_t counter_;
   bool semaphore_;
   bool nonblock_;
+  // Number of reads and writes, which may each change the readiness.
+  uint64_t readiness_sequence_ = 0;
   absl::Mutex counter_mutex_;
 };
 
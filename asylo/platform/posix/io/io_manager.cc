@@ -20,9 +20,13 @@
 
 #include <fcntl.h>
 #include <poll.h>
+#include <algorithm>
 #include <cerrno>
+#include <climits>
 #include <cstdint>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include "absl/algorithm/container.h"
 #include "absl/container/flat_hash_set.h"
@@ -33,12 +37,119 @@
 #include "asylo/platform/posix/io/io_context_eventfd.h"
 #include "asylo/platform/posix/io/io_context_inotify.h"
 #include "asylo/platform/posix/io/native_paths.h"
+#include "asylo/platform/posix/io/readiness_queue.h"
 #include "asylo/platform/posix/io/util.h"
 #include "asylo/util/posix_error_space.h"
 #include "asylo/util/statusor.h"
 
 namespace asylo {
 namespace io {
+namespace {
+
+// A context without a host file descriptor, and the index of its entry in the
+// array given to poll.
+using EnclavePollEntry =
+    std::pair<nfds_t, std::shared_ptr<IOManager::IOContext>>;
+
+// Waits as poll(2) for the |nfds| entries of |fds|, which hold host file
+// descriptors, except the entries of |enclave_entries|, which hold -1 and are
+// checked for readiness inside the enclave.
+int PollWithEnclaveContexts(
+    struct pollfd *fds, nfds_t nfds,
+    const std::vector<EnclavePollEntry> &enclave_entries, int timeout) {
+  ReadinessQueue *queue = ReadinessQueue::GetInstance();
+  absl::Time deadline = PollDeadline(timeout);
+  bool watches_host = nfds > enclave_entries.size();
+  std::vector<struct pollfd> host_fds;
+  while (true) {
+    uint64_t generation = queue->Generation();
+    bool ready = absl::c_any_of(
+        enclave_entries, [fds](const EnclavePollEntry &entry) {
+          return entry.second->PollReadiness(fds[entry.first].events) != 0;
+        });
+    bool expired = timeout == 0 || (timeout > 0 && absl::Now() >= deadline);
+
+    if (watches_host) {
+      // The host ignores the entries holding -1. When nothing is ready in the
+      // enclave, the host wait also watches the wake pipe of the readiness
+      // queue, so that a context becoming ready interrupts it.
+      host_fds.assign(fds, fds + nfds);
+      int host_timeout = (ready || expired) ? 0 : PollTimeout(deadline);
+      int wake_fd = -1;
+      if (host_timeout != 0) {
+        wake_fd = queue->BeginHostWait(generation, &host_timeout);
+        if (wake_fd != -1) {
+          host_fds.push_back({wake_fd, POLLIN, 0});
+        }
+      }
+      int ret = enc_untrusted_poll(host_fds.data(), host_fds.size(),
+                                   host_timeout);
+      if (wake_fd != -1) {
+        queue->EndHostWait();
+      }
+      if (ret < 0) {
+        return -1;
+      }
+      for (nfds_t i = 0; i < nfds; ++i) {
+        fds[i].revents = host_fds[i].revents;
+      }
+    } else {
+      if (!ready && !expired) {
+        queue->Wait(generation, deadline);
+        continue;
+      }
+      for (nfds_t i = 0; i < nfds; ++i) {
+        fds[i].revents = 0;
+      }
+    }
+
+    for (const EnclavePollEntry &entry : enclave_entries) {
+      struct pollfd *fd = &fds[entry.first];
+      fd->revents = entry.second->PollReadiness(fd->events);
+    }
+    int num_ready = std::count_if(
+        fds, fds + nfds,
+        [](const struct pollfd &fd) { return fd.revents != 0; });
+    if (num_ready > 0 || expired) {
+      return num_ready;
+    }
+  }
+}
+
+}  // namespace
+
+int IOManager::IOContext::SendMMsg(struct mmsghdr *msgvec, unsigned int vlen,
+                                   int flags) {
+  for (unsigned int i = 0; i < vlen; ++i) {
+    ssize_t ret = SendMsg(&msgvec[i].msg_hdr, flags);
+    if (ret < 0) {
+      // As sendmmsg(2), report an error only if no message was sent.
+      return i > 0 ? i : -1;
+    }
+    msgvec[i].msg_len = ret;
+  }
+  return vlen;
+}
+
+int IOManager::IOContext::RecvMMsg(struct mmsghdr *msgvec, unsigned int vlen,
+                                   int flags, struct timespec *timeout) {
+  if (timeout) {
+    errno = ENOSYS;
+    return -1;
+  }
+  for (unsigned int i = 0; i < vlen; ++i) {
+    ssize_t ret = RecvMsg(&msgvec[i].msg_hdr, flags & ~MSG_WAITFORONE);
+    if (ret < 0) {
+      // As recvmmsg(2), report an error only if no message was received.
+      return i > 0 ? i : -1;
+    }
+    msgvec[i].msg_len = ret;
+    if (flags & MSG_WAITFORONE) {
+      flags |= MSG_DONTWAIT;
+    }
+  }
+  return vlen;
+}
 
 IOManager::FileDescriptorTable::FileDescriptorTable()
     : maximum_fd_soft_limit(kMaxOpenFiles),
@@ -287,6 +398,24 @@ int IOManager::Select(int nfds, fd_set *readfds, fd_set *writefds,
     return -1;
   }
 
+  // The host cannot select file descriptors without a host file descriptor, so
+  // a select watching one is implemented with poll.
+  bool watches_enclave = false;
+  {
+    absl::ReaderMutexLock lock(&fd_table_lock_);
+    for (int fd = 0; fd < nfds && !watches_enclave; ++fd) {
+      if ((readfds && FD_ISSET(fd, readfds)) ||
+          (writefds && FD_ISSET(fd, writefds)) ||
+          (exceptfds && FD_ISSET(fd, exceptfds))) {
+        std::shared_ptr<IOContext> context = fd_table_.Get(fd);
+        watches_enclave = context && context->GetHostFileDescriptor() == -1;
+      }
+    }
+  }
+  if (watches_enclave) {
+    return SelectWithPoll(nfds, readfds, writefds, exceptfds, timeout);
+  }
+
   // Translate the fd_sets into host file descriptors.
   fd_set host_readfds, host_writefds, host_exceptfds;
   FD_ZERO(&host_readfds);
@@ -379,8 +508,65 @@ int IOManager::Select(int nfds, fd_set *readfds, fd_set *writefds,
   return ret;
 }
 
+int IOManager::SelectWithPoll(int nfds, fd_set *readfds, fd_set *writefds,
+                              fd_set *exceptfds, struct timeval *timeout) {
+  std::vector<struct pollfd> fds;
+  for (int fd = 0; fd < nfds; ++fd) {
+    short events = 0;
+    if (readfds && FD_ISSET(fd, readfds)) {
+      events |= POLLIN;
+    }
+    if (writefds && FD_ISSET(fd, writefds)) {
+      events |= POLLOUT;
+    }
+    if (exceptfds && FD_ISSET(fd, exceptfds)) {
+      events |= POLLPRI;
+    }
+    if (events) {
+      fds.push_back({fd, events, 0});
+    }
+  }
+  int poll_timeout = -1;
+  if (timeout) {
+    poll_timeout = static_cast<int>(std::min<int64_t>(
+        static_cast<int64_t>(timeout->tv_sec) * 1000 +
+            (timeout->tv_usec + 999) / 1000,
+        INT_MAX));
+  }
+  if (Poll(fds.data(), fds.size(), poll_timeout) < 0) {
+    return -1;
+  }
+
+  if (readfds) {
+    FD_ZERO(readfds);
+  }
+  if (writefds) {
+    FD_ZERO(writefds);
+  }
+  if (exceptfds) {
+    FD_ZERO(exceptfds);
+  }
+  int ret = 0;
+  for (const struct pollfd &fd : fds) {
+    if ((fd.events & POLLIN) && (fd.revents & (POLLIN | POLLHUP | POLLERR))) {
+      FD_SET(fd.fd, readfds);
+      ++ret;
+    }
+    if ((fd.events & POLLOUT) && (fd.revents & (POLLOUT | POLLERR))) {
+      FD_SET(fd.fd, writefds);
+      ++ret;
+    }
+    if ((fd.events & POLLPRI) && (fd.revents & POLLPRI)) {
+      FD_SET(fd.fd, exceptfds);
+      ++ret;
+    }
+  }
+  return ret;
+}
+
 int IOManager::Poll(struct pollfd *fds, nfds_t nfds, int timeout) {
   std::vector<int> enclave_fd(nfds);
+  std::vector<EnclavePollEntry> enclave_entries;
   {
     absl::ReaderMutexLock lock(&fd_table_lock_);
     for (int i = 0; i < nfds; ++i) {
@@ -388,12 +574,17 @@ int IOManager::Poll(struct pollfd *fds, nfds_t nfds, int timeout) {
       std::shared_ptr<IOContext> context = fd_table_.Get(enclave_fd[i]);
       if (context) {
         fds[i].fd = context->GetHostFileDescriptor();
+        if (fds[i].fd == -1) {
+          enclave_entries.emplace_back(i, std::move(context));
+        }
       } else {
         fds[i].fd = -1;
       }
     }
   }
-  int ret = enc_untrusted_poll(fds, nfds, timeout);
+  int ret = enclave_entries.empty()
+                ? enc_untrusted_poll(fds, nfds, timeout)
+                : PollWithEnclaveContexts(fds, nfds, enclave_entries, timeout);
   for (int i = 0; i < nfds; ++i) {
     fds[i].fd = enclave_fd[i];
   }
@@ -426,11 +617,20 @@ int IOManager::EpollCtl(int epfd, int op, int fd, struct epoll_event *event) {
     absl::ReaderMutexLock lock(&fd_table_lock_);
     context = fd_table_.Get(fd);
   }
-  int hostfd = context ? context->GetHostFileDescriptor() : -1;
-  if (hostfd == -1) {
+  if (!context) {
     errno = EBADF;
     return -1;
   }
+  int hostfd = context->GetHostFileDescriptor();
+  if (hostfd == -1) {
+    // The readiness of a context without a host file descriptor is tracked
+    // inside the enclave.
+    return CallWithContext(
+        epfd, [op, fd, &context, event](
+                  std::shared_ptr<IOContext> epoll_context) {
+          return epoll_context->EpollCtlEnclave(op, fd, context, event);
+        });
+  }
   return CallWithContext(
       epfd, [op, hostfd, event](std::shared_ptr<IOContext> epoll_context) {
         return epoll_context->EpollCtl(op, hostfd, event);
@@ -969,6 +1169,22 @@ ssize_t IOManager::RecvMsg(int sockfd, struct msghdr *msg, int flags) {
                          });
 }
 
+int IOManager::SendMMsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+                        int flags) {
+  return CallWithContext(
+      sockfd, [msgvec, vlen, flags](std::shared_ptr<IOContext> context) {
+        return context->SendMMsg(msgvec, vlen, flags);
+      });
+}
+
+int IOManager::RecvMMsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+                        int flags, struct timespec *timeout) {
+  return CallWithContext(sockfd, [msgvec, vlen, flags, timeout](
+                                     std::shared_ptr<IOContext> context) {
+    return context->RecvMMsg(msgvec, vlen, flags, timeout);
+  });
+}
+
 int IOManager::GetSockName(int sockfd, struct sockaddr *addr,
                            socklen_t *addrlen) {
   return CallWithContext(sockfd,
@@ -61,6 +61,21 @@ class IOManager {
    public:
     virtual ~IOContext() = default;
 
+    // Returns the poll events of |events| the context is ready for. Only
+    // called on contexts without a host file descriptor, whose readiness is
+    // known inside the enclave. Such contexts call ReadinessQueue::Notify()
+    // each time their readiness may change. By default, a context is always
+    // ready, as a regular file is.
+    virtual short PollReadiness(short events) {
+      return events & (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM);
+    }
+
+    // Returns a counter incremented each time the readiness reported by
+    // PollReadiness() may change. Edge-triggered epoll waits report a context
+    // again only once its counter moved. By default, the readiness of a
+    // context never changes.
+    virtual uint64_t ReadinessSequence() { return 0; }
+
    protected:
     // Implements IOManager::Read.
     virtual ssize_t Read(void *buf, size_t count) = 0;
@@ -191,6 +206,16 @@ class IOManager {
       return -1;
     }
 
+    // Implements sendmmsg. The default implementation sends each message with
+    // SendMsg.
+    virtual int SendMMsg(struct mmsghdr *msgvec, unsigned int vlen,
+                         int flags);
+
+    // Implements recvmmsg. The default implementation receives each message
+    // with RecvMsg, and does not support |timeout|.
+    virtual int RecvMMsg(struct mmsghdr *msgvec, unsigned int vlen, int flags,
+                         struct timespec *timeout);
+
     // Implements getsockname.
     virtual int GetSockName(struct sockaddr *addr, socklen_t *addrlen) {
       errno = ENOSYS;
@@ -210,6 +235,16 @@ class IOManager {
       return -1;
     }
 
+    // Adds, modifies or removes, according to |op|, the context |context|
+    // without a host file descriptor, open as |fd| in the enclave, in the
+    // interest list of this epoll instance.
+    virtual int EpollCtlEnclave(int op, int fd,
+                                std::shared_ptr<IOContext> context,
+                                struct epoll_event *event) {
+      errno = EINVAL;
+      return -1;
+    }
+
     // Implements epoll_wait.
     virtual int EpollWait(struct epoll_event *events, int maxevents,
                           int timeout) {
@@ -601,6 +636,14 @@ class IOManager {
   // Implements recvmsg(2).
   ssize_t RecvMsg(int sockfd, struct msghdr *msg, int flags);
 
+  // Implements sendmmsg(2).
+  int SendMMsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+               int flags);
+
+  // Implements recvmmsg(2).
+  int RecvMMsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+               int flags, struct timespec *timeout);
+
   // Implements getsockname(2).
   int GetSockName(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
 
@@ -666,6 +709,12 @@ class IOManager {
   // nullptr if no entry is found.
   VirtualPathHandler *HandlerForPath(absl::string_view path) const;
 
+  // Implements select(2) with Poll(), for a select watching file descriptors
+  // without a host file descriptor.
+  int SelectWithPoll(int nfds, fd_set *readfds, fd_set *writefds,
+                     fd_set *exceptfds, struct timeval *timeout)
+      LOCKS_EXCLUDED(fd_table_lock_);
+
   // Locks the mutex corresponding to |fd| and performs thread safe action.
   template <typename IOAction, typename ReturnType = typename std::result_of<
                                    IOAction(std::shared_ptr<IOContext>)>::type>
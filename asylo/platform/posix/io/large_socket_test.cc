@@ -0,0 +1,227 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "asylo/platform/core/untrusted_buffer_pool.h"
+
+namespace asylo {
+namespace {
+
+// Larger than two staging buffers, so that a transfer takes several chunks.
+constexpr size_t kPayloadSize =
+    2 * UntrustedBufferPool::kBufferSize + UntrustedBufferPool::kBufferSize / 2;
+
+// An errno value no call in these tests sets.
+constexpr int kSentinelErrno = ENOTDIR;
+
+// Returns |size| bytes of a recognizable pattern.
+std::vector<uint8_t> MakePayload(size_t size) {
+  std::vector<uint8_t> payload(size);
+  for (size_t i = 0; i < size; ++i) {
+    payload[i] = static_cast<uint8_t>(i * 7 + i / 251);
+  }
+  return payload;
+}
+
+// Sends all of |size| bytes of |buf| on |fd|.
+bool SendAll(int fd, const uint8_t *buf, size_t size) {
+  while (size > 0) {
+    ssize_t ret = send(fd, buf, size, 0);
+    if (ret <= 0) {
+      return false;
+    }
+    buf += ret;
+    size -= ret;
+  }
+  return true;
+}
+
+// Receives exactly |size| bytes from |fd| into |buf|.
+bool RecvAll(int fd, uint8_t *buf, size_t size) {
+  while (size > 0) {
+    ssize_t ret = recv(fd, buf, size, 0);
+    if (ret <= 0) {
+      return false;
+    }
+    buf += ret;
+    size -= ret;
+  }
+  return true;
+}
+
+// Tests sends and receives large enough to be staged in chunks through an
+// UntrustedBufferPool, over a connected pair of host TCP sockets.
+class LargeSocketTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(listener, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t addr_len = sizeof(addr);
+    ASSERT_EQ(bind(listener, reinterpret_cast<struct sockaddr *>(&addr),
+                   sizeof(addr)),
+              0);
+    ASSERT_EQ(listen(listener, 1), 0);
+    ASSERT_EQ(getsockname(listener, reinterpret_cast<struct sockaddr *>(&addr),
+                          &addr_len),
+              0);
+
+    sender_ = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(sender_, 0);
+    ASSERT_EQ(connect(sender_, reinterpret_cast<struct sockaddr *>(&addr),
+                      sizeof(addr)),
+              0);
+    receiver_ = accept(listener, nullptr, nullptr);
+    ASSERT_GE(receiver_, 0);
+    close(listener);
+  }
+
+  void TearDown() override {
+    close(sender_);
+    close(receiver_);
+  }
+
+  int sender_ = -1;
+  int receiver_ = -1;
+};
+
+// Verifies that a payload spanning several chunks arrives intact when received
+// with MSG_WAITALL.
+TEST_F(LargeSocketTest, RoundTripsPayloadLargerThanBuffer) {
+  std::vector<uint8_t> payload = MakePayload(kPayloadSize);
+  bool sent = false;
+  std::thread sender([this, &payload, &sent] {
+    sent = SendAll(sender_, payload.data(), payload.size());
+  });
+
+  std::vector<uint8_t> received(kPayloadSize);
+  EXPECT_EQ(recv(receiver_, received.data(), received.size(), MSG_WAITALL),
+            static_cast<ssize_t>(kPayloadSize));
+  sender.join();
+  EXPECT_TRUE(sent);
+  EXPECT_EQ(received, payload);
+}
+
+// Verifies that a non-blocking send reports the bytes that fit in the socket
+// buffer, and fails with EAGAIN once the buffer is full.
+TEST_F(LargeSocketTest, NonBlockingSendIsPartial) {
+  int buffer_size = 64 * 1024;
+  ASSERT_EQ(setsockopt(sender_, SOL_SOCKET, SO_SNDBUF, &buffer_size,
+                       sizeof(buffer_size)),
+            0);
+  ASSERT_EQ(setsockopt(receiver_, SOL_SOCKET, SO_RCVBUF, &buffer_size,
+                       sizeof(buffer_size)),
+            0);
+  std::vector<uint8_t> payload = MakePayload(kPayloadSize);
+
+  errno = kSentinelErrno;
+  ssize_t first = send(sender_, payload.data(), payload.size(), MSG_DONTWAIT);
+  ASSERT_GT(first, 0);
+  ASSERT_LT(first, static_cast<ssize_t>(kPayloadSize));
+  EXPECT_EQ(errno, kSentinelErrno);
+
+  // Fill the socket buffer until a send would block.
+  size_t sent = first;
+  ssize_t ret;
+  while ((ret = send(sender_, payload.data() + sent, payload.size() - sent,
+                     MSG_DONTWAIT)) > 0) {
+    sent += ret;
+  }
+  EXPECT_EQ(ret, -1);
+  EXPECT_EQ(errno, EAGAIN);
+  ASSERT_LT(sent, kPayloadSize);
+
+  std::vector<uint8_t> received(sent);
+  ASSERT_TRUE(RecvAll(receiver_, received.data(), received.size()));
+  EXPECT_TRUE(std::equal(received.begin(), received.end(), payload.begin()));
+}
+
+// Verifies that a large MSG_PEEK receive does not consume the bytes it returns.
+TEST_F(LargeSocketTest, PeekDoesNotConsume) {
+  std::vector<uint8_t> payload = MakePayload(kPayloadSize);
+  bool sent = false;
+  std::thread sender([this, &payload, &sent] {
+    sent = SendAll(sender_, payload.data(), payload.size());
+  });
+
+  std::vector<uint8_t> peeked(kPayloadSize);
+  ssize_t peeked_size = recv(receiver_, peeked.data(), peeked.size(), MSG_PEEK);
+  ASSERT_GT(peeked_size, 0);
+  EXPECT_LE(peeked_size,
+            static_cast<ssize_t>(UntrustedBufferPool::kBufferSize));
+  EXPECT_TRUE(std::equal(peeked.begin(), peeked.begin() + peeked_size,
+                         payload.begin()));
+
+  std::vector<uint8_t> received(kPayloadSize);
+  ASSERT_TRUE(RecvAll(receiver_, received.data(), received.size()));
+  sender.join();
+  EXPECT_TRUE(sent);
+  EXPECT_EQ(received, payload);
+}
+
+// Verifies that a large non-blocking receive on an empty socket fails with
+// EAGAIN.
+TEST_F(LargeSocketTest, NonBlockingRecvOnEmptySocketFails) {
+  std::vector<uint8_t> buf(kPayloadSize);
+  EXPECT_EQ(recv(receiver_, buf.data(), buf.size(), MSG_DONTWAIT), -1);
+  EXPECT_EQ(errno, EAGAIN);
+}
+
+// Verifies that large receives returning part of the requested bytes leave
+// errno unchanged, even when a later chunk found no more data.
+TEST_F(LargeSocketTest, PartialRecvPreservesErrno) {
+  constexpr size_t kSentSize =
+      UntrustedBufferPool::kBufferSize + UntrustedBufferPool::kBufferSize / 2;
+  std::vector<uint8_t> payload = MakePayload(kSentSize);
+  bool sent = false;
+  std::thread sender([this, &payload, &sent] {
+    sent = SendAll(sender_, payload.data(), payload.size());
+  });
+
+  std::vector<uint8_t> received(kPayloadSize);
+  size_t received_size = 0;
+  while (received_size < kSentSize) {
+    errno = kSentinelErrno;
+    ssize_t ret = recv(receiver_, received.data() + received_size,
+                       received.size() - received_size, 0);
+    ASSERT_GT(ret, 0);
+    EXPECT_EQ(errno, kSentinelErrno);
+    received_size += ret;
+  }
+  sender.join();
+  EXPECT_TRUE(sent);
+  EXPECT_EQ(received_size, kSentSize);
+  EXPECT_TRUE(std::equal(payload.begin(), payload.end(), received.begin()));
+}
+
+}  // namespace
+}  // namespace asylo
@@ -0,0 +1,255 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/memory/memory.h"
+#include "asylo/platform/posix/io/io_manager.h"
+
+namespace asylo {
+namespace {
+
+using ::testing::ElementsAre;
+
+constexpr char kQueuePath[] = "/mmsg_test/queue";
+
+// A message queue that is not backed by a host socket, so that sendmmsg and
+// recvmmsg fall back to one SendMsg or RecvMsg per message.
+class QueueContext : public io::IOManager::IOContext {
+ public:
+  ssize_t Read(void *buf, size_t count) override { return -1; }
+  ssize_t Write(const void *buf, size_t count) override { return -1; }
+  int Close() override { return 0; }
+
+  ssize_t SendMsg(const struct msghdr *msg, int flags) override {
+    std::string message;
+    for (size_t i = 0; i < msg->msg_iovlen; ++i) {
+      message.append(static_cast<const char *>(msg->msg_iov[i].iov_base),
+                     msg->msg_iov[i].iov_len);
+    }
+    queue_.push_back(message);
+    return message.size();
+  }
+
+  ssize_t RecvMsg(struct msghdr *msg, int flags) override {
+    if (queue_.empty()) {
+      errno = EAGAIN;
+      return -1;
+    }
+    std::string message = queue_.front();
+    queue_.pop_front();
+    size_t size = std::min(message.size(), msg->msg_iov[0].iov_len);
+    memcpy(msg->msg_iov[0].iov_base, message.data(), size);
+    msg->msg_flags = 0;
+    return size;
+  }
+
+ private:
+  std::deque<std::string> queue_;
+};
+
+class QueueHandler : public io::IOManager::VirtualPathHandler {
+ public:
+  std::unique_ptr<io::IOManager::IOContext> Open(const char *path, int flags,
+                                                 mode_t mode) override {
+    return absl::make_unique<QueueContext>();
+  }
+};
+
+class MMsgTest : public ::testing::Test {
+ protected:
+  static constexpr int kNumMessages = 3;
+  static constexpr size_t kMessageSize = 16;
+
+  void SetUp() override {
+    for (int i = 0; i < kNumMessages; ++i) {
+      send_buffers_[i] = std::string(kMessageSize, 'a' + i);
+      send_iov_[i].iov_base = &send_buffers_[i][0];
+      send_iov_[i].iov_len = send_buffers_[i].size();
+      recv_iov_[i].iov_base = recv_buffers_[i];
+      recv_iov_[i].iov_len = sizeof(recv_buffers_[i]);
+    }
+    ResetHeaders();
+  }
+
+  void ResetHeaders() {
+    memset(send_msgs_, 0, sizeof(send_msgs_));
+    memset(recv_msgs_, 0, sizeof(recv_msgs_));
+    memset(recv_buffers_, 0, sizeof(recv_buffers_));
+    for (int i = 0; i < kNumMessages; ++i) {
+      send_msgs_[i].msg_hdr.msg_iov = &send_iov_[i];
+      send_msgs_[i].msg_hdr.msg_iovlen = 1;
+      recv_msgs_[i].msg_hdr.msg_iov = &recv_iov_[i];
+      recv_msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+  }
+
+  // Creates two UDP sockets on the loopback interface connected to each
+  // other.
+  void CreateUdpPair(int *sender, int *receiver) {
+    *sender = socket(AF_INET, SOCK_DGRAM, 0);
+    *receiver = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_NE(*sender, -1);
+    ASSERT_NE(*receiver, -1);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    ASSERT_EQ(bind(*receiver, reinterpret_cast<struct sockaddr *>(&addr),
+                   sizeof(addr)),
+              0);
+    socklen_t addrlen = sizeof(addr);
+    ASSERT_EQ(getsockname(*receiver, reinterpret_cast<struct sockaddr *>(&addr),
+                          &addrlen),
+              0);
+    ASSERT_EQ(connect(*sender, reinterpret_cast<struct sockaddr *>(&addr),
+                      addrlen),
+              0);
+  }
+
+  // Returns the messages received in the first |count| entries.
+  std::vector<std::string> Received(int count) {
+    std::vector<std::string> messages;
+    for (int i = 0; i < count; ++i) {
+      messages.emplace_back(recv_buffers_[i], recv_msgs_[i].msg_len);
+    }
+    return messages;
+  }
+
+  std::string send_buffers_[kNumMessages];
+  char recv_buffers_[kNumMessages][2 * kMessageSize];
+  struct iovec send_iov_[kNumMessages];
+  struct iovec recv_iov_[kNumMessages];
+  struct mmsghdr send_msgs_[kNumMessages];
+  struct mmsghdr recv_msgs_[kNumMessages];
+};
+
+constexpr int MMsgTest::kNumMessages;
+constexpr size_t MMsgTest::kMessageSize;
+
+TEST_F(MMsgTest, SendsAndReceivesUdpBatch) {
+  int sender, receiver;
+  CreateUdpPair(&sender, &receiver);
+
+  ASSERT_EQ(sendmmsg(sender, send_msgs_, kNumMessages, 0), kNumMessages);
+  for (int i = 0; i < kNumMessages; ++i) {
+    EXPECT_EQ(send_msgs_[i].msg_len, kMessageSize);
+  }
+  ASSERT_EQ(recvmmsg(receiver, recv_msgs_, kNumMessages, 0, nullptr),
+            kNumMessages);
+  EXPECT_THAT(Received(kNumMessages),
+              ElementsAre(send_buffers_[0], send_buffers_[1],
+                          send_buffers_[2]));
+  close(sender);
+  close(receiver);
+}
+
+// Verifies that recvmmsg reports the source address of each message, bounded
+// by the size of the caller's address buffer.
+TEST_F(MMsgTest, ReceivesUdpSourceAddress) {
+  int sender, receiver;
+  CreateUdpPair(&sender, &receiver);
+  struct sockaddr_in sender_addr;
+  socklen_t sender_addrlen = sizeof(sender_addr);
+  ASSERT_EQ(
+      getsockname(sender, reinterpret_cast<struct sockaddr *>(&sender_addr),
+                  &sender_addrlen),
+      0);
+
+  struct sockaddr_in source_addrs[kNumMessages] = {};
+  for (int i = 0; i < kNumMessages; ++i) {
+    recv_msgs_[i].msg_hdr.msg_name = &source_addrs[i];
+    recv_msgs_[i].msg_hdr.msg_namelen = sizeof(source_addrs[i]);
+  }
+  ASSERT_EQ(sendmmsg(sender, send_msgs_, kNumMessages, 0), kNumMessages);
+  ASSERT_EQ(recvmmsg(receiver, recv_msgs_, kNumMessages, 0, nullptr),
+            kNumMessages);
+  for (int i = 0; i < kNumMessages; ++i) {
+    EXPECT_EQ(recv_msgs_[i].msg_hdr.msg_namelen, sender_addrlen);
+    EXPECT_EQ(source_addrs[i].sin_family, AF_INET);
+    EXPECT_EQ(source_addrs[i].sin_port, sender_addr.sin_port);
+    EXPECT_EQ(source_addrs[i].sin_addr.s_addr, sender_addr.sin_addr.s_addr);
+  }
+  close(sender);
+  close(receiver);
+}
+
+// Verifies that MSG_WAITFORONE returns the messages already received rather
+// than wait for a full batch.
+TEST_F(MMsgTest, UdpWaitForOneReturnsAvailableMessages) {
+  int sender, receiver;
+  CreateUdpPair(&sender, &receiver);
+
+  ASSERT_EQ(sendmmsg(sender, send_msgs_, 1, 0), 1);
+  ASSERT_EQ(
+      recvmmsg(receiver, recv_msgs_, kNumMessages, MSG_WAITFORONE, nullptr),
+      1);
+  EXPECT_THAT(Received(1), ElementsAre(send_buffers_[0]));
+
+  ResetHeaders();
+  EXPECT_EQ(
+      recvmmsg(receiver, recv_msgs_, kNumMessages, MSG_DONTWAIT, nullptr), -1);
+  EXPECT_EQ(errno, EAGAIN);
+  close(sender);
+  close(receiver);
+}
+
+// Verifies that a stream without its own sendmmsg and recvmmsg sends and
+// receives one message at a time.
+TEST_F(MMsgTest, FallsBackToOneMessageAtATime) {
+  io::IOManager::GetInstance().RegisterVirtualPathHandler(
+      kQueuePath, absl::make_unique<QueueHandler>());
+  int fd = open(kQueuePath, O_RDWR);
+  ASSERT_NE(fd, -1);
+
+  ASSERT_EQ(sendmmsg(fd, send_msgs_, kNumMessages - 1, 0), kNumMessages - 1);
+  EXPECT_EQ(send_msgs_[0].msg_len, kMessageSize);
+  EXPECT_EQ(send_msgs_[1].msg_len, kMessageSize);
+
+  // The queue runs out of messages before the batch is full.
+  ASSERT_EQ(recvmmsg(fd, recv_msgs_, kNumMessages, MSG_WAITFORONE, nullptr),
+            kNumMessages - 1);
+  EXPECT_THAT(Received(kNumMessages - 1),
+              ElementsAre(send_buffers_[0], send_buffers_[1]));
+
+  EXPECT_EQ(recvmmsg(fd, recv_msgs_, kNumMessages, 0, nullptr), -1);
+  EXPECT_EQ(errno, EAGAIN);
+
+  struct timespec timeout = {1, 0};
+  EXPECT_EQ(recvmmsg(fd, recv_msgs_, kNumMessages, 0, &timeout), -1);
+  EXPECT_EQ(errno, ENOSYS);
+
+  close(fd);
+  io::IOManager::GetInstance().DeregisterVirtualPathHandler(kQueuePath);
+}
+
+}  // namespace
+}  // namespace asylo
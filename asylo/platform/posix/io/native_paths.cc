@@ -19,12 +19,16 @@
 #include "asylo/platform/posix/io/native_paths.h"
 
 #include <fcntl.h>
+#include <algorithm>
 #include <cerrno>
 #include <cstring>
+#include <memory>
+#include <vector>
 
+#include "absl/memory/memory.h"
 #include "asylo/platform/arch/include/trusted/host_calls.h"
 #include "asylo/platform/core/bridge_msghdr_wrapper.h"
-#include "asylo/platform/core/untrusted_cache_malloc.h"
+#include "asylo/platform/core/untrusted_scratch.h"
 #include "asylo/platform/posix/io/secure_paths.h"
 
 namespace asylo {
@@ -64,54 +68,116 @@ int IOContextNative::FLock(int operation) {
   return enc_untrusted_flock(host_fd_, operation);
 }
 
-bool IOContextNative::CreateUntrustedBuffer(const struct iovec *iov, int iovcnt,
-                                            char **buf, int *size) {
+namespace {
+
+// Returns the total size in bytes of the buffers of |iov|.
+size_t IovSize(const struct iovec *iov, int iovcnt) {
   size_t total_size = 0;
   for (int i = 0; i < iovcnt; ++i) {
     total_size += iov[i].iov_len;
   }
+  return total_size;
+}
+
+// Messages of at least this size are sent and received through the buffer pool
+// of the stream, rather than copied to untrusted memory on each host call.
+constexpr size_t kLargeMessageSize = 64 * 1024;
+
+// Maximum number of messages moved by a single sendmmsg or recvmmsg host call,
+// as UIO_MAXIOV on Linux.
+constexpr unsigned int kMaxMMsgVlen = 1024;
+
+// Copies the messages of |msgvec| and their buffers to untrusted memory, as
+// an array of |vlen| bridge messages in |buffer|. |wrappers| owns the copied
+// buffers. Returns the bridge messages, or nullptr on failure.
+struct bridge_mmsghdr *CopyMMsgHdrs(
+    const struct mmsghdr *msgvec, unsigned int vlen,
+    std::vector<std::unique_ptr<BridgeMsghdrWrapper>> *wrappers,
+    std::unique_ptr<UntrustedScratchBuffer> *buffer) {
+  *buffer = absl::make_unique<UntrustedScratchBuffer>(
+      vlen * sizeof(struct bridge_mmsghdr));
+  auto *bridge_msgvec =
+      static_cast<struct bridge_mmsghdr *>((*buffer)->data());
+  if (!bridge_msgvec) {
+    return nullptr;
+  }
+  wrappers->reserve(vlen);
+  for (unsigned int i = 0; i < vlen; ++i) {
+    wrappers->push_back(
+        absl::make_unique<BridgeMsghdrWrapper>(&msgvec[i].msg_hdr));
+    if (!wrappers->back()->CopyAllBuffers()) {
+      return nullptr;
+    }
+    bridge_msgvec[i].msg_hdr = *wrappers->back()->get_msg();
+    bridge_msgvec[i].msg_len = 0;
+  }
+  return bridge_msgvec;
+}
 
-  // Instance of the global memory pool singleton.
-  asylo::UntrustedCacheMalloc *untrusted_cache_malloc =
-      asylo::UntrustedCacheMalloc::Instance();
-  char *tmp = reinterpret_cast<char *>(
-      untrusted_cache_malloc->Malloc(total_size * sizeof(char)));
-  if (!tmp) {
+// Copies the first |len| bytes received in the untrusted buffers of |wrapper|
+// to the buffers of |msg|, which |wrapper| was made from. Returns false if
+// |len| exceeds the size of the buffers.
+bool CopyReceivedBytes(const BridgeMsghdrWrapper &wrapper, size_t len,
+                       struct msghdr *msg) {
+  if (len > IovSize(msg->msg_iov, msg->msg_iovlen)) {
     return false;
   }
-  *size = total_size;
-  *buf = tmp;
+  for (size_t i = 0; i < msg->msg_iovlen && len > 0; ++i) {
+    size_t size = std::min<size_t>(len, msg->msg_iov[i].iov_len);
+    const void *iov_base = wrapper.get_iov_base(i);
+    if (size > 0 && !iov_base) {
+      return false;
+    }
+    memcpy(msg->msg_iov[i].iov_base, iov_base, size);
+    len -= size;
+  }
   return true;
 }
 
-bool IOContextNative::SerializeIov(const struct iovec *iov, int iovcnt,
-                                   char **buf, int *size) {
-  char *tmp;
-  if (!CreateUntrustedBuffer(iov, iovcnt, &tmp, size)) {
-    return false;
+// Copies the source address and control data received in the untrusted buffers
+// of |wrapper| to the buffers of |msg|, which |wrapper| was made from. The
+// lengths reported by the host in |bridge_msg| are bounded by the sizes of the
+// buffers of |msg|.
+void CopyReceivedNameAndControl(const BridgeMsghdrWrapper &wrapper,
+                                const struct bridge_msghdr &bridge_msg,
+                                struct msghdr *msg) {
+  // Read each length once, as the host may still modify |bridge_msg|.
+  uint64_t namelen = bridge_msg.msg_namelen;
+  uint64_t controllen = bridge_msg.msg_controllen;
+  if (wrapper.get_msg_name()) {
+    msg->msg_namelen = std::min<uint64_t>(namelen, msg->msg_namelen);
+    memcpy(msg->msg_name, wrapper.get_msg_name(), msg->msg_namelen);
+  } else {
+    msg->msg_namelen = 0;
   }
-  size_t copied_bytes = 0;
-  for (int i = 0; i < iovcnt; ++i) {
-    size_t len =  iov[i].iov_len;
-    memcpy(tmp + copied_bytes, iov[i].iov_base, len);
-    copied_bytes += len;
+  if (wrapper.get_msg_control()) {
+    msg->msg_controllen = std::min<uint64_t>(controllen, msg->msg_controllen);
+    memcpy(msg->msg_control, wrapper.get_msg_control(), msg->msg_controllen);
+  } else {
+    msg->msg_controllen = 0;
   }
-  *buf = tmp;
-  return true;
 }
 
+}  // namespace
+
 ssize_t IOContextNative::Writev(const struct iovec *iov, int iovcnt) {
   if (iovcnt <= 0) {
     errno = EINVAL;
     return -1;
   }
 
-  char *buf;
-  int size;
-  if (!SerializeIov(iov, iovcnt, &buf, &size)) {
+  UntrustedScratchBuffer buffer(IovSize(iov, iovcnt));
+  char *buf = static_cast<char *>(buffer.data());
+  if (!buf && buffer.size() > 0) {
+    errno = ENOMEM;
     return -1;
   }
-  return enc_untrusted_writev(host_fd_, buf, size);
+  size_t copied_bytes = 0;
+  for (int i = 0; i < iovcnt; ++i) {
+    memcpy(buf + copied_bytes, iov[i].iov_base, iov[i].iov_len);
+    copied_bytes += iov[i].iov_len;
+  }
+  return enc_untrusted_writev(host_fd_, buf, buffer.size());
 }
 
 ssize_t IOContextNative::Readv(const struct iovec *iov, int iovcnt) {
@@ -119,12 +185,14 @@ ssize_t IOContextNative::Readv(const struct iovec *iov, int iovcnt) {
     errno = EINVAL;
     return -1;
   }
-  char *buf;
-  int size;
-  if (!CreateUntrustedBuffer(iov, iovcnt, &buf, &size)) {
+  UntrustedScratchBuffer buffer(IovSize(iov, iovcnt));
+  if (!buffer.data() && buffer.size() > 0) {
+    errno = ENOMEM;
     return -1;
   }
-  return enc_untrusted_readv(host_fd_, iov, iovcnt, buf, size);
+  return enc_untrusted_readv(host_fd_, iov, iovcnt,
+                             static_cast<char *>(buffer.data()),
+                             buffer.size());
 }
 
 int IOContextNative::SetSockOpt(int level, int option_name,
@@ -142,10 +210,115 @@ int IOContextNative::Shutdown(int how) {
   return enc_untrusted_shutdown(host_fd_, how);
 }
 
+bool IOContextNative::IsStreamSocket() {
+  int type = socket_type_.load(std::memory_order_relaxed);
+  if (type == 0) {
+    // Like send() and recv(), leave errno untouched if the stream is not a
+    // socket.
+    int saved_errno = errno;
+    socklen_t type_len = sizeof(type);
+    if (enc_untrusted_getsockopt(host_fd_, SOL_SOCKET, SO_TYPE, &type,
+                                 &type_len) != 0) {
+      type = -1;
+    }
+    errno = saved_errno;
+    socket_type_.store(type, std::memory_order_relaxed);
+  }
+  return type == SOCK_STREAM;
+}
+
 ssize_t IOContextNative::Send(const void *buf, size_t len, int flags) {
+  // Chunks would split the message of a datagram or sequenced-packet socket.
+  if (len >= kLargeMessageSize && IsStreamSocket()) {
+    return SendLarge(static_cast<const uint8_t *>(buf), len, flags);
+  }
   return enc_untrusted_send(host_fd_, buf, len, flags);
 }
 
+ssize_t IOContextNative::SendLarge(const uint8_t *buf, size_t len, int flags) {
+  UntrustedBufferPool::Buffer chunk(&buffer_pool_);
+  if (!chunk.data()) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  // Like send(), leave errno untouched unless the call fails. The host calls
+  // below set it on every return.
+  int saved_errno = errno;
+
+  // Each chunk is handed to the kernel as soon as it is copied out, so the
+  // kernel transmits chunk i while the next one is copied.
+  size_t sent = 0;
+  while (sent < len) {
+    size_t size = std::min(len - sent, UntrustedBufferPool::kBufferSize);
+    memcpy(chunk.data(), buf + sent, size);
+    ssize_t ret = enc_untrusted_send_with_untrusted_ptr(host_fd_, chunk.data(),
+                                                        size, flags);
+    if (ret < 0) {
+      if (sent == 0) {
+        return -1;
+      }
+      // Report the bytes already sent, and the error on the next call.
+      break;
+    }
+    if (static_cast<size_t>(ret) > size) {
+      errno = EFAULT;
+      return -1;
+    }
+    sent += ret;
+    if (static_cast<size_t>(ret) < size) {
+      // The socket buffer is full or the call was interrupted.
+      break;
+    }
+  }
+  errno = saved_errno;
+  return sent;
+}
+
+ssize_t IOContextNative::RecvLarge(uint8_t *buf, size_t len, int flags) {
+  UntrustedBufferPool::Buffer chunk(&buffer_pool_);
+  if (!chunk.data()) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  // Like recv(), leave errno untouched unless the call fails. The host calls
+  // below set it on every return, including the EAGAIN of a chunk that found
+  // no more data after some bytes were received.
+  int saved_errno = errno;
+
+  // Only the first chunk may block. Without MSG_WAITALL, later chunks only
+  // collect the bytes the kernel received while the previous chunk was being
+  // copied in.
+  size_t received = 0;
+  while (received < len) {
+    size_t size = std::min(len - received, UntrustedBufferPool::kBufferSize);
+    int chunk_flags = flags;
+    if (received > 0 && !(flags & MSG_WAITALL)) {
+      chunk_flags |= MSG_DONTWAIT;
+    }
+    ssize_t ret = enc_untrusted_recv_with_untrusted_ptr(host_fd_, chunk.data(),
+                                                        size, chunk_flags);
+    if (ret < 0) {
+      if (received == 0) {
+        return -1;
+      }
+      break;
+    }
+    if (static_cast<size_t>(ret) > size) {
+      errno = EFAULT;
+      return -1;
+    }
+    memcpy(buf + received, chunk.data(), ret);
+    received += ret;
+    if (static_cast<size_t>(ret) < size || (flags & MSG_PEEK)) {
+      break;
+    }
+  }
+  errno = saved_errno;
+  return received;
+}
+
 int IOContextNative::GetSockOpt(int level, int optname, void *optval,
                                 socklen_t *optlen) {
   return enc_untrusted_getsockopt(host_fd_, level, optname, optval, optlen);
@@ -184,6 +357,61 @@ ssize_t IOContextNative::RecvMsg(struct msghdr *msg, int flags) {
   return enc_untrusted_recvmsg(host_fd_, msg, tmp_wrapper.get_msg(), flags);
 }
 
+int IOContextNative::SendMMsg(struct mmsghdr *msgvec, unsigned int vlen,
+                              int flags) {
+  vlen = std::min(vlen, kMaxMMsgVlen);
+  std::vector<std::unique_ptr<BridgeMsghdrWrapper>> wrappers;
+  std::unique_ptr<UntrustedScratchBuffer> buffer;
+  struct bridge_mmsghdr *bridge_msgvec =
+      CopyMMsgHdrs(msgvec, vlen, &wrappers, &buffer);
+  if (!bridge_msgvec) {
+    errno = EFAULT;
+    return -1;
+  }
+
+  int ret = enc_untrusted_sendmmsg(host_fd_, bridge_msgvec, vlen, flags);
+  if (ret > static_cast<int>(vlen)) {
+    errno = EFAULT;
+    return -1;
+  }
+  for (int i = 0; i < ret; ++i) {
+    msgvec[i].msg_len = bridge_msgvec[i].msg_len;
+  }
+  return ret;
+}
+
+int IOContextNative::RecvMMsg(struct mmsghdr *msgvec, unsigned int vlen,
+                              int flags, struct timespec *timeout) {
+  vlen = std::min(vlen, kMaxMMsgVlen);
+  std::vector<std::unique_ptr<BridgeMsghdrWrapper>> wrappers;
+  std::unique_ptr<UntrustedScratchBuffer> buffer;
+  struct bridge_mmsghdr *bridge_msgvec =
+      CopyMMsgHdrs(msgvec, vlen, &wrappers, &buffer);
+  if (!bridge_msgvec) {
+    errno = EFAULT;
+    return -1;
+  }
+
+  int ret =
+      enc_untrusted_recvmmsg(host_fd_, bridge_msgvec, vlen, flags, timeout);
+  if (ret > static_cast<int>(vlen)) {
+    errno = EFAULT;
+    return -1;
+  }
+  // Only the received bytes are copied back into the enclave.
+  for (int i = 0; i < ret; ++i) {
+    struct msghdr *msg = &msgvec[i].msg_hdr;
+    if (!CopyReceivedBytes(*wrappers[i], bridge_msgvec[i].msg_len, msg)) {
+      errno = EFAULT;
+      return -1;
+    }
+    CopyReceivedNameAndControl(*wrappers[i], bridge_msgvec[i].msg_hdr, msg);
+    msgvec[i].msg_len = bridge_msgvec[i].msg_len;
+    msg->msg_flags = bridge_msgvec[i].msg_hdr.msg_flags;
+  }
+  return ret;
+}
+
 int IOContextNative::GetSockName(struct sockaddr *addr, socklen_t *addrlen) {
   return enc_untrusted_getsockname(host_fd_, addr, addrlen);
 }
@@ -195,6 +423,9 @@ int IOContextNative::GetPeerName(struct sockaddr *addr, socklen_t *addrlen) {
 ssize_t IOContextNative::RecvFrom(void *buf, size_t len, int flags,
                                   struct sockaddr *src_addr,
                                   socklen_t *addrlen) {
+  if (!src_addr && len >= kLargeMessageSize && IsStreamSocket()) {
+    return RecvLarge(static_cast<uint8_t *>(buf), len, flags);
+  }
   return enc_untrusted_recvfrom(host_fd_, buf, len, flags, src_addr, addrlen);
 }
 
@@ -19,6 +19,11 @@
 #ifndef ASYLO_PLATFORM_POSIX_IO_NATIVE_PATHS_H_
 #define ASYLO_PLATFORM_POSIX_IO_NATIVE_PATHS_H_
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "asylo/platform/core/untrusted_buffer_pool.h"
 #include "asylo/platform/posix/io/io_manager.h"
 
 namespace asylo {
@@ -28,7 +33,7 @@ namespace io {
 // operations to the host operating system.
 class IOContextNative : public IOManager::IOContext {
  public:
-  explicit IOContextNative(int host_fd) : host_fd_(host_fd) {}
+  explicit IOContextNative(int host_fd) : host_fd_(host_fd), socket_type_(0) {}
 
   ssize_t Read(void *buf, size_t count) override;
   ssize_t Write(const void *buf, size_t count) override;
@@ -54,6 +59,9 @@ class IOContextNative : public IOManager::IOContext {
   int Listen(int backlog) override;
   ssize_t SendMsg(const struct msghdr *msg, int flags) override;
   ssize_t RecvMsg(struct msghdr *msg, int flags) override;
+  int SendMMsg(struct mmsghdr *msgvec, unsigned int vlen, int flags) override;
+  int RecvMMsg(struct mmsghdr *msgvec, unsigned int vlen, int flags,
+               struct timespec *timeout) override;
   int GetSockName(struct sockaddr *addr, socklen_t *addrlen) override;
   int GetPeerName(struct sockaddr *addr, socklen_t *addrlen) override;
   ssize_t RecvFrom(void *buf, size_t len, int flags, struct sockaddr *src_addr,
@@ -61,12 +69,28 @@ class IOContextNative : public IOManager::IOContext {
   int GetHostFileDescriptor() override;
 
  private:
+  // Returns true if the stream is a SOCK_STREAM socket, the only kind of stream
+  // whose messages may be sent and received in chunks.
+  bool IsStreamSocket();
+
+  // Sends |len| bytes of |buf| in chunks staged in |buffer_pool_|.
+  ssize_t SendLarge(const uint8_t *buf, size_t len, int flags);
+
+  // Receives up to |len| bytes into |buf| in chunks staged in |buffer_pool_|.
+  ssize_t RecvLarge(uint8_t *buf, size_t len, int flags);
+
   // Host file descriptor implementing this stream.
   int host_fd_;
-  bool CreateUntrustedBuffer(const struct iovec *iov,
-      int iovcnt, char **buf, int *size);
-  bool SerializeIov(const struct iovec *iov, int iovcnt,
-      char **buf, int *size);
+
+  // The SO_TYPE of |host_fd_|, -1 if it is not a socket, or 0 until it is
+  // queried.
+  std::atomic<int> socket_type_;
+
+  // Untrusted buffers reused by the large messages sent and received on this
+  // stream. Once a large message has moved through the stream, the pool keeps
+  // up to UntrustedBufferPool::kMaxFreeBuffers buffers, 2 MiB in all, until the
+  // stream is closed. Only SOCK_STREAM sockets use it.
+  UntrustedBufferPool buffer_pool_;
 };
 
 // VirtualPathHandler implementation handling paths to be forwarded to the host.
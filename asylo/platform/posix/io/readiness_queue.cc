@@ -0,0 +1,149 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "asylo/platform/posix/io/readiness_queue.h"
+
+#include <fcntl.h>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+#include "asylo/platform/arch/include/trusted/host_calls.h"
+
+namespace asylo {
+namespace io {
+
+constexpr int ReadinessQueue::kMaxUninterruptibleWaitMs;
+
+ReadinessQueue *ReadinessQueue::GetInstance() {
+  static ReadinessQueue *instance = new ReadinessQueue();
+  return instance;
+}
+
+ReadinessQueue::ReadinessQueue()
+    : generation_(0),
+      host_waiters_(0),
+      wake_pending_(false),
+      wake_failed_(false) {
+  wake_fds_[0] = -1;
+  wake_fds_[1] = -1;
+}
+
+uint64_t ReadinessQueue::Generation() {
+  absl::MutexLock lock(&mu_);
+  return generation_;
+}
+
+void ReadinessQueue::Notify() {
+  int wake_fd = -1;
+  {
+    absl::MutexLock lock(&mu_);
+    ++generation_;
+    // Waiters in the enclave are woken when the lock is released. Waiters in
+    // the host need one write to the wake pipe, which stays readable until the
+    // last of them drains it.
+    if (host_waiters_ > 0 && !wake_pending_) {
+      wake_pending_ = true;
+      wake_fd = wake_fds_[1];
+    }
+  }
+  if (wake_fd != -1) {
+    char byte = 0;
+    enc_untrusted_write(wake_fd, &byte, sizeof(byte));
+  }
+}
+
+bool ReadinessQueue::Wait(uint64_t generation, absl::Time deadline) {
+  absl::MutexLock lock(&mu_);
+  auto changed = [this, generation]() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return generation_ != generation;
+  };
+  return mu_.AwaitWithDeadline(absl::Condition(&changed), deadline);
+}
+
+int ReadinessQueue::BeginHostWait(uint64_t generation, int *timeout) {
+  absl::MutexLock lock(&mu_);
+  if (generation_ != generation) {
+    *timeout = 0;
+    return -1;
+  }
+  if (wake_fds_[0] == -1 && !wake_failed_ &&
+      enc_untrusted_pipe2(wake_fds_, O_NONBLOCK | O_CLOEXEC) != 0) {
+    wake_fds_[0] = -1;
+    wake_fds_[1] = -1;
+    wake_failed_ = true;
+  }
+  // A wait started while a wakeup is pending may be registered on the wake
+  // pipe as edge-triggered, and would miss the wakeup.
+  if (wake_failed_ || wake_pending_) {
+    *timeout = LimitUninterruptibleWait(*timeout);
+    return -1;
+  }
+  ++host_waiters_;
+  return wake_fds_[0];
+}
+
+void ReadinessQueue::EndHostWait() {
+  int wake_fd;
+  {
+    absl::MutexLock lock(&mu_);
+    if (--host_waiters_ > 0 || !wake_pending_) {
+      return;
+    }
+    // |wake_pending_| stays set while the pipe is drained, so no host wait
+    // starts on it and Notify() does not write to it meanwhile.
+    wake_fd = wake_fds_[0];
+  }
+  // Drain outside |mu_|, so that Notify() and waiters in the enclave are not
+  // held up by the host calls.
+  char buffer[64];
+  while (enc_untrusted_read(wake_fd, buffer, sizeof(buffer)) > 0) {
+  }
+  absl::MutexLock lock(&mu_);
+  wake_pending_ = false;
+}
+
+int LimitUninterruptibleWait(int timeout) {
+  if (timeout < 0) {
+    return ReadinessQueue::kMaxUninterruptibleWaitMs;
+  }
+  return std::min(timeout, ReadinessQueue::kMaxUninterruptibleWaitMs);
+}
+
+absl::Time PollDeadline(int timeout) {
+  if (timeout < 0) {
+    return absl::InfiniteFuture();
+  }
+  return absl::Now() + absl::Milliseconds(timeout);
+}
+
+int PollTimeout(absl::Time deadline) {
+  if (deadline == absl::InfiniteFuture()) {
+    return -1;
+  }
+  int64_t remaining_us = absl::ToInt64Microseconds(deadline - absl::Now());
+  if (remaining_us <= 0) {
+    return 0;
+  }
+  return static_cast<int>(
+      std::min<int64_t>((remaining_us + 999) / 1000, INT_MAX));
+}
+
+}  // namespace io
+}  // namespace asylo
@@ -0,0 +1,119 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef ASYLO_PLATFORM_POSIX_IO_READINESS_QUEUE_H_
+#define ASYLO_PLATFORM_POSIX_IO_READINESS_QUEUE_H_
+
+#include <cstdint>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace asylo {
+namespace io {
+
+// Wait queue shared by the IOContexts implemented inside the enclave, such as
+// eventfd, whose readiness the host cannot observe.
+//
+// A context calls Notify() each time its readiness may have changed. poll,
+// select and epoll_wait take a Generation() before checking the readiness of
+// such contexts, and if none is ready, Wait() for a newer generation. A thread
+// signalling another one through an in-enclave context thus never leaves the
+// enclave, unless the waiter is blocked in a host call.
+//
+// A waiter watching host file descriptors as well blocks in the host, and adds
+// the wake file descriptor returned by BeginHostWait() to its host wait. Only
+// then does Notify() make a host call, writing to the wake file descriptor to
+// interrupt the host wait.
+//
+// This class is thread-safe.
+class ReadinessQueue {
+ public:
+  // Longest host wait, in milliseconds, that Notify() cannot interrupt.
+  static constexpr int kMaxUninterruptibleWaitMs = 10;
+
+  static ReadinessQueue *GetInstance();
+
+  ReadinessQueue(const ReadinessQueue &other) = delete;
+  ReadinessQueue &operator=(const ReadinessQueue &other) = delete;
+
+  // Returns a counter incremented by each call to Notify().
+  uint64_t Generation() LOCKS_EXCLUDED(mu_);
+
+  // Records that the readiness of an in-enclave context may have changed, and
+  // wakes the threads waiting for it. Must not be called with a lock held that
+  // a waiter acquires to check readiness.
+  void Notify() LOCKS_EXCLUDED(mu_);
+
+  // Blocks until the generation differs from |generation|, or until
+  // |deadline|. Returns false if the deadline passed first.
+  bool Wait(uint64_t generation, absl::Time deadline) LOCKS_EXCLUDED(mu_);
+
+  // Prepares the calling thread to block in a host call for |*timeout|
+  // milliseconds, after finding no in-enclave context ready at generation
+  // |generation|. Returns a host file descriptor to wait on for readability
+  // next to the host file descriptors of the wait. Otherwise, returns -1 and
+  // shortens |*timeout|: to 0 if the generation changed since, or else to at
+  // most kMaxUninterruptibleWaitMs, as the wait cannot be interrupted. A
+  // return value other than -1 must be matched by a call to EndHostWait().
+  int BeginHostWait(uint64_t generation, int *timeout) LOCKS_EXCLUDED(mu_);
+
+  // Ends a host wait started by BeginHostWait().
+  void EndHostWait() LOCKS_EXCLUDED(mu_);
+
+ private:
+  ReadinessQueue();
+
+  absl::Mutex mu_;
+
+  // Number of calls to Notify().
+  uint64_t generation_ GUARDED_BY(mu_);
+
+  // Number of threads between BeginHostWait() and EndHostWait().
+  int host_waiters_ GUARDED_BY(mu_);
+
+  // True if the wake pipe was written to and not drained yet.
+  bool wake_pending_ GUARDED_BY(mu_);
+
+  // Host pipe interrupting host waits, created on first use. Both ends are -1
+  // until then.
+  int wake_fds_[2] GUARDED_BY(mu_);
+
+  // True if the wake pipe could not be created, in which case host waits are
+  // not interrupted by Notify().
+  bool wake_failed_ GUARDED_BY(mu_);
+};
+
+// Returns |timeout|, in milliseconds as given to poll(2), shortened to a wait
+// Notify() cannot interrupt.
+int LimitUninterruptibleWait(int timeout);
+
+// Returns the deadline of a wait with a |timeout| in milliseconds, as given to
+// poll(2), with a negative |timeout| waiting forever.
+absl::Time PollDeadline(int timeout);
+
+// Returns the timeout in milliseconds of a host wait until |deadline|, rounded
+// up, or -1 if |deadline| is infinite.
+int PollTimeout(absl::Time deadline);
+
+}  // namespace io
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_POSIX_IO_READINESS_QUEUE_H_
@@ -58,15 +58,16 @@ int sigaction(int signum, const struct sigaction *act,
   {
     absl::MutexLock lock(&sigaction_lock);
     asylo::SignalManager *signal_manager = asylo::SignalManager::GetInstance();
+    struct sigaction old_action;
+    bool has_old_action = signal_manager->GetSigAction(signum, &old_action);
+    signal_manager->SetSigAction(signum, *act);
     if (oldact) {
-      if (signal_manager->GetSigAction(signum)) {
-        oldact = const_cast<struct sigaction *>(
-            signal_manager->GetSigAction(signum));
+      if (has_old_action) {
+        *oldact = old_action;
       } else {
         oldact->sa_handler = SIG_DFL;
       }
     }
-    signal_manager->SetSigAction(signum, *act);
   }
   sigset_t mask;
   sigemptyset(&mask);
@@ -17,10 +17,12 @@
  */
 
 #include <signal.h>
+#include <sys/ucontext.h>
 
-#include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
 #include "absl/synchronization/mutex.h"
+#include "asylo/platform/common/bridge_functions.h"
+#include "asylo/platform/common/bridge_types.h"
 #include "asylo/platform/posix/signal/signal_manager.h"
 
 namespace asylo {
@@ -36,7 +38,10 @@ sigset_t EmptySigSet() {
 
 }  // namespace
 
+constexpr int SignalManager::kNumSignals;
+
 thread_local sigset_t SignalManager::signal_mask_ = EmptySigSet();
+thread_local bool SignalManager::in_signal_handler_ = false;
 
 SignalManager *SignalManager::GetInstance() {
   static SignalManager *instance = new SignalManager();
@@ -45,50 +50,102 @@ SignalManager *SignalManager::GetInstance() {
 
 Status SignalManager::HandleSignal(int signum, siginfo_t *info,
                                    void *ucontext) {
-  const struct sigaction *act = GetSigAction(signum);
-  if (!act) {
+  struct sigaction act;
+  if (!GetSigAction(signum, &act)) {
     return Status(
         error::GoogleError::INTERNAL,
         absl::StrCat("No handler has been registered for signal: ", signum));
   }
   Status status;
   sigset_t old_mask = GetSignalMask();
-  BlockSignals(act->sa_mask);
-  bool is_siginfo = act->sa_flags & SA_SIGINFO;
-  if (is_siginfo && act->sa_sigaction) {
-    act->sa_sigaction(signum, info, ucontext);
-  } else if (!is_siginfo && act->sa_handler) {
-    act->sa_handler(signum);
+  bool was_in_signal_handler = in_signal_handler_;
+  in_signal_handler_ = true;
+  BlockSignals(act.sa_mask);
+  bool is_siginfo = act.sa_flags & SA_SIGINFO;
+  if (is_siginfo && act.sa_sigaction) {
+    act.sa_sigaction(signum, info, ucontext);
+  } else if (!is_siginfo && act.sa_handler) {
+    act.sa_handler(signum);
   } else {
     status = Status(
         error::GoogleError::INTERNAL,
         absl::StrCat("Handler registered for signal: ", signum, " is invalid"));
   }
   SetSignalMask(old_mask);
+  in_signal_handler_ = was_in_signal_handler;
   return status;
 }
 
 void SignalManager::SetSigAction(int signum, const struct sigaction &act) {
-  // To avoid deadlock, block all signals before registering a signal handler.
-  sigset_t mask;
-  sigfillset(&mask);
-  sigset_t old_mask;
-  sigprocmask(SIG_SETMASK, &mask, &old_mask);
-  {
-    absl::MutexLock lock(&signal_to_sigaction_lock_);
-    signal_to_sigaction_[signum] = absl::make_unique<struct sigaction>(act);
+  if (signum <= 0 || signum >= kNumSignals) {
+    return;
+  }
+  absl::MutexLock lock(&sigaction_lock_);
+  uint32_t generation =
+      sigaction_generations_[signum].load(std::memory_order_relaxed);
+  sigaction_slots_[signum][(generation + 1) % 2] = act;
+  sigaction_generations_[signum].store(generation + 1,
+                                       std::memory_order_release);
+}
+
+bool SignalManager::GetSigAction(int signum, struct sigaction *act) const {
+  if (signum <= 0 || signum >= kNumSignals) {
+    return false;
+  }
+  uint32_t generation =
+      sigaction_generations_[signum].load(std::memory_order_acquire);
+  while (generation != 0) {
+    *act = sigaction_slots_[signum][generation % 2];
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // The slot that was read is only overwritten by the second update after
+    // it was published, so the copy is consistent if no update happened.
+    uint32_t current =
+        sigaction_generations_[signum].load(std::memory_order_relaxed);
+    if (current == generation) {
+      return true;
+    }
+    generation = current;
   }
-  // Set the signal mask back to the original one to unblock the signals.
-  sigprocmask(SIG_SETMASK, &old_mask, nullptr);
+  return false;
 }
 
-const struct sigaction *SignalManager::GetSigAction(int signum) const {
-  absl::MutexLock lock(&signal_to_sigaction_lock_);
-  auto sigaction_iterator = signal_to_sigaction_.find(signum);
-  if (sigaction_iterator == signal_to_sigaction_.end()) {
-    return nullptr;
+void SignalManager::SetPendingSignals(std::atomic<uint64_t> *pending_signals) {
+  pending_signals_.store(pending_signals, std::memory_order_release);
+}
+
+void SignalManager::HandlePendingSignals() {
+  std::atomic<uint64_t> *pending_signals =
+      pending_signals_.load(std::memory_order_acquire);
+  if (!pending_signals || in_signal_handler_) {
+    return;
+  }
+
+  uint64_t pending = pending_signals->load(std::memory_order_acquire);
+  while (pending != 0) {
+    int bit = __builtin_ctzll(pending);
+    uint64_t bit_mask = UINT64_C(1) << bit;
+    pending &= ~bit_mask;
+
+    // The word is in untrusted memory, so treat its contents as a hint only:
+    // deliver only signals with a registered, unblocked handler.
+    int signum = FromBridgeSignal(bit + 1);
+    struct sigaction act;
+    if (signum <= 0 || !GetSigAction(signum, &act) ||
+        sigismember(&signal_mask_, signum)) {
+      continue;
+    }
+    // Claim the signal, unless another thread has already handled it.
+    if (!(pending_signals->fetch_and(~bit_mask, std::memory_order_acq_rel) &
+          bit_mask)) {
+      continue;
+    }
+    siginfo_t info = {};
+    info.si_signo = signum;
+    // Queued signals are coalesced, so the origin of each is not kept.
+    info.si_code = FromBridgeSignalCode(BRIDGE_SI_USER);
+    ucontext_t ucontext = {};
+    HandleSignal(signum, &info, &ucontext);
   }
-  return sigaction_iterator->second.get();
 }
 
 void SignalManager::BlockSignals(const sigset_t &set) {
@@ -20,9 +20,9 @@
 #define ASYLO_PLATFORM_POSIX_SIGNAL_SIGNAL_MANAGER_H_
 
 #include <signal.h>
-#include <memory>
+#include <atomic>
+#include <cstdint>
 
-#include "absl/container/flat_hash_map.h"
 #include "absl/synchronization/mutex.h"
 #include "asylo/util/status.h"
 
@@ -30,6 +30,9 @@ namespace asylo {
 
 // SignalManager class is a singleton responsible for maintaining mapping
 // between signum and registered signal handlers.
+//
+// Handlers are looked up without locking, so that signals can be handled while
+// a handler is being registered.
 class SignalManager {
  public:
   static SignalManager *GetInstance();
@@ -39,11 +42,23 @@ class SignalManager {
 
   // Sets a signal handler pointer for a specific signal |signum|.
   void SetSigAction(int signum, const struct sigaction &act)
-      LOCKS_EXCLUDED(signal_to_sigaction_lock_);
+      LOCKS_EXCLUDED(sigaction_lock_);
 
-  // Gets a signal handler for a specific signal |signum|.
-  const struct sigaction *GetSigAction(int signum) const
-      LOCKS_EXCLUDED(signal_to_sigaction_lock_);
+  // Copies the signal handler registered for |signum| to |act|. Returns false
+  // if no handler is registered for |signum|.
+  bool GetSigAction(int signum, struct sigaction *act) const;
+
+  // Sets the set of signals queued by the host, in untrusted memory. Bit
+  // |bridge_signum| - 1 of |*pending_signals| is set while a signal is queued.
+  // The host queues a signal instead of entering the enclave to deliver it
+  // when another delivery is already in progress.
+  void SetPendingSignals(std::atomic<uint64_t> *pending_signals);
+
+  // Handles the signals queued by the host that have a registered handler and
+  // are not blocked on the calling thread. Called by threads already inside
+  // the enclave, so that queued signals do not wait for the next enclave
+  // entry. Does nothing when called from a signal handler.
+  void HandlePendingSignals();
 
   // Blocks all the signals in |set|.
   void BlockSignals(const sigset_t &set);
@@ -65,11 +80,29 @@ class SignalManager {
   SignalManager(SignalManager const &) = delete;
   void operator=(SignalManager const &) = delete;
 
-  mutable absl::Mutex signal_to_sigaction_lock_;
-  absl::flat_hash_map<int, std::unique_ptr<struct sigaction>>
-      signal_to_sigaction_ GUARDED_BY(signal_to_sigaction_lock_);
+  // Number of entries in the handler table, indexed by signal number.
+  static constexpr int kNumSignals = sizeof(sigset_t) * 8 + 1;
+
+  // Registered handlers, indexed by signal number. Each signal has two slots:
+  // the current handler is in slot |sigaction_generations_[signum]| % 2, and
+  // SetSigAction() writes a new handler into the other slot before publishing
+  // it, so a reader is only disturbed by two updates made during one read.
+  struct sigaction sigaction_slots_[kNumSignals][2];
+
+  // The number of times a handler was set for each signal. Zero while no
+  // handler is registered.
+  std::atomic<uint32_t> sigaction_generations_[kNumSignals] = {};
+
+  // Serializes SetSigAction() calls.
+  absl::Mutex sigaction_lock_;
+
+  // Signals queued by the host, or nullptr if not set yet.
+  std::atomic<std::atomic<uint64_t> *> pending_signals_ = {nullptr};
 
   thread_local static sigset_t signal_mask_;
+
+  // True while the calling thread is running a signal handler.
+  thread_local static bool in_signal_handler_;
 };
 
 }  // namespace asylo
@@ -0,0 +1,143 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/posix/signal/signal_manager.h"
+
+#include <signal.h>
+#include <atomic>
+#include <cstdint>
+
+#include <gtest/gtest.h>
+#include "asylo/platform/common/bridge_functions.h"
+
+namespace asylo {
+namespace {
+
+int handled_usr1 = 0;
+int handled_usr2 = 0;
+
+// Signals queued for the signal manager, as the host would queue them.
+std::atomic<uint64_t> pending_signals(0);
+
+void CountSignal(int signum) {
+  if (signum == SIGUSR1) {
+    ++handled_usr1;
+  } else if (signum == SIGUSR2) {
+    ++handled_usr2;
+  }
+}
+
+// Returns the bit of |signum| in a set of queued signals.
+uint64_t PendingBit(int signum) {
+  return UINT64_C(1) << (ToBridgeSignal(signum) - 1);
+}
+
+void RegisterHandler(int signum, void (*handler)(int)) {
+  struct sigaction act = {};
+  act.sa_handler = handler;
+  sigemptyset(&act.sa_mask);
+  SignalManager::GetInstance()->SetSigAction(signum, act);
+}
+
+class SignalManagerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    handled_usr1 = 0;
+    handled_usr2 = 0;
+    pending_signals = 0;
+    SignalManager::GetInstance()->SetPendingSignals(&pending_signals);
+  }
+
+  void TearDown() override {
+    SignalManager::GetInstance()->SetPendingSignals(nullptr);
+  }
+};
+
+// Queues SIGUSR2 and tries to handle it from inside the SIGUSR1 handler.
+void QueueAndHandleUsr2(int signum) {
+  CountSignal(signum);
+  pending_signals |= PendingBit(SIGUSR2);
+  SignalManager::GetInstance()->HandlePendingSignals();
+}
+
+// Verifies that the most recently set handler is returned after a handler has
+// been replaced many times.
+TEST_F(SignalManagerTest, ReplacesHandlers) {
+  SignalManager *signal_manager = SignalManager::GetInstance();
+  struct sigaction act;
+  EXPECT_FALSE(signal_manager->GetSigAction(SIGWINCH, &act));
+  for (int i = 0; i < 1000; ++i) {
+    RegisterHandler(SIGWINCH, i % 2 ? SIG_IGN : &CountSignal);
+  }
+  ASSERT_TRUE(signal_manager->GetSigAction(SIGWINCH, &act));
+  EXPECT_EQ(act.sa_handler, SIG_IGN);
+}
+
+// Verifies that signals queued several times are handled once, and that the
+// handled signals are removed from the queue.
+TEST_F(SignalManagerTest, CoalescesQueuedSignals) {
+  RegisterHandler(SIGUSR1, &CountSignal);
+  pending_signals |= PendingBit(SIGUSR1);
+  pending_signals |= PendingBit(SIGUSR1);
+
+  SignalManager::GetInstance()->HandlePendingSignals();
+  EXPECT_EQ(handled_usr1, 1);
+  EXPECT_EQ(pending_signals.load(), 0);
+
+  SignalManager::GetInstance()->HandlePendingSignals();
+  EXPECT_EQ(handled_usr1, 1);
+}
+
+// Verifies that queued signals without a handler, or blocked on the calling
+// thread, stay queued.
+TEST_F(SignalManagerTest, LeavesUnhandledSignalsQueued) {
+  SignalManager *signal_manager = SignalManager::GetInstance();
+  RegisterHandler(SIGUSR2, &CountSignal);
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGUSR2);
+  signal_manager->BlockSignals(mask);
+  pending_signals = PendingBit(SIGUSR2) | PendingBit(SIGPROF);
+
+  signal_manager->HandlePendingSignals();
+  EXPECT_EQ(handled_usr2, 0);
+  EXPECT_EQ(pending_signals.load(), PendingBit(SIGUSR2) | PendingBit(SIGPROF));
+
+  signal_manager->UnblockSignals(mask);
+  signal_manager->HandlePendingSignals();
+  EXPECT_EQ(handled_usr2, 1);
+  EXPECT_EQ(pending_signals.load(), PendingBit(SIGPROF));
+}
+
+// Verifies that queued signals are not handled from inside a signal handler.
+TEST_F(SignalManagerTest, DoesNotHandleQueuedSignalsInHandler) {
+  RegisterHandler(SIGUSR1, &QueueAndHandleUsr2);
+  RegisterHandler(SIGUSR2, &CountSignal);
+  pending_signals = PendingBit(SIGUSR1);
+
+  SignalManager::GetInstance()->HandlePendingSignals();
+  EXPECT_EQ(handled_usr1, 1);
+  EXPECT_EQ(handled_usr2, 0);
+  EXPECT_EQ(pending_signals.load(), PendingBit(SIGUSR2));
+
+  SignalManager::GetInstance()->HandlePendingSignals();
+  EXPECT_EQ(handled_usr2, 1);
+}
+
+}  // namespace
+}  // namespace asylo
@@ -0,0 +1,63 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_PRIMITIVES_BATCHED_CALL_H_
+#define ASYLO_PLATFORM_PRIMITIVES_BATCHED_CALL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "asylo/platform/primitives/primitive_status.h"
+
+namespace asylo {
+namespace primitives {
+
+// A record describing one of the calls made by a single entry into the enclave
+// at the `kSelectorAsyloBatch` entry point. Untrusted code passes an array of
+// records as the only parameter of the entry, and the trusted runtime invokes
+// the entry handler of each record in order, storing its result in the record.
+struct BatchedCall {
+  // Entry point selector of the call.
+  uint64_t selector;
+
+  // Parameters of the call, a ParameterStack owned by untrusted code.
+  void *params;
+
+  // Result of the call, set by the trusted runtime.
+  PrimitiveStatus status;
+
+ private:
+  // This method is not intended to be called, it is defined only to provide a
+  // scope where offsetof may be applied to BatchedCall as a complete type.
+  static void CheckLayout() {
+    static_assert(std::is_standard_layout<BatchedCall>::value,
+                  "BatchedCall must satisfy std::is_standard_layout");
+    static_assert(offsetof(BatchedCall, selector) == 0x0,
+                  "Unexpected layout for field BatchedCall::selector");
+    static_assert(offsetof(BatchedCall, params) == sizeof(uint64_t),
+                  "Unexpected layout for field BatchedCall::params");
+    static_assert(offsetof(BatchedCall, status) == 2 * sizeof(uint64_t),
+                  "Unexpected layout for field BatchedCall::status");
+  }
+};
+
+}  // namespace primitives
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_PRIMITIVES_BATCHED_CALL_H_
@@ -36,8 +36,8 @@ namespace primitives {
 static constexpr char kHello[] = "Hello";
 
 // When the enclave asks for it, send "Hello"
-Status hello_handler(std::shared_ptr<EnclaveClient> client, void *context,
-                     UntrustedParameterStack *params) {
+Status hello_handler(const std::shared_ptr<EnclaveClient> &client,
+                     void *context, UntrustedParameterStack *params) {
   // Push our message on to the parameter stack to pass to the enclave
   params->Push(Extent{const_cast<char *>(kHello), strlen(kHello)});
   return Status::OkStatus();
@@ -57,11 +57,15 @@ Status call_enclave() {
       client, LoadEnclave<SimBackend>(FLAGS_enclave_path,
                                       absl::make_unique<DispatchTable>()));
 
-  auto status = client->exit_call_provider()->RegisterExitHandler(
-      kExternalHelloHandler, ExitHandler{hello_handler});
+  ASYLO_RETURN_IF_ERROR(client->exit_call_provider()->RegisterExitHandler(
+      kExternalHelloHandler, ExitHandler{hello_handler}));
+
+  // No more exit handlers are registered, so let the dispatch table switch to
+  // lock-free lookups.
+  ASYLO_RETURN_IF_ERROR(client->exit_call_provider()->Freeze());
 
   UntrustedParameterStack params;
-  status = client->EnclaveCall(kHelloEnclaveSelector, &params);
+  Status status = client->EnclaveCall(kHelloEnclaveSelector, &params);
   if (status.ok()) {
     auto span = params.Pop();
     char *hello = reinterpret_cast<char *>(span->data());
@@ -48,6 +48,7 @@ class HelloTest : public ::testing::Test {
                                         absl::make_unique<DispatchTable>()));
     ASYLO_RETURN_IF_ERROR(client->exit_call_provider()->RegisterExitHandler(
         kExternalHelloHandler, ExitHandler{test_handler}));
+    ASYLO_RETURN_IF_ERROR(client->exit_call_provider()->Freeze());
     return client;
   }
 
@@ -62,7 +63,7 @@ class HelloTest : public ::testing::Test {
   static constexpr char kTest[] = "Test";
 
   // When the enclave asks for it, send "Test"
-  static Status test_handler(std::shared_ptr<EnclaveClient> client,
+  static Status test_handler(const std::shared_ptr<EnclaveClient> &client,
                              void *context, UntrustedParameterStack *params) {
     // Push our message on to the parameter stack to pass to the enclave
     params->Push(Extent{const_cast<char *>(kTest), strlen(kTest)});
@@ -20,7 +20,10 @@
 #define ASYLO_PLATFORM_PRIMITIVES_PARAMETER_STACK_H_
 
 #include <array>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <memory>
 #include <type_traits>
 
@@ -30,6 +33,15 @@
 namespace asylo {
 namespace primitives {
 
+// Decides whether a ParameterStack allocating with ALLOCATOR may write to arena
+// memory at |addr|. A stack used by trusted code is shared with the host, which
+// may modify its arena, so trusted code specializes this template to reject
+// memory inside the enclave.
+template <void *(*ALLOCATOR)(size_t)>
+struct ParameterStackMemory {
+  static bool IsWritable(const void *addr, size_t size) { return true; }
+};
+
 // A stack of Extent objects and ownership data. An extent can be
 // added as owned or not owned, and when owned extent is removed, its
 // memory is freed automatically. Template parameters provide the
@@ -37,13 +49,31 @@ namespace primitives {
 // std::functions, to accommodate malloc and free.
 //
 // These two parameters specify an allocation strategy used for the
-// item nodes in a linked list representing the stack entries, as well
-// as the Extents associated with those nodes. This is provided to
-// enable the same code to allocate stack items on the untrusted local
-// heap: directly using ParameterStack<malloc, free> by untrusted
-// code, or indirectly using ParameterStack<UntrustedLocalAlloc,
-// UntrustedLocalFree> by trusted code.  The same ParameterStack
-// object can thus be shared between untrusted and trusted code.
+// arena holding the item nodes of a linked list representing the stack
+// entries, as well as the Extents associated with those nodes. This is
+// provided to enable the same code to allocate stack items on the
+// untrusted local heap: directly using ParameterStack<malloc, free> by
+// untrusted code, or indirectly using ParameterStack<UntrustedLocalAlloc,
+// UntrustedLocalFree> by trusted code.  The same ParameterStack object
+// can thus be shared between untrusted and trusted code.
+//
+// Item nodes, and extents of up to kMaxInlineExtentSize bytes allocated
+// by PushAlloc, are carved out of a contiguous arena rather than
+// allocated one by one, since each allocation by trusted code is a call
+// to the untrusted host. The arena grows by chaining a larger block when
+// it is full, so extents never move. Its memory is reused once the stack
+// is empty and every popped extent has been released, and is freed when
+// the stack is destroyed. A stack reused across calls therefore
+// marshals parameters without allocating.
+//
+// The arena may be shared with the host, so its header is read once per
+// allocation, and an item is placed in the newest block only if it fits in
+// the block and ParameterStackMemory allows writing there. Otherwise the item
+// goes to a new block.
+//
+// Extents popped from the stack must be released before the stack is
+// destroyed, since they refer to the stack and its arena. Destroying a stack
+// with popped extents outstanding aborts rather than leaving them dangling.
 //
 // The class is NOT thread-safe.
 template <void *(*ALLOCATOR)(size_t), void (*FREER)(void *)>
@@ -52,6 +82,13 @@ class ParameterStack {
   static_assert(ALLOCATOR != nullptr && FREER != nullptr,
                 "ALLOCATOR and FREER may not be null");
 
+  // Largest extent allocated inside the arena by PushAlloc. Larger extents
+  // are allocated separately with ALLOCATOR.
+  static constexpr size_t kMaxInlineExtentSize = 256;
+
+  // Size of the first arena block allocated by a stack.
+  static constexpr size_t kMinArenaBlockSize = 1024;
+
   // An individual parameter entry in the parameters list with a link to the
   // next.
   struct Item {
@@ -63,7 +100,7 @@ class ParameterStack {
     Item(const Item &other) = delete;
     Item &operator=(const Item &other) = delete;
 
-    // Disallow destruction, always call Deleter.
+    // Disallow destruction, always call Release.
     ~Item() = delete;
 
     // This method is not intended to be called, it is defined only to provide a
@@ -87,25 +124,33 @@ class ParameterStack {
       static_assert(sizeof(size_t) == 8, "Unexpected size for type size_t");
     }
 
-    // Frees memory allocated for the item using FREER template parameter.
-    // Frees parameter extent too, if owned by the item.
-    // Must be used instead of (disallowed) destructor.
-    void Delete() {
-      if (owned && !extent.empty()) {
+    // Returns true if the extent is stored in the arena right after the item.
+    bool IsInline() const {
+      return extent.data() == reinterpret_cast<const uint8_t *>(this) +
+                                  ArenaBlock::AlignedSize(sizeof(Item));
+    }
+
+    // Frees the parameter extent using FREER template parameter, if owned by
+    // the item and not stored in the arena. The item itself is part of the
+    // arena and is not freed. Must be used instead of (disallowed) destructor.
+    void Release() {
+      if (owned && !extent.empty() && !IsInline()) {
         (*FREER)(extent.data());
       }
-      (*FREER)(this);
     }
   };
 
-  // Deleter implementation for unique_ptr values returned by Pop.
+  // Deleter implementation for unique_ptr values returned by Pop. Refers to
+  // the stack, which must outlive it.
   class ItemDeleter {
    public:
-    explicit ItemDeleter(Item *item) : item_(item) {}
-    void operator()(Extent *extent) { item_->Delete(); }
+    ItemDeleter(Item *item, ParameterStack *stack)
+        : item_(item), stack_(stack) {}
+    void operator()(Extent *extent) { stack_->ReleasePopped(item_); }
 
    private:
     Item *item_;
+    ParameterStack *stack_;
   };
 
   // Smart pointer to the extent holding on to the item.
@@ -116,12 +161,16 @@ class ParameterStack {
   ParameterStack operator=(const ParameterStack &other) = delete;
 
   ~ParameterStack() {
+    if (popped_ != 0) {
+      abort();
+    }
     while (top_) {
       auto item = top_;
       top_ = top_->next;
-      item->Delete();
+      item->Release();
       size_--;
     }
+    FreeArenaBlocks(arena_);
   }
 
   // Returns whether the stack is empty.
@@ -137,8 +186,9 @@ class ParameterStack {
     top_ = item->next;
     item->next = nullptr;
     size_--;
+    popped_++;
     return std::unique_ptr<Extent, ItemDeleter>(&item->extent,
-                                                ItemDeleter(item));
+                                                ItemDeleter(item, this));
   }
 
   // Returns the Extent at the top of the stack. Valid only if !empty().
@@ -146,24 +196,26 @@ class ParameterStack {
 
   // Pushes a extent, owned by the caller.
   void Push(Extent extent) {
-    auto item = static_cast<Item *>((*ALLOCATOR)(sizeof(Item)));
+    auto item = NewItem(0);
     item->extent = extent;
     item->owned = false;
-    item->next = top_;
-    top_ = item;
-    size_++;
   }
 
   // Allocates and pushes a new extent of the specified size,
   // owned by ParameterStack.
   Extent PushAlloc(size_t extent_size) {
-    auto item = static_cast<Item *>((*ALLOCATOR)(sizeof(Item)));
-    item->extent =
-        Extent{static_cast<void *>((*ALLOCATOR)(extent_size)), extent_size};
+    if (extent_size > kMaxInlineExtentSize) {
+      auto item = NewItem(0);
+      item->extent =
+          Extent{static_cast<void *>((*ALLOCATOR)(extent_size)), extent_size};
+      item->owned = true;
+      return item->extent;
+    }
+    auto item = NewItem(extent_size);
+    item->extent = Extent{reinterpret_cast<uint8_t *>(item) +
+                              ArenaBlock::AlignedSize(sizeof(Item)),
+                          extent_size};
     item->owned = true;
-    item->next = top_;
-    top_ = item;
-    size_++;
     return item->extent;
   }
 
@@ -194,22 +246,160 @@ class ParameterStack {
   }
 
  private:
+  // A block of arena memory, followed by |capacity| bytes of storage. Blocks
+  // are chained from the newest to the oldest.
+  struct ArenaBlock {
+    ArenaBlock *previous;
+    size_t capacity;
+    size_t used;
+
+    // Alignment of every allocation in the arena.
+    static constexpr size_t kAlignment = 16;
+
+    // Returns |size| rounded up to a multiple of kAlignment.
+    static constexpr size_t AlignedSize(size_t size) {
+      return (size + kAlignment - 1) & ~(kAlignment - 1);
+    }
+
+    // Returns the first byte of storage of the block.
+    uint8_t *storage() {
+      return reinterpret_cast<uint8_t *>(this) +
+             AlignedSize(sizeof(ArenaBlock));
+    }
+
+    static void CheckLayout() {
+      static_assert(std::is_standard_layout<ArenaBlock>::value,
+                    "ParameterStack::ArenaBlock must satisfy "
+                    "std::is_standard_layout");
+      static_assert(offsetof(ArenaBlock, previous) == 0x0,
+                    "Unexpected layout for field "
+                    "ParameterStack::ArenaBlock::previous");
+      static_assert(offsetof(ArenaBlock, capacity) == sizeof(uint64_t),
+                    "Unexpected layout for field "
+                    "ParameterStack::ArenaBlock::capacity");
+      static_assert(offsetof(ArenaBlock, used) == 2 * sizeof(uint64_t),
+                    "Unexpected layout for field "
+                    "ParameterStack::ArenaBlock::used");
+    }
+  };
+
   // This method is not intended to be called, it is defined only to provide a
   // scope where offsetof may be applied to private members and ParameterStack
   // is a complete type.
   static void CheckLayout() {
     static_assert(std::is_standard_layout<ParameterStack>::value,
                   "ParameterStack must satisfy std::is_standard_layout");
-    static_assert(offsetof(ParameterStack, front_) == 0x0,
-                  "Unexpected layout for field ParameterStack::front_");
-    static_assert(offsetof(ParameterStack, back_) == sizeof(uint64_t),
-                  "Unexpected layout for field ParameterStack::back_");
+    static_assert(offsetof(ParameterStack, top_) == 0x0,
+                  "Unexpected layout for field ParameterStack::top_");
+    static_assert(offsetof(ParameterStack, size_) == sizeof(uint64_t),
+                  "Unexpected layout for field ParameterStack::size_");
+    static_assert(offsetof(ParameterStack, arena_) == 2 * sizeof(uint64_t),
+                  "Unexpected layout for field ParameterStack::arena_");
+    static_assert(offsetof(ParameterStack, popped_) == 3 * sizeof(uint64_t),
+                  "Unexpected layout for field ParameterStack::popped_");
+  }
+
+  // Allocates an item followed by |inline_size| bytes of extent storage from
+  // the arena, and pushes it on the stack.
+  Item *NewItem(size_t inline_size) {
+    size_t size = ArenaBlock::AlignedSize(sizeof(Item)) +
+                  ArenaBlock::AlignedSize(inline_size);
+    uint8_t *address = nullptr;
+    ArenaBlock *block = arena_;
+    size_t capacity = 0;
+    if (block && IsWritable(block, sizeof(ArenaBlock))) {
+      capacity = block->capacity;
+      size_t used = block->used;
+      if (used <= capacity && capacity - used >= size &&
+          IsWritable(block->storage() + used, size)) {
+        address = block->storage() + used;
+        block->used = used + size;
+      }
+    }
+    if (!address) {
+      block = NewArenaBlock(size, capacity);
+      address = block->storage();
+      block->used = size;
+    }
+    auto item = reinterpret_cast<Item *>(address);
+    item->next = top_;
+    top_ = item;
+    size_++;
+    return item;
+  }
+
+  // Returns true if the stack may write |size| bytes at |addr|.
+  static bool IsWritable(const void *addr, size_t size) {
+    return ParameterStackMemory<ALLOCATOR>::IsWritable(addr, size);
+  }
+
+  // Releases |item|, previously returned by Pop. Once the stack is empty and
+  // every popped item is released, the arena is recycled. If it grew to more
+  // than one block, it is replaced by a single block of the same total
+  // capacity, so that the next use of the stack does not need to grow it.
+  void ReleasePopped(Item *item) {
+    item->Release();
+    popped_--;
+    if (top_ || popped_ != 0 || !arena_) {
+      return;
+    }
+    if (arena_->previous) {
+      size_t capacity = 0;
+      for (ArenaBlock *block = arena_; block; block = block->previous) {
+        capacity += block->capacity;
+      }
+      FreeArenaBlocks(arena_);
+      arena_ = nullptr;
+      // Doubling half the total capacity gives a block of the same capacity.
+      NewArenaBlock(0, capacity / 2);
+    }
+    if (IsWritable(arena_, sizeof(ArenaBlock))) {
+      arena_->used = 0;
+    }
+  }
+
+  // Adds a block with room for at least |size| bytes as the newest block of the
+  // arena, and returns it. The block is twice as large as the previous newest
+  // block, of capacity |previous_capacity|.
+  ArenaBlock *NewArenaBlock(size_t size, size_t previous_capacity) {
+    size_t capacity = kMinArenaBlockSize;
+    if (previous_capacity >= kMinArenaBlockSize / 2 &&
+        previous_capacity <= SIZE_MAX / 4) {
+      capacity = 2 * previous_capacity;
+    }
+    while (capacity < size) {
+      capacity *= 2;
+    }
+    auto block = static_cast<ArenaBlock *>(
+        (*ALLOCATOR)(ArenaBlock::AlignedSize(sizeof(ArenaBlock)) + capacity));
+    block->previous = arena_;
+    block->capacity = capacity;
+    block->used = 0;
+    arena_ = block;
+    return block;
+  }
+
+  // Frees |block| and the blocks older than it.
+  static void FreeArenaBlocks(ArenaBlock *block) {
+    while (block) {
+      ArenaBlock *previous = block->previous;
+      (*FREER)(block);
+      block = previous;
+    }
   }
 
   Item *top_ = nullptr;  // Stack top.
   size_t size_ = 0;
+  ArenaBlock *arena_ = nullptr;  // Newest arena block.
+  size_t popped_ = 0;            // Popped items not yet released.
 };
 
+template <void *(*ALLOCATOR)(size_t), void (*FREER)(void *)>
+constexpr size_t ParameterStack<ALLOCATOR, FREER>::kMaxInlineExtentSize;
+
+template <void *(*ALLOCATOR)(size_t), void (*FREER)(void *)>
+constexpr size_t ParameterStack<ALLOCATOR, FREER>::kMinArenaBlockSize;
+
 // Type signature of the enclave entry function pointer. All data extents in
 // `params` are expected to be located in untrusted memory.
 using EnclaveCallPtr = PrimitiveStatus (*)(
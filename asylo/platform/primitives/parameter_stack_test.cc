@@ -19,6 +19,9 @@
 #include "asylo/platform/primitives/parameter_stack.h"
 #include <algorithm>
 #include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <vector>
 #include <gmock/gmock.h>
@@ -34,6 +37,46 @@ namespace {
 constexpr size_t kNumIterations = 64;
 constexpr size_t kNumParams = 256;
 
+// Layout of the header of an arena block, which the host may modify, as
+// asserted by ParameterStack::ArenaBlock::CheckLayout().
+struct ArenaHeader {
+  ArenaHeader *previous;
+  size_t capacity;
+  size_t used;
+};
+
+// Offset of the arena storage from its header.
+constexpr size_t kArenaStorageOffset = 32;
+
+// Returns the newest arena block of |params|, stored after the stack top and
+// size as asserted by ParameterStack::CheckLayout().
+template <typename StackT>
+ArenaHeader *GetArena(StackT *params) {
+  return reinterpret_cast<ArenaHeader **>(params)[2];
+}
+
+// Memory standing for the enclave in tests of stacks allocating with
+// TestMalloc.
+uint8_t fake_enclave[4096];
+
+void *TestMalloc(size_t size) { return malloc(size); }
+
+void TestFree(void *ptr) { free(ptr); }
+
+}  // namespace
+
+template <>
+struct ParameterStackMemory<TestMalloc> {
+  static bool IsWritable(const void *addr, size_t size) {
+    auto begin = reinterpret_cast<uintptr_t>(addr);
+    auto enclave_begin = reinterpret_cast<uintptr_t>(fake_enclave);
+    return begin + size <= enclave_begin ||
+           begin >= enclave_begin + sizeof(fake_enclave);
+  }
+};
+
+namespace {
+
 TEST(ParameterStackTest, PushPopOwnedSpans) {
   ParameterStack<malloc, free> params;
   for (int32_t iter = 1; iter <= kNumIterations; ++iter) {
@@ -107,6 +150,122 @@ TEST(ParameterStackTest, PushPopMixture) {
   }
 }
 
+TEST(ParameterStackTest, PushAllocLargeExtents) {
+  using Stack = ParameterStack<malloc, free>;
+  Stack params;
+  std::vector<size_t> sizes = {1, Stack::kMaxInlineExtentSize,
+                               Stack::kMaxInlineExtentSize + 1,
+                               4 * Stack::kMinArenaBlockSize};
+  for (size_t size : sizes) {
+    Extent extent = params.PushAlloc(size);
+    ASSERT_THAT(extent.size(), Eq(size));
+    memset(extent.data(), static_cast<int>(size % 256), size);
+  }
+  for (auto it = sizes.rbegin(); it != sizes.rend(); ++it) {
+    auto extent = params.Pop();
+    ASSERT_THAT(extent->size(), Eq(*it));
+    const uint8_t *data = extent->As<uint8_t>();
+    EXPECT_TRUE(std::all_of(data, data + extent->size(), [it](uint8_t byte) {
+      return byte == *it % 256;
+    }));
+  }
+}
+
+TEST(ParameterStackTest, PoppedExtentsSurviveLaterPushes) {
+  ParameterStack<malloc, free> params;
+  *params.PushAlloc<int32_t>() = 1;
+  auto popped = params.Pop();
+  for (int32_t i = 0; i < kNumParams; ++i) {
+    *params.PushAlloc<int32_t>() = -1;
+  }
+  EXPECT_THAT(*popped->As<int32_t>(), Eq(1));
+}
+
+TEST(ParameterStackTest, ReusesArenaOnceEmpty) {
+  ParameterStack<malloc, free> params;
+  std::vector<void *> reused_round;
+  for (int32_t iter = 1; iter <= kNumIterations; ++iter) {
+    std::vector<void *> round;
+    for (int32_t i = 0; i < kNumParams; ++i) {
+      round.push_back(params.PushAlloc<int32_t>());
+    }
+    while (!params.empty()) {
+      params.Pop();
+    }
+    // The first round grows the arena, and the following rounds reuse the
+    // block it is merged into.
+    if (iter == 2) {
+      reused_round = round;
+    } else if (iter > 2) {
+      EXPECT_THAT(round, Eq(reused_round));
+    }
+  }
+}
+
+// Verifies that an arena block whose used size was corrupted past its capacity
+// is not written to, and that items go to a new block instead.
+TEST(ParameterStackTest, RejectsCorruptedArenaUsedSize) {
+  ParameterStack<malloc, free> params;
+  *params.PushAlloc<int32_t>() = 1;
+  ArenaHeader *block = GetArena(&params);
+  size_t corrupted_used = block->capacity + 4096;
+  block->used = corrupted_used;
+
+  *params.PushAlloc<int32_t>() = 2;
+  ArenaHeader *new_block = GetArena(&params);
+  EXPECT_NE(new_block, block);
+  EXPECT_EQ(new_block->previous, block);
+  EXPECT_EQ(block->used, corrupted_used);
+
+  // A used size wrapping the free space computation is rejected too.
+  new_block->used = SIZE_MAX - 8;
+  params.Push<int64_t>(3);
+  EXPECT_NE(GetArena(&params), new_block);
+  EXPECT_EQ(new_block->used, SIZE_MAX - 8);
+
+  EXPECT_THAT(params.Pop<int64_t>(), Eq(3));
+  EXPECT_THAT(params.Pop<int32_t>(), Eq(2));
+  EXPECT_THAT(params.Pop<int32_t>(), Eq(1));
+}
+
+// Verifies that an arena block redirected to memory the stack may not write is
+// not written to.
+TEST(ParameterStackTest, RejectsArenaInsideEnclave) {
+  ParameterStack<TestMalloc, TestFree> params;
+  *params.PushAlloc<int32_t>() = 1;
+  ArenaHeader *block = GetArena(&params);
+  uint8_t *storage = reinterpret_cast<uint8_t *>(block) + kArenaStorageOffset;
+  block->capacity = SIZE_MAX;
+  block->used = reinterpret_cast<uintptr_t>(fake_enclave) -
+                reinterpret_cast<uintptr_t>(storage);
+
+  *params.PushAlloc<int32_t>() = 2;
+  EXPECT_NE(GetArena(&params), block);
+  EXPECT_TRUE(std::all_of(fake_enclave, fake_enclave + sizeof(fake_enclave),
+                          [](uint8_t byte) { return byte == 0; }));
+  EXPECT_THAT(params.Pop<int32_t>(), Eq(2));
+  EXPECT_THAT(params.Pop<int32_t>(), Eq(1));
+}
+
+// Verifies that an arena block redirected so that the next item would straddle
+// the start of memory the stack may not write is not written to.
+TEST(ParameterStackTest, RejectsArenaStraddlingEnclave) {
+  ParameterStack<TestMalloc, TestFree> params;
+  *params.PushAlloc<int32_t>() = 1;
+  ArenaHeader *block = GetArena(&params);
+  uint8_t *storage = reinterpret_cast<uint8_t *>(block) + kArenaStorageOffset;
+  block->capacity = SIZE_MAX;
+  block->used = reinterpret_cast<uintptr_t>(fake_enclave) - 8 -
+                reinterpret_cast<uintptr_t>(storage);
+
+  *params.PushAlloc<int32_t>() = 2;
+  EXPECT_NE(GetArena(&params), block);
+  EXPECT_TRUE(std::all_of(fake_enclave, fake_enclave + sizeof(fake_enclave),
+                          [](uint8_t byte) { return byte == 0; }));
+  EXPECT_THAT(params.Pop<int32_t>(), Eq(2));
+  EXPECT_THAT(params.Pop<int32_t>(), Eq(1));
+}
+
 }  // namespace
 }  // namespace primitives
 }  // namespace asylo
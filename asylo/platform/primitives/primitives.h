@@ -34,6 +34,9 @@ static constexpr uint64_t kSelectorAsyloInvalid = 0;
 // Enclave finalization entry point selector.
 static constexpr uint64_t kSelectorAsyloFini = 1;
 
+// Batched enclave call entry point selector. See BatchedCall.
+static constexpr uint64_t kSelectorAsyloBatch = 2;
+
 // Selector values less than `kSelectorUser` are reserved by the runtime and may
 // not be registered by the applications.
 static constexpr uint64_t kSelectorUser = 128;
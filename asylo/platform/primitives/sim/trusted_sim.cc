@@ -17,9 +17,12 @@
  */
 
 #include <unistd.h>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
 
+#include "asylo/platform/primitives/batched_call.h"
+#include "asylo/platform/primitives/extent.h"
 #include "asylo/platform/primitives/primitives.h"
 #include "asylo/platform/primitives/sim/shared_sim.h"
 #include "asylo/platform/primitives/trusted_primitives.h"
@@ -39,6 +42,8 @@ PrimitiveStatus asylo_exit_call(uint64_t untrusted_selector,
                                 TrustedParameterStack *params);
 void *asylo_local_alloc_handler(size_t size);
 void asylo_local_free_handler(void *ptr);
+void asylo_sim_heap_reservation(void **base, size_t *size);
+int asylo_sim_heap_commit(void *addr, size_t size);
 }
 
 namespace {
@@ -46,10 +51,13 @@ namespace {
 // Maximum number of supported enclave entry points.
 static constexpr size_t kEntryPointMax = 4096;
 
-// Size of the enclave heap in bytes, set here to 128 megabytes for rough parity
-// with Intel SGX. This is the size of the nominally secure heap considered
-// "trusted" for purposes of the simulation.
-constexpr size_t kSimulatorHeapSize = 128 * 1024 * 1024;
+// Maximum number of threads inside the enclave at once, modeling the number of
+// thread control structures (TCS) of an SGX enclave.
+constexpr size_t kMaxEnclaveThreads = 64;
+
+// Granularity in bytes at which pages of the heap reservation are committed.
+// Must be a multiple of the page size.
+constexpr size_t kHeapCommitSize = 1024 * 1024;
 
 // Enclave status flag bits.
 enum Flag : uint64_t { kInitialized = 0x1, kAborted = 0x2 };
@@ -71,16 +79,144 @@ struct {
 
   // Lock protecting entry_table.
   asylo_spinlock_t entry_table_lock = ASYLO_SPIN_LOCK_INITIALIZER;
+} simulator;
 
-  // The simulator heap is implemented as a block of static storage allocated at
-  // enclave load time by dlopen(). Note that the newlib malloc implementation
-  // expects sbrk() to return maximally aligned addresses.
-  uint8_t heap[kSimulatorHeapSize] __attribute__((aligned(8)));
+// The simulator heap is a region of address space reserved by the loader
+// before the enclave is opened, and is considered "trusted" for purposes of
+// the simulation. Pages are committed as the program break moves up. The
+// region is page aligned, as the newlib malloc implementation expects sbrk()
+// to return maximally aligned addresses.
+//
+// Unlike the simulator record, which is initialized dynamically, this record
+// is constant initialized so it is valid when the heap reservation is fetched
+// by the first constructor of the enclave.
+struct {
+  uint8_t *begin = nullptr;
+  uint8_t *end = nullptr;
+
+  // The end of the committed part of the heap.
+  uint8_t *committed = nullptr;
 
   // The "program break," defined as the first location after the end of the of
   // the heap.
-  uint8_t *brk = heap;
-} simulator;
+  uint8_t *brk = nullptr;
+} heap;
+
+// Fetches the heap reserved for this enclave from the loader if it has not
+// been fetched already. Returns false if no heap is available.
+bool EnsureHeapReserved() {
+  if (heap.begin) {
+    return true;
+  }
+  void *base = nullptr;
+  size_t size = 0;
+  asylo_sim_heap_reservation(&base, &size);
+  if (!base) {
+    return false;
+  }
+  heap.begin = static_cast<uint8_t *>(base);
+  heap.end = heap.begin + size;
+  heap.committed = heap.begin;
+  heap.brk = heap.begin;
+  return true;
+}
+
+// The heap reservation is handed over by the loader only while the enclave is
+// being opened, so fetch it before any other initialization of the enclave.
+__attribute__((constructor(101))) void ReserveHeapAtLoad() {
+  EnsureHeapReserved();
+}
+
+// Returns true if the extent of |size| bytes at |addr| is within the range
+// [|begin|, |end|).
+bool IsWithin(const void *addr, size_t size, const void *begin,
+              const void *end) {
+  auto addr_begin = reinterpret_cast<uintptr_t>(addr);
+  return addr_begin >= reinterpret_cast<uintptr_t>(begin) &&
+         addr_begin + size >= addr_begin &&
+         addr_begin + size <= reinterpret_cast<uintptr_t>(end);
+}
+
+// Returns true if the extent of |size| bytes at |addr| shares any byte with the
+// range [|begin|, |end|). An extent wrapping around the address space is
+// considered overlapping, and an empty extent is treated as a single byte.
+bool Overlaps(const void *addr, size_t size, const void *begin,
+              const void *end) {
+  auto addr_begin = reinterpret_cast<uintptr_t>(addr);
+  if (size == 0) {
+    size = 1;
+  }
+  if (addr_begin + size < addr_begin) {
+    return true;
+  }
+  return addr_begin < reinterpret_cast<uintptr_t>(end) &&
+         addr_begin + size > reinterpret_cast<uintptr_t>(begin);
+}
+
+// Per-thread state of a thread inside the enclave, the simulated counterpart of
+// an SGX thread control structure. A context is bound to a thread from its
+// outermost entry to the matching return, so entries nested in exit calls reuse
+// the context of their thread.
+struct ThreadContext {
+  // Nonzero while the context is bound to a thread.
+  uint32_t in_use;
+
+  // Number of entries by the bound thread which have not returned yet.
+  uint64_t depth;
+};
+
+// Thread contexts of the enclave. These are kept apart from |simulator| since
+// the thread finalizing the enclave holds one of them while the simulator
+// state is reset.
+ThreadContext thread_contexts[kMaxEnclaveThreads];
+
+// The context bound to this thread, or nullptr if the thread is outside the
+// enclave.
+thread_local ThreadContext *current_thread_context = nullptr;
+
+// Index of the context this thread used last, tried first on its next entry so
+// that a thread entering repeatedly finds a free context on the first attempt.
+thread_local size_t preferred_thread_context = 0;
+
+// Binds a thread context to the calling thread for the duration of an entry.
+class ScopedThreadContext {
+ public:
+  ScopedThreadContext() : context_(current_thread_context) {
+    if (context_) {
+      context_->depth++;
+      return;
+    }
+    for (size_t i = 0; i < kMaxEnclaveThreads; i++) {
+      size_t index = (preferred_thread_context + i) % kMaxEnclaveThreads;
+      uint32_t expected = 0;
+      if (__atomic_compare_exchange_n(&thread_contexts[index].in_use,
+                                      &expected, 1, /*weak=*/false,
+                                      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        context_ = &thread_contexts[index];
+        context_->depth = 1;
+        current_thread_context = context_;
+        preferred_thread_context = index;
+        return;
+      }
+    }
+  }
+
+  ~ScopedThreadContext() {
+    if (context_ && --context_->depth == 0) {
+      current_thread_context = nullptr;
+      __atomic_store_n(&context_->in_use, 0, __ATOMIC_RELEASE);
+    }
+  }
+
+  ScopedThreadContext(const ScopedThreadContext &other) = delete;
+  ScopedThreadContext &operator=(const ScopedThreadContext &other) = delete;
+
+  // Returns false if all thread contexts are bound to other threads.
+  bool ok() const { return context_ != nullptr; }
+
+ private:
+  ThreadContext *context_;
+};
 
 // Message handler installed by the runtime to finalize the enclave at the time
 // it is destroyed.
@@ -99,10 +235,75 @@ PrimitiveStatus ReservedEntry(void *context, TrustedParameterStack *params) {
   return {error::GoogleError::INTERNAL, "Invalid call to reserved selector."};
 }
 
+// Returns the status flag bitmap. Flags are only ever set with release
+// semantics, so state published before a flag is set is visible to a caller
+// observing it.
+uint64_t LoadFlags() {
+  return __atomic_load_n(&simulator.flags, __ATOMIC_ACQUIRE);
+}
+
+// Sets |flag| in the status flag bitmap.
+void SetFlag(Flag flag) {
+  SpinLockGuard lock(&simulator.flags_write_lock);
+  __atomic_fetch_or(&simulator.flags, flag, __ATOMIC_RELEASE);
+}
+
+// Invokes the entry handler registered for |selector|.
+PrimitiveStatus InvokeEntryHandler(uint64_t selector,
+                                   TrustedParameterStack *params) {
+  // Bounds check the passed selector.
+  if (selector >= kEntryPointMax || simulator.entry_table[selector].IsNull()) {
+    return {error::GoogleError::OUT_OF_RANGE,
+            "Invalid selector passed in call to asylo_enclave_call."};
+  }
+
+  // Invoke the entry point handler.
+  auto &handler = simulator.entry_table[selector];
+  return handler.callback(handler.context, params);
+}
+
+// Message handler installed by the runtime to make a batch of calls in a
+// single entry. Expects a single parameter, an array of BatchedCall records in
+// untrusted memory.
+PrimitiveStatus BatchEntry(void *context, TrustedParameterStack *params) {
+  if (params->size() != 1) {
+    return {error::GoogleError::INVALID_ARGUMENT,
+            "BatchEntry expects a single parameter."};
+  }
+  Extent calls = params->Top();
+  if (calls.empty() || calls.size() % sizeof(BatchedCall) != 0 ||
+      TrustedPrimitives::IsTrustedExtent(calls.data(), calls.size())) {
+    return {error::GoogleError::INVALID_ARGUMENT,
+            "Invalid batch of calls passed to BatchEntry."};
+  }
+
+  auto records = reinterpret_cast<BatchedCall *>(calls.data());
+  size_t count = calls.size() / sizeof(BatchedCall);
+  for (size_t i = 0; i < count; i++) {
+    // Read the selector once, as untrusted code may modify the record.
+    uint64_t selector = records[i].selector;
+    if (selector < kSelectorUser) {
+      records[i].status = {error::GoogleError::INVALID_ARGUMENT,
+                           "Reserved selector passed in a batch of calls."};
+    } else if (LoadFlags() & Flag::kAborted) {
+      records[i].status = {error::GoogleError::ABORTED,
+                           "Invalid call to aborted enclave."};
+    } else {
+      records[i].status = InvokeEntryHandler(
+          selector, static_cast<TrustedParameterStack *>(records[i].params));
+    }
+  }
+  return PrimitiveStatus::OkStatus();
+}
+
 // Initialized the enclave if it has not been initialized already.
 void EnsureInitialized() {
+  // Once the enclave is initialized, entries only need to observe the flag.
+  if (LoadFlags() & Flag::kInitialized) {
+    return;
+  }
   SpinLockGuard lock(&simulator.initialization_lock);
-  if (!(simulator.flags & Flag::kInitialized)) {
+  if (!(LoadFlags() & Flag::kInitialized)) {
     // Register the enclave finalization entry handler.
     EntryHandler handler{FinalizeEnclave};
     if (!TrustedPrimitives::RegisterEntryHandler(kSelectorAsyloFini, handler)
@@ -110,8 +311,15 @@ void EnsureInitialized() {
       TrustedPrimitives::BestEffortAbort("Could not register entry handler");
     }
 
+    // Register the batched call entry handler.
+    if (!TrustedPrimitives::RegisterEntryHandler(kSelectorAsyloBatch,
+                                                 EntryHandler{BatchEntry})
+             .ok()) {
+      TrustedPrimitives::BestEffortAbort("Could not register entry handler");
+    }
+
     // Register placeholder handlers for reserved entry points.
-    for (uint64_t i = kSelectorAsyloFini + 1; i < kSelectorUser; i++) {
+    for (uint64_t i = kSelectorAsyloBatch + 1; i < kSelectorUser; i++) {
       EntryHandler handler{ReservedEntry};
       if (!TrustedPrimitives::RegisterEntryHandler(i, handler).ok()) {
         TrustedPrimitives::BestEffortAbort("Could not register entry handler");
@@ -126,18 +334,14 @@ void EnsureInitialized() {
     }
 
     // Mark this enclave as initialized.
-    {
-      SpinLockGuard lock(&simulator.flags_write_lock);
-      simulator.flags |= Flag::kInitialized;
-    }
+    SetFlag(Flag::kInitialized);
   }
 }
 
 }  // namespace
 
 void TrustedPrimitives::BestEffortAbort(const char *message) {
-  SpinLockGuard lock(&simulator.flags_write_lock);
-  simulator.flags |= Flag::kAborted;
+  SetFlag(Flag::kAborted);
 }
 
 void TrustedPrimitives::DebugPuts(const char *message) {
@@ -158,40 +362,74 @@ PrimitiveStatus TrustedPrimitives::RegisterEntryHandler(
 }
 
 extern "C" void *enclave_sbrk(intptr_t increment) {
-  if (simulator.brk + increment > simulator.heap + kSimulatorHeapSize) {
-    return reinterpret_cast<void *>(INT64_C(-1));
+  void *const kFailure = reinterpret_cast<void *>(INT64_C(-1));
+  if (!EnsureHeapReserved()) {
+    return kFailure;
+  }
+  if (increment > heap.end - heap.brk || increment < heap.begin - heap.brk) {
+    return kFailure;
   }
-  void *result = simulator.brk;
-  simulator.brk += increment;
+  uint8_t *new_brk = heap.brk + increment;
+
+  // Commit enough pages to cover the new break, rounded up to the commit
+  // granularity. Pages are left committed when the break moves down.
+  if (new_brk > heap.committed) {
+    size_t commit_end = new_brk - heap.begin;
+    commit_end = (commit_end + kHeapCommitSize - 1) / kHeapCommitSize *
+                 kHeapCommitSize;
+    uint8_t *new_committed =
+        commit_end < static_cast<size_t>(heap.end - heap.begin)
+            ? heap.begin + commit_end
+            : heap.end;
+    if (asylo_sim_heap_commit(heap.committed,
+                              new_committed - heap.committed) != 0) {
+      return kFailure;
+    }
+    heap.committed = new_committed;
+  }
+
+  void *result = heap.brk;
+  heap.brk = new_brk;
   return result;
 }
 
 extern "C" PrimitiveStatus asylo_enclave_call(uint64_t selector,
                                               TrustedParameterStack *params) {
+  // Bind a thread context to this thread, failing as SGX does when all thread
+  // control structures are in use.
+  ScopedThreadContext thread_context;
+  if (!thread_context.ok()) {
+    return {error::GoogleError::RESOURCE_EXHAUSTED,
+            "Too many threads inside the enclave."};
+  }
+
   // Initialize the enclave if necessary.
   EnsureInitialized();
 
   // Ensure the enclave has not been aborted.
-  if (simulator.flags & Flag::kAborted) {
+  if (LoadFlags() & Flag::kAborted) {
     return {error::GoogleError::ABORTED, "Invalid call to aborted enclave."};
   }
 
-  // Bounds check the passed selector.
-  if (selector >= kEntryPointMax || simulator.entry_table[selector].IsNull()) {
-    return {error::GoogleError::OUT_OF_RANGE,
-            "Invalid selector passed in call to asylo_enclave_call."};
-  }
-
-  // Invoke the entry point handler.
-  auto &handler = simulator.entry_table[selector];
-  return handler.callback(handler.context, params);
+  return InvokeEntryHandler(selector, params);
 }
 
 bool TrustedPrimitives::IsTrustedExtent(const void *addr, size_t size) {
   auto begin = reinterpret_cast<const uint8_t *>(&simulator);
   const uint8_t *end = begin + sizeof(simulator);
-  return reinterpret_cast<const uint8_t *>(addr) >= begin &&
-         reinterpret_cast<const uint8_t *>(addr) + size < end;
+  auto heap_record = reinterpret_cast<const uint8_t *>(&heap);
+  return IsWithin(addr, size, begin, end) ||
+         IsWithin(addr, size, heap_record, heap_record + sizeof(heap)) ||
+         (heap.begin && IsWithin(addr, size, heap.begin, heap.end));
+}
+
+bool TrustedPrimitives::IsUntrustedExtent(const void *addr, size_t size) {
+  auto begin = reinterpret_cast<const uint8_t *>(&simulator);
+  const uint8_t *end = begin + sizeof(simulator);
+  auto heap_record = reinterpret_cast<const uint8_t *>(&heap);
+  return !Overlaps(addr, size, begin, end) &&
+         !Overlaps(addr, size, heap_record, heap_record + sizeof(heap)) &&
+         !(heap.begin && Overlaps(addr, size, heap.begin, heap.end));
 }
 
 void *TrustedPrimitives::UntrustedLocalAlloc(size_t size) {
@@ -19,58 +19,164 @@
 #include "asylo/platform/primitives/sim/untrusted_sim.h"
 
 #include <dlfcn.h>
+#include <errno.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include <cstdlib>
 #include <memory>
 #include <utility>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/debugging/leak_check.h"
 #include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
 #include "asylo/platform/primitives/extent.h"
 #include "asylo/platform/primitives/primitive_status.h"
 #include "asylo/platform/primitives/primitives.h"
 #include "asylo/platform/primitives/untrusted_primitives.h"
 #include "asylo/platform/primitives/util/status_conversions.h"
 #include "asylo/util/error_codes.h"
+#include "asylo/util/posix_error_space.h"
 #include "asylo/util/status.h"
 #include "asylo/util/statusor.h"
 
 namespace asylo {
 namespace primitives {
+namespace {
+
+// A heap reserved for an enclave.
+struct HeapReservation {
+  void *base;
+  size_t size;
+};
+
+// The heap reserved for the enclave being opened by this thread, handed to the
+// enclave by asylo_sim_heap_reservation().
+thread_local const HeapReservation *loading_heap = nullptr;
+
+// An enclave image opened by the loader. Opening an image which is already
+// loaded returns the existing dlopen handle without running its constructors
+// again, so all clients of an image share the heap reserved when it was first
+// opened.
+struct LoadedImage {
+  // The heap handed to the image by its constructors, or null if the image
+  // was loaded by other means.
+  HeapReservation heap;
+
+  // Number of clients holding a handle to the image.
+  int clients;
+};
+
+// Guards the loaded image map and serializes opening and closing images.
+absl::Mutex *loaded_images_mutex() {
+  static absl::Mutex *const mutex = new absl::Mutex();
+  return mutex;
+}
+
+// Loaded images keyed by their dlopen handle.
+absl::flat_hash_map<void *, LoadedImage> *loaded_images() {
+  static auto *const images = new absl::flat_hash_map<void *, LoadedImage>();
+  return images;
+}
+
+}  // namespace
+
+constexpr size_t SimBackend::kDefaultHeapSize;
 
 SimEnclaveClient::~SimEnclaveClient() {
-  if (dl_handle_) {
-    if (enclave_call_) {
-      UntrustedParameterStack fini_params;
-      enclave_call_(kSelectorAsyloFini, &fini_params);
-    }
-    dlclose(dl_handle_);
+  if (dl_handle_ && enclave_call_) {
+    UntrustedParameterStack fini_params;
+    enclave_call_(kSelectorAsyloFini, &fini_params);
+  }
+  ReleaseImage();
+}
+
+void SimEnclaveClient::ReleaseImage() {
+  if (!dl_handle_) {
+    return;
+  }
+  absl::MutexLock lock(loaded_images_mutex());
+  auto it = loaded_images()->find(dl_handle_);
+  dlclose(dl_handle_);
+  dl_handle_ = nullptr;
+  if (it == loaded_images()->end() || --it->second.clients > 0) {
+    return;
+  }
+
+  // The heap is in use for as long as the image stays mapped, which may
+  // outlive its last client if the image was opened elsewhere too.
+  void *handle = dlopen(path_.c_str(), RTLD_LAZY | RTLD_NOLOAD);
+  if (handle) {
+    dlclose(handle);
+    return;
+  }
+  if (it->second.heap.base) {
+    munmap(it->second.heap.base, it->second.heap.size);
   }
+  loaded_images()->erase(it);
 }
 
 StatusOr<std::shared_ptr<EnclaveClient>> SimBackend::Load(
     const std::string &path,
-    std::unique_ptr<EnclaveClient::ExitCallProvider> exit_call_provider) {
+    std::unique_ptr<EnclaveClient::ExitCallProvider> exit_call_provider,
+    size_t heap_size) {
+  if (heap_size == 0) {
+    return Status{error::GoogleError::INVALID_ARGUMENT,
+                  "Enclave heap size must be positive"};
+  }
   std::shared_ptr<SimEnclaveClient> client(
       new SimEnclaveClient(std::move(exit_call_provider)));
+  client->path_ = path;
 
   // Open the enclave shared object file.
   {
-    // Make client reference available as thread-local for the time it loads
-    // the enclave binary, in order to enable exit calls by the enclave
-    // initialization.
-    EnclaveClient::ScopedCurrentClient scoped_client(client.get());
-
-    // dlopen may allocate resources which are not disposed by dlclose.
-    absl::LeakCheckDisabler disabler;
-    client->dl_handle_ = dlopen(path.c_str(), RTLD_LAZY | RTLD_LOCAL);
-  }
-  if (!client->dl_handle_) {
-    return Status{
-        error::GoogleError::NOT_FOUND,
-        absl::StrCat("dlopen of ", path, " failed with: ", dlerror())};
+    absl::MutexLock lock(loaded_images_mutex());
+
+    // A client of an image which is already loaded shares its heap.
+    void *handle = dlopen(path.c_str(), RTLD_LAZY | RTLD_LOCAL | RTLD_NOLOAD);
+    if (handle) {
+      auto result = loaded_images()->emplace(
+          handle, LoadedImage{HeapReservation{nullptr, 0}, 0});
+      ++result.first->second.clients;
+      client->dl_handle_ = handle;
+    } else {
+      // Reserve address space for the enclave heap without committing memory
+      // to it. The enclave commits pages as its heap grows.
+      const size_t page_size = sysconf(_SC_PAGESIZE);
+      heap_size = (heap_size + page_size - 1) / page_size * page_size;
+      void *heap = mmap(nullptr, heap_size, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (heap == MAP_FAILED) {
+        return Status{static_cast<error::PosixError>(errno),
+                      absl::StrCat("Failed to reserve ", heap_size,
+                                   " bytes for the enclave heap")};
+      }
+      HeapReservation reservation{heap, heap_size};
+
+      // Make client reference available as thread-local for the time it loads
+      // the enclave binary, in order to enable exit calls by the enclave
+      // initialization.
+      const std::shared_ptr<EnclaveClient> current_client = client;
+      EnclaveClient::ScopedCurrentClient scoped_client(current_client);
+
+      // Likewise hand the heap reservation to the enclave as it is opened.
+      loading_heap = &reservation;
+
+      // dlopen may allocate resources which are not disposed by dlclose.
+      absl::LeakCheckDisabler disabler;
+      handle = dlopen(path.c_str(), RTLD_LAZY | RTLD_LOCAL);
+      loading_heap = nullptr;
+      if (!handle) {
+        munmap(heap, heap_size);
+        return Status{
+            error::GoogleError::NOT_FOUND,
+            absl::StrCat("dlopen of ", path, " failed with: ", dlerror())};
+      }
+      (*loaded_images())[handle] = LoadedImage{reservation, 1};
+      client->dl_handle_ = handle;
+    }
   }
 
   // Resolve and set the enclave entry point trampoline.
@@ -85,12 +191,7 @@ StatusOr<std::shared_ptr<EnclaveClient>> SimBackend::Load(
   return client;
 }
 
-void SimEnclaveClient::Destroy() {
-  if (dl_handle_) {
-    dlclose(dl_handle_);
-    dl_handle_ = nullptr;
-  }
-}
+void SimEnclaveClient::Destroy() { ReleaseImage(); }
 
 Status SimEnclaveClient::EnclaveCallInternal(uint64_t selector,
                                              UntrustedParameterStack *params) {
@@ -108,5 +209,15 @@ Status SimEnclaveClient::EnclaveCallInternal(uint64_t selector,
 
 bool SimEnclaveClient::IsClosed() const { return dl_handle_ == nullptr; }
 
+// Functions below are dynamically linked to the enclave heap allocator.
+extern "C" void asylo_sim_heap_reservation(void **base, size_t *size) {
+  *base = loading_heap ? loading_heap->base : nullptr;
+  *size = loading_heap ? loading_heap->size : 0;
+}
+
+extern "C" int asylo_sim_heap_commit(void *addr, size_t size) {
+  return mprotect(addr, size, PROT_READ | PROT_WRITE);
+}
+
 }  // namespace primitives
 }  // namespace asylo
@@ -19,11 +19,11 @@
 #ifndef ASYLO_PLATFORM_PRIMITIVES_SIM_UNTRUSTED_SIM_H_
 #define ASYLO_PLATFORM_PRIMITIVES_SIM_UNTRUSTED_SIM_H_
 
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <string>
 
-#include "absl/container/flat_hash_map.h"
 #include "asylo/platform/primitives/sim/shared_sim.h"
 #include "asylo/platform/primitives/untrusted_primitives.h"
 #include "asylo/util/statusor.h"
@@ -44,12 +44,23 @@ namespace primitives {
 
 // Simulator implementation of the generic "EnclaveBackend" concept.
 struct SimBackend {
+  // Default size of the enclave heap in bytes, set here to 128 megabytes for
+  // rough parity with Intel SGX.
+  static constexpr size_t kDefaultHeapSize = 128 * 1024 * 1024;
+
   // Loads a simulation enclave from a file system path for the untrusted
   // application. Returns a client to the loaded enclave or an error status on
   // failure.
+  //
+  // The enclave heap is given |heap_size| bytes of reserved address space,
+  // rounded up to the page size. Memory is only committed as the enclave grows
+  // its heap, so a large reservation costs little for enclaves using less.
+  // Clients of an enclave which is already loaded share its existing heap, and
+  // the heap is released when the last of them is destroyed.
   static StatusOr<std::shared_ptr<EnclaveClient>> Load(
       const std::string &path,
-      std::unique_ptr<EnclaveClient::ExitCallProvider> exit_call_provider);
+      std::unique_ptr<EnclaveClient::ExitCallProvider> exit_call_provider,
+      size_t heap_size = kDefaultHeapSize);
 };
 
 // Simulator implementation of EnclaveClient.
@@ -70,6 +81,12 @@ class SimEnclaveClient : public EnclaveClient {
       std::unique_ptr<ExitCallProvider> exit_call_provider)
       : EnclaveClient(std::move(exit_call_provider)) {}
 
+  // Closes the enclave image, releasing its heap once no client uses it.
+  void ReleaseImage();
+
+  // Path of the enclave shared object file.
+  std::string path_;
+
   // Dynamic library handle for enclave instance loaded at runtime.
   void *dl_handle_ = nullptr;
 
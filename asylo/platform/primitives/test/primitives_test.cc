@@ -18,14 +18,17 @@
 
 #include <array>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <thread>
 #include <utility>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "absl/debugging/leak_check.h"
 #include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
 #include "asylo/platform/primitives/extent.h"
 #include "asylo/platform/primitives/parameter_stack.h"
 #include "asylo/platform/primitives/primitive_status.h"
@@ -55,8 +58,8 @@ class PrimitivesTest : public ::testing::Test {
   std::shared_ptr<EnclaveClient> LoadTestEnclaveOrDie(bool reload) {
     auto exit_call_provider = absl::make_unique<DispatchTable>();
     // Register init exit call invoked during test_enclave.cc initialization.
-    MockFunction<Status(std::shared_ptr<class EnclaveClient> enclave, void *,
-                        UntrustedParameterStack *params)>
+    MockFunction<Status(const std::shared_ptr<class EnclaveClient> &enclave,
+                        void *, UntrustedParameterStack *params)>
         mock_init_handler;
     if (reload) {
       EXPECT_CALL(mock_init_handler, Call(NotNull(), _, _))
@@ -92,6 +95,62 @@ int32_t MultiplyByTwoOrDie(const std::shared_ptr<EnclaveClient> &client,
   return res;
 }
 
+// Enters an instance of the test enclave with TrustedFibonacci(2), which makes
+// an exit call for kUntrustedFibonacci.
+Status EnterFibonacciTwo(const std::shared_ptr<EnclaveClient> &client) {
+  UntrustedParameterStack params;
+  *params.PushAlloc<int32_t>() = 2;
+  return client->EnclaveCall(kTrustedFibonacci, &params);
+}
+
+// Threads kept inside an enclave by HoldThreadHandler().
+struct HeldThreads {
+  absl::Mutex mu;
+
+  // Number of threads blocked in the exit handler.
+  size_t held GUARDED_BY(mu) = 0;
+
+  // Set to have each held thread enter the enclave again.
+  bool reenter GUARDED_BY(mu) = false;
+
+  // Number of nested entries which succeeded.
+  size_t reentered GUARDED_BY(mu) = 0;
+
+  // Set to let the held threads return.
+  bool release GUARDED_BY(mu) = false;
+};
+
+// Returns an exit handler for kUntrustedFibonacci which blocks its thread, and
+// so keeps the thread inside the enclave, until |held->release| is set.
+ExitHandler::Callback HoldThreadHandler(HeldThreads *held) {
+  return [held](const std::shared_ptr<EnclaveClient> &client, void *context,
+                UntrustedParameterStack *params) -> Status {
+    const int32_t n = params->Pop<int32_t>();
+    *params->PushAlloc<int32_t>() = n;
+    absl::MutexLock lock(&held->mu);
+    if (held->release) {
+      return Status::OkStatus();
+    }
+    ++held->held;
+    auto woken = [held]() EXCLUSIVE_LOCKS_REQUIRED(held->mu) {
+      return held->reenter || held->release;
+    };
+    held->mu.Await(absl::Condition(&woken));
+    if (!held->release) {
+      UntrustedParameterStack nested_params;
+      *nested_params.PushAlloc<int32_t>() = n;
+      held->mu.Unlock();
+      Status status = client->EnclaveCall(kTimesTwoSelector, &nested_params);
+      held->mu.Lock();
+      if (status.ok() && nested_params.Pop<int32_t>() == 2 * n) {
+        ++held->reentered;
+      }
+    }
+    held->mu.Await(absl::Condition(&held->release));
+    return Status::OkStatus();
+  };
+}
+
 // Ensure making an invalid call into an enclave returns an appropriate failure
 // status.
 
@@ -115,6 +174,37 @@ TEST_F(PrimitivesTest, BadCall) {
   EXPECT_THAT(status, Not(IsOk()));
 }
 
+// Ensure a batch of calls makes each call in order, and reports the result of
+// each call separately.
+TEST_F(PrimitivesTest, BatchCall) {
+  auto client = LoadTestEnclaveOrDie(/*reload=*/false);
+
+  constexpr int kNumCalls = 8;
+  std::array<UntrustedParameterStack, kNumCalls> params;
+  UntrustedParameterStack bad_params;
+  UntrustedParameterStack reserved_params;
+  std::vector<EnclaveClient::BatchCall> calls;
+  for (int i = 0; i < kNumCalls; i++) {
+    params[i].Push<int32_t>(i);
+    calls.emplace_back(kTimesTwoSelector, &params[i]);
+  }
+  calls.emplace_back(kNotRegisteredSelector, &bad_params);
+  calls.emplace_back(kSelectorAsyloFini, &reserved_params);
+
+  ASSERT_THAT(client->EnclaveCallBatch(&calls), IsOk());
+  for (int i = 0; i < kNumCalls; i++) {
+    EXPECT_THAT(calls[i].status, IsOk());
+    ASSERT_FALSE(params[i].empty());
+    EXPECT_THAT(params[i].Pop<int32_t>(), Eq(2 * i));
+    EXPECT_TRUE(params[i].empty());
+  }
+  EXPECT_THAT(calls[kNumCalls].status, Not(IsOk()));
+  EXPECT_THAT(calls[kNumCalls + 1].status, Not(IsOk()));
+
+  // The enclave is still usable, as the reserved selector was not called.
+  EXPECT_THAT(MultiplyByTwoOrDie(client, 21), Eq(42));
+}
+
 TEST_F(PrimitivesTest, EnclaveLifetime) {
   // Ensure that an enclave is not closed before its clients leave scope.
   auto client = LoadTestEnclaveOrDie(/*reload=*/false);
@@ -225,7 +315,7 @@ TEST_F(PrimitivesTest, CallChain) {
   // An exit handler to compute a Fibonacci number, calling back into the
   // enclave recursively.
   ExitHandler::Callback fibonacci_handler =
-      [&](std::shared_ptr<EnclaveClient> client, void *context,
+      [&](const std::shared_ptr<EnclaveClient> &client, void *context,
           UntrustedParameterStack *params) -> Status {
     if (params->empty()) {
       return Status{error::GoogleError::INVALID_ARGUMENT,
@@ -270,6 +360,100 @@ TEST_F(PrimitivesTest, ThreadedTest) {
   }
 }
 
+// Ensure an entry fails once every enclave thread is held by another thread,
+// and that threads holding an enclave thread can still enter it from an exit
+// call.
+TEST_F(PrimitivesTest, ThreadLimit) {
+  const size_t max_threads = test::TestBackend::Get()->MaxEnclaveThreads();
+  if (max_threads == 0) {
+    // The backend does not bound the number of threads inside an enclave.
+    return;
+  }
+  auto client = LoadTestEnclaveOrDie(/*reload=*/false);
+  HeldThreads held;
+  ASSERT_THAT(client->exit_call_provider()->RegisterExitHandler(
+                  kUntrustedFibonacci, ExitHandler{HoldThreadHandler(&held)}),
+              IsOk());
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < max_threads; i++) {
+    threads.emplace_back(
+        [&client]() { EXPECT_THAT(EnterFibonacciTwo(client), IsOk()); });
+  }
+  {
+    absl::MutexLock lock(&held.mu);
+    auto all_held = [&held, max_threads]() EXCLUSIVE_LOCKS_REQUIRED(held.mu) {
+      return held.held == max_threads;
+    };
+    held.mu.Await(absl::Condition(&all_held));
+  }
+
+  UntrustedParameterStack params;
+  *params.PushAlloc<int32_t>() = 1;
+  EXPECT_THAT(client->EnclaveCall(kTimesTwoSelector, &params),
+              StatusIs(error::GoogleError::RESOURCE_EXHAUSTED));
+
+  // Entries nested in an exit call reuse the enclave thread of their thread.
+  {
+    absl::MutexLock lock(&held.mu);
+    held.reenter = true;
+    auto done = [&held, max_threads]() EXCLUSIVE_LOCKS_REQUIRED(held.mu) {
+      return held.reentered == max_threads;
+    };
+    held.mu.Await(absl::Condition(&done));
+    held.release = true;
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // The enclave threads are released once their threads return.
+  EXPECT_THAT(MultiplyByTwoOrDie(client, 21), Eq(42));
+}
+
+// Ensure as many threads as the enclave has threads can enter and leave it
+// concurrently through nested exit calls.
+TEST_F(PrimitivesTest, ConcurrentNestedCalls) {
+  size_t num_threads = test::TestBackend::Get()->MaxEnclaveThreads();
+  if (num_threads == 0) {
+    num_threads = 64;
+  }
+  auto client = LoadTestEnclaveOrDie(/*reload=*/false);
+
+  std::function<int32_t(int32_t)> trusted_fibonacci =
+      [&client](int32_t n) -> int32_t {
+    UntrustedParameterStack params;
+    *params.PushAlloc<int32_t>() = n;
+    Status status = client->EnclaveCall(kTrustedFibonacci, &params);
+    EXPECT_THAT(status, IsOk());
+    return status.ok() ? params.Pop<int32_t>() : -1;
+  };
+  ExitHandler::Callback fibonacci_handler =
+      [&trusted_fibonacci](const std::shared_ptr<EnclaveClient> &client,
+                           void *context,
+                           UntrustedParameterStack *params) -> Status {
+    const int32_t n = params->Pop<int32_t>();
+    *params->PushAlloc<int32_t>() =
+        n < 2 ? n : trusted_fibonacci(n - 1) + trusted_fibonacci(n - 2);
+    return Status::OkStatus();
+  };
+  ASSERT_THAT(client->exit_call_provider()->RegisterExitHandler(
+                  kUntrustedFibonacci, ExitHandler{fibonacci_handler}),
+              IsOk());
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_threads; i++) {
+    threads.emplace_back([&trusted_fibonacci]() {
+      for (int round = 0; round < 4; round++) {
+        EXPECT_THAT(trusted_fibonacci(10), Eq(55));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
 // Ensure the buffers returned by trusted malloc satisfy
 // TrustedPrimitives::IsTrustedExtent().
 TEST_F(PrimitivesTest, TrustedMalloc) {
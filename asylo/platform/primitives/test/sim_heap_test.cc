@@ -0,0 +1,231 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/memory/memory.h"
+#include "gflags/gflags.h"
+#include "asylo/platform/primitives/sim/untrusted_sim.h"
+#include "asylo/platform/primitives/test/test_selectors.h"
+#include "asylo/platform/primitives/untrusted_primitives.h"
+#include "asylo/platform/primitives/util/dispatch_table.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/util/status.h"
+
+DEFINE_string(enclave_binary, "",
+              "Path to the Sim enclave binary to be loaded");
+
+using ::testing::Eq;
+using ::testing::Gt;
+using ::testing::Ne;
+using ::testing::Not;
+
+namespace asylo {
+namespace primitives {
+namespace {
+
+constexpr size_t kMiB = 1024 * 1024;
+
+// Loads the heap test enclave with a heap of |heap_size| bytes.
+std::shared_ptr<EnclaveClient> LoadEnclaveOrDie(size_t heap_size) {
+  auto client_or_status = SimBackend::Load(
+      FLAGS_enclave_binary, absl::make_unique<DispatchTable>(), heap_size);
+  EXPECT_THAT(client_or_status, IsOk());
+  return client_or_status.ValueOrDie();
+}
+
+// Returns the bounds of the enclave heap as [begin, end).
+std::pair<uintptr_t, uintptr_t> HeapBounds(
+    const std::shared_ptr<EnclaveClient> &client) {
+  UntrustedParameterStack params;
+  EXPECT_THAT(client->EnclaveCall(kHeapBoundsSelector, &params), IsOk());
+  const uint64_t end = params.Pop<uint64_t>();
+  const uint64_t begin = params.Pop<uint64_t>();
+  return {begin, end};
+}
+
+// Moves the enclave break by |increment| bytes. Returns the previous break, or
+// zero on failure.
+uintptr_t Sbrk(const std::shared_ptr<EnclaveClient> &client,
+               int64_t increment) {
+  UntrustedParameterStack params;
+  params.Push<int64_t>(increment);
+  EXPECT_THAT(client->EnclaveCall(kSbrkSelector, &params), IsOk());
+  return params.Pop<uint64_t>();
+}
+
+// Checks |size| bytes at |addr| with the enclave entry point |selector|.
+bool CheckExtent(const std::shared_ptr<EnclaveClient> &client,
+                 uint64_t selector, uintptr_t addr, size_t size) {
+  UntrustedParameterStack params;
+  params.Push<uint64_t>(addr);
+  params.Push<uint64_t>(size);
+  EXPECT_THAT(client->EnclaveCall(selector, &params), IsOk());
+  return params.Pop<bool>();
+}
+
+// Returns whether the enclave considers |size| bytes at |addr| trusted.
+bool IsTrustedExtent(const std::shared_ptr<EnclaveClient> &client,
+                     uintptr_t addr, size_t size) {
+  return CheckExtent(client, kIsTrustedExtentSelector, addr, size);
+}
+
+// Returns whether a trusted parameter stack may write its arena at |size|
+// bytes at |addr|.
+bool IsArenaWritable(const std::shared_ptr<EnclaveClient> &client,
+                     uintptr_t addr, size_t size) {
+  return CheckExtent(client, kArenaWritableSelector, addr, size);
+}
+
+// Returns the permissions of the mapping containing |addr|, as listed in
+// /proc/self/maps, or an empty string if |addr| is not mapped.
+std::string MappingPermissions(uintptr_t addr) {
+  std::ifstream maps("/proc/self/maps");
+  std::string line;
+  while (std::getline(maps, line)) {
+    std::istringstream fields(line);
+    uintptr_t begin;
+    uintptr_t end;
+    char dash;
+    std::string permissions;
+    fields >> std::hex >> begin >> dash >> end >> permissions;
+    if (begin <= addr && addr < end) {
+      return permissions;
+    }
+  }
+  return "";
+}
+
+// Ensure the heap spans the requested size, rounded up to the page size.
+TEST(SimHeapTest, HeapSize) {
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  auto client = LoadEnclaveOrDie(4 * kMiB + 1);
+  auto bounds = HeapBounds(client);
+  EXPECT_THAT(bounds.second - bounds.first, Eq(4 * kMiB + page_size));
+
+  EXPECT_THAT(SimBackend::Load(FLAGS_enclave_binary,
+                               absl::make_unique<DispatchTable>(),
+                               /*heap_size=*/0),
+              Not(IsOk()));
+}
+
+// Ensure the heap cannot grow past its reservation.
+TEST(SimHeapTest, SbrkLimit) {
+  auto client = LoadEnclaveOrDie(4 * kMiB);
+  auto bounds = HeapBounds(client);
+  const uintptr_t brk = Sbrk(client, 0);
+  ASSERT_THAT(brk, Ne(0));
+
+  EXPECT_THAT(Sbrk(client, bounds.second - brk + 1), Eq(0));
+  EXPECT_THAT(Sbrk(client, bounds.first - brk - 1), Eq(0));
+  EXPECT_THAT(Sbrk(client, 0), Eq(brk));
+
+  EXPECT_THAT(Sbrk(client, bounds.second - brk), Eq(brk));
+  EXPECT_THAT(Sbrk(client, 1), Eq(0));
+  EXPECT_THAT(Sbrk(client, brk - bounds.second), Eq(bounds.second));
+}
+
+// Ensure heap memory is only committed as the break grows.
+TEST(SimHeapTest, CommitsOnDemand) {
+  auto client = LoadEnclaveOrDie(64 * kMiB);
+  const uintptr_t brk = Sbrk(client, 0);
+  ASSERT_THAT(brk, Ne(0));
+  const uintptr_t probe = brk + 16 * kMiB;
+  EXPECT_THAT(MappingPermissions(probe), Eq("---p"));
+
+  ASSERT_THAT(Sbrk(client, 16 * kMiB + 1), Eq(brk));
+  EXPECT_THAT(MappingPermissions(probe), Eq("rw-p"));
+  EXPECT_THAT(Sbrk(client, -(16 * kMiB + 1)), Gt(brk));
+}
+
+// Ensure the whole heap, committed or not, is trusted, and memory beyond it
+// is not.
+TEST(SimHeapTest, HeapIsTrusted) {
+  auto client = LoadEnclaveOrDie(4 * kMiB);
+  auto bounds = HeapBounds(client);
+  const size_t size = bounds.second - bounds.first;
+  EXPECT_TRUE(IsTrustedExtent(client, bounds.first, size));
+  EXPECT_TRUE(IsTrustedExtent(client, bounds.second - 1, 1));
+  EXPECT_FALSE(IsTrustedExtent(client, bounds.second, 1));
+  EXPECT_FALSE(IsTrustedExtent(client, bounds.first - 1, 1));
+
+  int untrusted;
+  EXPECT_FALSE(IsTrustedExtent(client, reinterpret_cast<uintptr_t>(&untrusted),
+                               sizeof(untrusted)));
+}
+
+// Ensure a trusted parameter stack does not place arena items overlapping the
+// heap, including items straddling either of its bounds.
+TEST(SimHeapTest, ArenaAvoidsHeap) {
+  auto client = LoadEnclaveOrDie(4 * kMiB);
+  auto bounds = HeapBounds(client);
+  EXPECT_FALSE(IsArenaWritable(client, bounds.first, 16));
+  EXPECT_FALSE(IsArenaWritable(client, bounds.first - 8, 16));
+  EXPECT_FALSE(IsArenaWritable(client, bounds.second - 8, 16));
+  EXPECT_FALSE(IsArenaWritable(client, bounds.first - 8, SIZE_MAX));
+  EXPECT_TRUE(IsArenaWritable(client, bounds.first - 16, 16));
+  EXPECT_TRUE(IsArenaWritable(client, bounds.second, 16));
+
+  // Neither bound is a trusted extent when straddled.
+  EXPECT_FALSE(IsTrustedExtent(client, bounds.first - 8, 16));
+  EXPECT_FALSE(IsTrustedExtent(client, bounds.second - 8, 16));
+}
+
+// Ensure clients of an image which is already loaded share its heap, which
+// stays mapped until the last of them is destroyed.
+TEST(SimHeapTest, ClientsShareHeap) {
+  auto first = LoadEnclaveOrDie(4 * kMiB);
+  auto second = LoadEnclaveOrDie(8 * kMiB);
+  auto bounds = HeapBounds(first);
+  EXPECT_THAT(HeapBounds(second), Eq(bounds));
+
+  first->Destroy();
+  EXPECT_THAT(HeapBounds(second), Eq(bounds));
+  EXPECT_THAT(MappingPermissions(bounds.first), Ne(""));
+  const uintptr_t brk = Sbrk(second, 0);
+  ASSERT_THAT(Sbrk(second, bounds.second - brk), Eq(brk));
+  EXPECT_THAT(MappingPermissions(bounds.second - 1), Eq("rw-p"));
+  EXPECT_THAT(Sbrk(second, brk - bounds.second), Eq(bounds.second));
+
+  second->Destroy();
+  auto third = LoadEnclaveOrDie(8 * kMiB);
+  auto new_bounds = HeapBounds(third);
+  EXPECT_TRUE(IsTrustedExtent(third, new_bounds.first,
+                              new_bounds.second - new_bounds.first));
+}
+
+}  // namespace
+}  // namespace primitives
+}  // namespace asylo
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  ::google::ParseCommandLineFlags(&argc, &argv,
+                                  /*remove_flags=*/ true);
+
+  return RUN_ALL_TESTS();
+}
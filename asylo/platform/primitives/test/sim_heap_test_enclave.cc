@@ -0,0 +1,145 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <cstdint>
+
+#include "asylo/platform/primitives/extent.h"
+#include "asylo/platform/primitives/parameter_stack.h"
+#include "asylo/platform/primitives/primitive_status.h"
+#include "asylo/platform/primitives/test/test_selectors.h"
+#include "asylo/platform/primitives/trusted_primitives.h"
+#include "asylo/util/error_codes.h"
+#include "asylo/util/status_macros.h"
+
+// The simulator break allocator backing the enclave heap.
+extern "C" void *enclave_sbrk(intptr_t increment);
+
+namespace asylo {
+namespace primitives {
+
+namespace {
+
+// Returns true if a call to enclave_sbrk() succeeded.
+bool SbrkSucceeded(void *result) {
+  return result != reinterpret_cast<void *>(INT64_C(-1));
+}
+
+// Moves the break as far as it goes in the direction of |sign|, and returns
+// the break reached. The break is moved in decreasing steps so it ends up at
+// the exact limit of the heap.
+uint8_t *MoveBreakToLimit(intptr_t sign) {
+  for (intptr_t step = INT64_C(1) << 40; step > 0; step /= 2) {
+    while (SbrkSucceeded(enclave_sbrk(sign * step))) {
+    }
+  }
+  return static_cast<uint8_t *>(enclave_sbrk(0));
+}
+
+// Finds the bounds of the enclave heap by moving the break to either end of
+// it, then restores the break. Nothing may be allocated from the heap while the
+// break is moved. Parameters are two OUTs, the heap begin and end addresses.
+PrimitiveStatus HeapBounds(void *context, TrustedParameterStack *params) {
+  if (!params->empty()) {
+    return {error::GoogleError::INVALID_ARGUMENT,
+            "HeapBounds called with incorrect argument(s)."};
+  }
+  uint8_t *const brk = static_cast<uint8_t *>(enclave_sbrk(0));
+  uint8_t *const end = MoveBreakToLimit(1);
+  enclave_sbrk(brk - end);
+  uint8_t *const begin = MoveBreakToLimit(-1);
+  enclave_sbrk(brk - begin);
+  *params->PushAlloc<uint64_t>() = reinterpret_cast<uint64_t>(begin);
+  *params->PushAlloc<uint64_t>() = reinterpret_cast<uint64_t>(end);
+  return PrimitiveStatus::OkStatus();
+}
+
+// Moves the break by the increment passed as the only input item, and returns
+// the previous break, or zero on failure.
+PrimitiveStatus Sbrk(void *context, TrustedParameterStack *params) {
+  if (params->empty()) {
+    return {error::GoogleError::INVALID_ARGUMENT,
+            "Sbrk called with incorrect argument(s)."};
+  }
+  const int64_t increment = params->Pop<int64_t>();
+  if (!params->empty()) {
+    return {error::GoogleError::INVALID_ARGUMENT,
+            "Sbrk called with incorrect argument(s)."};
+  }
+  void *result = enclave_sbrk(increment);
+  *params->PushAlloc<uint64_t>() =
+      SbrkSucceeded(result) ? reinterpret_cast<uint64_t>(result) : 0;
+  return PrimitiveStatus::OkStatus();
+}
+
+// Pops an address and size pushed in that order, and pushes the result of
+// |predicate| applied to them.
+PrimitiveStatus CheckExtent(bool (*predicate)(const void *, size_t),
+                            TrustedParameterStack *params) {
+  if (params->empty()) {
+    return {error::GoogleError::INVALID_ARGUMENT,
+            "Extent check called with incorrect argument(s)."};
+  }
+  const uint64_t size = params->Pop<uint64_t>();
+  if (params->empty()) {
+    return {error::GoogleError::INVALID_ARGUMENT,
+            "Extent check called with incorrect argument(s)."};
+  }
+  const uint64_t addr = params->Pop<uint64_t>();
+  if (!params->empty()) {
+    return {error::GoogleError::INVALID_ARGUMENT,
+            "Extent check called with incorrect argument(s)."};
+  }
+  *params->PushAlloc<bool>() = predicate(reinterpret_cast<void *>(addr), size);
+  return PrimitiveStatus::OkStatus();
+}
+
+// Checks TrustedPrimitives::IsTrustedExtent() on the address and size passed
+// as input items, in that order. Parameter is a single OUT.
+PrimitiveStatus IsTrustedExtent(void *context, TrustedParameterStack *params) {
+  return CheckExtent(TrustedPrimitives::IsTrustedExtent, params);
+}
+
+// Checks whether a trusted parameter stack may place arena items at the
+// address and size passed as input items, in that order. Parameter is a single
+// OUT.
+PrimitiveStatus ArenaWritable(void *context, TrustedParameterStack *params) {
+  return CheckExtent(
+      ParameterStackMemory<TrustedPrimitives::UntrustedLocalAlloc>::IsWritable,
+      params);
+}
+
+}  // namespace
+
+extern "C" PrimitiveStatus asylo_enclave_init() {
+  ASYLO_RETURN_IF_ERROR(TrustedPrimitives::RegisterEntryHandler(
+      kHeapBoundsSelector, EntryHandler{HeapBounds}));
+  ASYLO_RETURN_IF_ERROR(TrustedPrimitives::RegisterEntryHandler(
+      kSbrkSelector, EntryHandler{Sbrk}));
+  ASYLO_RETURN_IF_ERROR(TrustedPrimitives::RegisterEntryHandler(
+      kIsTrustedExtentSelector, EntryHandler{IsTrustedExtent}));
+  ASYLO_RETURN_IF_ERROR(TrustedPrimitives::RegisterEntryHandler(
+      kArenaWritableSelector, EntryHandler{ArenaWritable}));
+  return PrimitiveStatus::OkStatus();
+}
+
+extern "C" PrimitiveStatus asylo_enclave_fini() {
+  return PrimitiveStatus::OkStatus();
+}
+
+}  // namespace primitives
+}  // namespace asylo
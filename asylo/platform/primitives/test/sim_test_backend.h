@@ -38,6 +38,10 @@ class SimTestBackend : public TestBackend {
 
   // Signals to ignore memory leak checking on abort tests.
   bool LeaksMemoryOnAbort() override { return true; }
+
+  // The simulator has as many thread contexts as it models SGX thread control
+  // structures.
+  size_t MaxEnclaveThreads() override { return 64; }
 };
 
 }  // namespace test
@@ -19,6 +19,7 @@
 #ifndef ASYLO_PLATFORM_PRIMITIVES_TEST_TEST_BACKEND_H_
 #define ASYLO_PLATFORM_PRIMITIVES_TEST_TEST_BACKEND_H_
 
+#include <cstddef>
 #include <memory>
 
 #include "asylo/platform/primitives/untrusted_primitives.h"
@@ -49,6 +50,10 @@ class TestBackend {
   // Allows to ignore memory leak checking on abort tests. Off by default.
   virtual bool LeaksMemoryOnAbort() { return false; }
 
+  // Returns the number of threads which may be inside an enclave at once, or 0
+  // if the backend does not bound it.
+  virtual size_t MaxEnclaveThreads() { return 0; }
+
  private:
   // Loads an instance of an enclave, aborting on failure.
   virtual StatusOr<std::shared_ptr<EnclaveClient>> LoadTestEnclave(
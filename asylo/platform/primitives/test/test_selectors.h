@@ -33,6 +33,12 @@ constexpr uint64_t kTrustedFibonacci = kSelectorUser + 3;
 constexpr uint64_t kTrustedMallocTest = kSelectorUser + 4;
 constexpr uint64_t kUntrustedLocalAllocTest = kSelectorUser + 5;
 
+// Entry points registered by the simulator heap test enclave.
+constexpr uint64_t kHeapBoundsSelector = kSelectorUser + 6;
+constexpr uint64_t kSbrkSelector = kSelectorUser + 7;
+constexpr uint64_t kIsTrustedExtentSelector = kSelectorUser + 8;
+constexpr uint64_t kArenaWritableSelector = kSelectorUser + 9;
+
 // Entry point with no registered handler.
 constexpr uint64_t kNotRegisteredSelector = kSelectorUser + 100;
 
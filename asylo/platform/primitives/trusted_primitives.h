@@ -59,6 +59,12 @@ class TrustedPrimitives {
   static bool IsTrustedExtent(const void *addr,
                               size_t size) ASYLO_MUST_USE_RESULT;
 
+  // Returns true if no byte of a `size` byte value at an address `addr` falls
+  // inside the TCB. Unlike the negation of IsTrustedExtent, this is false for a
+  // value straddling the boundary of trusted memory.
+  static bool IsUntrustedExtent(const void *addr,
+                                size_t size) ASYLO_MUST_USE_RESULT;
+
   // Allocates `size` bytes of untrusted local memory, which must later be freed
   // by calling UntrustedLocalFree or by free call in local untrusted code.
   // Local untrusted memory is addressable by the enclave directly, but its
@@ -91,6 +97,16 @@ class TrustedPrimitives {
       ASYLO_MUST_USE_RESULT;
 };
 
+// A ParameterStack used by trusted code is in untrusted memory, so the host
+// may redirect its arena. The stack never writes arena memory overlapping the
+// enclave.
+template <>
+struct ParameterStackMemory<TrustedPrimitives::UntrustedLocalAlloc> {
+  static bool IsWritable(const void *addr, size_t size) {
+    return TrustedPrimitives::IsUntrustedExtent(addr, size);
+  }
+};
+
 // ParameterStack to be used in trusted code.
 using TrustedParameterStack =
     ParameterStack<TrustedPrimitives::UntrustedLocalAlloc,
@@ -21,35 +21,64 @@
 #include <cstdint>
 #include <memory>
 #include <utility>
+#include <vector>
 
+#include "asylo/platform/common/call_metrics.h"
+#include "asylo/platform/primitives/batched_call.h"
 #include "asylo/platform/primitives/extent.h"
 #include "asylo/platform/primitives/primitive_status.h"
 #include "asylo/platform/primitives/primitives.h"
 #include "asylo/platform/primitives/util/status_conversions.h"
 #include "asylo/util/asylo_macros.h"
 #include "asylo/util/status.h"
+#include "asylo/util/status_macros.h"
 #include "asylo/util/statusor.h"
 
 namespace asylo {
 namespace primitives {
 
-thread_local EnclaveClient *EnclaveClient::current_client_ = nullptr;
+thread_local const std::shared_ptr<EnclaveClient>
+    *EnclaveClient::current_client_ = nullptr;
 
 Status EnclaveClient::EnclaveCall(uint64_t selector,
                                   UntrustedParameterStack *params) {
-  ScopedCurrentClient scoped_client(this);
+  // Take the reference passed to exit handlers once per entry rather than once
+  // per exit.
+  const std::shared_ptr<EnclaveClient> self = shared_from_this();
+  ScopedCurrentClient scoped_client(self);
+  ScopedCallTimer call_timer(
+      CallMetricsRegistry::GetInstance()->GetCounter(CallMetric::ECALL,
+                                                     selector));
   return EnclaveCallInternal(selector, params);
 }
 
+Status EnclaveClient::EnclaveCallBatch(std::vector<BatchCall> *calls) {
+  if (calls->empty()) {
+    return Status::OkStatus();
+  }
+  std::vector<BatchedCall> records(calls->size());
+  for (size_t i = 0; i < calls->size(); i++) {
+    records[i].selector = (*calls)[i].selector;
+    records[i].params = (*calls)[i].params;
+  }
+  UntrustedParameterStack params;
+  params.Push(Extent{records.data(), records.size()});
+  ASYLO_RETURN_IF_ERROR(EnclaveCall(kSelectorAsyloBatch, &params));
+  for (size_t i = 0; i < calls->size(); i++) {
+    (*calls)[i].status = MakeStatus(records[i].status);
+  }
+  return Status::OkStatus();
+}
+
 PrimitiveStatus EnclaveClient::ExitCallback(uint64_t untrusted_selector,
                                             UntrustedParameterStack *params) {
-  if (!current_client_->exit_call_provider()) {
+  const std::shared_ptr<EnclaveClient> &client = *current_client_;
+  if (!client->exit_call_provider()) {
     return PrimitiveStatus{error::GoogleError::FAILED_PRECONDITION,
                            "Exit call provider not set yet"};
   }
-  return MakePrimitiveStatus(
-      current_client_->exit_call_provider()->InvokeExitHandler(
-          untrusted_selector, params, current_client_));
+  return MakePrimitiveStatus(client->exit_call_provider()->InvokeExitHandler(
+      untrusted_selector, params, client));
 }
 
 // External functions below need to be dynamically linked to the loaded enclave
@@ -22,6 +22,7 @@
 #include <cstdint>
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include "asylo/platform/primitives/extent.h"
 #include "asylo/platform/primitives/parameter_stack.h"
@@ -57,9 +58,9 @@ StatusOr<std::shared_ptr<class EnclaveClient>> LoadEnclave(Args &&... args) {
 
 // Callback structure for dispatching messages from the enclave.
 struct ExitHandler {
-  using Callback =
-      std::function<Status(std::shared_ptr<class EnclaveClient> enclave, void *,
-                           ParameterStack<malloc, free> *)>;
+  using Callback = std::function<Status(
+      const std::shared_ptr<class EnclaveClient> &enclave, void *,
+      ParameterStack<malloc, free> *)>;
 
   ExitHandler() : context(nullptr) {}
 
@@ -106,24 +107,36 @@ class EnclaveClient : public std::enable_shared_from_this<EnclaveClient> {
     // Finds and invokes an exit handler. Returns an error status on failure.
     virtual Status InvokeExitHandler(
         uint64_t untrusted_selector, UntrustedParameterStack *params,
-        EnclaveClient *client) ASYLO_MUST_USE_RESULT = 0;
+        const std::shared_ptr<EnclaveClient> &client) ASYLO_MUST_USE_RESULT = 0;
+
+    // Declares that no more exit handlers will be registered, allowing the
+    // provider to optimize dispatch. Returns an error status if the provider
+    // cannot be frozen.
+    virtual Status Freeze() ASYLO_MUST_USE_RESULT {
+      return Status::OkStatus();
+    }
   };
 
   // RAII wrapper that sets thread-local enclave client reference and resets
-  // it when going out of scope.
+  // it when going out of scope. The reference is passed to exit handlers, so
+  // `client` must outlive the wrapper.
   class ScopedCurrentClient {
    public:
-    explicit ScopedCurrentClient(EnclaveClient *client)
+    explicit ScopedCurrentClient(const std::shared_ptr<EnclaveClient> &client)
         : saved_client_(EnclaveClient::current_client_) {
-      current_client_ = client;
+      current_client_ = &client;
     }
     ~ScopedCurrentClient() { current_client_ = saved_client_; }
 
+    // Disallow temporaries, which would not outlive the wrapper.
+    explicit ScopedCurrentClient(std::shared_ptr<EnclaveClient> &&client) =
+        delete;
+
     ScopedCurrentClient(const ScopedCurrentClient &other) = delete;
     ScopedCurrentClient &operator=(const ScopedCurrentClient &other) = delete;
 
    private:
-    EnclaveClient *saved_client_;
+    const std::shared_ptr<EnclaveClient> *saved_client_;
   };
 
   virtual ~EnclaveClient() = default;
@@ -138,13 +151,37 @@ class EnclaveClient : public std::enable_shared_from_this<EnclaveClient> {
   virtual void Destroy() = 0;
 
   // Enters the enclave synchronously at an entry point to trusted code
-  // designated by `selector`.
+  // designated by `selector`. The client must be owned by a std::shared_ptr,
+  // which is passed to the exit handlers invoked during the call.
   // Input `params` is copied into the enclave, which occurs locally inside the
   // same address space.
   // Conversely, results are copied and returned in 'params'.
   Status EnclaveCall(uint64_t selector,
                      UntrustedParameterStack *params) ASYLO_MUST_USE_RESULT;
 
+  // A call made as part of a batch by EnclaveCallBatch.
+  struct BatchCall {
+    BatchCall(uint64_t selector, UntrustedParameterStack *params)
+        : selector(selector), params(params) {}
+
+    // Entry point to trusted code to call.
+    uint64_t selector;
+
+    // Inputs and results of the call, as for EnclaveCall.
+    UntrustedParameterStack *params;
+
+    // Result of the call, set by EnclaveCallBatch.
+    Status status;
+  };
+
+  // Enters the enclave once to make each call of `calls` in order, amortizing
+  // the cost of entering the enclave over the batch. Returns an error status if
+  // the batch could not be delivered, in which case no call status is set.
+  // Otherwise, the result of each call is stored in its `status`, and a failed
+  // call does not prevent the later calls of the batch. Calls to selectors
+  // reserved by the runtime fail.
+  Status EnclaveCallBatch(std::vector<BatchCall> *calls) ASYLO_MUST_USE_RESULT;
+
   // Enclave exit callback function shared with the enclave.
   static PrimitiveStatus ExitCallback(uint64_t untrusted_selector,
                                       UntrustedParameterStack *params);
@@ -167,7 +204,7 @@ class EnclaveClient : public std::enable_shared_from_this<EnclaveClient> {
 
   // Thread-local reference to the enclave that makes exit call.
   // Can be set by EnclaveCall, enclave loader.
-  static thread_local EnclaveClient *current_client_;
+  static thread_local const std::shared_ptr<EnclaveClient> *current_client_;
 };
 
 }  // namespace primitives
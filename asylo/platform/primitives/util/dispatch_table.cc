@@ -17,6 +17,8 @@
  */
 
 #include "asylo/platform/primitives/util/dispatch_table.h"
+
+#include <algorithm>
 #include <memory>
 
 #include "absl/synchronization/mutex.h"
@@ -24,6 +26,8 @@
 namespace asylo {
 namespace primitives {
 
+constexpr uint64_t DispatchTable::kMaxFrozenSelector;
+
 // Registers a callback as the handler routine for an enclave exit point
 // `untrusted_selector`. Returns an error code if a handler has already been
 // registered for `trusted_selector` or if an invalid selector value is
@@ -32,20 +36,38 @@ Status DispatchTable::RegisterExitHandler(uint64_t untrusted_selector,
                                           const ExitHandler &handler) {
   // Ensure no handler is installed for untrusted_selector.
   absl::MutexLock lock(&mutex_);
+  if (frozen_.load(std::memory_order_relaxed)) {
+    return {error::GoogleError::FAILED_PRECONDITION,
+            "RegisterExitHandler called on a frozen dispatch table."};
+  }
   auto it = exit_table_.find(untrusted_selector);
   if (it != exit_table_.end()) {
     return {error::GoogleError::ALREADY_EXISTS,
             "Invalid selector in RegisterExitHandler."};
   }
-  exit_table_.emplace(untrusted_selector, handler);
+  CallCounter *counter = CallMetricsRegistry::GetInstance()->GetCounter(
+      CallMetric::EXIT_HANDLER, untrusted_selector);
+  exit_table_.emplace(untrusted_selector, ExitTableEntry{handler, counter});
   return Status::OkStatus();
 }
 
 // Finds and invokes an exit handler, setting an error status on failure.
-Status DispatchTable::InvokeExitHandler(uint64_t untrusted_selector,
-                                        UntrustedParameterStack *params,
-                                        EnclaveClient *client) {
+Status DispatchTable::InvokeExitHandler(
+    uint64_t untrusted_selector, UntrustedParameterStack *params,
+    const std::shared_ptr<EnclaveClient> &client) {
+  if (frozen_.load(std::memory_order_acquire)) {
+    if (untrusted_selector >= frozen_table_.size() ||
+        frozen_table_[untrusted_selector].handler.IsNull()) {
+      return {error::GoogleError::OUT_OF_RANGE,
+              "Invalid selector in enclave exit."};
+    }
+    const ExitTableEntry &entry = frozen_table_[untrusted_selector];
+    ScopedCallTimer call_timer(entry.counter);
+    return entry.handler.callback(client, entry.handler.context, params);
+  }
+
   ExitHandler *handler;
+  CallCounter *counter;
   {
     absl::ReaderMutexLock lock(&mutex_);
     auto it = exit_table_.find(untrusted_selector);
@@ -53,10 +75,34 @@ Status DispatchTable::InvokeExitHandler(uint64_t untrusted_selector,
       return {error::GoogleError::OUT_OF_RANGE,
               "Invalid selector in enclave exit."};
     }
-    handler = &it->second;
+    handler = &it->second.handler;
+    counter = it->second.counter;
   }
-  return handler->callback(client->shared_from_this(), handler->context,
-                           params);
+  ScopedCallTimer call_timer(counter);
+  return handler->callback(client, handler->context, params);
+}
+
+// Converts the table to an array read without locking.
+Status DispatchTable::Freeze() {
+  absl::MutexLock lock(&mutex_);
+  if (frozen_.load(std::memory_order_relaxed)) {
+    return Status::OkStatus();
+  }
+  uint64_t max_selector = 0;
+  for (const auto &entry : exit_table_) {
+    max_selector = std::max(max_selector, entry.first);
+  }
+  if (max_selector > kMaxFrozenSelector) {
+    return {error::GoogleError::OUT_OF_RANGE,
+            "Selector too large to freeze the dispatch table."};
+  }
+  frozen_table_.resize(exit_table_.empty() ? 0 : max_selector + 1,
+                       ExitTableEntry{ExitHandler(), nullptr});
+  for (const auto &entry : exit_table_) {
+    frozen_table_[entry.first] = entry.second;
+  }
+  frozen_.store(true, std::memory_order_release);
+  return Status::OkStatus();
 }
 
 }  // namespace primitives
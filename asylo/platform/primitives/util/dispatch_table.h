@@ -19,9 +19,15 @@
 #ifndef ASYLO_PLATFORM_PRIMITIVES_UTIL_DISPATCH_TABLE_H_
 #define ASYLO_PLATFORM_PRIMITIVES_UTIL_DISPATCH_TABLE_H_
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 #include "absl/base/thread_annotations.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/synchronization/mutex.h"
+#include "asylo/platform/common/call_metrics.h"
 #include "asylo/platform/primitives/parameter_stack.h"
 #include "asylo/platform/primitives/untrusted_primitives.h"
 #include "asylo/util/asylo_macros.h"
@@ -30,14 +36,21 @@ namespace asylo {
 namespace primitives {
 
 // Implementation of ExitCallProvider based on dispatch table (thread safe).
+//
+// Until it is frozen, the table is a hash map guarded by a mutex. Freeze()
+// converts it to an immutable array indexed by selector, which exits then read
+// without locking.
 class DispatchTable : public EnclaveClient::ExitCallProvider {
  public:
-  DispatchTable() = default;
+  // Largest selector a frozen table can hold.
+  static constexpr uint64_t kMaxFrozenSelector = 4095;
+
+  DispatchTable() : frozen_(false) {}
 
   // Registers a callback as the handler routine for an enclave exit point
   // `untrusted_selector`. Returns an error code if a handler has already been
-  // registered for `trusted_selector` or if an invalid selector value is
-  // passed.
+  // registered for `trusted_selector`, if an invalid selector value is
+  // passed, or if the table is frozen.
   Status RegisterExitHandler(uint64_t untrusted_selector,
                              const ExitHandler &handler) override
       ASYLO_MUST_USE_RESULT LOCKS_EXCLUDED(mutex_);
@@ -45,12 +58,30 @@ class DispatchTable : public EnclaveClient::ExitCallProvider {
   // Finds and invokes an exit handler, setting an error status on failure.
   Status InvokeExitHandler(uint64_t untrusted_selector,
                            UntrustedParameterStack *params,
-                           EnclaveClient *client) override ASYLO_MUST_USE_RESULT
-      LOCKS_EXCLUDED(mutex_);
+                           const std::shared_ptr<EnclaveClient> &client)
+      override ASYLO_MUST_USE_RESULT LOCKS_EXCLUDED(mutex_);
+
+  // Converts the table to an array read without locking. Returns an error if
+  // a handler is registered for a selector larger than kMaxFrozenSelector, in
+  // which case the table is left unfrozen.
+  Status Freeze() override ASYLO_MUST_USE_RESULT LOCKS_EXCLUDED(mutex_);
 
  private:
+  // A registered exit handler and the counter recording its invocations.
+  struct ExitTableEntry {
+    ExitHandler handler;
+    CallCounter *counter;
+  };
+
   absl::Mutex mutex_;
-  absl::flat_hash_map<uint64_t, ExitHandler> exit_table_ GUARDED_BY(mutex_);
+  absl::flat_hash_map<uint64_t, ExitTableEntry> exit_table_ GUARDED_BY(mutex_);
+
+  // Set once |frozen_table_| is complete. Neither table changes afterwards.
+  std::atomic<bool> frozen_;
+
+  // Entries indexed by selector, with a null handler for unused selectors.
+  // Written by Freeze() before |frozen_| is set.
+  std::vector<ExitTableEntry> frozen_table_;
 };
 
 }  // namespace primitives
@@ -43,8 +43,8 @@ namespace {
 class MockedEnclaveClient : public EnclaveClient {
  public:
   using MockExitHandlerCallback =
-      MockFunction<Status(std::shared_ptr<class EnclaveClient> enclave, void *,
-                          UntrustedParameterStack *params)>;
+      MockFunction<Status(const std::shared_ptr<class EnclaveClient> &enclave,
+                          void *, UntrustedParameterStack *params)>;
 
   MockedEnclaveClient() : EnclaveClient(absl::make_unique<DispatchTable>()) {}
 
@@ -94,17 +94,65 @@ TEST(DispatchTableTest, HandlersInvocation) {
               IsOk());
   UntrustedParameterStack params;
   EXPECT_THAT(
-      client->exit_call_provider()->InvokeExitHandler(0, &params, client.get()),
+      client->exit_call_provider()->InvokeExitHandler(0, &params, client),
       IsOk());
-  EXPECT_THAT(client->exit_call_provider()->InvokeExitHandler(10, &params,
-                                                              client.get()),
+  EXPECT_THAT(
+      client->exit_call_provider()->InvokeExitHandler(10, &params, client),
+      IsOk());
+  EXPECT_THAT(
+      client->exit_call_provider()->InvokeExitHandler(0, &params, client),
+      IsOk());
+  EXPECT_THAT(
+      client->exit_call_provider()->InvokeExitHandler(30, &params, client),
+      StatusIs(error::GoogleError::OUT_OF_RANGE));
+}
+
+TEST(DispatchTableTest, FrozenHandlersInvocation) {
+  const auto client = std::make_shared<MockedEnclaveClient>();
+  MockedEnclaveClient::MockExitHandlerCallback callbacks[2];
+  EXPECT_CALL(callbacks[0], Call(Eq(client), _, _)).Times(2);
+  EXPECT_CALL(callbacks[1], Call(Eq(client), _, _)).Times(1);
+  ASSERT_THAT(client->exit_call_provider()->RegisterExitHandler(
+                  0, ExitHandler{callbacks[0].AsStdFunction()}),
+              IsOk());
+  ASSERT_THAT(client->exit_call_provider()->RegisterExitHandler(
+                  10, ExitHandler{callbacks[1].AsStdFunction()}),
               IsOk());
+  ASSERT_THAT(client->exit_call_provider()->Freeze(), IsOk());
+  ASSERT_THAT(client->exit_call_provider()->Freeze(), IsOk());
+  EXPECT_THAT(client->exit_call_provider()->RegisterExitHandler(
+                  20, ExitHandler{callbacks[1].AsStdFunction()}),
+              StatusIs(error::GoogleError::FAILED_PRECONDITION));
+  UntrustedParameterStack params;
+  EXPECT_THAT(
+      client->exit_call_provider()->InvokeExitHandler(0, &params, client),
+      IsOk());
+  EXPECT_THAT(
+      client->exit_call_provider()->InvokeExitHandler(10, &params, client),
+      IsOk());
   EXPECT_THAT(
-      client->exit_call_provider()->InvokeExitHandler(0, &params, client.get()),
+      client->exit_call_provider()->InvokeExitHandler(0, &params, client),
       IsOk());
-  EXPECT_THAT(client->exit_call_provider()->InvokeExitHandler(30, &params,
-                                                              client.get()),
+  EXPECT_THAT(
+      client->exit_call_provider()->InvokeExitHandler(5, &params, client),
+      StatusIs(error::GoogleError::OUT_OF_RANGE));
+  EXPECT_THAT(
+      client->exit_call_provider()->InvokeExitHandler(20, &params, client),
+      StatusIs(error::GoogleError::OUT_OF_RANGE));
+}
+
+TEST(DispatchTableTest, FreezeRejectsLargeSelectors) {
+  DispatchTable dispatch_table;
+  MockedEnclaveClient::MockExitHandlerCallback callback;
+  ASSERT_THAT(dispatch_table.RegisterExitHandler(
+                  DispatchTable::kMaxFrozenSelector + 1,
+                  ExitHandler{callback.AsStdFunction()}),
+              IsOk());
+  EXPECT_THAT(dispatch_table.Freeze(),
               StatusIs(error::GoogleError::OUT_OF_RANGE));
+  EXPECT_THAT(dispatch_table.RegisterExitHandler(
+                  0, ExitHandler{callback.AsStdFunction()}),
+              IsOk());
 }
 
 TEST(DispatchTableTest, HandlersInMultipleThreads) {
@@ -130,7 +178,7 @@ TEST(DispatchTableTest, HandlersInMultipleThreads) {
           for (size_t c = 0; c < kCount; ++c) {
             absl::SleepFor(absl::Milliseconds(rand_gen(rand_engine)));
             EXPECT_THAT(client->exit_call_provider()->InvokeExitHandler(
-                            i, &params, client.get()),
+                            i, &params, client),
                         IsOk());
           }
         }));
@@ -0,0 +1,186 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/profiling/profile_builder.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace {
+
+using perftools::profiles::Function;
+using perftools::profiles::Location;
+using perftools::profiles::Profile;
+using perftools::profiles::Sample;
+using perftools::profiles::ValueType;
+
+// Id of the mapping of the enclave binary, the only mapping in the profile.
+constexpr uint64_t kEnclaveMappingId = 1;
+
+// Incrementally adds samples to a profile, sharing the strings, functions and
+// locations between samples.
+class Builder {
+ public:
+  Builder(const std::vector<ElfReader::FunctionSymbol> &symbols,
+          Profile *profile)
+      : symbols_(symbols), profile_(profile) {
+    // The string table always starts with the empty string.
+    String("");
+  }
+
+  // Returns the index of |str| in the string table.
+  int64_t String(const std::string &str) {
+    auto result = strings_.emplace(str, profile_->string_table_size());
+    if (result.second) {
+      profile_->add_string_table(str);
+    }
+    return result.first->second;
+  }
+
+  // Sets |value_type| to the type |type| measured in |unit|.
+  void SetValueType(const std::string &type, const std::string &unit,
+                    ValueType *value_type) {
+    value_type->set_type(String(type));
+    value_type->set_unit(String(unit));
+  }
+
+  // Returns the id of the location of the code at |address|. |lookup_address|
+  // is the address used to find the function containing the code.
+  uint64_t LocationId(uint64_t address, uint64_t lookup_address) {
+    auto it = location_ids_.find(address);
+    if (it != location_ids_.end()) {
+      return it->second;
+    }
+    Location *location = profile_->add_location();
+    location->set_id(profile_->location_size());
+    location->set_mapping_id(kEnclaveMappingId);
+    location->set_address(address);
+    const ElfReader::FunctionSymbol *symbol = FindSymbol(lookup_address);
+    if (symbol) {
+      location->add_line()->set_function_id(FunctionId(*symbol));
+    }
+    location_ids_.emplace(address, location->id());
+    return location->id();
+  }
+
+ private:
+  // Returns the function containing |address|, or nullptr if |address| is not
+  // in a known function.
+  const ElfReader::FunctionSymbol *FindSymbol(uint64_t address) const {
+    auto it = std::upper_bound(
+        symbols_.begin(), symbols_.end(), address,
+        [](uint64_t address, const ElfReader::FunctionSymbol &symbol) {
+          return address < symbol.address;
+        });
+    if (it == symbols_.begin()) {
+      return nullptr;
+    }
+    --it;
+    if (it->size != 0 && address >= it->address + it->size) {
+      return nullptr;
+    }
+    return &*it;
+  }
+
+  // Returns the id of the function described by |symbol|.
+  uint64_t FunctionId(const ElfReader::FunctionSymbol &symbol) {
+    auto it = function_ids_.find(symbol.address);
+    if (it != function_ids_.end()) {
+      return it->second;
+    }
+    Function *function = profile_->add_function();
+    function->set_id(profile_->function_size());
+    function->set_name(String(symbol.name));
+    function->set_system_name(function->name());
+    function_ids_.emplace(symbol.address, function->id());
+    return function->id();
+  }
+
+  const std::vector<ElfReader::FunctionSymbol> &symbols_;
+  Profile *const profile_;
+
+  absl::flat_hash_map<std::string, int64_t> strings_;
+  absl::flat_hash_map<uint64_t, uint64_t> location_ids_;
+  absl::flat_hash_map<uint64_t, uint64_t> function_ids_;
+};
+
+}  // namespace
+
+StatusOr<Profile> BuildProfile(const ProfileSamples &samples,
+                               const ElfReader &enclave_binary,
+                               absl::string_view binary_name) {
+  std::vector<ElfReader::FunctionSymbol> symbols;
+  ASYLO_ASSIGN_OR_RETURN(symbols, enclave_binary.GetFunctionSymbols());
+  return BuildProfileFromSymbols(samples, symbols, binary_name);
+}
+
+Profile BuildProfileFromSymbols(
+    const ProfileSamples &samples,
+    const std::vector<ElfReader::FunctionSymbol> &symbols,
+    absl::string_view binary_name) {
+  Profile profile;
+  Builder builder(symbols, &profile);
+
+  builder.SetValueType("samples", "count", profile.add_sample_type());
+  builder.SetValueType("cpu", "nanoseconds", profile.add_sample_type());
+  builder.SetValueType("cpu", "nanoseconds", profile.mutable_period_type());
+  profile.set_period(samples.sampling_period_ns());
+
+  // Samples hold offsets from the base of the enclave, which are addresses in
+  // the enclave binary.
+  uint64_t memory_limit = 0;
+  for (const ElfReader::FunctionSymbol &symbol : symbols) {
+    memory_limit = std::max(memory_limit, symbol.address + symbol.size);
+  }
+  perftools::profiles::Mapping *mapping = profile.add_mapping();
+  mapping->set_id(kEnclaveMappingId);
+  mapping->set_memory_start(0);
+  mapping->set_memory_limit(memory_limit);
+  mapping->set_filename(builder.String(std::string(binary_name)));
+  mapping->set_has_functions(!symbols.empty());
+
+  // Identical stacks are merged into one sample.
+  absl::flat_hash_map<std::string, Sample *> samples_by_stack;
+  for (const ProfileSample &profile_sample : samples.samples()) {
+    std::string stack = profile_sample.SerializeAsString();
+    Sample *&sample = samples_by_stack[stack];
+    if (!sample) {
+      sample = profile.add_sample();
+      for (int i = 0; i < profile_sample.addresses_size(); ++i) {
+        uint64_t address = profile_sample.addresses(i);
+        // A return address follows the call, which may be the last
+        // instruction of the calling function.
+        uint64_t lookup_address = (i == 0 || address == 0) ? address
+                                                            : address - 1;
+        sample->add_location_id(builder.LocationId(address, lookup_address));
+      }
+      sample->add_value(0);
+      sample->add_value(0);
+    }
+    sample->set_value(0, sample->value(0) + 1);
+    sample->set_value(1, sample->value(1) + samples.sampling_period_ns());
+  }
+  return profile;
+}
+
+}  // namespace asylo
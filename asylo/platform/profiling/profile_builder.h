@@ -0,0 +1,51 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_PROFILING_PROFILE_BUILDER_H_
+#define ASYLO_PLATFORM_PROFILING_PROFILE_BUILDER_H_
+
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "asylo/platform/profiling/profile.pb.h"
+#include "asylo/platform/profiling/profile_samples.pb.h"
+#include "asylo/util/elf_reader.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+
+// Builds a pprof profile from |samples| recorded by the in-enclave
+// SamplingProfiler, naming the sampled functions after the symbols of
+// |enclave_binary|, the ELF file the enclave was loaded from. |binary_name| is
+// the name given to the enclave binary in the profile.
+//
+// The returned profile can be serialized and read with `pprof`.
+StatusOr<perftools::profiles::Profile> BuildProfile(
+    const ProfileSamples &samples, const ElfReader &enclave_binary,
+    absl::string_view binary_name);
+
+// As above, with the functions of the enclave given by |symbols|, sorted by
+// address.
+perftools::profiles::Profile BuildProfileFromSymbols(
+    const ProfileSamples &samples,
+    const std::vector<ElfReader::FunctionSymbol> &symbols,
+    absl::string_view binary_name);
+
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_PROFILING_PROFILE_BUILDER_H_
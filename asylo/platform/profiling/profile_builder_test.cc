@@ -0,0 +1,131 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/profiling/profile_builder.h"
+
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+namespace asylo {
+namespace {
+
+using perftools::profiles::Location;
+using perftools::profiles::Profile;
+using perftools::profiles::Sample;
+using ::testing::ElementsAre;
+
+constexpr int64_t kPeriodNs = 10000000;
+
+class ProfileBuilderTest : public ::testing::Test {
+ protected:
+  ProfileBuilderTest()
+      : symbols_({{"outer", 0x1000, 0x100},
+                  {"inner", 0x1100, 0x80},
+                  {"unsized", 0x2000, 0}}) {
+    samples_.set_sampling_period_ns(kPeriodNs);
+  }
+
+  void AddSample(const std::vector<uint64_t> &addresses) {
+    ProfileSample *sample = samples_.add_samples();
+    for (uint64_t address : addresses) {
+      sample->add_addresses(address);
+    }
+  }
+
+  // Returns the name of the function at |location|, or an empty string if the
+  // location was not symbolized.
+  std::string FunctionName(const Profile &profile, const Location &location) {
+    if (location.line_size() == 0) {
+      return "";
+    }
+    for (const auto &function : profile.function()) {
+      if (function.id() == location.line(0).function_id()) {
+        return profile.string_table(function.name());
+      }
+    }
+    return "<missing function>";
+  }
+
+  // Returns the names of the functions of the stack of |sample|, innermost
+  // first.
+  std::vector<std::string> StackNames(const Profile &profile,
+                                      const Sample &sample) {
+    std::vector<std::string> names;
+    for (uint64_t location_id : sample.location_id()) {
+      names.push_back(FunctionName(profile, profile.location(location_id - 1)));
+    }
+    return names;
+  }
+
+  std::vector<ElfReader::FunctionSymbol> symbols_;
+  ProfileSamples samples_;
+};
+
+// Verifies that sampled addresses are attributed to the functions containing
+// them, and that return addresses are attributed to the calling function.
+TEST_F(ProfileBuilderTest, SymbolizesStacks) {
+  // 0x1100 is a return address that follows a call ending "outer".
+  AddSample({0x1110, 0x1100});
+  AddSample({0x2345, 0x1050});
+
+  Profile profile = BuildProfileFromSymbols(samples_, symbols_, "enclave.so");
+
+  ASSERT_EQ(profile.sample_size(), 2);
+  EXPECT_THAT(StackNames(profile, profile.sample(0)),
+              ElementsAre("inner", "outer"));
+  EXPECT_THAT(StackNames(profile, profile.sample(1)),
+              ElementsAre("unsized", "outer"));
+  EXPECT_EQ(profile.string_table(0), "");
+  EXPECT_EQ(profile.period(), kPeriodNs);
+  ASSERT_EQ(profile.mapping_size(), 1);
+  EXPECT_EQ(profile.string_table(profile.mapping(0).filename()), "enclave.so");
+}
+
+// Verifies that addresses outside of every function are kept unsymbolized.
+TEST_F(ProfileBuilderTest, KeepsUnknownAddresses) {
+  AddSample({0x1190, 0x10});
+
+  Profile profile = BuildProfileFromSymbols(samples_, symbols_, "enclave.so");
+
+  ASSERT_EQ(profile.sample_size(), 1);
+  EXPECT_THAT(StackNames(profile, profile.sample(0)), ElementsAre("", ""));
+  EXPECT_EQ(profile.location(0).address(), 0x1190u);
+  EXPECT_EQ(profile.location(1).address(), 0x10u);
+}
+
+// Verifies that identical stacks are merged into one sample, and that
+// locations and functions are shared between samples.
+TEST_F(ProfileBuilderTest, MergesIdenticalStacks) {
+  AddSample({0x1110, 0x1080});
+  AddSample({0x1110, 0x1080});
+  AddSample({0x1120, 0x1080});
+
+  Profile profile = BuildProfileFromSymbols(samples_, symbols_, "enclave.so");
+
+  ASSERT_EQ(profile.sample_size(), 2);
+  EXPECT_THAT(profile.sample(0).value(), ElementsAre(2, 2 * kPeriodNs));
+  EXPECT_THAT(profile.sample(1).value(), ElementsAre(1, kPeriodNs));
+  EXPECT_EQ(profile.location_size(), 3);
+  EXPECT_EQ(profile.function_size(), 2);
+}
+
+}  // namespace
+}  // namespace asylo
@@ -0,0 +1,225 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/profiling/sampling_profiler.h"
+
+#include <errno.h>
+#include <sys/time.h>
+
+#include "asylo/platform/arch/include/trusted/enclave_interface.h"
+#include "asylo/platform/common/time_util.h"
+#include "asylo/util/posix_error_space.h"
+
+namespace asylo {
+namespace {
+
+// Indices of the frame pointer and instruction pointer in gregset_t, which
+// follows the x86-64 Linux layout of the registers copied from the host.
+constexpr int kFramePointerIndex = 10;
+constexpr int kInstructionPointerIndex = 16;
+
+// Bounds of the stack of the calling thread inside the enclave.
+struct StackBounds {
+  uintptr_t limit;
+  uintptr_t base;
+};
+
+// Returns the bounds of the stack of the calling thread.
+StackBounds CurrentStackBounds() {
+  EnclaveMemoryLayout layout;
+  enc_get_memory_layout(&layout);
+  return {reinterpret_cast<uintptr_t>(layout.stack_limit),
+          reinterpret_cast<uintptr_t>(layout.stack_base)};
+}
+
+// Returns true if |address| is the address of a frame record, a pair of words,
+// on the stack with bounds |stack|.
+bool IsFrameRecord(uintptr_t address, const StackBounds &stack) {
+  return address % sizeof(uintptr_t) == 0 && address >= stack.limit &&
+         address < stack.base &&
+         stack.base - address >= 2 * sizeof(uintptr_t);
+}
+
+// Returns true if |address| may be the address of enclave code.
+bool IsEnclaveAddress(uintptr_t address) {
+  return address != 0 &&
+         enc_is_within_enclave(reinterpret_cast<const void *>(address), 1);
+}
+
+// Follows the chain of frame pointers starting at |frame_pointer|, appending
+// the return address of each frame to |frames|, which holds |num_frames| of
+// |max_frames| entries. Returns the new number of entries in |frames|.
+//
+// Only frame records on the stack of the calling thread are read, since the
+// frame pointer may come from registers supplied by the host.
+int UnwindFrames(uintptr_t frame_pointer, uintptr_t *frames, int num_frames,
+                 int max_frames) {
+  const StackBounds stack = CurrentStackBounds();
+  while (num_frames < max_frames && IsFrameRecord(frame_pointer, stack)) {
+    const uintptr_t *frame = reinterpret_cast<const uintptr_t *>(frame_pointer);
+    uintptr_t caller_frame_pointer = frame[0];
+    uintptr_t return_address = frame[1];
+    if (!IsEnclaveAddress(return_address)) {
+      break;
+    }
+    frames[num_frames++] = return_address;
+
+    // The stack grows down, so the frame of a caller is at a higher address.
+    // Anything else is not a frame pointer.
+    if (caller_frame_pointer <= frame_pointer) {
+      break;
+    }
+    frame_pointer = caller_frame_pointer;
+  }
+  return num_frames;
+}
+
+}  // namespace
+
+constexpr int SamplingProfiler::kMaxFrames;
+constexpr size_t SamplingProfiler::kBufferSize;
+
+SamplingProfiler *SamplingProfiler::GetInstance() {
+  static SamplingProfiler *instance = new SamplingProfiler();
+  return instance;
+}
+
+SamplingProfiler::SamplingProfiler()
+    : period_(absl::ZeroDuration()),
+      last_period_(absl::ZeroDuration()),
+      running_(false),
+      next_slot_(0),
+      dropped_samples_(0) {
+  for (Slot &slot : slots_) {
+    slot.state.store(Slot::kEmpty, std::memory_order_relaxed);
+  }
+}
+
+Status SamplingProfiler::Start(absl::Duration period) {
+  if (period <= absl::ZeroDuration()) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "Sampling period must be positive");
+  }
+  absl::MutexLock lock(&mu_);
+  if (period_ != absl::ZeroDuration()) {
+    return Status(error::GoogleError::FAILED_PRECONDITION,
+                  "Profiler is already running");
+  }
+
+  struct sigaction act = {};
+  act.sa_sigaction = &SamplingProfiler::HandleSignal;
+  act.sa_flags = SA_SIGINFO;
+  sigemptyset(&act.sa_mask);
+  if (sigaction(SIGPROF, &act, nullptr) != 0) {
+    return Status(static_cast<error::PosixError>(errno),
+                  "Failed to register SIGPROF handler");
+  }
+
+  struct itimerval timer;
+  NanosecondsToTimeVal(&timer.it_interval, absl::ToInt64Nanoseconds(period));
+  timer.it_value = timer.it_interval;
+  running_.store(true, std::memory_order_release);
+  if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+    running_.store(false, std::memory_order_release);
+    return Status(static_cast<error::PosixError>(errno),
+                  "Failed to start profiling timer");
+  }
+  period_ = period;
+  last_period_ = period;
+  return Status::OkStatus();
+}
+
+Status SamplingProfiler::Stop() {
+  absl::MutexLock lock(&mu_);
+  if (period_ == absl::ZeroDuration()) {
+    return Status(error::GoogleError::FAILED_PRECONDITION,
+                  "Profiler is not running");
+  }
+
+  // The SIGPROF handler stays registered, and ignores signals still in flight.
+  running_.store(false, std::memory_order_release);
+  struct itimerval timer = {};
+  if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+    return Status(static_cast<error::PosixError>(errno),
+                  "Failed to stop profiling timer");
+  }
+  period_ = absl::ZeroDuration();
+  return Status::OkStatus();
+}
+
+void SamplingProfiler::Collect(ProfileSamples *samples) {
+  absl::MutexLock lock(&mu_);
+  const uintptr_t base_address =
+      reinterpret_cast<uintptr_t>(enc_get_base_address());
+  samples->set_sampling_period_ns(absl::ToInt64Nanoseconds(last_period_));
+  for (Slot &slot : slots_) {
+    if (slot.state.load(std::memory_order_acquire) != Slot::kFull) {
+      continue;
+    }
+    ProfileSample *sample = samples->add_samples();
+    for (int i = 0; i < slot.num_frames; ++i) {
+      sample->add_addresses(slot.frames[i] - base_address);
+    }
+    slot.state.store(Slot::kEmpty, std::memory_order_release);
+  }
+  samples->set_dropped_samples(
+      samples->dropped_samples() +
+      dropped_samples_.exchange(0, std::memory_order_relaxed));
+}
+
+void SamplingProfiler::HandleSignal(int signum, siginfo_t *info,
+                                    void *ucontext) {
+  SamplingProfiler *profiler = GetInstance();
+  if (profiler->running_.load(std::memory_order_acquire)) {
+    profiler->RecordSample(static_cast<const ucontext_t *>(ucontext));
+  }
+}
+
+void SamplingProfiler::RecordSample(const ucontext_t *ucontext) {
+  Slot &slot = slots_[next_slot_.fetch_add(1, std::memory_order_relaxed) %
+                      kBufferSize];
+  int expected = Slot::kEmpty;
+  if (!slot.state.compare_exchange_strong(expected, Slot::kWriting,
+                                          std::memory_order_acquire)) {
+    // The buffer has wrapped around to samples not collected yet.
+    dropped_samples_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  int num_frames = 0;
+  uintptr_t instruction_pointer =
+      ucontext ? static_cast<uintptr_t>(
+                     ucontext->uc_mcontext.gregs[kInstructionPointerIndex])
+               : 0;
+  if (IsEnclaveAddress(instruction_pointer)) {
+    // The signal interrupted enclave code on this thread.
+    slot.frames[num_frames++] = instruction_pointer;
+    num_frames = UnwindFrames(
+        static_cast<uintptr_t>(ucontext->uc_mcontext.gregs[kFramePointerIndex]),
+        slot.frames, num_frames, kMaxFrames);
+  } else {
+    num_frames = UnwindFrames(
+        reinterpret_cast<uintptr_t>(__builtin_frame_address(0)), slot.frames,
+        num_frames, kMaxFrames);
+  }
+  slot.num_frames = num_frames;
+  slot.state.store(num_frames > 0 ? Slot::kFull : Slot::kEmpty,
+                   std::memory_order_release);
+}
+
+}  // namespace asylo
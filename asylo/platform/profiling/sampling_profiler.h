@@ -0,0 +1,123 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_PROFILING_SAMPLING_PROFILER_H_
+#define ASYLO_PLATFORM_PROFILING_SAMPLING_PROFILER_H_
+
+#include <signal.h>
+#include <sys/ucontext.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "asylo/platform/profiling/profile_samples.pb.h"
+#include "asylo/util/status.h"
+
+namespace asylo {
+
+// A sampling profiler for code running inside the enclave.
+//
+// While the profiler runs, an ITIMER_PROF timer has the host deliver SIGPROF to
+// the enclave each time the process has used a sampling period of CPU time.
+// The SIGPROF handler, registered with the SignalManager, records the stack of
+// the interrupted code into a fixed-size buffer. Collect() moves the recorded
+// stacks into a ProfileSamples message, which the enclave hands to the host to
+// be symbolized against the enclave binary by BuildProfile().
+//
+// Stacks are unwound by following frame pointers, so functions compiled without
+// frame pointers end the recorded stack. Only frames on the stack of the thread
+// handling the signal are followed, as the interrupted registers may be
+// supplied by the host.
+//
+// The interrupted registers are only visible to the enclave when the signal is
+// delivered on the interrupted thread, which is the case in simulation mode.
+// Otherwise, as in hardware mode, a sample records the stack of the thread that
+// handles the signal: a thread picking up the signal on its return from a host
+// call, or the thread that entered the enclave to deliver it.
+//
+// This class is thread-safe.
+class SamplingProfiler {
+ public:
+  // Maximum number of frames recorded for a stack.
+  static constexpr int kMaxFrames = 64;
+
+  // Number of stacks the sample buffer holds until they are collected.
+  static constexpr size_t kBufferSize = 512;
+
+  static SamplingProfiler *GetInstance();
+
+  SamplingProfiler(const SamplingProfiler &other) = delete;
+  SamplingProfiler &operator=(const SamplingProfiler &other) = delete;
+
+  // Starts sampling each |period| of CPU time used by the process. Replaces
+  // any SIGPROF handler registered in the enclave.
+  Status Start(absl::Duration period) LOCKS_EXCLUDED(mu_);
+
+  // Stops sampling. Samples already recorded are kept until collected.
+  Status Stop() LOCKS_EXCLUDED(mu_);
+
+  // Moves the samples recorded since the last call into |samples|, along with
+  // the sampling period of the current or last run.
+  void Collect(ProfileSamples *samples) LOCKS_EXCLUDED(mu_);
+
+ private:
+  // A stack in the sample buffer.
+  struct Slot {
+    enum State { kEmpty, kWriting, kFull };
+
+    std::atomic<int> state;
+    int num_frames;
+    uintptr_t frames[kMaxFrames];
+  };
+
+  SamplingProfiler();
+
+  // SIGPROF handler.
+  static void HandleSignal(int signum, siginfo_t *info, void *ucontext);
+
+  // Records the stack interrupted by the signal with context |ucontext|.
+  // Called from a signal handler, so only touches the sample buffer.
+  void RecordSample(const ucontext_t *ucontext);
+
+  absl::Mutex mu_;
+
+  // The sampling period, or zero if the profiler is stopped.
+  absl::Duration period_ GUARDED_BY(mu_);
+
+  // The sampling period of the last run, kept once the profiler is stopped for
+  // the samples it recorded. Zero if the profiler never ran.
+  absl::Duration last_period_ GUARDED_BY(mu_);
+
+  // True while SIGPROF should be sampled.
+  std::atomic<bool> running_;
+
+  // Index of the slot to use for the next sample, modulo |kBufferSize|.
+  std::atomic<uint64_t> next_slot_;
+
+  // Number of samples lost since the last call to Collect().
+  std::atomic<uint64_t> dropped_samples_;
+
+  Slot slots_[kBufferSize];
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_PROFILING_SAMPLING_PROFILER_H_
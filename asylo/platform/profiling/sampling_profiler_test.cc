@@ -0,0 +1,151 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/profiling/sampling_profiler.h"
+
+#include <signal.h>
+
+#include <cstdint>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/base/attributes.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "asylo/platform/arch/include/trusted/enclave_interface.h"
+#include "asylo/platform/profiling/profile_samples.pb.h"
+#include "asylo/test/util/status_matchers.h"
+
+namespace asylo {
+namespace {
+
+// The sampling period used by the tests.
+const absl::Duration kPeriod = absl::Milliseconds(1);
+
+// Upper bound on the size of the code of Spin().
+constexpr uintptr_t kMaxSpinCodeSize = 512;
+
+// Keeps the CPU busy for |duration|. Samples taken while it runs on the
+// sampled thread have their innermost frame in this function.
+ABSL_ATTRIBUTE_NOINLINE void Spin(absl::Duration duration) {
+  volatile uint64_t counter = 0;
+  absl::Time deadline = absl::Now() + duration;
+  while (absl::Now() < deadline) {
+    for (int i = 0; i < (1 << 16); ++i) {
+      counter = counter + 1;
+    }
+  }
+}
+
+// Returns true if |offset| from the enclave base address falls in Spin().
+bool IsInSpin(uint64_t offset) {
+  uintptr_t address =
+      reinterpret_cast<uintptr_t>(enc_get_base_address()) + offset;
+  uintptr_t spin = reinterpret_cast<uintptr_t>(&Spin);
+  return address >= spin && address < spin + kMaxSpinCodeSize;
+}
+
+class SamplingProfilerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    profiler_ = SamplingProfiler::GetInstance();
+    // Drop samples left over by an earlier test.
+    ProfileSamples samples;
+    profiler_->Collect(&samples);
+  }
+
+  SamplingProfiler *profiler_;
+};
+
+// Verifies that the profiler rejects a non-positive period, and calls that do
+// not match its state.
+TEST_F(SamplingProfilerTest, RejectsInvalidCalls) {
+  EXPECT_THAT(profiler_->Start(absl::ZeroDuration()),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+  EXPECT_THAT(profiler_->Stop(),
+              StatusIs(error::GoogleError::FAILED_PRECONDITION));
+
+  ASYLO_ASSERT_OK(profiler_->Start(kPeriod));
+  EXPECT_THAT(profiler_->Start(kPeriod),
+              StatusIs(error::GoogleError::FAILED_PRECONDITION));
+  ASYLO_EXPECT_OK(profiler_->Stop());
+}
+
+// Verifies that a busy loop is sampled, and that samples hold enclave code
+// offsets.
+TEST_F(SamplingProfilerTest, SamplesBusyLoop) {
+  ASYLO_ASSERT_OK(profiler_->Start(kPeriod));
+  Spin(absl::Milliseconds(200));
+  ProfileSamples samples;
+  profiler_->Collect(&samples);
+  ASYLO_EXPECT_OK(profiler_->Stop());
+
+  EXPECT_EQ(samples.sampling_period_ns(), absl::ToInt64Nanoseconds(kPeriod));
+  ASSERT_GT(samples.samples_size(), 0);
+  for (const ProfileSample &sample : samples.samples()) {
+    EXPECT_GT(sample.addresses_size(), 0);
+  }
+
+#ifdef ASYLO_TEST_SIGNAL_ON_INTERRUPTED_THREAD
+  // The signal is delivered on the thread running Spin(), with the registers
+  // it was interrupted with, so most samples start in Spin().
+  int samples_in_spin = 0;
+  for (const ProfileSample &sample : samples.samples()) {
+    if (sample.addresses_size() > 0 && IsInSpin(sample.addresses(0))) {
+      ++samples_in_spin;
+    }
+  }
+  EXPECT_GT(samples_in_spin, 0);
+#endif
+}
+
+// Verifies that samples beyond the capacity of the buffer are counted as
+// dropped, that the period of a stopped run is still reported, and that no
+// samples are recorded once the profiler is stopped.
+TEST_F(SamplingProfilerTest, CountsDroppedSamplesAndStops) {
+  // Sample on signals raised by the test rather than on the timer, which fires
+  // at most once per kernel tick and would take seconds to fill the buffer.
+  const absl::Duration kLongPeriod = absl::Hours(1);
+  constexpr int kExtraSignals = 16;
+  ASYLO_ASSERT_OK(profiler_->Start(kLongPeriod));
+  for (int i = 0;
+       i < static_cast<int>(SamplingProfiler::kBufferSize) + kExtraSignals;
+       ++i) {
+    ASSERT_EQ(raise(SIGPROF), 0);
+  }
+  ASYLO_ASSERT_OK(profiler_->Stop());
+
+  ProfileSamples samples;
+  profiler_->Collect(&samples);
+  EXPECT_EQ(samples.sampling_period_ns(),
+            absl::ToInt64Nanoseconds(kLongPeriod));
+  EXPECT_LE(samples.samples_size(),
+            static_cast<int>(SamplingProfiler::kBufferSize));
+  EXPECT_GE(samples.dropped_samples(), kExtraSignals);
+
+  for (int i = 0; i < kExtraSignals; ++i) {
+    ASSERT_EQ(raise(SIGPROF), 0);
+  }
+  ProfileSamples after_stop;
+  profiler_->Collect(&after_stop);
+  EXPECT_EQ(after_stop.samples_size(), 0);
+  EXPECT_EQ(after_stop.dropped_samples(), 0);
+}
+
+}  // namespace
+}  // namespace asylo
@@ -180,5 +180,14 @@ TEST_F(ActiveEnclaveSignalTest, SigactionMaskTest) {
   EXPECT_THAT(RunSignalTest(enclave_input), IsOk());
 }
 
+// Test that a signal queued by the host is handled by a thread returning into
+// the enclave from a host call, and that a signal queued twice is handled once.
+TEST_F(ActiveEnclaveSignalTest, HostCallReturnTest) {
+  EnclaveInput enclave_input;
+  enclave_input.MutableExtension(signal_test_input)
+      ->set_signal_test_type(SignalTestInput::HOST_CALL_RETURN);
+  EXPECT_THAT(client_->EnterAndRun(enclave_input, nullptr), IsOk());
+}
+
 }  // namespace
 }  // namespace asylo
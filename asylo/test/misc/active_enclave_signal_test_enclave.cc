@@ -19,8 +19,14 @@
 #include <signal.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <atomic>
+#include <cstdint>
 #include <future>
+#include <new>
 
+#include "asylo/platform/arch/include/trusted/host_calls.h"
+#include "asylo/platform/common/bridge_functions.h"
+#include "asylo/platform/posix/signal/signal_manager.h"
 #include "asylo/test/misc/signal_test.pb.h"
 #include "asylo/test/util/enclave_test_application.h"
 #include "asylo/util/posix_error_space.h"
@@ -93,6 +99,8 @@ class ActiveEnclaveSignalTest : public TrustedApplication {
         return status;
       case SignalTestInput::SIGACTIONMASK:
         return RunSignalTest(SignalTestInput::SIGACTIONMASK);
+      case SignalTestInput::HOST_CALL_RETURN:
+        return RunHostCallReturnTest();
       default:
         return Status(error::GoogleError::INVALID_ARGUMENT,
                       "No vaild test type");
@@ -194,6 +202,45 @@ class ActiveEnclaveSignalTest : public TrustedApplication {
                                    "Signal not received after unblocked");
   }
 
+  // Queues SIGUSR1 twice in a set of pending signals in untrusted memory, as
+  // the host does while another signal is being delivered, and checks that the
+  // signal is handled once when this thread returns from a host call.
+  Status RunHostCallReturnTest() {
+    struct sigaction act = {};
+    sigemptyset(&act.sa_mask);
+    act.sa_handler = &HandleSignalWithHandler;
+    sigaction(SIGUSR1, &act, nullptr);
+
+    void *buffer = enc_untrusted_malloc(sizeof(std::atomic<uint64_t>));
+    if (!buffer) {
+      return Status(error::GoogleError::RESOURCE_EXHAUSTED,
+                    "Failed to allocate pending signals");
+    }
+    uint64_t bit = UINT64_C(1) << (ToBridgeSignal(SIGUSR1) - 1);
+    auto *pending = new (buffer) std::atomic<uint64_t>(0);
+    pending->fetch_or(bit);
+    pending->fetch_or(bit);
+    SignalManager *signal_manager = SignalManager::GetInstance();
+    signal_manager->SetPendingSignals(pending);
+
+    bool handled_before_host_call = signal_handled;
+    sleep(0);
+    bool handled_after_host_call = signal_handled;
+    uint64_t still_pending = pending->load();
+
+    signal_manager->SetPendingSignals(nullptr);
+    enc_untrusted_free(buffer);
+    if (handled_before_host_call || !handled_after_host_call) {
+      return Status(error::GoogleError::INTERNAL,
+                    "Queued signal not handled on return from a host call");
+    }
+    if (still_pending != 0) {
+      return Status(error::GoogleError::INTERNAL,
+                    "Handled signal left in the pending signals");
+    }
+    return Status::OkStatus();
+  }
+
   // Keeps unblocking the signal to test whether the signal mask in the other
   // thread is affected.
   Status SetSignalMask() {
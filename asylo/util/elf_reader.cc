@@ -18,6 +18,7 @@
 
 #include "asylo/util/elf_reader.h"
 
+#include <algorithm>
 #include <cstring>
 
 #include "absl/strings/str_cat.h"
@@ -172,6 +173,58 @@ StatusOr<absl::Span<const uint8_t>> ElfReader::GetSectionData(
   return section_data_lookup->second;
 }
 
+StatusOr<std::vector<ElfReader::FunctionSymbol>> ElfReader::GetFunctionSymbols()
+    const {
+  absl::string_view symbol_table_name = ".symtab";
+  absl::string_view string_table_name = ".strtab";
+  if (section_headers_.find(std::string(symbol_table_name)) ==
+      section_headers_.cend()) {
+    symbol_table_name = ".dynsym";
+    string_table_name = ".dynstr";
+  }
+
+  auto symbol_table_result = GetSectionData(symbol_table_name);
+  if (!symbol_table_result.ok()) {
+    return Status(error::GoogleError::NOT_FOUND,
+                  "File does not contain a symbol table");
+  }
+  absl::Span<const uint8_t> symbol_table = symbol_table_result.ValueOrDie();
+
+  absl::Span<const uint8_t> string_table;
+  ASYLO_ASSIGN_OR_RETURN(string_table, GetSectionData(string_table_name));
+
+  std::vector<FunctionSymbol> symbols;
+  for (size_t offset = 0; offset + sizeof(Elf64_Sym) <= symbol_table.size();
+       offset += sizeof(Elf64_Sym)) {
+    const Elf64_Sym *symbol =
+        reinterpret_cast<const Elf64_Sym *>(&symbol_table[offset]);
+
+    // Skip symbols that are not functions, and functions that are only
+    // referenced by the file.
+    if (ELF64_ST_TYPE(symbol->st_info) != STT_FUNC ||
+        symbol->st_shndx == SHN_UNDEF) {
+      continue;
+    }
+
+    auto name_or_none = GetStringAtOffset(string_table, symbol->st_name);
+    if (!name_or_none.has_value()) {
+      return Status(error::GoogleError::INVALID_ARGUMENT,
+                    absl::StrCat("Malformed ELF file: symbol at offset ",
+                                 offset, " of ", symbol_table_name,
+                                 " has invalid st_name"));
+    }
+
+    symbols.push_back({std::string(name_or_none.value()), symbol->st_value,
+                       symbol->st_size});
+  }
+
+  std::sort(symbols.begin(), symbols.end(),
+            [](const FunctionSymbol &lhs, const FunctionSymbol &rhs) {
+              return lhs.address < rhs.address;
+            });
+  return symbols;
+}
+
 StatusOr<ElfReader> ElfReaderCreator::Create() {
   ASYLO_RETURN_IF_ERROR(InitializeSectionMaps());
   return ElfReader(elf_file_, std::move(section_headers_),
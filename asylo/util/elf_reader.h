@@ -23,6 +23,7 @@
 #include <cstdint>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/strings/string_view.h"
@@ -34,6 +35,18 @@ namespace asylo {
 // A class for reading ELF files. Only supports 64-bit little-endian ELF files.
 class ElfReader {
  public:
+  // A function defined in the symbol table of an ELF file.
+  struct FunctionSymbol {
+    // The name of the function, as it appears in the symbol table.
+    std::string name;
+
+    // The virtual address of the first instruction of the function.
+    Elf64_Addr address;
+
+    // The size of the function's code in bytes, or 0 if unknown.
+    uint64_t size;
+  };
+
   // Constructs an ElfReader from an ELF file in a buffer in memory. The
   // lifetime of the buffer must not be shorter than the lifetime of the
   // ElfReader.
@@ -52,6 +65,11 @@ class ElfReader {
   StatusOr<absl::Span<const uint8_t>> GetSectionData(
       absl::string_view section_name) const;
 
+  // Returns the functions defined in the given ELF file, sorted by address.
+  // The symbols are read from the .symtab section, or from the .dynsym section
+  // if the file has been stripped of its .symtab section.
+  StatusOr<std::vector<FunctionSymbol>> GetFunctionSymbols() const;
+
  private:
   // This class is defined in elf_reader.cc.
   friend class ElfReaderCreator;
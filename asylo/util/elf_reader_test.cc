@@ -21,6 +21,7 @@
 #include <elf.h>
 #include <cstring>
 #include <limits>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -195,6 +196,30 @@ TEST_F(ElfReaderTest, WorksOnValidInputs) {
       0);
 }
 
+// Tests that GetFunctionSymbols finds the functions defined in a valid ELF file
+// and sorts them by address.
+TEST_F(ElfReaderTest, GetFunctionSymbolsFindsDefinedFunctions) {
+  auto create_from_span_result =
+      ElfReader::CreateFromSpan(elf_file_mapping_.buffer());
+  ASSERT_THAT(create_from_span_result, IsOk());
+  ElfReader reader = create_from_span_result.ValueOrDie();
+
+  auto get_function_symbols_result = reader.GetFunctionSymbols();
+  ASSERT_THAT(get_function_symbols_result, IsOk());
+  std::vector<ElfReader::FunctionSymbol> symbols =
+      get_function_symbols_result.ValueOrDie();
+
+  ASSERT_FALSE(symbols.empty());
+  bool found_main = false;
+  for (size_t i = 0; i < symbols.size(); ++i) {
+    if (i > 0) {
+      EXPECT_LE(symbols[i - 1].address, symbols[i].address);
+    }
+    found_main |= symbols[i].name == "main";
+  }
+  EXPECT_TRUE(found_main);
+}
+
 // Tests that CreateFromSpan returns an appropriate error if the input file does
 // not start with the ELF magic number.
 TEST_F(ElfReaderTest, ReturnsAppropriateErrorIfBadMagicNumber) {
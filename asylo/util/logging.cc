@@ -21,16 +21,24 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <cstdio>
 #include <cstdlib>
 #include <ctime>
 #include <sstream>
 #include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 
 namespace asylo {
 
@@ -89,6 +97,310 @@ const std::string get_log_basename() {
   return *log_basename;
 }
 
+// Capacity, in bytes, of the buffer in which each thread collects its log
+// messages while the log flusher is running. Messages that do not fit are
+// dropped.
+constexpr size_t kThreadLogBufferSize = 16 * 1024;
+
+// The log flusher is woken early once a thread's buffer holds this many bytes.
+constexpr size_t kThreadLogBufferHighWater = kThreadLogBufferSize / 2;
+
+// How long a message may wait in a buffer before the log flusher writes it.
+constexpr absl::Duration kLogFlushInterval = absl::Milliseconds(100);
+
+// A single-producer, single-consumer ring of log text. The owning thread
+// appends messages without locking, and the log flusher drains them.
+class ThreadLogBuffer {
+ public:
+  ThreadLogBuffer() : head_(0), tail_(0), released_(false) {}
+
+  // Appends |text|, followed by a newline if |text| does not end with one.
+  // Returns false if the buffer does not have room for the message, in which
+  // case nothing is appended. Must only be called by the owning thread.
+  bool Append(const std::string &text) {
+    bool add_newline = text.empty() || text.back() != '\n';
+    size_t size = text.size() + (add_newline ? 1 : 0);
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    if (kThreadLogBufferSize - (head - tail) < size) {
+      return false;
+    }
+    Copy(head, text.data(), text.size());
+    if (add_newline) {
+      Copy(head + text.size(), "\n", 1);
+    }
+    head_.store(head + size, std::memory_order_release);
+    return true;
+  }
+
+  // Returns the number of buffered bytes.
+  size_t size() const {
+    return head_.load(std::memory_order_acquire) -
+           tail_.load(std::memory_order_acquire);
+  }
+
+  // Moves the buffered text to the end of |out|. Must only be called by one
+  // thread at a time.
+  void Drain(std::string *out) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t head = head_.load(std::memory_order_acquire);
+    while (tail != head) {
+      size_t offset = tail % kThreadLogBufferSize;
+      size_t chunk = std::min(head - tail, kThreadLogBufferSize - offset);
+      out->append(data_ + offset, chunk);
+      tail += chunk;
+    }
+    tail_.store(tail, std::memory_order_release);
+  }
+
+  // Marks the buffer as abandoned by its owning thread.
+  void Release() { released_.store(true, std::memory_order_release); }
+
+  // Returns true if the owning thread has abandoned the buffer.
+  bool released() const { return released_.load(std::memory_order_acquire); }
+
+ private:
+  // Copies |size| bytes from |data| into the ring at |position|.
+  void Copy(size_t position, const char *data, size_t size) {
+    size_t offset = position % kThreadLogBufferSize;
+    size_t chunk = std::min(size, kThreadLogBufferSize - offset);
+    memcpy(data_ + offset, data, chunk);
+    memcpy(data_, data + chunk, size - chunk);
+  }
+
+  char data_[kThreadLogBufferSize];
+
+  // Total number of bytes ever appended and drained, respectively.
+  std::atomic<size_t> head_;
+  std::atomic<size_t> tail_;
+
+  std::atomic<bool> released_;
+};
+
+// The calling thread's log buffer, if it has one.
+thread_local ThreadLogBuffer *thread_log_buffer = nullptr;
+
+// Releases the calling thread's log buffer when the thread exits.
+struct ThreadLogBufferReleaser {
+  ~ThreadLogBufferReleaser() {
+    if (thread_log_buffer) {
+      thread_log_buffer->Release();
+      thread_log_buffer = nullptr;
+    }
+  }
+};
+
+thread_local ThreadLogBufferReleaser thread_log_buffer_releaser;
+
+// Writes log messages to the log file and to stdout through a persistent file
+// descriptor. While the log flusher is running, messages below ERROR severity
+// are collected in per-thread buffers and written in batches by a background
+// thread. Otherwise, and for messages of ERROR severity or above, messages are
+// written as they are logged, after any buffered messages.
+class LogSink {
+ public:
+  static LogSink *GetInstance() {
+    static LogSink *instance = new LogSink();
+    return instance;
+  }
+
+  // Writes or buffers |text|, which has the given |severity|.
+  void Log(const std::string &text, LogSeverity severity) {
+    if (severity < ERROR &&
+        flusher_running_.load(std::memory_order_acquire)) {
+      ThreadLogBuffer *buffer = GetThreadBuffer();
+      if (!buffer->Append(text)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        flush_requested_.Signal();
+      } else if (buffer->size() >= kThreadLogBufferHighWater) {
+        flush_requested_.Signal();
+      }
+      // If the flusher was stopped while the message was being appended, its
+      // final flush may have missed the message, so write it now. Pairs with
+      // the fence in StopFlusher().
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (!flusher_running_.load(std::memory_order_relaxed)) {
+        Flush();
+      }
+      return;
+    }
+
+    absl::MutexLock lock(&mu_);
+    FlushLocked();
+    if (text.empty() || text.back() != '\n') {
+      WriteLocked(text + "\n");
+    } else {
+      WriteLocked(text);
+    }
+    if (severity >= ERROR) {
+      fprintf(stderr, "%s\n", text.c_str());
+      fflush(stderr);
+    }
+  }
+
+  // Writes all buffered messages.
+  void Flush() {
+    absl::MutexLock lock(&mu_);
+    FlushLocked();
+  }
+
+  // Starts the log flusher. Returns false if the flusher could not be started
+  // or has been stopped.
+  bool StartFlusher() {
+    absl::MutexLock lock(&mu_);
+    if (flusher_state_ != FlusherState::kNotStarted) {
+      return flusher_state_ == FlusherState::kRunning;
+    }
+    flusher_state_ = FlusherState::kRunning;
+    if (pthread_create(&flusher_, nullptr, &LogSink::FlusherMain, this) != 0) {
+      flusher_state_ = FlusherState::kStopped;
+      return false;
+    }
+    flusher_running_.store(true, std::memory_order_release);
+    return true;
+  }
+
+  // Stops the log flusher and writes all buffered messages.
+  void StopFlusher() {
+    {
+      absl::MutexLock lock(&mu_);
+      if (flusher_state_ != FlusherState::kRunning) {
+        flusher_state_ = FlusherState::kStopped;
+        FlushLocked();
+        return;
+      }
+      flusher_state_ = FlusherState::kStopped;
+      flusher_running_.store(false, std::memory_order_relaxed);
+      // Either the final flush below sees a message appended concurrently,
+      // or the thread appending it sees that the flusher has stopped.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      flush_requested_.Signal();
+    }
+    pthread_join(flusher_, nullptr);
+    Flush();
+  }
+
+ private:
+  enum class FlusherState { kNotStarted, kRunning, kStopped };
+
+  LogSink()
+      : fd_(-1),
+        flusher_state_(FlusherState::kNotStarted),
+        flusher_running_(false),
+        dropped_(0) {}
+
+  // Returns the calling thread's log buffer, creating it if needed.
+  ThreadLogBuffer *GetThreadBuffer() LOCKS_EXCLUDED(mu_) {
+    if (!thread_log_buffer) {
+      // Refer to the releaser so that it is constructed, and destroyed when
+      // the thread exits.
+      (void)&thread_log_buffer_releaser;
+      thread_log_buffer = new ThreadLogBuffer();
+      absl::MutexLock lock(&mu_);
+      buffers_.push_back(thread_log_buffer);
+    }
+    return thread_log_buffer;
+  }
+
+  // Writes the contents of all thread buffers, along with a note about any
+  // dropped messages, and frees buffers abandoned by their threads.
+  void FlushLocked() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    std::string batch;
+    for (auto it = buffers_.begin(); it != buffers_.end();) {
+      ThreadLogBuffer *buffer = *it;
+      // Check for release before draining, so that no message appended before
+      // the release is lost.
+      bool released = buffer->released();
+      buffer->Drain(&batch);
+      if (released) {
+        delete buffer;
+        it = buffers_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    uint64_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+      batch += "[" + std::to_string(dropped) + " log messages dropped]\n";
+    }
+    if (!batch.empty()) {
+      WriteLocked(batch);
+    }
+  }
+
+  // Writes |text| to the log file and to stdout.
+  void WriteLocked(const std::string &text) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    // The log path may change when logging is initialized.
+    std::string log_path = get_log_directory() + get_log_basename();
+    if (fd_ < 0 || log_path != fd_path_) {
+      if (fd_ >= 0) {
+        close(fd_);
+      }
+      fd_ = open(log_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0666);
+      fd_path_ = log_path;
+    }
+    if (fd_ < 0) {
+      fprintf(stderr, "Failed to open log file : %s!\n", log_path.c_str());
+    } else if (!WriteFully(fd_, text)) {
+      fprintf(stderr, "Failed to write to log file : %s!\n", log_path.c_str());
+    }
+    fwrite(text.data(), 1, text.size(), stdout);
+    fflush(stdout);
+  }
+
+  // Writes all of |text| to |fd|. Returns false on failure.
+  static bool WriteFully(int fd, const std::string &text) {
+    const char *data = text.data();
+    size_t remaining = text.size();
+    while (remaining > 0) {
+      ssize_t written = write(fd, data, remaining);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      data += written;
+      remaining -= written;
+    }
+    return true;
+  }
+
+  static void *FlusherMain(void *arg) {
+    static_cast<LogSink *>(arg)->RunFlusher();
+    return nullptr;
+  }
+
+  // Writes buffered messages periodically, or when a buffer fills up, until
+  // the flusher is stopped.
+  void RunFlusher() {
+    absl::MutexLock lock(&mu_);
+    while (flusher_state_ == FlusherState::kRunning) {
+      flush_requested_.WaitWithTimeout(&mu_, kLogFlushInterval);
+      FlushLocked();
+    }
+  }
+
+  absl::Mutex mu_;
+  absl::CondVar flush_requested_;
+
+  // Buffers of all threads that have logged while the flusher was running.
+  std::vector<ThreadLogBuffer *> buffers_ GUARDED_BY(mu_);
+
+  // The log file descriptor, and the path it was opened with.
+  int fd_ GUARDED_BY(mu_);
+  std::string fd_path_ GUARDED_BY(mu_);
+
+  FlusherState flusher_state_ GUARDED_BY(mu_);
+  pthread_t flusher_;
+
+  // Mirrors |flusher_state_ == FlusherState::kRunning| for lock-free reads.
+  std::atomic<bool> flusher_running_;
+
+  // Number of messages dropped because a thread's buffer was full.
+  std::atomic<uint64_t> dropped_;
+};
+
 }  // namespace
 
 bool set_log_directory(const std::string &log_directory) {
@@ -155,6 +467,12 @@ bool InitLogging(const char *directory, const char *file_name, int level) {
   return true;
 }
 
+bool StartLogFlusher() { return LogSink::GetInstance()->StartFlusher(); }
+
+void StopLogFlusher() { LogSink::GetInstance()->StopFlusher(); }
+
+void FlushLog() { LogSink::GetInstance()->Flush(); }
+
 LogMessage::LogMessage(const char *file, int line) { Init(file, line, INFO); }
 
 LogMessage::LogMessage(const char *file, int line, LogSeverity severity) {
@@ -201,27 +519,9 @@ LogMessage::~LogMessage() {
 }
 
 void LogMessage::SendToLog(const std::string &message_text) {
-  std::string log_path = get_log_directory() + get_log_basename();
-
-  FILE *file = fopen(log_path.c_str(), "ab");
-  if (file) {
-    if (fprintf(file, "%s", message_text.c_str()) > 0) {
-      if (message_text.back() != '\n') {
-        fprintf(file, "\n");
-      }
-    } else {
-      fprintf(stderr, "Failed to write to log file : %s!\n", log_path.c_str());
-    }
-    fclose(file);
-  } else {
-    fprintf(stderr, "Failed to open log file : %s!\n", log_path.c_str());
-  }
-  if (severity_ >= ERROR) {
-    fprintf(stderr, "%s\n", message_text.c_str());
-    fflush(stderr);
-  }
-  printf("%s\n", message_text.c_str());
-  fflush(stdout);
+  // Messages of ERROR severity and above, including FATAL messages, are
+  // written before this call returns, along with any buffered messages.
+  LogSink::GetInstance()->Log(message_text, severity_);
 
   // if FATAL occurs, abort enclave.
   if (severity_ == FATAL) {
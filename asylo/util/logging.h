@@ -322,6 +322,26 @@ bool EnsureDirectory(const char *path);
 ///        a level equal to or lower than it will be logged.
 bool InitLogging(const char *directory, const char *file_name, int level);
 
+/// Starts a background thread that writes log messages in batches. Until this
+/// is called, and after StopLogFlusher() is called, messages are written as
+/// they are logged. Messages of `ERROR` severity and above are always written
+/// as they are logged, after any buffered messages.
+///
+/// While the thread is running, each thread buffers a bounded amount of log
+/// text. Messages that do not fit are dropped, and the number of dropped
+/// messages is noted in the log.
+///
+/// \return True if and only if the background thread is running.
+bool StartLogFlusher();
+
+/// Writes all buffered log messages and stops the background thread started by
+/// StartLogFlusher(). The thread cannot be restarted. This method is called
+/// during enclave finalization.
+void StopLogFlusher();
+
+/// Writes all buffered log messages.
+void FlushLog();
+
 /// Class representing a log message created by a log macro.
 class LogMessage {
  public:
@@ -0,0 +1,111 @@
+/*
+ *
+ * Copyright 2018 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/util/logging.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/strings/str_cat.h"
+#include "asylo/test/util/test_flags.h"
+
+namespace asylo {
+namespace {
+
+using ::testing::HasSubstr;
+
+constexpr char kLogName[] = "logging_test";
+
+class LoggingTest : public ::testing::Test {
+ protected:
+  static void SetUpTestCase() {
+    ASSERT_TRUE(InitLogging(FLAGS_test_tmpdir.c_str(), kLogName, 0));
+  }
+
+  // Returns the contents of the log file.
+  std::string ReadLog() {
+    std::ifstream log_file(get_log_directory() + kLogName);
+    std::stringstream contents;
+    contents << log_file.rdbuf();
+    return contents.str();
+  }
+};
+
+// Verifies that messages are written as they are logged when the log flusher
+// is not running.
+TEST_F(LoggingTest, WritesMessagesWithoutFlusher) {
+  LOG(INFO) << "unbuffered message";
+  EXPECT_THAT(ReadLog(), HasSubstr("unbuffered message\n"));
+}
+
+// Verifies that messages buffered while the log flusher is running are written
+// by FlushLog and StopLogFlusher, including messages from exited threads, and
+// that the flusher cannot be restarted.
+TEST_F(LoggingTest, WritesBufferedMessages) {
+  ASSERT_TRUE(StartLogFlusher());
+
+  LOG(INFO) << "buffered message";
+  std::thread thread([] { LOG(INFO) << "message from exited thread"; });
+  thread.join();
+  FlushLog();
+  std::string log = ReadLog();
+  EXPECT_THAT(log, HasSubstr("buffered message\n"));
+  EXPECT_THAT(log, HasSubstr("message from exited thread\n"));
+
+  LOG(INFO) << "message before error";
+  LOG(ERROR) << "error message";
+  log = ReadLog();
+  EXPECT_THAT(log, HasSubstr("message before error\n"));
+  EXPECT_THAT(log, HasSubstr("error message\n"));
+  EXPECT_LT(log.find("message before error"), log.find("error message"));
+
+  LOG(INFO) << "message before stop";
+  // Keep logging from other threads while the flusher stops, so that messages
+  // are appended to the buffers around the final flush.
+  constexpr int kThreads = 4;
+  constexpr int kMessagesPerThread = 100;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.emplace_back([i] {
+      for (int j = 0; j < kMessagesPerThread; ++j) {
+        LOG(INFO) << "concurrent message " << i << "-" << j;
+      }
+    });
+  }
+  StopLogFlusher();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  log = ReadLog();
+  EXPECT_THAT(log, HasSubstr("message before stop\n"));
+  for (int i = 0; i < kThreads; ++i) {
+    for (int j = 0; j < kMessagesPerThread; ++j) {
+      EXPECT_THAT(log, HasSubstr(absl::StrCat("concurrent message ", i, "-", j,
+                                              "\n")));
+    }
+  }
+  EXPECT_FALSE(StartLogFlusher());
+}
+
+}  // namespace
+}  // namespace asylo